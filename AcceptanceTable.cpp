@@ -0,0 +1,136 @@
+#include "AcceptanceTable.h"
+#include "Setup.h"
+#include <cmath>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+/**********************************************************************/
+
+uint32_t cAcceptanceTable::CalculateAcceptanceThreshold(const double probability)
+{
+	const double threshold = std::ceil(probability * 4294967296.0);													// 2^32
+	return (uint32_t)std::clamp(threshold, 0.0, 4294967295.0);
+}
+
+/**********************************************************************/
+
+uint32_t cAcceptanceTable::GetAcceptanceThresholdIndex(const int spin, const int neighbourSpinSum)
+{
+	return (spin > 0 ? 5 : 0) + (neighbourSpinSum + 4) / 2;
+}
+
+/**********************************************************************/
+
+cAcceptanceTable::cAcceptanceTable(const double beta, const double coupling, const double externalField)
+{
+	this->beta = beta;
+	this->coupling = coupling;
+	this->externalField = externalField;
+
+	for (int spin = -1; spin <= 1; spin += 2)
+	{
+		for (int neighbourSpinSum = -4; neighbourSpinSum <= 4; neighbourSpinSum += 2)
+		{
+			acceptanceThresholds[GetAcceptanceThresholdIndex(spin, neighbourSpinSum)] = CalculateAcceptanceThreshold(GetAcceptanceProbability(spin, neighbourSpinSum));
+		}
+	}
+}
+
+/**********************************************************************/
+
+double cAcceptanceTable::GetBeta() const
+{
+	return beta;
+}
+
+/**********************************************************************/
+
+double cAcceptanceTable::GetCoupling() const
+{
+	return coupling;
+}
+
+/**********************************************************************/
+
+double cAcceptanceTable::GetExternalField() const
+{
+	return externalField;
+}
+
+/**********************************************************************/
+
+double cAcceptanceTable::GetDeltaE(const int spin, const int neighbourSpinSum) const
+{
+	return 2.0 * spin * (coupling * neighbourSpinSum + externalField);
+}
+
+/**********************************************************************/
+
+double cAcceptanceTable::GetAcceptanceProbability(const int spin, const int neighbourSpinSum) const
+{
+	return std::min(1.0, std::exp(-beta * GetDeltaE(spin, neighbourSpinSum)));
+}
+
+/**********************************************************************/
+
+uint32_t cAcceptanceTable::GetAcceptanceThreshold(const int spin, const int neighbourSpinSum) const
+{
+	return acceptanceThresholds[GetAcceptanceThresholdIndex(spin, neighbourSpinSum)];
+}
+
+/**********************************************************************/
+
+const std::array<uint32_t, 10>& cAcceptanceTable::GetAcceptanceThresholds() const
+{
+	return acceptanceThresholds;
+}
+
+/**********************************************************************/
+
+void CheckAcceptanceTableStatistically(const cAcceptanceTable& acceptanceTable, const uint32_t sampleCount, const double maxZScore)
+{
+	uint32_t randomState = (uint32_t)std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()) % std::numeric_limits<uint32_t>::max();
+	randomState |= 1;																								// XORShift must not be seeded with 0
+
+	for (int spin = -1; spin <= 1; spin += 2)
+	{
+		for (int neighbourSpinSum = -4; neighbourSpinSum <= 4; neighbourSpinSum += 2)
+		{
+			const uint32_t acceptanceThreshold = acceptanceTable.GetAcceptanceThreshold(spin, neighbourSpinSum);
+			const double acceptanceProbability = acceptanceTable.GetAcceptanceProbability(spin, neighbourSpinSum);
+			if (acceptanceThreshold == cAcceptanceTable::acceptanceThresholdAlways)
+			{
+				// The engines accept these flips without a random number, so the probability has to be 1 to within the resolution of the threshold
+				if (acceptanceProbability < 1.0 - 1.0 / 4294967296.0)
+				{
+					throw std::runtime_error("An acceptance threshold is always accepted but its probability is below 1!");
+				}
+				continue;
+			}
+
+			// The same compare the engines do
+			uint32_t numberOfAcceptedFlips = 0;
+			for (uint32_t i = 0; i < sampleCount; i++)
+			{
+				randomState = XORShift(randomState);
+				if (randomState < acceptanceThreshold)
+				{
+					numberOfAcceptedFlips++;
+				}
+			}
+
+			// The accepted count is binomial around sampleCount * p
+			const double expectedNumberOfAcceptedFlips = sampleCount * acceptanceProbability;
+			const double standardDeviation = std::sqrt(sampleCount * acceptanceProbability * (1.0 - acceptanceProbability));
+			const double zScore = (standardDeviation > 0.0) ? (numberOfAcceptedFlips - expectedNumberOfAcceptedFlips) / standardDeviation : 0.0;
+			if (std::abs(zScore) > maxZScore)
+			{
+				throw std::runtime_error("The acceptance ratio of deltaE = " + std::to_string(acceptanceTable.GetDeltaE(spin, neighbourSpinSum))
+					+ " is off by " + std::to_string(zScore) + " standard deviations!");
+			}
+		}
+	}
+}
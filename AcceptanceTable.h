@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <array>
+
+/* The Metropolis acceptance thresholds of one (beta, coupling, external field). Flipping the spin s with the neighbour spin sum n changes the energy by
+   deltaE = 2 * s * (coupling * n + externalField), so there are only 2 * 5 different flips. A raw 32-bit random number r accepts a flip if r < threshold,
+   one compare and no modulo. A flip with exp(-beta * deltaE) >= 1 gets acceptanceThresholdAlways, the engines accept it without drawing a random number.
+   The thresholds are laid out as [(s + 1) / 2 * 5 + (n + 4) / 2], which is also the order the compute shaders read them from the UBO */
+class cAcceptanceTable
+{
+private:
+	double beta = 0.0;
+	double coupling = 1.0;
+	double externalField = 0.0;
+	std::array<uint32_t, 10> acceptanceThresholds = {};
+
+public:
+	static constexpr uint32_t numberOfAcceptanceThresholds = 10;
+	static constexpr uint32_t acceptanceThresholdAlways = 0xFFFFFFFF;
+
+	// The threshold a raw 32-bit random number is accepted below with the given probability, rounded up. Probabilities this close to 1 become acceptanceThresholdAlways
+	static uint32_t CalculateAcceptanceThreshold(const double probability);
+	// The index of the threshold of the spin s (+1 or -1) with the neighbour spin sum n (-4, -2, 0, 2 or 4)
+	static uint32_t GetAcceptanceThresholdIndex(const int spin, const int neighbourSpinSum);
+
+	cAcceptanceTable(const double beta, const double coupling = 1.0, const double externalField = 0.0);
+
+	double GetBeta() const;
+	double GetCoupling() const;
+	double GetExternalField() const;
+	double GetDeltaE(const int spin, const int neighbourSpinSum) const;
+	// The exact acceptance probability min(1, exp(-beta * deltaE)) the threshold stands for
+	double GetAcceptanceProbability(const int spin, const int neighbourSpinSum) const;
+	uint32_t GetAcceptanceThreshold(const int spin, const int neighbourSpinSum) const;
+	const std::array<uint32_t, 10>& GetAcceptanceThresholds() const;
+};
+
+// Draw sampleCount XORShift numbers for every flip of the table, compare the accepted fraction with the exact probability and throw if a z-score passes maxZScore
+void CheckAcceptanceTableStatistically(const cAcceptanceTable& acceptanceTable, const uint32_t sampleCount, const double maxZScore);
@@ -0,0 +1,700 @@
+#include "ClusterUpdates.h"
+#include "Setup.h"
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <stdexcept>
+
+/**********************************************************************/
+
+cWolffClusterUpdater::cWolffClusterUpdater(const uint32_t isingL)
+{
+	this->isingL = isingL;
+	isingN = isingL * isingL;
+	clusterStack.resize(isingN);
+
+	const uint32_t randomSeed = (uint32_t)std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()) % std::numeric_limits<uint32_t>::max();
+	SetRandomSeed(randomSeed);
+}
+
+/**********************************************************************/
+
+void cWolffClusterUpdater::SetRandomSeed(const uint32_t randomSeed)
+{
+	std::default_random_engine randomNumberGenerator(randomSeed);
+	randomState = (uint32_t)randomNumberGenerator() | 1;														// XORShift must not be seeded with 0
+}
+
+/**********************************************************************/
+
+void cWolffClusterUpdater::SetBeta(const double beta)
+{
+	// An aligned neighbour joins the cluster with the probability 1 - exp(-2 * beta)
+	const double threshold = std::ceil((1.0 - std::exp(-2.0 * beta)) * 4294967296.0);							// 2^32
+	addThreshold = (uint32_t)std::min(threshold, 4294967295.0);
+}
+
+/**********************************************************************/
+
+uint32_t cWolffClusterUpdater::GrowAndFlipOneCluster(uint32_t* pArraySpinBatches, int& TheSpinSum)
+{
+	// Multiply instead of taking the modulo to map the random number onto a spin index
+	randomState = XORShift(randomState);
+	const uint32_t seedSpinIndex = (uint32_t)(((uint64_t)randomState * isingN) >> 32);
+	const uint32_t clusterSpinBit = (pArraySpinBatches[seedSpinIndex / 32] >> (31 - seedSpinIndex % 32)) & 1U;		// 1 for +1 spins
+
+	pArraySpinBatches[seedSpinIndex / 32] ^= 1U << (31 - seedSpinIndex % 32);
+	clusterStack[0] = seedSpinIndex;
+	uint32_t clusterStackSize = 1;
+	uint32_t clusterSize = 1;
+
+	while (clusterStackSize > 0)
+	{
+		const uint32_t spinIndex = clusterStack[--clusterStackSize];
+		const uint32_t rowNumber = spinIndex / isingL;
+		const uint32_t columnNumber = spinIndex - rowNumber * isingL;
+
+		const uint32_t neighbourSpinIndices[4] =
+		{
+			(columnNumber + 1 == isingL) ? spinIndex + 1 - isingL : spinIndex + 1,									// Right
+			(columnNumber == 0) ? spinIndex + isingL - 1 : spinIndex - 1,											// Left
+			(rowNumber == 0) ? spinIndex + isingN - isingL : spinIndex - isingL,									// Above
+			(rowNumber + 1 == isingL) ? spinIndex + isingL - isingN : spinIndex + isingL							// Below
+		};
+
+		for (const uint32_t neighbourSpinIndex : neighbourSpinIndices)
+		{
+			// Spins already in the cluster have been flipped, so they are never aligned with the cluster spin
+			uint32_t& neighbourSpinBatch = pArraySpinBatches[neighbourSpinIndex / 32];
+			const uint32_t neighbourSpinBitMask = 1U << (31 - neighbourSpinIndex % 32);
+			if (((neighbourSpinBatch & neighbourSpinBitMask) != 0) != (clusterSpinBit != 0))
+			{
+				continue;
+			}
+
+			randomState = XORShift(randomState);
+			if (randomState < addThreshold)
+			{
+				neighbourSpinBatch ^= neighbourSpinBitMask;
+				clusterStack[clusterStackSize++] = neighbourSpinIndex;
+				clusterSize++;
+			}
+		}
+	}
+
+	// Flipping +1 spins lowers the spin sum by 2 each, flipping -1 spins raises it by 2 each
+	TheSpinSum += (clusterSpinBit != 0) ? -2 * (int)clusterSize : 2 * (int)clusterSize;
+	return clusterSize;
+}
+
+/**********************************************************************/
+
+void DoTheIsingGridSweepsWolffCPU(cWolffClusterUpdater* pTheUpdater, uint32_t* pArraySpinBatches, int* pArraySpinSumOutputs,
+	int& TheSpinSum, const double beta, const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+	const uint32_t sweepsPerSpinSumSample, cObservableAccumulator* pObservableAccumulator)
+{
+	pTheUpdater->SetBeta(beta);
+	if (pObservableAccumulator != nullptr)
+	{
+		pObservableAccumulator->Reset(pTheUpdater->isingL);
+	}
+	uint32_t spinSumOutputsIndex = 0;
+	uint64_t numberOfClustersInTheWait = 0;
+	uint64_t numberOfFlippedSpinsInTheWait = 0;
+
+	for (uint32_t sweepNumber = 0; sweepNumber < numberOfSweepsPerTemperature; sweepNumber++)
+	{
+		if (sweepNumber < numberOfSweepsToWaitBeforeSpinSumSamplingStarts)
+		{
+			// Clusters are flipped whole, so the flips that overshoot one sweep are taken from the next one
+			pTheUpdater->spinFlipCredit += pTheUpdater->isingN / 2;
+			while (pTheUpdater->spinFlipCredit > 0)
+			{
+				const uint32_t clusterSize = pTheUpdater->GrowAndFlipOneCluster(pArraySpinBatches, TheSpinSum);
+				pTheUpdater->spinFlipCredit -= clusterSize;
+				numberOfClustersInTheWait++;
+				numberOfFlippedSpinsInTheWait += clusterSize;
+			}
+		}
+		else
+		{
+			// Ending the sweeps on the flipped spin count would make the sample times depend on the cluster sizes, which biases the samples
+			// towards the states right after big clusters. So the sampled sweeps flip a fixed number of clusters, picked from the mean cluster size in the wait.
+			// The mean cluster size depends on beta, so it is measured at every temperature. Without a wait, one unsampled sweep of clusters measures it
+			if (sweepNumber == numberOfSweepsToWaitBeforeSpinSumSamplingStarts)
+			{
+				if (numberOfClustersInTheWait == 0)
+				{
+					pTheUpdater->spinFlipCredit = 0;
+					while (numberOfFlippedSpinsInTheWait < pTheUpdater->isingN / 2)
+					{
+						numberOfFlippedSpinsInTheWait += pTheUpdater->GrowAndFlipOneCluster(pArraySpinBatches, TheSpinSum);
+						numberOfClustersInTheWait++;
+					}
+				}
+				const double meanClusterSize = (double)numberOfFlippedSpinsInTheWait / (double)numberOfClustersInTheWait;
+				pTheUpdater->clustersPerSweep = std::max(1U, (uint32_t)std::lround((pTheUpdater->isingN / 2) / meanClusterSize));
+			}
+			for (uint32_t i = 0; i < pTheUpdater->clustersPerSweep; i++)
+			{
+				pTheUpdater->GrowAndFlipOneCluster(pArraySpinBatches, TheSpinSum);
+			}
+		}
+
+		// Save the spin sum
+		if (sweepNumber >= numberOfSweepsToWaitBeforeSpinSumSamplingStarts
+			&& (sweepNumber - numberOfSweepsToWaitBeforeSpinSumSamplingStarts) % sweepsPerSpinSumSample == 0)
+		{
+			if (pArraySpinSumOutputs != nullptr)
+			{
+				pArraySpinSumOutputs[spinSumOutputsIndex] = TheSpinSum;
+			}
+			// A cluster flip changes the bonds on the boundary of the cluster, which the growth does not tell apart from the bonds inside it,
+			// so the energy is summed up over the grid for every sample instead of being tracked
+			if (pObservableAccumulator != nullptr)
+			{
+				pObservableAccumulator->AddSample(TheSpinSum, CalculateTheEnergyCPU(pArraySpinBatches, pTheUpdater->isingL));
+			}
+			spinSumOutputsIndex++;
+		}
+	}
+}
+
+/**********************************************************************/
+
+// The 64-bit XORShift of the same paper as XORShift, https://www.jstatsoft.org/article/view/v008i14
+static inline uint64_t XORShift64Step(uint64_t rngState)
+{
+	rngState ^= (rngState << 13);
+	rngState ^= (rngState >> 7);
+	rngState ^= (rngState << 17);
+	return rngState;
+}
+
+/**********************************************************************/
+
+// Two words in which every bit is set with the probability threshold / 2^32. Going through the binary digits of the threshold from the lowest
+// set one up, a set digit ORs a random word in and a cleared digit ANDs one in, which halves the probability and adds the digit on top.
+// Bit b of a word only depends on bit b of the random words, so the bits are independent if the random words are. Consecutive states of one
+// XORShift stream are linear in each other, so every digit of every word has a stream of its own, seeded apart. Successive bond words take
+// the next states of the same streams, like the Metropolis engines take the next states of theirs
+static inline void DrawTwoBernoulliWords(const uint32_t threshold, uint64_t (&randomStates)[2][32], uint64_t& bernoulliWord0, uint64_t& bernoulliWord1)
+{
+	bernoulliWord0 = 0;
+	bernoulliWord1 = 0;
+	for (int digit = std::countr_zero(threshold); digit < 32; digit++)
+	{
+		randomStates[0][digit] = XORShift64Step(randomStates[0][digit]);
+		randomStates[1][digit] = XORShift64Step(randomStates[1][digit]);
+		if ((threshold >> digit) & 1U)
+		{
+			bernoulliWord0 |= randomStates[0][digit];
+			bernoulliWord1 |= randomStates[1][digit];
+		}
+		else
+		{
+			bernoulliWord0 &= randomStates[0][digit];
+			bernoulliWord1 &= randomStates[1][digit];
+		}
+	}
+}
+
+/**********************************************************************/
+
+// Find the root of a cluster and halve the path on the way. Another thread may link the root meanwhile, which only makes the result an
+// old root, and the parents written here are always ancestors, so concurrent finds and unions never break the forest
+static inline uint32_t FindClusterRoot(uint32_t* pClusterParents, uint32_t spinIndex)
+{
+	while (true)
+	{
+		const uint32_t parent = std::atomic_ref<uint32_t>(pClusterParents[spinIndex]).load(std::memory_order_relaxed);
+		if (parent == spinIndex)
+		{
+			return spinIndex;
+		}
+		const uint32_t grandParent = std::atomic_ref<uint32_t>(pClusterParents[parent]).load(std::memory_order_relaxed);
+		if (grandParent != parent)
+		{
+			std::atomic_ref<uint32_t>(pClusterParents[spinIndex]).store(grandParent, std::memory_order_relaxed);
+		}
+		spinIndex = grandParent;
+	}
+}
+
+/**********************************************************************/
+
+// Lock-free union. The larger root is linked to the smaller one with a compare-and-swap that fails if another thread linked it first
+static inline void UniteClusters(uint32_t* pClusterParents, uint32_t spinIndexA, uint32_t spinIndexB)
+{
+	while (true)
+	{
+		uint32_t rootA = FindClusterRoot(pClusterParents, spinIndexA);
+		uint32_t rootB = FindClusterRoot(pClusterParents, spinIndexB);
+		if (rootA == rootB)
+		{
+			return;
+		}
+		if (rootA < rootB)
+		{
+			std::swap(rootA, rootB);
+		}
+		uint32_t expectedParent = rootA;
+		if (std::atomic_ref<uint32_t>(pClusterParents[rootA]).compare_exchange_strong(expectedParent, rootB, std::memory_order_relaxed))
+		{
+			return;
+		}
+		spinIndexA = rootA;
+		spinIndexB = rootB;
+	}
+}
+
+/**********************************************************************/
+
+// The flip decision of a cluster, from the MurmurHash3 finalizer of its root
+static inline bool bFlipTheCluster(const uint32_t clusterRoot, const uint32_t clusterFlipSalt)
+{
+	uint32_t hash = clusterRoot ^ clusterFlipSalt;
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6BU;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35U;
+	hash ^= hash >> 16;
+	return (hash >> 31) != 0;
+}
+
+/**********************************************************************/
+
+cSwendsenWangClusterUpdater::cSwendsenWangClusterUpdater(const uint32_t isingL, const uint32_t numberOfThreads)
+{
+	if (isingL < 2)
+	{
+		throw std::runtime_error("The Swendsen-Wang CPU engine needs a grid length of at least 2!");
+	}
+
+	this->isingL = isingL;
+	isingN = isingL * isingL;
+	wordsPerRow = (isingL + 63) / 64;
+	bitsInTheLastWord = isingL - 64 * (wordsPerRow - 1);
+	lastWordMask = (bitsInTheLastWord == 64) ? ~0ULL : ((1ULL << bitsInTheLastWord) - 1);
+	spinWords.assign((size_t)isingL * wordsPerRow, 0);
+	rightBondWords.assign((size_t)isingL * wordsPerRow, 0);
+	belowBondWords.assign((size_t)isingL * wordsPerRow, 0);
+	clusterParents.resize(isingN);
+	spinSumSamplesOfTheChunk.resize(cObservableAccumulator::spinSumSamplesPerChunk);
+
+	// Give every thread a strip of at least 8 rows, more threads than that only add synchronization
+	const uint32_t minimumRowsPerThread = 8;
+	this->numberOfThreads = std::max(1U, std::min(numberOfThreads, isingL / minimumRowsPerThread));
+	pThreadPool = std::make_unique<cThreadPool>(this->numberOfThreads);
+	pThreadStates = std::make_unique<sSwendsenWangThreadState[]>(this->numberOfThreads);
+	pPhaseBarrier = std::make_unique<std::barrier<>>(this->numberOfThreads);
+
+	for (uint32_t i = 0; i < this->numberOfThreads; i++)
+	{
+		sSwendsenWangThreadState& threadState = pThreadStates[i];
+		threadState.firstRowNumber = (uint32_t)(((uint64_t)isingL * i) / this->numberOfThreads);
+		threadState.endRowNumber = (uint32_t)(((uint64_t)isingL * (i + 1)) / this->numberOfThreads);
+		threadState.shiftedRowWords.assign(wordsPerRow, 0);
+	}
+
+	const uint32_t randomSeed = (uint32_t)std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()) % std::numeric_limits<uint32_t>::max();
+	SetRandomSeed(randomSeed);
+}
+
+/**********************************************************************/
+
+void cSwendsenWangClusterUpdater::SetRandomSeed(const uint32_t randomSeed)
+{
+	// The 64-bit Mersenne Twister fills every bit of the XORShift states, std::default_random_engine only gives 31 bits a number
+	std::mt19937_64 randomNumberGenerator(randomSeed);
+	const uint32_t clusterFlipSalt = (uint32_t)randomNumberGenerator() | 1;
+
+	for (uint32_t i = 0; i < numberOfThreads; i++)
+	{
+		sSwendsenWangThreadState& threadState = pThreadStates[i];
+		for (auto& randomStatesOfOneBondDirection : threadState.randomStates)
+		{
+			for (uint64_t& randomState : randomStatesOfOneBondDirection)
+			{
+				randomState = randomNumberGenerator() | 1;															// XORShift must not be seeded with 0
+			}
+		}
+		threadState.clusterFlipSalt = clusterFlipSalt;
+	}
+}
+
+/**********************************************************************/
+
+void cSwendsenWangClusterUpdater::ImportSpinBatches(const uint32_t* pArraySpinBatches)
+{
+	std::fill(spinWords.begin(), spinWords.end(), 0);
+
+	for (uint32_t spinIndex = 0; spinIndex < isingN; spinIndex++)
+	{
+		if ((pArraySpinBatches[spinIndex / 32] & (1U << (31 - spinIndex % 32))) != 0)
+		{
+			const uint32_t rowNumber = spinIndex / isingL;
+			const uint32_t columnNumber = spinIndex % isingL;
+			spinWords[(size_t)rowNumber * wordsPerRow + columnNumber / 64] |= 1ULL << (columnNumber % 64);
+		}
+	}
+}
+
+/**********************************************************************/
+
+void cSwendsenWangClusterUpdater::ExportSpinBatches(uint32_t* pArraySpinBatches) const
+{
+	const uint32_t numberOfSpinBatches = (isingN + 31) / 32;
+	std::fill(pArraySpinBatches, pArraySpinBatches + numberOfSpinBatches, 0U);
+
+	for (uint32_t spinIndex = 0; spinIndex < isingN; spinIndex++)
+	{
+		const uint32_t rowNumber = spinIndex / isingL;
+		const uint32_t columnNumber = spinIndex % isingL;
+		if ((spinWords[(size_t)rowNumber * wordsPerRow + columnNumber / 64] >> (columnNumber % 64)) & 1ULL)
+		{
+			pArraySpinBatches[spinIndex / 32] |= 1U << (31 - spinIndex % 32);
+		}
+	}
+}
+
+/**********************************************************************/
+
+void cSwendsenWangClusterUpdater::SetBeta(const double beta)
+{
+	// A bond between aligned neighbours is active with the probability 1 - exp(-2 * beta)
+	const double threshold = std::ceil((1.0 - std::exp(-2.0 * beta)) * 4294967296.0);							// 2^32
+	bondThreshold = (uint32_t)std::min(threshold, 4294967295.0);
+}
+
+/**********************************************************************/
+
+uint32_t cSwendsenWangClusterUpdater::GetNumberOfThreads() const
+{
+	return numberOfThreads;
+}
+
+/**********************************************************************/
+
+void cSwendsenWangClusterUpdater::ActivateBondsAndLabelTheStrip(sSwendsenWangThreadState& threadState)
+{
+	const uint32_t lastWord = wordsPerRow - 1;
+	uint64_t* pShiftedRowWords = threadState.shiftedRowWords.data();
+	uint32_t* pClusterParents = clusterParents.data();
+
+	for (uint32_t rowNumber = threadState.firstRowNumber; rowNumber < threadState.endRowNumber; rowNumber++)
+	{
+		const uint64_t* pRowWords = spinWords.data() + (size_t)rowNumber * wordsPerRow;
+		const uint64_t* pRowBelowWords = spinWords.data() + (size_t)((rowNumber + 1) % isingL) * wordsPerRow;
+		uint64_t* pRightBondWords = rightBondWords.data() + (size_t)rowNumber * wordsPerRow;
+		uint64_t* pBelowBondWords = belowBondWords.data() + (size_t)rowNumber * wordsPerRow;
+
+		// Bit b of the shifted row is the right neighbour of bit b, the last column wraps around to column 0
+		for (uint32_t w = 0; w < lastWord; w++)
+		{
+			pShiftedRowWords[w] = (pRowWords[w] >> 1) | (pRowWords[w + 1] << 63);
+		}
+		pShiftedRowWords[lastWord] = (pRowWords[lastWord] >> 1) | ((pRowWords[0] & 1ULL) << (bitsInTheLastWord - 1));
+
+		// Only aligned neighbours can be bonded
+		for (uint32_t w = 0; w < wordsPerRow; w++)
+		{
+			const uint64_t wordMask = (w == lastWord) ? lastWordMask : ~0ULL;
+			uint64_t rightBondActivationWord, belowBondActivationWord;
+			DrawTwoBernoulliWords(bondThreshold, threadState.randomStates, rightBondActivationWord, belowBondActivationWord);
+			pRightBondWords[w] = ~(pRowWords[w] ^ pShiftedRowWords[w]) & wordMask & rightBondActivationWord;
+			pBelowBondWords[w] = ~(pRowWords[w] ^ pRowBelowWords[w]) & wordMask & belowBondActivationWord;
+		}
+
+		// A run of right bonds is one cluster, so point every spin of the run at its first spin
+		const uint32_t rowStartSpinIndex = rowNumber * isingL;
+		pClusterParents[rowStartSpinIndex] = rowStartSpinIndex;
+		for (uint32_t columnNumber = 1; columnNumber < isingL; columnNumber++)
+		{
+			const uint32_t spinIndex = rowStartSpinIndex + columnNumber;
+			const bool bBondToTheLeft = (pRightBondWords[(columnNumber - 1) / 64] >> ((columnNumber - 1) % 64)) & 1ULL;
+			pClusterParents[spinIndex] = bBondToTheLeft ? pClusterParents[spinIndex - 1] : spinIndex;
+		}
+		if ((pRightBondWords[lastWord] >> (bitsInTheLastWord - 1)) & 1ULL)
+		{
+			UniteClusters(pClusterParents, rowStartSpinIndex + isingL - 1, rowStartSpinIndex);
+		}
+
+		// The bonds from the row above are united right away if that row is in the strip (and it was labelled just before)
+		if (rowNumber > threadState.firstRowNumber)
+		{
+			const uint64_t* pRowAboveBelowBondWords = belowBondWords.data() + (size_t)(rowNumber - 1) * wordsPerRow;
+			const uint64_t* pRowAboveRightBondWords = rightBondWords.data() + (size_t)(rowNumber - 1) * wordsPerRow;
+			for (uint32_t w = 0; w < wordsPerRow; w++)
+			{
+				// A bond next to another one is redundant if both rows are bonded in between, the runs are already united
+				const uint64_t leftBelowBonds = (pRowAboveBelowBondWords[w] << 1) | ((w > 0) ? pRowAboveBelowBondWords[w - 1] >> 63 : 0);
+				const uint64_t leftRowAboveRightBonds = (pRowAboveRightBondWords[w] << 1) | ((w > 0) ? pRowAboveRightBondWords[w - 1] >> 63 : 0);
+				const uint64_t leftRightBonds = (pRightBondWords[w] << 1) | ((w > 0) ? pRightBondWords[w - 1] >> 63 : 0);
+				uint64_t bonds = pRowAboveBelowBondWords[w] & ~(leftBelowBonds & leftRowAboveRightBonds & leftRightBonds);
+				while (bonds != 0)
+				{
+					const uint32_t columnNumber = 64 * w + std::countr_zero(bonds);
+					bonds &= bonds - 1;
+					UniteClusters(pClusterParents, rowStartSpinIndex - isingL + columnNumber, rowStartSpinIndex + columnNumber);
+				}
+			}
+		}
+	}
+}
+
+/**********************************************************************/
+
+void cSwendsenWangClusterUpdater::LabelAcrossTheStripBoundary(sSwendsenWangThreadState& threadState)
+{
+	uint32_t* pClusterParents = clusterParents.data();
+	const uint32_t lastRowNumber = threadState.endRowNumber - 1;
+	const uint64_t* pBelowBondWords = belowBondWords.data() + (size_t)lastRowNumber * wordsPerRow;
+	const uint32_t rowStartSpinIndex = lastRowNumber * isingL;
+	const uint32_t rowBelowStartSpinIndex = ((lastRowNumber + 1) % isingL) * isingL;
+
+	for (uint32_t w = 0; w < wordsPerRow; w++)
+	{
+		uint64_t bonds = pBelowBondWords[w];
+		while (bonds != 0)
+		{
+			const uint32_t columnNumber = 64 * w + std::countr_zero(bonds);
+			bonds &= bonds - 1;
+			UniteClusters(pClusterParents, rowStartSpinIndex + columnNumber, rowBelowStartSpinIndex + columnNumber);
+		}
+	}
+}
+
+/**********************************************************************/
+
+int cSwendsenWangClusterUpdater::FlipTheClustersOfTheStrip(sSwendsenWangThreadState& threadState)
+{
+	uint32_t* pClusterParents = clusterParents.data();
+	int spinSumChange = 0;
+
+	for (uint32_t rowNumber = threadState.firstRowNumber; rowNumber < threadState.endRowNumber; rowNumber++)
+	{
+		uint64_t* pRowWords = spinWords.data() + (size_t)rowNumber * wordsPerRow;
+		const uint64_t* pRightBondWords = rightBondWords.data() + (size_t)rowNumber * wordsPerRow;
+		bool bFlip = false;
+		for (uint32_t w = 0; w < wordsPerRow; w++)
+		{
+			const uint32_t numberOfColumnsInTheWord = (w == wordsPerRow - 1) ? bitsInTheLastWord : 64;
+			uint64_t flipMask = 0;
+			for (uint32_t b = 0; b < numberOfColumnsInTheWord; b++)
+			{
+				// A spin bonded to its left neighbour is in the same cluster, so only the first spin of a run needs a find
+				const uint32_t columnNumber = 64 * w + b;
+				const bool bBondToTheLeft = columnNumber > 0 && ((pRightBondWords[(columnNumber - 1) / 64] >> ((columnNumber - 1) % 64)) & 1ULL);
+				if (!bBondToTheLeft)
+				{
+					bFlip = bFlipTheCluster(FindClusterRoot(pClusterParents, rowNumber * isingL + columnNumber), threadState.clusterFlipSalt);
+				}
+				flipMask |= (uint64_t)bFlip << b;
+			}
+
+			const uint64_t rowWord = pRowWords[w];
+			pRowWords[w] = rowWord ^ flipMask;
+			spinSumChange += 2 * (std::popcount(flipMask & ~rowWord) - std::popcount(flipMask & rowWord));
+		}
+	}
+
+	return spinSumChange;
+}
+
+/**********************************************************************/
+
+int cSwendsenWangClusterUpdater::CalculateTheEnergyOfTheStrip(sSwendsenWangThreadState& threadState)
+{
+	const uint32_t lastWord = wordsPerRow - 1;
+	uint64_t* pShiftedRowWords = threadState.shiftedRowWords.data();
+
+	// Every row owns the bonds to its right and below neighbours, so every bond of the grid is counted by exactly one strip
+	int numberOfAntiAlignedBonds = 0;
+	for (uint32_t rowNumber = threadState.firstRowNumber; rowNumber < threadState.endRowNumber; rowNumber++)
+	{
+		const uint64_t* pRowWords = spinWords.data() + (size_t)rowNumber * wordsPerRow;
+		const uint64_t* pRowBelowWords = spinWords.data() + (size_t)((rowNumber + 1) % isingL) * wordsPerRow;
+
+		for (uint32_t w = 0; w < lastWord; w++)
+		{
+			pShiftedRowWords[w] = (pRowWords[w] >> 1) | (pRowWords[w + 1] << 63);
+		}
+		pShiftedRowWords[lastWord] = (pRowWords[lastWord] >> 1) | ((pRowWords[0] & 1ULL) << (bitsInTheLastWord - 1));
+
+		for (uint32_t w = 0; w < wordsPerRow; w++)
+		{
+			const uint64_t wordMask = (w == lastWord) ? lastWordMask : ~0ULL;
+			numberOfAntiAlignedBonds += std::popcount((pRowWords[w] ^ pShiftedRowWords[w]) & wordMask) + std::popcount((pRowWords[w] ^ pRowBelowWords[w]) & wordMask);
+		}
+	}
+
+	// An aligned bond adds -1 and an anti-aligned one +1
+	return 2 * numberOfAntiAlignedBonds - 2 * (int)(isingL * (threadState.endRowNumber - threadState.firstRowNumber));
+}
+
+/**********************************************************************/
+
+void cSwendsenWangClusterUpdater::DoTheSweepsOfOneThread(const uint32_t threadIndex, int* pSpinSumSamplesOfTheChunk, int* pEnergySamplesOfTheChunk,
+	const uint32_t firstSweepNumberOfTheChunk,
+	const uint32_t endSweepNumberOfTheChunk, const uint32_t firstSpinSumOutputsIndexOfTheChunk, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+	const uint32_t sweepsPerSpinSumSample)
+{
+	sSwendsenWangThreadState& threadState = pThreadStates[threadIndex];
+
+	for (uint32_t sweepNumber = firstSweepNumberOfTheChunk; sweepNumber < endSweepNumberOfTheChunk; sweepNumber++)
+	{
+		// The bonds of a strip reach one row into the next strip, which the thread owning it flips in the last phase of the sweep before
+		ActivateBondsAndLabelTheStrip(threadState);
+		pPhaseBarrier->arrive_and_wait();
+		LabelAcrossTheStripBoundary(threadState);
+		pPhaseBarrier->arrive_and_wait();
+
+		// Every thread steps the salt the same way, so all of them agree on the flip decisions
+		threadState.clusterFlipSalt = XORShift(threadState.clusterFlipSalt);
+		threadState.spinSumChangeSinceTheStartOfTheTemperature += FlipTheClustersOfTheStrip(threadState);
+		pPhaseBarrier->arrive_and_wait();
+
+		// Add the change of this strip to the sample. The spin sum at the start of the temperature is added after all threads are done
+		if (sweepNumber >= numberOfSweepsToWaitBeforeSpinSumSamplingStarts
+			&& (sweepNumber - numberOfSweepsToWaitBeforeSpinSumSamplingStarts) % sweepsPerSpinSumSample == 0)
+		{
+			const uint32_t spinSumOutputsIndex = (sweepNumber - numberOfSweepsToWaitBeforeSpinSumSamplingStarts) / sweepsPerSpinSumSample;
+			std::atomic_ref<int>(pSpinSumSamplesOfTheChunk[spinSumOutputsIndex - firstSpinSumOutputsIndexOfTheChunk])
+				.fetch_add(threadState.spinSumChangeSinceTheStartOfTheTemperature, std::memory_order_relaxed);
+
+			// The flips are done on every strip after the barrier, and the next ones come two barriers later, so the rows below can be read
+			if (pEnergySamplesOfTheChunk != nullptr)
+			{
+				std::atomic_ref<int>(pEnergySamplesOfTheChunk[spinSumOutputsIndex - firstSpinSumOutputsIndexOfTheChunk])
+					.fetch_add(CalculateTheEnergyOfTheStrip(threadState), std::memory_order_relaxed);
+			}
+		}
+	}
+}
+
+/**********************************************************************/
+
+void DoTheIsingGridSweepsSwendsenWangCPU(cSwendsenWangClusterUpdater* pTheUpdater, uint32_t* pArraySpinBatches, int* pArraySpinSumOutputs,
+	int& TheSpinSum, const double beta, const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+	const uint32_t sweepsPerSpinSumSample, cObservableAccumulator* pObservableAccumulator)
+{
+	const uint32_t numberOfSpinSumSamples = (numberOfSweepsPerTemperature > numberOfSweepsToWaitBeforeSpinSumSamplingStarts) ?
+		(numberOfSweepsPerTemperature - numberOfSweepsToWaitBeforeSpinSumSamplingStarts - 1) / sweepsPerSpinSumSample + 1 : 0;
+	if (pObservableAccumulator != nullptr)
+	{
+		pObservableAccumulator->Reset(pTheUpdater->isingL);
+	}
+
+	pTheUpdater->ImportSpinBatches(pArraySpinBatches);
+	pTheUpdater->SetBeta(beta);
+
+	for (uint32_t i = 0; i < pTheUpdater->numberOfThreads; i++)
+	{
+		pTheUpdater->pThreadStates[i].spinSumChangeSinceTheStartOfTheTemperature = 0;
+	}
+
+	// The whole time series is one chunk. Without it the samples go through a small buffer, one chunk of sweeps at a time
+	const uint32_t spinSumSamplesPerChunk = (pArraySpinSumOutputs != nullptr) ? numberOfSpinSumSamples : cObservableAccumulator::spinSumSamplesPerChunk;
+	uint32_t firstSweepNumberOfTheChunk = 0;
+	for (uint32_t firstSpinSumOutputsIndexOfTheChunk = 0; firstSweepNumberOfTheChunk < numberOfSweepsPerTemperature; firstSpinSumOutputsIndexOfTheChunk += spinSumSamplesPerChunk)
+	{
+		const uint32_t endSweepNumberOfTheChunk = (pArraySpinSumOutputs != nullptr) ? numberOfSweepsPerTemperature : (uint32_t)std::min<uint64_t>(numberOfSweepsPerTemperature,
+			numberOfSweepsToWaitBeforeSpinSumSamplingStarts + (uint64_t)(firstSpinSumOutputsIndexOfTheChunk + spinSumSamplesPerChunk) * sweepsPerSpinSumSample);
+		const uint32_t numberOfSpinSumSamplesInTheChunk = std::min(spinSumSamplesPerChunk, numberOfSpinSumSamples - std::min(numberOfSpinSumSamples, firstSpinSumOutputsIndexOfTheChunk));
+		int* pSpinSumSamplesOfTheChunk = (pArraySpinSumOutputs != nullptr) ? pArraySpinSumOutputs + firstSpinSumOutputsIndexOfTheChunk : pTheUpdater->spinSumSamplesOfTheChunk.data();
+		std::fill(pSpinSumSamplesOfTheChunk, pSpinSumSamplesOfTheChunk + numberOfSpinSumSamplesInTheChunk, 0);
+		int* pEnergySamplesOfTheChunk = nullptr;
+		if (pObservableAccumulator != nullptr)
+		{
+			pTheUpdater->energySamplesOfTheChunk.resize(std::max<size_t>(pTheUpdater->energySamplesOfTheChunk.size(), numberOfSpinSumSamplesInTheChunk));
+			pEnergySamplesOfTheChunk = pTheUpdater->energySamplesOfTheChunk.data();
+			std::fill(pEnergySamplesOfTheChunk, pEnergySamplesOfTheChunk + numberOfSpinSumSamplesInTheChunk, 0);
+		}
+
+		pTheUpdater->pThreadPool->RunOnEveryThread([&](const uint32_t threadIndex)
+			{
+				pTheUpdater->DoTheSweepsOfOneThread(threadIndex, pSpinSumSamplesOfTheChunk, pEnergySamplesOfTheChunk, firstSweepNumberOfTheChunk, endSweepNumberOfTheChunk,
+					firstSpinSumOutputsIndexOfTheChunk, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+			});
+
+		// Reduce the per-thread changes
+		for (uint32_t i = 0; i < numberOfSpinSumSamplesInTheChunk; i++)
+		{
+			pSpinSumSamplesOfTheChunk[i] += TheSpinSum;
+		}
+		if (pObservableAccumulator != nullptr)
+		{
+			pObservableAccumulator->AddSamples(pSpinSumSamplesOfTheChunk, pEnergySamplesOfTheChunk, numberOfSpinSumSamplesInTheChunk);
+		}
+		firstSweepNumberOfTheChunk = endSweepNumberOfTheChunk;
+	}
+
+	for (uint32_t i = 0; i < pTheUpdater->numberOfThreads; i++)
+	{
+		TheSpinSum += pTheUpdater->pThreadStates[i].spinSumChangeSinceTheStartOfTheTemperature;
+	}
+
+	pTheUpdater->ExportSpinBatches(pArraySpinBatches);
+}
+
+/**********************************************************************/
+
+void CheckSwendsenWangBondsStatistically(const double beta, const uint32_t numberOfBondWords, const double maxZScore)
+{
+	cSwendsenWangClusterUpdater TheUpdater(2, 1);
+	TheUpdater.SetBeta(beta);
+	sSwendsenWangThreadState& threadState = TheUpdater.pThreadStates[0];
+
+	uint64_t numberOfActiveBonds = 0;
+	uint64_t numberOfActiveNeighbouringBondPairs = 0;
+	uint64_t numberOfActiveRightAndBelowBondPairs = 0;
+	uint64_t numberOfActiveSuccessiveBondPairs = 0;
+	uint64_t lastRightBondWord = 0, lastBelowBondWord = 0;
+	for (uint32_t i = 0; i < numberOfBondWords; i++)
+	{
+		uint64_t rightBondWord, belowBondWord;
+		DrawTwoBernoulliWords(TheUpdater.bondThreshold, threadState.randomStates, rightBondWord, belowBondWord);
+		numberOfActiveBonds += std::popcount(rightBondWord) + std::popcount(belowBondWord);
+		numberOfActiveNeighbouringBondPairs += std::popcount(rightBondWord & (rightBondWord >> 1)) + std::popcount(belowBondWord & (belowBondWord >> 1));
+		numberOfActiveRightAndBelowBondPairs += std::popcount(rightBondWord & belowBondWord);
+		if (i > 0)
+		{
+			numberOfActiveSuccessiveBondPairs += std::popcount(rightBondWord & lastRightBondWord) + std::popcount(belowBondWord & lastBelowBondWord);
+		}
+		lastRightBondWord = rightBondWord;
+		lastBelowBondWord = belowBondWord;
+	}
+
+	// The counts are binomial around their expectations if the bonds are independent. Neighbouring pairs in a word share a bond with the pair
+	// next to them, which adds their covariance p^3 - p^4 twice for every one of the 62 neighbours in the 63 pairs of a word
+	const double bondProbability = 1.0 - std::exp(-2.0 * beta);
+	const double bondPairProbability = bondProbability * bondProbability;
+	auto CheckTheCount = [&](const char* countName, const uint64_t count, const double numberOfTrials, const double probability, const double variance)
+		{
+			const double zScore = (variance > 0.0) ? (count - numberOfTrials * probability) / std::sqrt(variance) : 0.0;
+			if (std::abs(zScore) > maxZScore)
+			{
+				throw std::runtime_error(std::string("The ") + countName + " of the Swendsen-Wang bonds at beta = " + std::to_string(beta) + " is off by "
+					+ std::to_string(zScore) + " standard deviations!");
+			}
+		};
+	const double numberOfBonds = 2.0 * 64 * numberOfBondWords;
+	CheckTheCount("number of active bonds", numberOfActiveBonds, numberOfBonds, bondProbability, numberOfBonds * bondProbability * (1.0 - bondProbability));
+	const double numberOfNeighbouringBondPairs = 2.0 * 63 * numberOfBondWords;
+	CheckTheCount("number of active neighbouring bond pairs", numberOfActiveNeighbouringBondPairs, numberOfNeighbouringBondPairs, bondPairProbability,
+		numberOfNeighbouringBondPairs * bondPairProbability * (1.0 - bondPairProbability)
+		+ 2.0 * 2 * 62 * numberOfBondWords * (bondPairProbability * bondProbability - bondPairProbability * bondPairProbability));
+	const double numberOfRightAndBelowBondPairs = 64.0 * numberOfBondWords;
+	CheckTheCount("number of active right and below bond pairs", numberOfActiveRightAndBelowBondPairs, numberOfRightAndBelowBondPairs, bondPairProbability,
+		numberOfRightAndBelowBondPairs * bondPairProbability * (1.0 - bondPairProbability));
+	// Successive pairs share a word with the pair before them the same way
+	const double numberOfSuccessiveBondPairs = 2.0 * 64 * (numberOfBondWords - 1);
+	CheckTheCount("number of active successive bond pairs", numberOfActiveSuccessiveBondPairs, numberOfSuccessiveBondPairs, bondPairProbability,
+		numberOfSuccessiveBondPairs * bondPairProbability * (1.0 - bondPairProbability)
+		+ 2.0 * 2 * 64 * ((double)numberOfBondWords - 2) * (bondPairProbability * bondProbability - bondPairProbability * bondPairProbability));
+}
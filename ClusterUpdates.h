@@ -0,0 +1,128 @@
+#pragma once
+#include "ThreadPool.h"
+#include "ObservableAccumulator.h"
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <barrier>
+
+/* Wolff single-cluster updates on the pArraySpinBatches grid (32 spins per uint32_t in row-major order, most significant bit first).
+   The spins of a cluster are flipped as they are added, so a flipped spin doubles as the visited mark and the cluster stack is all the scratch needed.
+   To keep the sweep based sampling of the Metropolis engines, one "sweep" flips about isingN / 2 spins, which is as many spin updates as
+   one checkerboard colour of a Metropolis sweep. The sweeps before sampling starts flip clusters until that many spins have been flipped and
+   measure the mean cluster size, the sampled sweeps flip the fixed number of clusters that gives isingN / 2 spins on average. Without a wait,
+   one unsampled sweep of clusters is flipped to measure it */
+class cWolffClusterUpdater
+{
+	// Do the sweeps (same sampling semantics as DoTheIsingGridSweepsCPU)
+	friend void DoTheIsingGridSweepsWolffCPU(cWolffClusterUpdater* pTheUpdater, uint32_t* pArraySpinBatches, int* pArraySpinSumOutputs,
+		int& TheSpinSum, const double beta, const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+		const uint32_t sweepsPerSpinSumSample, cObservableAccumulator* pObservableAccumulator);
+
+private:
+	uint32_t isingL = 0;
+	uint32_t isingN = 0;
+	std::vector<uint32_t> clusterStack;												// Spin indices. Holds isingN entries, so a cluster never allocates
+	uint32_t randomState = 1;
+	uint32_t addThreshold = 0;														// A raw 32-bit random number below this adds an aligned neighbour to the cluster
+	int64_t spinFlipCredit = 0;														// The spin flips left in the current sweep (negative if the last cluster overshot)
+	uint32_t clustersPerSweep = 1;													// Used once sampling starts, measured again at every temperature
+
+	// Grow a cluster from a random seed spin and flip it. Returns the number of flipped spins
+	uint32_t GrowAndFlipOneCluster(uint32_t* pArraySpinBatches, int& TheSpinSum);
+
+public:
+	cWolffClusterUpdater(const uint32_t isingL);
+
+	void SetBeta(const double beta);
+	// The constructor seeds from the clock, so updaters made in the same second share their stream unless they are reseeded
+	void SetRandomSeed(const uint32_t randomSeed);
+};
+
+// pArraySpinSumOutputs can be nullptr if the samples only go into pObservableAccumulator
+void DoTheIsingGridSweepsWolffCPU(cWolffClusterUpdater* pTheUpdater, uint32_t* pArraySpinBatches, int* pArraySpinSumOutputs,
+	int& TheSpinSum, const double beta, const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+	const uint32_t sweepsPerSpinSumSample, cObservableAccumulator* pObservableAccumulator = nullptr);
+
+/* The state a Swendsen-Wang thread owns. Aligned to a cache line so the threads do not share one */
+struct alignas(64) sSwendsenWangThreadState
+{
+	uint32_t firstRowNumber = 0;													// The thread updates the rows [firstRowNumber, endRowNumber)
+	uint32_t endRowNumber = 0;
+	uint64_t randomStates[2][32] = {};												// 64-bit XORShift streams for the bonds (right and below), one per binary digit of the threshold
+	uint32_t clusterFlipSalt = 1;													// The same on every thread, so they agree on which clusters flip
+	int spinSumChangeSinceTheStartOfTheTemperature = 0;
+	std::vector<uint64_t> shiftedRowWords;											// Scratch row holding the right neighbours
+};
+
+/* Swendsen-Wang multi-cluster updates, split over row strips like the multi-spin-coded engine.
+   Every update activates the bonds between aligned neighbours 64 at a time, labels the clusters with a lock-free union-find
+   (every strip is labelled on its own, then the bonds across the strip boundaries are united in parallel) and flips every cluster with
+   the probability 1/2. The flip decision is a hash of the cluster label, so every thread can make it for its own spins without sharing a table.
+   Every spin gets a new cluster in every update, so one update counts as one "sweep" */
+class cSwendsenWangClusterUpdater
+{
+	// Do the sweeps (same sampling semantics as DoTheIsingGridSweepsCPU)
+	friend void DoTheIsingGridSweepsSwendsenWangCPU(cSwendsenWangClusterUpdater* pTheUpdater, uint32_t* pArraySpinBatches, int* pArraySpinSumOutputs,
+		int& TheSpinSum, const double beta, const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+		const uint32_t sweepsPerSpinSumSample, cObservableAccumulator* pObservableAccumulator);
+	// Draws the bond words of its first thread
+	friend void CheckSwendsenWangBondsStatistically(const double beta, const uint32_t numberOfBondWords, const double maxZScore);
+
+private:
+	uint32_t isingL = 0;
+	uint32_t isingN = 0;
+	uint32_t wordsPerRow = 0;
+	uint32_t bitsInTheLastWord = 0;													// The number of used bits in the last word of a row
+	uint64_t lastWordMask = 0;
+	std::vector<uint64_t> spinWords;												// Indexed as [row][word]. Bit b of word w is the spin at column 64 * w + b
+	std::vector<uint64_t> rightBondWords;											// A set bit is an active bond to the right neighbour
+	std::vector<uint64_t> belowBondWords;											// A set bit is an active bond to the neighbour below
+	std::vector<uint32_t> clusterParents;											// The union-find forest over the spin indices. A root is its own parent
+	std::vector<int> spinSumSamplesOfTheChunk;										// Used when the samples only go into an observable accumulator
+	std::vector<int> energySamplesOfTheChunk;										// Only used with an observable accumulator, as long as the longest chunk
+	uint32_t bondThreshold = 0;														// A bond between aligned neighbours is active with the probability bondThreshold / 2^32
+
+	std::unique_ptr<cThreadPool> pThreadPool;
+	std::unique_ptr<sSwendsenWangThreadState[]> pThreadStates;
+	std::unique_ptr<std::barrier<>> pPhaseBarrier;
+	uint32_t numberOfThreads = 1;
+
+	// Draw the active bonds of the strip and label the clusters inside it
+	void ActivateBondsAndLabelTheStrip(sSwendsenWangThreadState& threadState);
+	// Unite the clusters across the bonds from the last row of the strip to the first row of the next strip
+	void LabelAcrossTheStripBoundary(sSwendsenWangThreadState& threadState);
+	// Flip the clusters of the spins in the strip. Returns the change of the spin sum
+	int FlipTheClustersOfTheStrip(sSwendsenWangThreadState& threadState);
+	// The energy of the bonds from the rows of the strip to their right and below neighbours
+	int CalculateTheEnergyOfTheStrip(sSwendsenWangThreadState& threadState);
+	// Run the sweeps [firstSweepNumberOfTheChunk, endSweepNumberOfTheChunk) of one temperature on the strip of one thread.
+	// The samples are counted from the start of the temperature, the one with the index firstSpinSumOutputsIndexOfTheChunk goes into pSpinSumSamplesOfTheChunk[0].
+	// pEnergySamplesOfTheChunk gets the energies of the strips the same way, it is nullptr if the energies are not needed
+	void DoTheSweepsOfOneThread(const uint32_t threadIndex, int* pSpinSumSamplesOfTheChunk, int* pEnergySamplesOfTheChunk, const uint32_t firstSweepNumberOfTheChunk,
+		const uint32_t endSweepNumberOfTheChunk, const uint32_t firstSpinSumOutputsIndexOfTheChunk, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+		const uint32_t sweepsPerSpinSumSample);
+
+public:
+	// The number of threads is capped so that every strip has at least a few rows
+	cSwendsenWangClusterUpdater(const uint32_t isingL, const uint32_t numberOfThreads = 1);
+
+	// Convert from and to the pArraySpinBatches format
+	void ImportSpinBatches(const uint32_t* pArraySpinBatches);
+	void ExportSpinBatches(uint32_t* pArraySpinBatches) const;
+
+	void SetBeta(const double beta);
+	// The constructor seeds from the clock, so updaters made in the same second share their streams unless they are reseeded
+	void SetRandomSeed(const uint32_t randomSeed);
+	uint32_t GetNumberOfThreads() const;
+};
+
+// pArraySpinSumOutputs can be nullptr if the samples only go into pObservableAccumulator
+void DoTheIsingGridSweepsSwendsenWangCPU(cSwendsenWangClusterUpdater* pTheUpdater, uint32_t* pArraySpinBatches, int* pArraySpinSumOutputs,
+	int& TheSpinSum, const double beta, const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+	const uint32_t sweepsPerSpinSumSample, cObservableAccumulator* pObservableAccumulator = nullptr);
+
+// Draw numberOfBondWords right and below bond words at beta like a Swendsen-Wang thread does. Throw if the fraction of active bonds is more than maxZScore
+// standard deviations off 1 - exp(-2 * beta), or if the bonds next to each other in a word, the right and below bonds of a spin or the same bond
+// of two successive words are both active more or less often than independent bonds would be
+void CheckSwendsenWangBondsStatistically(const double beta, const uint32_t numberOfBondWords, const double maxZScore);
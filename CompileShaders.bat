@@ -0,0 +1,34 @@
+@echo off
+rem Compiles the compute shaders to the .spv files LoadShaderModule reads. Run it after every change of a .comp file or of Philox.glsl,
+rem the UBO layouts of the shaders have to match the ones of Setup.h. The .spv files go next to the executable, the directory is the first argument
+rem (the directory of the sources if there is none). The word lists EmbeddedShaders.cpp embeds (.spv.inc) go next to the sources, so build the
+rem executable after running it. glslc comes with the Vulkan SDK
+setlocal
+set GLSLC=glslc
+if defined VULKAN_SDK set GLSLC="%VULKAN_SDK%\Bin\glslc.exe"
+set OUTPUT_DIRECTORY=%~f1
+if "%OUTPUT_DIRECTORY%"=="" set OUTPUT_DIRECTORY=%~dp0
+cd /d "%~dp0"
+
+call :CompileKernel IsingKernelOneBitPerSpin || exit /b 1
+call :CompileKernel IsingKernelOneIntPerSpin || exit /b 1
+call :CompileKernel IsingKernelMultiSpinCoded || exit /b 1
+call :CompileKernel IsingKernelSharedMemoryTiled || exit /b 1
+call :CompileKernel IsingKernelOneBytePerSpinSublattices || exit /b 1
+call :CompileKernel IsingKernelBatchedReplicas || exit /b 1
+call :CompileKernel XYKernel || exit /b 1
+rem The reduction does not use the subgroup operations
+call :CompileShader SpinSumMomentReduction SpinSumMomentReduction || exit /b 1
+exit /b 0
+
+rem Every kernel is compiled twice, the second time without GL_KHR_shader_subgroup_arithmetic for the devices that do not have it
+:CompileKernel
+call :CompileShader %~1 %~1 || exit /b 1
+call :CompileShader %~1 %~1NoSubgroupArithmetic -DNO_SUBGROUP_ARITHMETIC || exit /b 1
+exit /b 0
+
+rem The shader %1.comp to %2.spv and %2.spv.inc, with the defines of %3
+:CompileShader
+%GLSLC% --target-env=vulkan1.2 %3 %~1.comp -o "%OUTPUT_DIRECTORY%\%~2.spv" || exit /b 1
+%GLSLC% --target-env=vulkan1.2 -mfmt=num %3 %~1.comp -o %~2.spv.inc || exit /b 1
+exit /b 0
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Compiles the compute shaders to the .spv files LoadShaderModule reads, like CompileShaders.bat does on Windows.
+# The .spv files go next to the executable, the directory is the first argument (the directory of the sources if there is none).
+# The word lists EmbeddedShaders.cpp embeds (.spv.inc) go next to the sources, so build the executable after running it
+set -e
+OUTPUT_DIRECTORY="$(cd "${1:-$(dirname "$0")}" && pwd)"
+cd "$(dirname "$0")"
+GLSLC="${VULKAN_SDK:+$VULKAN_SDK/bin/}glslc"
+
+# The shader $1.comp to $2.spv and $2.spv.inc, the other arguments are passed on to glslc
+CompileShader()
+{
+	shaderName="$1"
+	output="$2"
+	shift 2
+	"$GLSLC" --target-env=vulkan1.2 "$@" "$shaderName.comp" -o "$OUTPUT_DIRECTORY/$output.spv"
+	"$GLSLC" --target-env=vulkan1.2 -mfmt=num "$@" "$shaderName.comp" -o "$output.spv.inc"
+}
+
+# Every kernel is compiled twice, the second time without GL_KHR_shader_subgroup_arithmetic for the devices that do not have it
+CompileKernel()
+{
+	CompileShader "$1" "$1"
+	CompileShader "$1" "$1NoSubgroupArithmetic" -DNO_SUBGROUP_ARITHMETIC
+}
+
+CompileKernel IsingKernelOneBitPerSpin
+CompileKernel IsingKernelOneIntPerSpin
+CompileKernel IsingKernelMultiSpinCoded
+CompileKernel IsingKernelSharedMemoryTiled
+CompileKernel IsingKernelOneBytePerSpinSublattices
+CompileKernel IsingKernelBatchedReplicas
+CompileKernel XYKernel
+# The reduction does not use the subgroup operations
+CompileShader SpinSumMomentReduction SpinSumMomentReduction
@@ -1,5 +1,12 @@
 #include "Control.h"
 #include "Setup.h"
+#include "MultiSpinCoding.h"
+#include "ClusterUpdates.h"
+#include "ParallelTempering.h"
+#include "TemperatureScheduler.h"
+#include "HeterogeneousScheduler.h"
+#include "ObservableAccumulator.h"
+#include "AcceptanceTable.h"
 #include <TApplication.h>
 #include <TGraph.h>
 #include <TCanvas.h>
@@ -17,7 +24,11 @@
 #include <cassert>
 #include <cstdlib>
 #include <string>
+#include <memory>
 #include <sstream>
+#include <thread>
+#include <algorithm>
+#include <bit>
 
 
 void IsingGPUUserInputRun()
@@ -26,7 +37,6 @@ void IsingGPUUserInputRun()
 	isingParameters.GPUOrCPUIdentifierText = "GPU";
 	std::cout << "Enter the grid length: ";
 	std::cin >> isingParameters.isingL;
-	assert(isingParameters.isingL <= 2000);
 	std::cout << "Enter the start value of beta: ";
 	std::cin >> isingParameters.startBeta;
 	assert(isingParameters.startBeta > 0.0);
@@ -226,6 +236,14 @@ void IsingCPUUserInputRun()
 	std::cout << "Enter how many sweeps should happen per sample after the wait: ";
 	std::cin >> isingParameters.sweepsPerSpinSumSample;
 	assert(isingParameters.sweepsPerSpinSumSample <= (isingParameters.numberOfSweepsPerTemperature - isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts));
+	std::cout << "Enter the number of CPU threads: ";
+	std::cin >> isingParameters.numberOfCPUThreads;
+	assert(isingParameters.numberOfCPUThreads >= 1);
+	uint32_t updateAlgorithmType = 0;
+	std::cout << "Enter the update algorithm (0 = Metropolis, 1 = Wolff, 2 = Swendsen-Wang): ";
+	std::cin >> updateAlgorithmType;
+	assert(updateAlgorithmType <= UPDATE_ALGORITHM_TYPE_SWENDSEN_WANG);
+	isingParameters.updateAlgorithmType = (eUpdateAlgorithmType)updateAlgorithmType;
 	std::cout << '\n';
 
 	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
@@ -239,25 +257,67 @@ void IsingCPUUserInputRun()
 	// Set up the Ising grid on the CPU
 	const uint32_t isingN = isingParameters.isingL * isingParameters.isingL;
 	const uint32_t numberOfSpinBatches = (uint32_t) std::ceil(isingN / 32.0);
-	const uint32_t numberOfElementsInTheSpinSumOutputArray = (isingParameters.numberOfSweepsPerTemperature - isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts - 1)
-		/ isingParameters.sweepsPerSpinSumSample;																// Integer division
 	uint32_t* pArraySpinBatches = new uint32_t[numberOfSpinBatches];
-	int* pArraySpinSumOutputs = new int[numberOfElementsInTheSpinSumOutputArray];
+	cObservableAccumulator TheObservableAccumulator(isingParameters.isingL);												// Only the averages are needed, so no spin sum time series is kept
 	int TheSpinSum = isingN;
 	for (uint32_t i = 0; i < numberOfSpinBatches; i++)
 	{
 		pArraySpinBatches[i] = ~0U;																					// All spins are +1
 	}
 
+	// The multi-spin-coded engine needs an even grid length
+	eCPUSweepEngineType cpuSweepEngineType = (isingParameters.isingL % 2 == 0) ? CPU_SWEEP_ENGINE_TYPE_MULTI_SPIN_CODED : CPU_SWEEP_ENGINE_TYPE_BIT_BY_BIT;
+	if (isingParameters.updateAlgorithmType == UPDATE_ALGORITHM_TYPE_WOLFF)
+	{
+		cpuSweepEngineType = CPU_SWEEP_ENGINE_TYPE_WOLFF;
+	}
+	else if (isingParameters.updateAlgorithmType == UPDATE_ALGORITHM_TYPE_SWENDSEN_WANG)
+	{
+		cpuSweepEngineType = CPU_SWEEP_ENGINE_TYPE_SWENDSEN_WANG;
+	}
+	cMultiSpinCodedIsingLattice* pTheLattice = nullptr;
+	cWolffClusterUpdater* pTheWolffClusterUpdater = nullptr;
+	cSwendsenWangClusterUpdater* pTheSwendsenWangClusterUpdater = nullptr;
+	if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_MULTI_SPIN_CODED)
+	{
+		pTheLattice = new cMultiSpinCodedIsingLattice(isingParameters.isingL, isingParameters.numberOfCPUThreads);
+	}
+	else if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_WOLFF)
+	{
+		pTheWolffClusterUpdater = new cWolffClusterUpdater(isingParameters.isingL);
+	}
+	else if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_SWENDSEN_WANG)
+	{
+		pTheSwendsenWangClusterUpdater = new cSwendsenWangClusterUpdater(isingParameters.isingL, isingParameters.numberOfCPUThreads);
+	}
+
 	// Do the computation
 	double beta = isingParameters.startBeta;
 	for (int i = 0; i < numberOfDataPointsForTheBinderCumulantPlot; i++)
 	{
-		DoTheIsingGridSweepsCPU(pArraySpinBatches, pArraySpinSumOutputs, TheSpinSum, isingParameters.isingL, beta,
-			isingParameters.numberOfSweepsPerTemperature, isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, isingParameters.sweepsPerSpinSumSample);
+		if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_MULTI_SPIN_CODED)
+		{
+			DoTheIsingGridSweepsMultiSpinCodedCPU(pTheLattice, pArraySpinBatches, nullptr, TheSpinSum, beta,
+				isingParameters.numberOfSweepsPerTemperature, isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, isingParameters.sweepsPerSpinSumSample, &TheObservableAccumulator);
+		}
+		else if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_WOLFF)
+		{
+			DoTheIsingGridSweepsWolffCPU(pTheWolffClusterUpdater, pArraySpinBatches, nullptr, TheSpinSum, beta,
+				isingParameters.numberOfSweepsPerTemperature, isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, isingParameters.sweepsPerSpinSumSample, &TheObservableAccumulator);
+		}
+		else if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_SWENDSEN_WANG)
+		{
+			DoTheIsingGridSweepsSwendsenWangCPU(pTheSwendsenWangClusterUpdater, pArraySpinBatches, nullptr, TheSpinSum, beta,
+				isingParameters.numberOfSweepsPerTemperature, isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, isingParameters.sweepsPerSpinSumSample, &TheObservableAccumulator);
+		}
+		else
+		{
+			DoTheIsingGridSweepsCPU(pArraySpinBatches, nullptr, TheSpinSum, isingParameters.isingL, beta,
+				isingParameters.numberOfSweepsPerTemperature, isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, isingParameters.sweepsPerSpinSumSample, &TheObservableAccumulator);
+		}
 
 		betaValues[i] = beta;
-		binderCumulants[i] = CalculateBinderCumulantCPU(pArraySpinSumOutputs, isingParameters.isingL, numberOfElementsInTheSpinSumOutputArray);
+		binderCumulants[i] = TheObservableAccumulator.GetBinderCumulant();
 
 		beta -= isingParameters.betaDecrement;
 	}
@@ -300,7 +360,9 @@ void IsingCPUUserInputRun()
 	rootApp->Run();
 
 	delete[] pArraySpinBatches;
-	delete[] pArraySpinSumOutputs;
+	delete pTheLattice;
+	delete pTheWolffClusterUpdater;
+	delete pTheSwendsenWangClusterUpdater;
 	//delete rootApp, delete rootCanvas, delete rootMultiGraph, delete rootBinderCumulantGraph, delete rootMultiGraphLegend
 }
 
@@ -317,7 +379,9 @@ void IsingCPUHardcodedRun()
 		.numberOfSweepsPerTemperature = 100000,
 		.numberOfSweepsToWaitBeforeSpinSumSamplingStarts = 100,
 		.sweepsPerSpinSumSample = 2,
-		.GPUOrCPUIdentifierText = "CPU"
+		.GPUOrCPUIdentifierText = "CPU",
+		.numberOfCPUThreads = 1,
+		.updateAlgorithmType = UPDATE_ALGORITHM_TYPE_METROPOLIS
 	};
 
 	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
@@ -331,25 +395,67 @@ void IsingCPUHardcodedRun()
 	// Set up the Ising grid on the CPU
 	const uint32_t isingN = isingParameters.isingL * isingParameters.isingL;
 	const uint32_t numberOfSpinBatches = (uint32_t)std::ceil(isingN / 32.0);
-	const uint32_t numberOfElementsInTheSpinSumOutputArray = (isingParameters.numberOfSweepsPerTemperature - isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts - 1)
-		/ isingParameters.sweepsPerSpinSumSample;																	// Integer division
 	uint32_t* pArraySpinBatches = new uint32_t[numberOfSpinBatches];
-	int* pArraySpinSumOutputs = new int[numberOfElementsInTheSpinSumOutputArray];
+	cObservableAccumulator TheObservableAccumulator(isingParameters.isingL);												// Only the averages are needed, so no spin sum time series is kept
 	int TheSpinSum = isingN;
 	for (uint32_t i = 0; i < numberOfSpinBatches; i++)
 	{
 		pArraySpinBatches[i] = ~0U;																					// All spins are +1
 	}
 
+	// The multi-spin-coded engine needs an even grid length
+	eCPUSweepEngineType cpuSweepEngineType = (isingParameters.isingL % 2 == 0) ? CPU_SWEEP_ENGINE_TYPE_MULTI_SPIN_CODED : CPU_SWEEP_ENGINE_TYPE_BIT_BY_BIT;
+	if (isingParameters.updateAlgorithmType == UPDATE_ALGORITHM_TYPE_WOLFF)
+	{
+		cpuSweepEngineType = CPU_SWEEP_ENGINE_TYPE_WOLFF;
+	}
+	else if (isingParameters.updateAlgorithmType == UPDATE_ALGORITHM_TYPE_SWENDSEN_WANG)
+	{
+		cpuSweepEngineType = CPU_SWEEP_ENGINE_TYPE_SWENDSEN_WANG;
+	}
+	cMultiSpinCodedIsingLattice* pTheLattice = nullptr;
+	cWolffClusterUpdater* pTheWolffClusterUpdater = nullptr;
+	cSwendsenWangClusterUpdater* pTheSwendsenWangClusterUpdater = nullptr;
+	if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_MULTI_SPIN_CODED)
+	{
+		pTheLattice = new cMultiSpinCodedIsingLattice(isingParameters.isingL, isingParameters.numberOfCPUThreads);
+	}
+	else if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_WOLFF)
+	{
+		pTheWolffClusterUpdater = new cWolffClusterUpdater(isingParameters.isingL);
+	}
+	else if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_SWENDSEN_WANG)
+	{
+		pTheSwendsenWangClusterUpdater = new cSwendsenWangClusterUpdater(isingParameters.isingL, isingParameters.numberOfCPUThreads);
+	}
+
 	// Do the computation
 	double beta = isingParameters.startBeta;
 	for (int i = 0; i < numberOfDataPointsForTheBinderCumulantPlot; i++)
 	{
-		DoTheIsingGridSweepsCPU(pArraySpinBatches, pArraySpinSumOutputs, TheSpinSum, isingParameters.isingL, beta,
-			isingParameters.numberOfSweepsPerTemperature, isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, isingParameters.sweepsPerSpinSumSample);
+		if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_MULTI_SPIN_CODED)
+		{
+			DoTheIsingGridSweepsMultiSpinCodedCPU(pTheLattice, pArraySpinBatches, nullptr, TheSpinSum, beta,
+				isingParameters.numberOfSweepsPerTemperature, isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, isingParameters.sweepsPerSpinSumSample, &TheObservableAccumulator);
+		}
+		else if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_WOLFF)
+		{
+			DoTheIsingGridSweepsWolffCPU(pTheWolffClusterUpdater, pArraySpinBatches, nullptr, TheSpinSum, beta,
+				isingParameters.numberOfSweepsPerTemperature, isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, isingParameters.sweepsPerSpinSumSample, &TheObservableAccumulator);
+		}
+		else if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_SWENDSEN_WANG)
+		{
+			DoTheIsingGridSweepsSwendsenWangCPU(pTheSwendsenWangClusterUpdater, pArraySpinBatches, nullptr, TheSpinSum, beta,
+				isingParameters.numberOfSweepsPerTemperature, isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, isingParameters.sweepsPerSpinSumSample, &TheObservableAccumulator);
+		}
+		else
+		{
+			DoTheIsingGridSweepsCPU(pArraySpinBatches, nullptr, TheSpinSum, isingParameters.isingL, beta,
+				isingParameters.numberOfSweepsPerTemperature, isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, isingParameters.sweepsPerSpinSumSample, &TheObservableAccumulator);
+		}
 
 		betaValues[i] = beta;
-		binderCumulants[i] = CalculateBinderCumulantCPU(pArraySpinSumOutputs, isingParameters.isingL, numberOfElementsInTheSpinSumOutputArray);
+		binderCumulants[i] = TheObservableAccumulator.GetBinderCumulant();
 
 		beta -= isingParameters.betaDecrement;
 	}
@@ -392,6 +498,109 @@ void IsingCPUHardcodedRun()
 	rootApp->Run();
 
 	delete[] pArraySpinBatches;
+	delete pTheLattice;
+	delete pTheWolffClusterUpdater;
+	delete pTheSwendsenWangClusterUpdater;
+	//delete rootApp, delete rootCanvas, delete rootMultiGraph, delete rootBinderCumulantGraph, delete rootMultiGraphLegend
+}
+
+/**********************************************************************/
+
+void IsingCPUParallelTemperingRun()
+{
+	sIsingParameters isingParameters =
+	{
+		.isingL = 20,
+		.startBeta = 0.50,
+		.endBeta = 0.35,
+		.betaDecrement = 0.01,
+		.numberOfSweepsPerTemperature = 100000,
+		.numberOfSweepsToWaitBeforeSpinSumSamplingStarts = 100,
+		.sweepsPerSpinSumSample = 2,
+		.GPUOrCPUIdentifierText = "CPU (parallel tempering)",
+		.numberOfCPUThreads = std::max(1U, std::thread::hardware_concurrency()),
+		.updateAlgorithmType = UPDATE_ALGORITHM_TYPE_METROPOLIS
+	};
+	const uint32_t sweepsPerReplicaExchange = 10;
+
+	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+
+	std::cout << "The computation has started...\n";
+
+	int numberOfDataPointsForTheBinderCumulantPlot = (int)std::floor((isingParameters.startBeta - isingParameters.endBeta) / isingParameters.betaDecrement);
+	std::vector<double> binderCumulants(numberOfDataPointsForTheBinderCumulantPlot);
+	std::vector<double> betaValues(numberOfDataPointsForTheBinderCumulantPlot);
+
+	// Every beta gets its own replica and its own spin sum series
+	double beta = isingParameters.startBeta;
+	for (int i = 0; i < numberOfDataPointsForTheBinderCumulantPlot; i++)
+	{
+		betaValues[i] = beta;
+		beta -= isingParameters.betaDecrement;
+	}
+	const uint32_t numberOfElementsInTheSpinSumOutputArray = (isingParameters.numberOfSweepsPerTemperature - isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts - 1)
+		/ isingParameters.sweepsPerSpinSumSample + 1;																	// Integer division
+	int* pArraySpinSumOutputs = new int[(size_t)numberOfDataPointsForTheBinderCumulantPlot * numberOfElementsInTheSpinSumOutputArray];
+
+	try
+	{
+		cParallelTemperingEnsemble TheEnsemble(isingParameters.isingL, betaValues, sweepsPerReplicaExchange, isingParameters.numberOfCPUThreads);
+		DoTheIsingGridSweepsParallelTemperingCPU(&TheEnsemble, pArraySpinSumOutputs, isingParameters.numberOfSweepsPerTemperature,
+			isingParameters.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, isingParameters.sweepsPerSpinSumSample);
+
+		for (int i = 0; i < numberOfDataPointsForTheBinderCumulantPlot; i++)
+		{
+			binderCumulants[i] = CalculateBinderCumulantCPU(pArraySpinSumOutputs + (size_t)i * numberOfElementsInTheSpinSumOutputArray, isingParameters.isingL,
+				numberOfElementsInTheSpinSumOutputArray);
+		}
+
+		// A rate near 0 means the neighbouring betas are too far apart, a rate near 1 means they could be further apart
+		std::cout << "Beta;Beta;Swap acceptance rate\n";
+		for (int i = 0; i + 1 < numberOfDataPointsForTheBinderCumulantPlot; i++)
+		{
+			std::cout << betaValues[i] << ';' << betaValues[i + 1] << ';' << TheEnsemble.GetSwapAcceptanceRate(i) << '\n';
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << '\n';
+	}
+
+	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
+	std::chrono::duration<double> computationTime = timePoint2 - timePoint1;
+
+	std::cout << "The computation has finished.\nCOMPUTATION TIME (seconds): " << (computationTime.count()) << '\n';
+
+	// Ask the user to save the data
+	char saveDataOrNotUserInput;
+	std::cout << "\nSave data before displaying plot (Y/n)?\n";
+	std::cin >> saveDataOrNotUserInput;
+
+	if (saveDataOrNotUserInput == 89 || saveDataOrNotUserInput == 121)
+	{
+		std::string filename;
+		std::cout << "Enter the filename: ";
+		std::cin >> filename;
+		SaveBinderCumulantData(filename.c_str(), isingParameters, computationTime.count(), betaValues, binderCumulants);
+	}
+
+	// Plot the Binder cumulant graph
+	TApplication* rootApp = new TApplication("app", nullptr, nullptr);
+	TCanvas* rootCanvas = new TCanvas("canvas", "Ising CPU parallel tempering", 1280, 960);
+	TMultiGraph* rootMultiGraph = new TMultiGraph();
+	rootMultiGraph->SetName("multigraph");
+	rootMultiGraph->SetTitle("Binder cumulant vs #beta (CPU, parallel tempering);#beta;Binder cumulant");
+	TGraph* rootBinderCumulantGraph = new TGraph(numberOfDataPointsForTheBinderCumulantPlot, betaValues.data(), binderCumulants.data());
+	TLegend* rootMultiGraphLegend = new TLegend(0.1, 0.1, 0.2, 0.2);
+	std::string legendEntryText = "L: ";
+	legendEntryText.append(std::to_string(isingParameters.isingL));
+	rootMultiGraphLegend->AddEntry(rootBinderCumulantGraph, legendEntryText.c_str(), "P");
+	rootMultiGraph->Add(rootBinderCumulantGraph, "*");
+	rootMultiGraph->Draw("A");
+	rootMultiGraphLegend->Draw();
+
+	rootApp->Run();
+
 	delete[] pArraySpinSumOutputs;
 	//delete rootApp, delete rootCanvas, delete rootMultiGraph, delete rootBinderCumulantGraph, delete rootMultiGraphLegend
 }
@@ -471,6 +680,10 @@ void IsingGPUHardcodedMultipleGridsAndAutoSaveRun()
 	};
 	aOutputFilenames[0] = "output0.txt";
 
+	// The files are written on their own threads while the next grid is swept
+	std::vector<std::thread> saveThreads;
+	// Every grid creates its resources against the same device, which is only created once
+	std::shared_ptr<cVulkanEngine> pTheVulkanEngine;
 	for (int i = 0; i < 1; i++)
 	{
 		std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
@@ -481,20 +694,33 @@ void IsingGPUHardcodedMultipleGridsAndAutoSaveRun()
 
 		try
 		{
-			cSetup TheSetup(aIsingParameters[i].isingL, aIsingParameters[i].numberOfSweepsPerTemperature, aIsingParameters[i].numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+			if (!pTheVulkanEngine)
+			{
+				pTheVulkanEngine = std::make_shared<cVulkanEngine>();
+			}
+			cSetup TheSetup(pTheVulkanEngine, aIsingParameters[i].isingL, aIsingParameters[i].numberOfSweepsPerTemperature, aIsingParameters[i].numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
 				aIsingParameters[i].sweepsPerSpinSumSample, COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN);
 
+			// Submit the next beta before the samples of the last one are reduced, so the GPU sweeps while the host reduces
 			double beta = aIsingParameters[i].startBeta;
 			for (uint32_t j = 0; j < numberOfDataPointsForTheBinderCumulantPlot; j++)
 			{
-				DoTheIsingGridSweepsGPU(&TheSetup, aIsingParameters[i].isingL, beta, aIsingParameters[i].numberOfSweepsPerTemperature,
+				const uint64_t temperatureNumber = SubmitTheIsingGridSweepsGPU(&TheSetup, aIsingParameters[i].isingL, beta, aIsingParameters[i].numberOfSweepsPerTemperature,
 					aIsingParameters[i].numberOfSweepsToWaitBeforeSpinSumSamplingStarts, aIsingParameters[i].sweepsPerSpinSumSample);
 
 				betaValues[j] = beta;
-				binderCumulants[j] = CalculateBinderCumulantGPU(&TheSetup, aIsingParameters[i].isingL);
+				if (j > 0)
+				{
+					binderCumulants[j - 1] = CalculateBinderCumulantGPU(&TheSetup, aIsingParameters[i].isingL, temperatureNumber - 1);
+				}
 
 				beta -= aIsingParameters[i].betaDecrement;
 			}
+			if (numberOfDataPointsForTheBinderCumulantPlot > 0)
+			{
+				binderCumulants[numberOfDataPointsForTheBinderCumulantPlot - 1] = CalculateBinderCumulantGPU(&TheSetup, aIsingParameters[i].isingL,
+					TheSetup.GetLastSubmittedTemperatureNumber());
+			}
 		}
 		catch (const std::exception& e)
 		{
@@ -504,7 +730,15 @@ void IsingGPUHardcodedMultipleGridsAndAutoSaveRun()
 		std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
 		std::chrono::duration<double> computationTime = timePoint2 - timePoint1;
 
-		SaveBinderCumulantData(aOutputFilenames[i], aIsingParameters[i], computationTime.count(), betaValues, binderCumulants);
+		saveThreads.emplace_back([=]() mutable
+			{
+				SaveBinderCumulantData(aOutputFilenames[i], aIsingParameters[i], computationTime.count(), betaValues, binderCumulants);
+			});
+	}
+
+	for (std::thread& saveThread : saveThreads)
+	{
+		saveThread.join();
 	}
 }
 
@@ -523,7 +757,9 @@ void IsingCPUHardcodedMultipleGridsAndAutoSaveRun()
 		.numberOfSweepsPerTemperature = 10000,
 		.numberOfSweepsToWaitBeforeSpinSumSamplingStarts = 100,
 		.sweepsPerSpinSumSample = 2,
-		.GPUOrCPUIdentifierText = "CPU"
+		.GPUOrCPUIdentifierText = "CPU",
+		.numberOfCPUThreads = 1,
+		.updateAlgorithmType = UPDATE_ALGORITHM_TYPE_METROPOLIS
 	};
 	aOutputFilenames[0] = "output0.txt";
 
@@ -538,25 +774,67 @@ void IsingCPUHardcodedMultipleGridsAndAutoSaveRun()
 		// Set up the Ising grid on the CPU
 		const uint32_t isingN = aIsingParameters[i].isingL * aIsingParameters[i].isingL;
 		const uint32_t numberOfSpinBatches = (uint32_t)std::ceil(isingN / 32.0);
-		const uint32_t numberOfElementsInTheSpinSumOutputArray = (aIsingParameters[i].numberOfSweepsPerTemperature - aIsingParameters[i].numberOfSweepsToWaitBeforeSpinSumSamplingStarts - 1)
-			/ aIsingParameters[i].sweepsPerSpinSumSample;																// Integer division
 		uint32_t* pArraySpinBatches = new uint32_t[numberOfSpinBatches];
-		int* pArraySpinSumOutputs = new int[numberOfElementsInTheSpinSumOutputArray];
+		cObservableAccumulator TheObservableAccumulator(aIsingParameters[i].isingL);												// Only the averages are needed, so no spin sum time series is kept
 		int TheSpinSum = isingN;
 		for (uint32_t j = 0; j < numberOfSpinBatches; j++)
 		{
 			pArraySpinBatches[j] = ~0U;																					// All spins are +1
 		}
 
+		// The multi-spin-coded engine needs an even grid length
+		eCPUSweepEngineType cpuSweepEngineType = (aIsingParameters[i].isingL % 2 == 0) ? CPU_SWEEP_ENGINE_TYPE_MULTI_SPIN_CODED : CPU_SWEEP_ENGINE_TYPE_BIT_BY_BIT;
+		if (aIsingParameters[i].updateAlgorithmType == UPDATE_ALGORITHM_TYPE_WOLFF)
+		{
+			cpuSweepEngineType = CPU_SWEEP_ENGINE_TYPE_WOLFF;
+		}
+		else if (aIsingParameters[i].updateAlgorithmType == UPDATE_ALGORITHM_TYPE_SWENDSEN_WANG)
+		{
+			cpuSweepEngineType = CPU_SWEEP_ENGINE_TYPE_SWENDSEN_WANG;
+		}
+		cMultiSpinCodedIsingLattice* pTheLattice = nullptr;
+		cWolffClusterUpdater* pTheWolffClusterUpdater = nullptr;
+		cSwendsenWangClusterUpdater* pTheSwendsenWangClusterUpdater = nullptr;
+		if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_MULTI_SPIN_CODED)
+		{
+			pTheLattice = new cMultiSpinCodedIsingLattice(aIsingParameters[i].isingL, aIsingParameters[i].numberOfCPUThreads);
+		}
+		else if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_WOLFF)
+		{
+			pTheWolffClusterUpdater = new cWolffClusterUpdater(aIsingParameters[i].isingL);
+		}
+		else if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_SWENDSEN_WANG)
+		{
+			pTheSwendsenWangClusterUpdater = new cSwendsenWangClusterUpdater(aIsingParameters[i].isingL, aIsingParameters[i].numberOfCPUThreads);
+		}
+
 		// Do the computation
 		double beta = aIsingParameters[i].startBeta;
 		for (uint32_t j = 0; j < numberOfDataPointsForTheBinderCumulantPlot; j++)
 		{
-			DoTheIsingGridSweepsCPU(pArraySpinBatches, pArraySpinSumOutputs, TheSpinSum, aIsingParameters[i].isingL, beta,
-				aIsingParameters[i].numberOfSweepsPerTemperature, aIsingParameters[i].numberOfSweepsToWaitBeforeSpinSumSamplingStarts, aIsingParameters[i].sweepsPerSpinSumSample);
+			if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_MULTI_SPIN_CODED)
+			{
+				DoTheIsingGridSweepsMultiSpinCodedCPU(pTheLattice, pArraySpinBatches, nullptr, TheSpinSum, beta,
+					aIsingParameters[i].numberOfSweepsPerTemperature, aIsingParameters[i].numberOfSweepsToWaitBeforeSpinSumSamplingStarts, aIsingParameters[i].sweepsPerSpinSumSample, &TheObservableAccumulator);
+			}
+			else if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_WOLFF)
+			{
+				DoTheIsingGridSweepsWolffCPU(pTheWolffClusterUpdater, pArraySpinBatches, nullptr, TheSpinSum, beta,
+					aIsingParameters[i].numberOfSweepsPerTemperature, aIsingParameters[i].numberOfSweepsToWaitBeforeSpinSumSamplingStarts, aIsingParameters[i].sweepsPerSpinSumSample, &TheObservableAccumulator);
+			}
+			else if (cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_SWENDSEN_WANG)
+			{
+				DoTheIsingGridSweepsSwendsenWangCPU(pTheSwendsenWangClusterUpdater, pArraySpinBatches, nullptr, TheSpinSum, beta,
+					aIsingParameters[i].numberOfSweepsPerTemperature, aIsingParameters[i].numberOfSweepsToWaitBeforeSpinSumSamplingStarts, aIsingParameters[i].sweepsPerSpinSumSample, &TheObservableAccumulator);
+			}
+			else
+			{
+				DoTheIsingGridSweepsCPU(pArraySpinBatches, nullptr, TheSpinSum, aIsingParameters[i].isingL, beta,
+					aIsingParameters[i].numberOfSweepsPerTemperature, aIsingParameters[i].numberOfSweepsToWaitBeforeSpinSumSamplingStarts, aIsingParameters[i].sweepsPerSpinSumSample, &TheObservableAccumulator);
+			}
 
 			betaValues[j] = beta;
-			binderCumulants[j] = CalculateBinderCumulantCPU(pArraySpinSumOutputs, aIsingParameters[i].isingL, numberOfElementsInTheSpinSumOutputArray);
+			binderCumulants[j] = TheObservableAccumulator.GetBinderCumulant();
 
 			beta -= aIsingParameters[i].betaDecrement;
 		}
@@ -566,9 +844,964 @@ void IsingCPUHardcodedMultipleGridsAndAutoSaveRun()
 
 		SaveBinderCumulantData(aOutputFilenames[i], aIsingParameters[i], computationTime.count(), betaValues, binderCumulants);
 
+		delete[] pArraySpinBatches;
+		delete pTheLattice;
+		delete pTheWolffClusterUpdater;
+		delete pTheSwendsenWangClusterUpdater;
+	}
+}
+
+/**********************************************************************/
+
+void IsingCPUHardcodedMultipleGridsTemperatureParallelAndAutoSaveRun()
+{
+	// Same scans as a serial run, but every (grid length, beta) point of every grid is a work item for the temperature scheduler
+	std::array<sIsingParameters, 2> aIsingParameters;
+	std::array<const char*, 2> aOutputFilenames;
+	const uint32_t numberOfCPUThreads = std::max(1U, std::thread::hardware_concurrency());
+	aIsingParameters[0] =
+	{
+		.isingL = 20,
+		.startBeta = 0.50,
+		.endBeta = 0.35,
+		.betaDecrement = 0.01,
+		.numberOfSweepsPerTemperature = 100000,
+		.numberOfSweepsToWaitBeforeSpinSumSamplingStarts = 100,
+		.sweepsPerSpinSumSample = 2,
+		.GPUOrCPUIdentifierText = "CPU (temperature parallel)",
+		.numberOfCPUThreads = numberOfCPUThreads,
+		.updateAlgorithmType = UPDATE_ALGORITHM_TYPE_METROPOLIS
+	};
+	aIsingParameters[1] =
+	{
+		.isingL = 40,
+		.startBeta = 0.50,
+		.endBeta = 0.35,
+		.betaDecrement = 0.01,
+		.numberOfSweepsPerTemperature = 100000,
+		.numberOfSweepsToWaitBeforeSpinSumSamplingStarts = 100,
+		.sweepsPerSpinSumSample = 2,
+		.GPUOrCPUIdentifierText = "CPU (temperature parallel)",
+		.numberOfCPUThreads = numberOfCPUThreads,
+		.updateAlgorithmType = UPDATE_ALGORITHM_TYPE_METROPOLIS
+	};
+	aOutputFilenames[0] = "output0.txt";
+	aOutputFilenames[1] = "output1.txt";
+
+	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+
+	// The work items of a grid are kept together and in beta order, so the threads mostly walk down beta like a serial run
+	std::vector<sTemperatureWorkItem> workItems;
+	std::array<uint32_t, 2> aFirstWorkItemIndices;
+	std::array<int, 2> aNumberOfDataPoints;
+	for (int i = 0; i < 2; i++)
+	{
+		aFirstWorkItemIndices[i] = (uint32_t)workItems.size();
+		aNumberOfDataPoints[i] = (int)std::floor((aIsingParameters[i].startBeta - aIsingParameters[i].endBeta) / aIsingParameters[i].betaDecrement);
+		double beta = aIsingParameters[i].startBeta;
+		for (int j = 0; j < aNumberOfDataPoints[i]; j++)
+		{
+			workItems.push_back({ .isingL = aIsingParameters[i].isingL, .beta = beta });
+			beta -= aIsingParameters[i].betaDecrement;
+		}
+	}
+
+	// All grids here share the sweep parameters, so one scheduler run covers them
+	std::vector<double> allBinderCumulants;
+	try
+	{
+		cTemperatureScheduler TheScheduler(numberOfCPUThreads, aIsingParameters[0].updateAlgorithmType);
+		TheScheduler.Run(workItems, aIsingParameters[0].numberOfSweepsPerTemperature, aIsingParameters[0].numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+			aIsingParameters[0].sweepsPerSpinSumSample, allBinderCumulants);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << '\n';
+		return;
+	}
+
+	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
+	std::chrono::duration<double> computationTime = timePoint2 - timePoint1;
+
+	// The grids ran interleaved, so every file gets the time of the whole run
+	for (int i = 0; i < 2; i++)
+	{
+		std::vector<double> betaValues(aNumberOfDataPoints[i]);
+		std::vector<double> binderCumulants(aNumberOfDataPoints[i]);
+		for (int j = 0; j < aNumberOfDataPoints[i]; j++)
+		{
+			betaValues[j] = workItems[aFirstWorkItemIndices[i] + j].beta;
+			binderCumulants[j] = allBinderCumulants[aFirstWorkItemIndices[i] + j];
+		}
+
+		SaveBinderCumulantData(aOutputFilenames[i], aIsingParameters[i], computationTime.count(), betaValues, binderCumulants);
+	}
+}
+
+/**********************************************************************/
+
+void IsingCPUThreadScalingRun()
+{
+	// Measure how the sweep rate of the multi-spin-coded CPU engine scales with the number of threads, for every SIMD code path the CPU supports
+	std::array<uint32_t, 3> isingLs = { 400, 1000, 2000 };
+	const double beta = 0.44;
+	const uint32_t numberOfSweeps = 2000;
+	const uint32_t maxNumberOfThreads = std::max(1U, std::thread::hardware_concurrency());
+	const char* outputFilename = "CPUThreadScaling.txt";
+
+	// 1, 2, 4, ... threads and finally every hardware thread
+	std::vector<uint32_t> numbersOfThreads;
+	for (uint32_t numberOfThreads = 1; numberOfThreads < maxNumberOfThreads; numberOfThreads *= 2)
+	{
+		numbersOfThreads.push_back(numberOfThreads);
+	}
+	numbersOfThreads.push_back(maxNumberOfThreads);
+
+	std::vector<eSIMDInstructionSet> simdInstructionSets;
+	for (int simdInstructionSet = SIMD_INSTRUCTION_SET_NONE; simdInstructionSet <= DetectSIMDInstructionSet(); simdInstructionSet++)
+	{
+		simdInstructionSets.push_back((eSIMDInstructionSet)simdInstructionSet);
+	}
+
+	std::ofstream outputFileStream(outputFilename, std::ios_base::out);
+	if (!outputFileStream.is_open())
+	{
+		std::cout << "Failed to write to file.\n";
+		return;
+	}
+	outputFileStream << "Grid length;SIMD;Threads;Sweeps per second;Speedup\n";
+	std::cout << "Grid length;SIMD;Threads;Sweeps per second;Speedup\n";
+
+	for (uint32_t isingL : isingLs)
+	{
+		const uint32_t isingN = isingL * isingL;
+		const uint32_t numberOfSpinBatches = (uint32_t)std::ceil(isingN / 32.0);
+		uint32_t* pArraySpinBatches = new uint32_t[numberOfSpinBatches];
+		int* pArraySpinSumOutputs = new int[1];
+		double singleThreadSweepsPerSecond = 0.0;
+
+		for (eSIMDInstructionSet simdInstructionSet : simdInstructionSets)
+		{
+			for (uint32_t numberOfThreads : numbersOfThreads)
+			{
+				for (uint32_t i = 0; i < numberOfSpinBatches; i++)
+				{
+					pArraySpinBatches[i] = ~0U;																		// All spins are +1
+				}
+				int TheSpinSum = isingN;
+				cMultiSpinCodedIsingLattice TheLattice(isingL, numberOfThreads);
+				TheLattice.SetSIMDInstructionSet(simdInstructionSet);
+
+				// Sampling is switched off by waiting for all sweeps
+				std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+				DoTheIsingGridSweepsMultiSpinCodedCPU(&TheLattice, pArraySpinBatches, pArraySpinSumOutputs, TheSpinSum, beta, numberOfSweeps, numberOfSweeps, 1);
+				std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
+				std::chrono::duration<double> computationTime = timePoint2 - timePoint1;
+
+				// The speedup is relative to the scalar code path on one thread
+				const double sweepsPerSecond = numberOfSweeps / computationTime.count();
+				if (numberOfThreads == 1 && simdInstructionSet == SIMD_INSTRUCTION_SET_NONE)
+				{
+					singleThreadSweepsPerSecond = sweepsPerSecond;
+				}
+
+				outputFileStream << isingL << ';' << GetSIMDInstructionSetName(simdInstructionSet) << ';' << TheLattice.GetNumberOfThreads() << ';'
+					<< sweepsPerSecond << ';' << sweepsPerSecond / singleThreadSweepsPerSecond << '\n';
+				std::cout << isingL << ';' << GetSIMDInstructionSetName(simdInstructionSet) << ';' << TheLattice.GetNumberOfThreads() << ';'
+					<< sweepsPerSecond << ';' << sweepsPerSecond / singleThreadSweepsPerSecond << '\n';
+			}
+		}
+
 		delete[] pArraySpinBatches;
 		delete[] pArraySpinSumOutputs;
 	}
+
+	outputFileStream.close();
+}
+
+/**********************************************************************/
+
+void IsingCPUUpdateAlgorithmComparisonRun()
+{
+	// Measure how many decorrelated samples per second every CPU update algorithm gives at the critical point
+	std::array<uint32_t, 2> isingLs = { 200, 400 };
+	const double beta = 0.5 * std::log(1.0 + std::sqrt(2.0));														// The critical beta of the infinite grid
+	const uint32_t numberOfCPUThreads = std::max(1U, std::thread::hardware_concurrency());
+	const char* outputFilename = "CPUUpdateAlgorithmComparison.txt";
+
+	// Local updates decorrelate far slower, so they get more sweeps
+	struct sAlgorithmRun
+	{
+		eUpdateAlgorithmType updateAlgorithmType;
+		const char* algorithmName;
+		uint32_t numberOfSweeps;
+		uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts;
+	};
+	std::array<sAlgorithmRun, 3> algorithmRuns =
+	{ {
+		{ UPDATE_ALGORITHM_TYPE_METROPOLIS, "Metropolis", 400000, 40000 },
+		{ UPDATE_ALGORITHM_TYPE_WOLFF, "Wolff", 20000, 1000 },
+		{ UPDATE_ALGORITHM_TYPE_SWENDSEN_WANG, "Swendsen-Wang", 10000, 500 }
+	} };
+
+	std::ofstream outputFileStream(outputFilename, std::ios_base::out);
+	if (!outputFileStream.is_open())
+	{
+		std::cout << "Failed to write to file.\n";
+		return;
+	}
+	outputFileStream << "Grid length;Algorithm;Sweeps per second;Integrated autocorrelation time (sweeps);Decorrelated samples per second\n";
+	std::cout << "Grid length;Algorithm;Sweeps per second;Integrated autocorrelation time (sweeps);Decorrelated samples per second\n";
+
+	for (uint32_t isingL : isingLs)
+	{
+		const uint32_t isingN = isingL * isingL;
+		const uint32_t numberOfSpinBatches = (uint32_t)std::ceil(isingN / 32.0);
+
+		for (const sAlgorithmRun& algorithmRun : algorithmRuns)
+		{
+			const uint32_t numberOfElementsInTheSpinSumOutputArray = algorithmRun.numberOfSweeps - algorithmRun.numberOfSweepsToWaitBeforeSpinSumSamplingStarts;
+			uint32_t* pArraySpinBatches = new uint32_t[numberOfSpinBatches];
+			int* pArraySpinSumOutputs = new int[numberOfElementsInTheSpinSumOutputArray];
+			for (uint32_t i = 0; i < numberOfSpinBatches; i++)
+			{
+				pArraySpinBatches[i] = ~0U;																			// All spins are +1
+			}
+			int TheSpinSum = isingN;
+
+			// Every sweep is sampled
+			std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+			if (algorithmRun.updateAlgorithmType == UPDATE_ALGORITHM_TYPE_WOLFF)
+			{
+				cWolffClusterUpdater TheWolffClusterUpdater(isingL);
+				DoTheIsingGridSweepsWolffCPU(&TheWolffClusterUpdater, pArraySpinBatches, pArraySpinSumOutputs, TheSpinSum, beta,
+					algorithmRun.numberOfSweeps, algorithmRun.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, 1);
+			}
+			else if (algorithmRun.updateAlgorithmType == UPDATE_ALGORITHM_TYPE_SWENDSEN_WANG)
+			{
+				cSwendsenWangClusterUpdater TheSwendsenWangClusterUpdater(isingL, numberOfCPUThreads);
+				DoTheIsingGridSweepsSwendsenWangCPU(&TheSwendsenWangClusterUpdater, pArraySpinBatches, pArraySpinSumOutputs, TheSpinSum, beta,
+					algorithmRun.numberOfSweeps, algorithmRun.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, 1);
+			}
+			else
+			{
+				cMultiSpinCodedIsingLattice TheLattice(isingL, numberOfCPUThreads);
+				DoTheIsingGridSweepsMultiSpinCodedCPU(&TheLattice, pArraySpinBatches, pArraySpinSumOutputs, TheSpinSum, beta,
+					algorithmRun.numberOfSweeps, algorithmRun.numberOfSweepsToWaitBeforeSpinSumSamplingStarts, 1);
+			}
+			std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
+			std::chrono::duration<double> computationTime = timePoint2 - timePoint1;
+
+			// Samples that are 2 * tau apart are about independent
+			const double sweepsPerSecond = algorithmRun.numberOfSweeps / computationTime.count();
+			const double integratedAutocorrelationTime = CalculateIntegratedAutocorrelationTimeCPU(pArraySpinSumOutputs, numberOfElementsInTheSpinSumOutputArray);
+			const double decorrelatedSamplesPerSecond = numberOfElementsInTheSpinSumOutputArray / (2.0 * integratedAutocorrelationTime) / computationTime.count();
+
+			outputFileStream << isingL << ';' << algorithmRun.algorithmName << ';' << sweepsPerSecond << ';' << integratedAutocorrelationTime << ';' << decorrelatedSamplesPerSecond << '\n';
+			std::cout << isingL << ';' << algorithmRun.algorithmName << ';' << sweepsPerSecond << ';' << integratedAutocorrelationTime << ';' << decorrelatedSamplesPerSecond << '\n';
+
+			delete[] pArraySpinBatches;
+			delete[] pArraySpinSumOutputs;
+		}
+	}
+
+	outputFileStream.close();
+}
+
+/**********************************************************************/
+
+void IsingAcceptanceTableCheckRun()
+{
+	// Check that the 32-bit acceptance thresholds accept every flip with min(1, exp(-beta * deltaE)), with and without a coupling and an external field
+	struct sAcceptanceTableParameters
+	{
+		double beta;
+		double coupling;
+		double externalField;
+	};
+	std::array<sAcceptanceTableParameters, 6> aAcceptanceTableParameters =
+	{ {
+		{ 0.2, 1.0, 0.0 },
+		{ 0.44, 1.0, 0.0 },
+		{ 1.0, 1.0, 0.0 },
+		{ 0.44, 1.0, 0.1 },
+		{ 0.44, 0.5, -0.3 },
+		{ 0.3, -1.0, 0.25 }
+	} };
+	const uint32_t sampleCount = 10'000'000;																		// Draws per flip
+	const double maxZScore = 5.0;
+
+	std::cout << "Beta;Coupling;External field;Spin;Neighbour spin sum;deltaE;Acceptance probability;Threshold;Old modulo probability\n";
+	for (const sAcceptanceTableParameters& acceptanceTableParameters : aAcceptanceTableParameters)
+	{
+		const cAcceptanceTable TheAcceptanceTable(acceptanceTableParameters.beta, acceptanceTableParameters.coupling, acceptanceTableParameters.externalField);
+
+		for (int spin = -1; spin <= 1; spin += 2)
+		{
+			for (int neighbourSpinSum = -4; neighbourSpinSum <= 4; neighbourSpinSum += 2)
+			{
+				// The probability the old ceil(exp(-beta * deltaE) * 1e8) threshold gave against a random number % 1e8, including its modulo bias
+				const double acceptanceProbability = TheAcceptanceTable.GetAcceptanceProbability(spin, neighbourSpinSum);
+				const double oldTransitionProbability = std::min(std::ceil(acceptanceProbability * 100'000'000), 100'000'000.0);
+				const double oldModuloProbability = (43.0 * std::min(oldTransitionProbability, 94'967'296.0)
+					+ 42.0 * std::max(oldTransitionProbability - 94'967'296.0, 0.0)) / 4294967296.0;						// 2^32 = 42 * 1e8 + 94967296
+
+				std::cout << acceptanceTableParameters.beta << ';' << acceptanceTableParameters.coupling << ';' << acceptanceTableParameters.externalField << ';'
+					<< spin << ';' << neighbourSpinSum << ';' << TheAcceptanceTable.GetDeltaE(spin, neighbourSpinSum) << ';' << acceptanceProbability << ';'
+					<< TheAcceptanceTable.GetAcceptanceThreshold(spin, neighbourSpinSum) << ';' << oldModuloProbability << '\n';
+			}
+		}
+
+		// Throws if a ratio is off
+		CheckAcceptanceTableStatistically(TheAcceptanceTable, sampleCount, maxZScore);
+	}
+
+	std::cout << "Every acceptance ratio is within " << maxZScore << " standard deviations of its probability.\n\n";
+
+	// The Metropolis CPU engines sweep with the table, so sweep them at fixed betas on a 4 x 4 grid and compare their <m^2> and <m^4> with the exact ones
+	// summed over all 2^16 states. The samples are correlated, so the standard error comes from the means of consecutive bins of samples
+	const uint32_t exactIsingL = 4;
+	const uint32_t exactIsingN = exactIsingL * exactIsingL;
+	std::array<double, 3> engineCheckBetaValues = { 0.2, 0.44, 0.7 };
+	std::array<const char*, 2> engineNames = { "Bit by bit", "Multi-spin-coded" };
+	const uint32_t engineCheckNumberOfSweeps = 2'000'000;
+	const uint32_t engineCheckNumberOfSweepsToWait = 10'000;
+	const uint32_t numberOfBins = 100;
+
+	std::cout << "Engine;Beta;<m^2>;Exact <m^2>;z-score;<m^4>;Exact <m^4>;z-score\n";
+	for (double beta : engineCheckBetaValues)
+	{
+		// Spin i of a state is bit i, every bond counted once
+		double partitionFunction = 0.0;
+		std::array<double, 2> exactMoments = {};
+		for (uint32_t state = 0; state < (1U << exactIsingN); state++)
+		{
+			int energy = 0;
+			for (uint32_t i = 0; i < exactIsingN; i++)
+			{
+				const uint32_t rowNumber = i / exactIsingL;
+				const uint32_t columnNumber = i % exactIsingL;
+				const int spin = ((state >> i) & 1) ? 1 : -1;
+				const int rightSpin = ((state >> (rowNumber * exactIsingL + (columnNumber + 1) % exactIsingL)) & 1) ? 1 : -1;
+				const int belowSpin = ((state >> (((rowNumber + 1) % exactIsingL) * exactIsingL + columnNumber)) & 1) ? 1 : -1;
+				energy -= spin * (rightSpin + belowSpin);
+			}
+			const double magnetization2 = std::pow((2.0 * std::popcount(state) - exactIsingN) / exactIsingN, 2);
+			const double weight = std::exp(-beta * energy);
+			partitionFunction += weight;
+			exactMoments[0] += weight * magnetization2;
+			exactMoments[1] += weight * magnetization2 * magnetization2;
+		}
+		exactMoments[0] /= partitionFunction;
+		exactMoments[1] /= partitionFunction;
+
+		for (uint32_t i = 0; i < engineNames.size(); i++)
+		{
+			uint32_t spinBatch = ~0U;																				// All spins are +1, the grid fits into one batch
+			int TheSpinSum = exactIsingN;
+			std::vector<int> spinSumOutputs(engineCheckNumberOfSweeps - engineCheckNumberOfSweepsToWait);
+			if (i == 0)
+			{
+				DoTheIsingGridSweepsCPU(&spinBatch, spinSumOutputs.data(), TheSpinSum, exactIsingL, beta, engineCheckNumberOfSweeps, engineCheckNumberOfSweepsToWait, 1);
+			}
+			else
+			{
+				cMultiSpinCodedIsingLattice TheLattice(exactIsingL, 1);
+				DoTheIsingGridSweepsMultiSpinCodedCPU(&TheLattice, &spinBatch, spinSumOutputs.data(), TheSpinSum, beta, engineCheckNumberOfSweeps,
+					engineCheckNumberOfSweepsToWait, 1);
+			}
+
+			// The sums of the bin means and of their squares, for <m^2> and <m^4>
+			const uint32_t samplesPerBin = (uint32_t)spinSumOutputs.size() / numberOfBins;
+			std::array<double, 2> binMeanSums = {};
+			std::array<double, 2> binMeanSquareSums = {};
+			for (uint32_t binNumber = 0; binNumber < numberOfBins; binNumber++)
+			{
+				std::array<double, 2> binSums = {};
+				for (uint32_t j = binNumber * samplesPerBin; j < (binNumber + 1) * samplesPerBin; j++)
+				{
+					const double magnetization2 = std::pow((double)spinSumOutputs[j] / exactIsingN, 2);
+					binSums[0] += magnetization2;
+					binSums[1] += magnetization2 * magnetization2;
+				}
+				for (uint32_t k = 0; k < 2; k++)
+				{
+					const double binMean = binSums[k] / samplesPerBin;
+					binMeanSums[k] += binMean;
+					binMeanSquareSums[k] += binMean * binMean;
+				}
+			}
+
+			std::cout << engineNames[i] << ';' << beta;
+			for (uint32_t k = 0; k < 2; k++)
+			{
+				const double mean = binMeanSums[k] / numberOfBins;
+				const double standardError = std::sqrt(std::max(binMeanSquareSums[k] / numberOfBins - mean * mean, 0.0) / (numberOfBins - 1));
+				const double zScore = (standardError > 0.0) ? (mean - exactMoments[k]) / standardError : 0.0;
+				std::cout << ';' << mean << ';' << exactMoments[k] << ';' << zScore;
+				if (std::abs(zScore) > maxZScore)
+				{
+					std::cout << '\n';
+					throw std::runtime_error(std::string("The ") + engineNames[i] + " CPU engine is off the exact grid by " + std::to_string(zScore) + " standard deviations!");
+				}
+			}
+			std::cout << '\n';
+		}
+	}
+
+	std::cout << "Every engine is within " << maxZScore << " standard deviations of the exact grid.\n";
+}
+
+/**********************************************************************/
+
+void IsingGPUSchedulingModeComparisonRun()
+{
+	// Compare how much host time recording the command buffers takes with the time the device sweeps, for both GPU scheduling modes.
+	// Small grids show the difference best, the device finishes a sweep faster than the host records it
+	std::array<uint32_t, 3> isingLs = { 8, 32, 128 };
+	std::array<eGPUSchedulingMode, 2> gpuSchedulingModes = { GPU_SCHEDULING_MODE_RECORD_EVERY_TEMPERATURE, GPU_SCHEDULING_MODE_REPLAY_SWEEP_BLOCKS };
+	std::array<const char*, 2> gpuSchedulingModeNames = { "Record every temperature", "Replay sweep blocks" };
+	std::array<double, 4> betaValues = { 0.46, 0.44, 0.42, 0.40 };
+	const uint32_t numberOfSweepsPerTemperature = 20000;
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts = 2000;
+	const uint32_t sweepsPerSpinSumSample = 2;
+	const char* outputFilename = "GPUSchedulingModeComparison.txt";
+
+	std::ofstream outputFileStream(outputFilename, std::ios_base::out);
+	if (!outputFileStream.is_open())
+	{
+		std::cout << "Failed to write to file.\n";
+		return;
+	}
+	outputFileStream << "Grid length;Scheduling mode;Wall time;Host recording time;Device time;Submissions;Binder cumulant of the last beta\n";
+	std::cout << "Grid length;Scheduling mode;Wall time;Host recording time;Device time;Submissions;Binder cumulant of the last beta\n";
+
+	std::shared_ptr<cVulkanEngine> pTheVulkanEngine;
+	for (uint32_t isingL : isingLs)
+	{
+		for (uint32_t i = 0; i < gpuSchedulingModes.size(); i++)
+		{
+			try
+			{
+				// The recording of the sweep blocks in the constructor is part of the host recording time
+				if (!pTheVulkanEngine)
+				{
+					pTheVulkanEngine = std::make_shared<cVulkanEngine>();
+				}
+				cSetup TheSetup(pTheVulkanEngine, isingL, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample,
+					COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN, gpuSchedulingModes[i]);
+
+				double binderCumulant = 0.0;
+				for (double beta : betaValues)
+				{
+					DoTheIsingGridSweepsGPU(&TheSetup, isingL, beta, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+					binderCumulant = CalculateBinderCumulantGPU(&TheSetup, isingL);
+				}
+
+				const sGPUSweepTimes& gpuSweepTimes = TheSetup.GetGPUSweepTimes();
+				outputFileStream << isingL << ';' << gpuSchedulingModeNames[i] << ';' << gpuSweepTimes.wallTime << ';' << gpuSweepTimes.hostRecordingTime << ';'
+					<< gpuSweepTimes.deviceTime << ';' << gpuSweepTimes.numberOfSubmissions << ';' << binderCumulant << '\n';
+				std::cout << isingL << ';' << gpuSchedulingModeNames[i] << ';' << gpuSweepTimes.wallTime << ';' << gpuSweepTimes.hostRecordingTime << ';'
+					<< gpuSweepTimes.deviceTime << ';' << gpuSweepTimes.numberOfSubmissions << ';' << binderCumulant << '\n';
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << e.what() << '\n';
+			}
+		}
+	}
+
+	outputFileStream.close();
+}
+
+/**********************************************************************/
+
+void IsingGPUSpinSumReductionComparisonRun()
+{
+	// Compare the device time of the spin sum reductions at the critical beta, where the most flips are accepted and the global atomics collide the most.
+	// The subgroup reduction falls back to the shared memory one on devices without subgroup arithmetic, the output says which one ran
+	std::array<uint32_t, 7> isingLs = { 20, 50, 100, 200, 500, 1000, 2000 };
+	std::array<eSpinSumReductionType, 3> spinSumReductionTypes =
+		{ SPIN_SUM_REDUCTION_TYPE_GLOBAL_ATOMICS, SPIN_SUM_REDUCTION_TYPE_WORKGROUP_SHARED_MEMORY, SPIN_SUM_REDUCTION_TYPE_SUBGROUP_ARITHMETIC };
+	std::array<const char*, 3> spinSumReductionTypeNames = { "Global atomics", "Workgroup shared memory", "Subgroup arithmetic" };
+	std::array<double, 2> betaValues = { 0.50, 0.44 };
+	const uint32_t numberOfSweepsPerTemperature = 4000;
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts = 1000;
+	const uint32_t sweepsPerSpinSumSample = 2;
+	const char* outputFilename = "GPUSpinSumReductionComparison.txt";
+
+	std::ofstream outputFileStream(outputFilename, std::ios_base::out);
+	if (!outputFileStream.is_open())
+	{
+		std::cout << "Failed to write to file.\n";
+		return;
+	}
+	outputFileStream << "Grid length;Spin sum reduction;Device time;Device time per sweep and spin (ns);Wall time;Binder cumulant of the last beta\n";
+	std::cout << "Grid length;Spin sum reduction;Device time;Device time per sweep and spin (ns);Wall time;Binder cumulant of the last beta\n";
+
+	std::shared_ptr<cVulkanEngine> pTheVulkanEngine;
+	for (uint32_t isingL : isingLs)
+	{
+		for (eSpinSumReductionType spinSumReductionType : spinSumReductionTypes)
+		{
+			try
+			{
+				if (!pTheVulkanEngine)
+				{
+					pTheVulkanEngine = std::make_shared<cVulkanEngine>();
+				}
+				cSetup TheSetup(pTheVulkanEngine, isingL, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample,
+					COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN, GPU_SCHEDULING_MODE_REPLAY_SWEEP_BLOCKS, spinSumReductionType);
+
+				double binderCumulant = 0.0;
+				for (double beta : betaValues)
+				{
+					DoTheIsingGridSweepsGPU(&TheSetup, isingL, beta, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+					binderCumulant = CalculateBinderCumulantGPU(&TheSetup, isingL);
+				}
+
+				const sGPUSweepTimes& gpuSweepTimes = TheSetup.GetGPUSweepTimes();
+				const double deviceTimePerSweepAndSpin = gpuSweepTimes.deviceTime * 1e9 / ((double)betaValues.size() * numberOfSweepsPerTemperature * isingL * isingL);
+				const char* spinSumReductionTypeName = spinSumReductionTypeNames[TheSetup.GetSpinSumReductionType()];
+				outputFileStream << isingL << ';' << spinSumReductionTypeName << ';' << gpuSweepTimes.deviceTime << ';' << deviceTimePerSweepAndSpin << ';'
+					<< gpuSweepTimes.wallTime << ';' << binderCumulant << '\n';
+				std::cout << isingL << ';' << spinSumReductionTypeName << ';' << gpuSweepTimes.deviceTime << ';' << deviceTimePerSweepAndSpin << ';'
+					<< gpuSweepTimes.wallTime << ';' << binderCumulant << '\n';
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << e.what() << '\n';
+			}
+		}
+	}
+
+	outputFileStream.close();
+}
+
+/**********************************************************************/
+
+void IsingGPUComputeShaderTypeComparisonRun()
+{
+	// Compare the spin updates per nanosecond of the compute shader types. The Binder cumulants of every beta should agree within their noise
+	std::array<uint32_t, 4> isingLs = { 64, 256, 1024, 2000 };
+	std::array<eComputeShaderType, 5> computeShaderTypes = { COMPUTE_SHADER_TYPE_1_INT_PER_SPIN, COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN, COMPUTE_SHADER_TYPE_MULTI_SPIN_CODED,
+		COMPUTE_SHADER_TYPE_SHARED_MEMORY_TILED, COMPUTE_SHADER_TYPE_1_BYTE_PER_SPIN_SUBLATTICES };
+	std::array<const char*, 5> computeShaderTypeNames = { "1 int per spin", "1 bit per spin", "Multi-spin-coded", "Shared memory tiled", "1 byte per spin sublattices" };
+	std::array<double, 3> betaValues = { 0.50, 0.44, 0.40 };
+	const uint32_t numberOfSweepsPerTemperature = 10000;
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts = 2000;
+	const uint32_t sweepsPerSpinSumSample = 2;
+	const char* outputFilename = "GPUComputeShaderTypeComparison.txt";
+
+	std::ofstream outputFileStream(outputFilename, std::ios_base::out);
+	if (!outputFileStream.is_open())
+	{
+		std::cout << "Failed to write to file.\n";
+		return;
+	}
+	outputFileStream << "Grid length;Compute shader type;Device time;Spin updates per ns;Binder cumulant of every beta\n";
+	std::cout << "Grid length;Compute shader type;Device time;Spin updates per ns;Binder cumulant of every beta\n";
+
+	std::shared_ptr<cVulkanEngine> pTheVulkanEngine;
+	for (uint32_t isingL : isingLs)
+	{
+		for (uint32_t i = 0; i < computeShaderTypes.size(); i++)
+		{
+			try
+			{
+				if (!pTheVulkanEngine)
+				{
+					pTheVulkanEngine = std::make_shared<cVulkanEngine>();
+				}
+				cSetup TheSetup(pTheVulkanEngine, isingL, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample,
+					computeShaderTypes[i]);
+
+				std::vector<double> binderCumulants;
+				for (double beta : betaValues)
+				{
+					DoTheIsingGridSweepsGPU(&TheSetup, isingL, beta, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+					binderCumulants.push_back(CalculateBinderCumulantGPU(&TheSetup, isingL));
+				}
+
+				const sGPUSweepTimes& gpuSweepTimes = TheSetup.GetGPUSweepTimes();
+				// Every sweep updates one checkerboard colour, half of the spins
+				const double spinUpdatesPerNanosecond = ((double)betaValues.size() * numberOfSweepsPerTemperature * isingL * isingL / 2) / (gpuSweepTimes.deviceTime * 1e9);
+				outputFileStream << isingL << ';' << computeShaderTypeNames[i] << ';' << gpuSweepTimes.deviceTime << ';' << spinUpdatesPerNanosecond;
+				std::cout << isingL << ';' << computeShaderTypeNames[i] << ';' << gpuSweepTimes.deviceTime << ';' << spinUpdatesPerNanosecond;
+				for (double binderCumulant : binderCumulants)
+				{
+					outputFileStream << ';' << binderCumulant;
+					std::cout << ';' << binderCumulant;
+				}
+				outputFileStream << '\n';
+				std::cout << '\n';
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << e.what() << '\n';
+			}
+		}
+	}
+
+	outputFileStream.close();
+}
+
+/**********************************************************************/
+
+void IsingGPUStartupBenchmarkRun()
+{
+	// Compare the time it takes to create and destroy the cSetups of a sweep over many grid lengths when every cSetup creates its own device
+	// with the time it takes when all of them share one cVulkanEngine. The shared engine is created inside the timed part
+	const uint32_t numberOfGrids = 50;
+	const uint32_t numberOfSweepsPerTemperature = 10000;
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts = 1000;
+	const uint32_t sweepsPerSpinSumSample = 2;
+	const char* outputFilename = "GPUStartupBenchmark.txt";
+
+	std::vector<uint32_t> isingLs(numberOfGrids);
+	for (uint32_t i = 0; i < numberOfGrids; i++)
+	{
+		isingLs[i] = 8 + 8 * i;
+	}
+
+	std::ofstream outputFileStream(outputFilename, std::ios_base::out);
+	if (!outputFileStream.is_open())
+	{
+		std::cout << "Failed to write to file.\n";
+		return;
+	}
+	outputFileStream << "Vulkan engine;Grids;Startup time;Startup time per grid\n";
+	std::cout << "Vulkan engine;Grids;Startup time;Startup time per grid\n";
+
+	std::array<const char*, 2> engineNames = { "One per grid", "Shared" };
+	for (uint32_t i = 0; i < engineNames.size(); i++)
+	{
+		try
+		{
+			std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+
+			std::shared_ptr<cVulkanEngine> pTheVulkanEngine;
+			for (uint32_t isingL : isingLs)
+			{
+				if (!pTheVulkanEngine || i == 0)
+				{
+					pTheVulkanEngine = std::make_shared<cVulkanEngine>();
+				}
+				cSetup TheSetup(pTheVulkanEngine, isingL, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample,
+					COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN);
+			}
+			pTheVulkanEngine.reset();
+
+			std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
+			const double startupTime = (timePoint2 - timePoint1).count();
+			outputFileStream << engineNames[i] << ';' << numberOfGrids << ';' << startupTime << ';' << startupTime / numberOfGrids << '\n';
+			std::cout << engineNames[i] << ';' << numberOfGrids << ';' << startupTime << ';' << startupTime / numberOfGrids << '\n';
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << '\n';
+		}
+	}
+
+	// The cold start of one grid up to the end of its first temperature, without the pipeline cache like before it existed and then twice with it.
+	// The second start with the cache finds the pipelines the first one wrote to the cache file
+	outputFileStream << "Pipeline cache;Start;Cold start to the first temperature\n";
+	std::cout << "Pipeline cache;Start;Cold start to the first temperature\n";
+
+	std::array<bool, 3> bUsePipelineCacheOfEveryStart = { false, true, true };
+	for (uint32_t i = 0; i < bUsePipelineCacheOfEveryStart.size(); i++)
+	{
+		try
+		{
+			std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+
+			std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2;
+			{
+				const uint32_t isingL = 64;
+				std::shared_ptr<cVulkanEngine> pTheVulkanEngine = std::make_shared<cVulkanEngine>(bUsePipelineCacheOfEveryStart[i]);
+				cSetup TheSetup(pTheVulkanEngine, isingL, 100, 0, 1, COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN);
+				DoTheIsingGridSweepsGPU(&TheSetup, isingL, 0.44, 100, 0, 1);
+				timePoint2 = std::chrono::steady_clock::now();
+			}
+
+			const char* pipelineCacheName = bUsePipelineCacheOfEveryStart[i] ? "Yes" : "No";
+			outputFileStream << pipelineCacheName << ';' << i + 1 << ';' << (timePoint2 - timePoint1).count() << '\n';
+			std::cout << pipelineCacheName << ';' << i + 1 << ';' << (timePoint2 - timePoint1).count() << '\n';
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << '\n';
+		}
+	}
+
+	outputFileStream.close();
+}
+
+/**********************************************************************/
+
+void IsingGPURandomNumberGeneratorComparisonRun()
+{
+	// Compare the XORShift states with the Philox random numbers for every compute shader type. Every combination runs twice from the same seed
+	// in a new cSetup, and the Binder cumulants of both runs must be the same bit for bit
+	std::array<uint32_t, 3> isingLs = { 256, 1024, 4096 };
+	std::array<eComputeShaderType, 5> computeShaderTypes = { COMPUTE_SHADER_TYPE_1_INT_PER_SPIN, COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN, COMPUTE_SHADER_TYPE_MULTI_SPIN_CODED,
+		COMPUTE_SHADER_TYPE_SHARED_MEMORY_TILED, COMPUTE_SHADER_TYPE_1_BYTE_PER_SPIN_SUBLATTICES };
+	std::array<const char*, 5> computeShaderTypeNames = { "1 int per spin", "1 bit per spin", "Multi-spin-coded", "Shared memory tiled", "1 byte per spin sublattices" };
+	std::array<eRandomNumberGeneratorType, 2> randomNumberGeneratorTypes = { RANDOM_NUMBER_GENERATOR_TYPE_XORSHIFT_STATE_PER_SPIN, RANDOM_NUMBER_GENERATOR_TYPE_PHILOX };
+	std::array<const char*, 2> randomNumberGeneratorTypeNames = { "XORShift state per spin", "Philox" };
+	std::array<double, 3> betaValues = { 0.50, 0.44, 0.40 };
+	const uint64_t randomSeed = 20240611;
+	const uint32_t numberOfSweepsPerTemperature = 10000;
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts = 2000;
+	const uint32_t sweepsPerSpinSumSample = 2;
+	const char* outputFilename = "GPURandomNumberGeneratorComparison.txt";
+
+	std::ofstream outputFileStream(outputFilename, std::ios_base::out);
+	if (!outputFileStream.is_open())
+	{
+		std::cout << "Failed to write to file.\n";
+		return;
+	}
+	outputFileStream << "Grid length;Compute shader type;Random number generator;Device time;Spin updates per ns;Reproduced;Binder cumulant of every beta\n";
+	std::cout << "Grid length;Compute shader type;Random number generator;Device time;Spin updates per ns;Reproduced;Binder cumulant of every beta\n";
+
+	std::shared_ptr<cVulkanEngine> pTheVulkanEngine;
+	for (uint32_t isingL : isingLs)
+	{
+		for (uint32_t i = 0; i < computeShaderTypes.size(); i++)
+		{
+			for (uint32_t j = 0; j < randomNumberGeneratorTypes.size(); j++)
+			{
+				try
+				{
+					if (!pTheVulkanEngine)
+					{
+						pTheVulkanEngine = std::make_shared<cVulkanEngine>();
+					}
+
+					std::array<std::vector<double>, 2> binderCumulantsOfBothRuns;
+					double deviceTime = 0.0;
+					for (uint32_t k = 0; k < binderCumulantsOfBothRuns.size(); k++)
+					{
+						cSetup TheSetup(pTheVulkanEngine, isingL, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample,
+							computeShaderTypes[i], GPU_SCHEDULING_MODE_REPLAY_SWEEP_BLOCKS, SPIN_SUM_REDUCTION_TYPE_SUBGROUP_ARITHMETIC, {}, randomNumberGeneratorTypes[j]);
+						TheSetup.SetRandomSeed(randomSeed);
+
+						for (double beta : betaValues)
+						{
+							DoTheIsingGridSweepsGPU(&TheSetup, isingL, beta, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+							binderCumulantsOfBothRuns[k].push_back(CalculateBinderCumulantGPU(&TheSetup, isingL));
+						}
+						deviceTime = TheSetup.GetGPUSweepTimes().deviceTime;
+					}
+
+					const char* reproducedName = (binderCumulantsOfBothRuns[0] == binderCumulantsOfBothRuns[1]) ? "Yes" : "No";
+					// Every sweep updates one checkerboard colour, half of the spins
+					const double spinUpdatesPerNanosecond = ((double)betaValues.size() * numberOfSweepsPerTemperature * isingL * isingL / 2) / (deviceTime * 1e9);
+					outputFileStream << isingL << ';' << computeShaderTypeNames[i] << ';' << randomNumberGeneratorTypeNames[j] << ';' << deviceTime << ';'
+						<< spinUpdatesPerNanosecond << ';' << reproducedName;
+					std::cout << isingL << ';' << computeShaderTypeNames[i] << ';' << randomNumberGeneratorTypeNames[j] << ';' << deviceTime << ';'
+						<< spinUpdatesPerNanosecond << ';' << reproducedName;
+					for (double binderCumulant : binderCumulantsOfBothRuns[0])
+					{
+						outputFileStream << ';' << binderCumulant;
+						std::cout << ';' << binderCumulant;
+					}
+					outputFileStream << '\n';
+					std::cout << '\n';
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << e.what() << '\n';
+				}
+			}
+		}
+	}
+
+	outputFileStream.close();
+}
+
+/**********************************************************************/
+
+void IsingGPUBatchedReplicasRun()
+{
+	// Sweep many replicas of a small grid in every dispatch and compare the spin updates per nanosecond with one grid per cSetup.
+	// The replicas are independent, so the spread of their Binder cumulants gives the error bar of the mean
+	std::array<uint32_t, 5> isingLs = { 8, 16, 20, 32, 64 };
+	const uint32_t numberOfReplicas = 128;
+	std::array<double, 3> betaValues = { 0.50, 0.44, 0.40 };
+	const uint32_t numberOfSweepsPerTemperature = 10000;
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts = 2000;
+	const uint32_t sweepsPerSpinSumSample = 2;
+	const char* outputFilename = "GPUBatchedReplicas.txt";
+
+	std::ofstream outputFileStream(outputFilename, std::ios_base::out);
+	if (!outputFileStream.is_open())
+	{
+		std::cout << "Failed to write to file.\n";
+		return;
+	}
+	outputFileStream << "Grid length;Number of replicas;Beta;Mean Binder cumulant;Standard error;Batched spin updates per ns;Single grid spin updates per ns\n";
+	std::cout << "Grid length;Number of replicas;Beta;Mean Binder cumulant;Standard error;Batched spin updates per ns;Single grid spin updates per ns\n";
+
+	std::shared_ptr<cVulkanEngine> pTheVulkanEngine;
+	for (uint32_t isingL : isingLs)
+	{
+		try
+		{
+			if (!pTheVulkanEngine)
+			{
+				pTheVulkanEngine = std::make_shared<cVulkanEngine>();
+			}
+
+			// The cSetups are destroyed in the reverse order of their creation, like the engine needs
+			cSetup TheSingleGridSetup(pTheVulkanEngine, isingL, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample,
+				COMPUTE_SHADER_TYPE_1_INT_PER_SPIN);
+			cSetup TheBatchedReplicasSetup(pTheVulkanEngine, isingL, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample,
+				COMPUTE_SHADER_TYPE_BATCHED_REPLICAS, GPU_SCHEDULING_MODE_REPLAY_SWEEP_BLOCKS, SPIN_SUM_REDUCTION_TYPE_SUBGROUP_ARITHMETIC, {},
+				RANDOM_NUMBER_GENERATOR_TYPE_XORSHIFT_STATE_PER_SPIN, numberOfReplicas);
+
+			for (double beta : betaValues)
+			{
+				TheSingleGridSetup.ResetGPUSweepTimes();
+				DoTheIsingGridSweepsGPU(&TheSingleGridSetup, isingL, beta, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+					sweepsPerSpinSumSample);
+				// Every sweep updates one checkerboard colour, half of the spins
+				const double singleGridSpinUpdatesPerNanosecond = ((double)numberOfSweepsPerTemperature * isingL * isingL / 2) /
+					(TheSingleGridSetup.GetGPUSweepTimes().deviceTime * 1e9);
+
+				TheBatchedReplicasSetup.ResetGPUSweepTimes();
+				DoTheIsingGridSweepsGPU(&TheBatchedReplicasSetup, isingL, beta, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+					sweepsPerSpinSumSample);
+				const double batchedSpinUpdatesPerNanosecond = ((double)numberOfReplicas * numberOfSweepsPerTemperature * isingL * isingL / 2) /
+					(TheBatchedReplicasSetup.GetGPUSweepTimes().deviceTime * 1e9);
+
+				// The mean and the standard error of the Binder cumulants of the replicas
+				const std::vector<cObservableAccumulator> observableAccumulators = AccumulateTheSpinSumSamplesOfEveryReplicaGPU(&TheBatchedReplicasSetup, isingL,
+					TheBatchedReplicasSetup.GetLastSubmittedTemperatureNumber());
+				std::vector<double> binderCumulants;
+				for (const cObservableAccumulator& TheObservableAccumulator : observableAccumulators)
+				{
+					binderCumulants.push_back(TheObservableAccumulator.GetBinderCumulant());
+				}
+				double binderCumulantMean = 0.0;
+				for (double binderCumulant : binderCumulants)
+				{
+					binderCumulantMean += binderCumulant / binderCumulants.size();
+				}
+				// A single replica has no spread, so its standard error is left undefined
+				double binderCumulantStandardError = std::numeric_limits<double>::quiet_NaN();
+				if (binderCumulants.size() > 1)
+				{
+					double binderCumulantVariance = 0.0;
+					for (double binderCumulant : binderCumulants)
+					{
+						binderCumulantVariance += (binderCumulant - binderCumulantMean) * (binderCumulant - binderCumulantMean) / (binderCumulants.size() - 1);
+					}
+					binderCumulantStandardError = std::sqrt(binderCumulantVariance / binderCumulants.size());
+				}
+
+				outputFileStream << isingL << ';' << numberOfReplicas << ';' << beta << ';' << binderCumulantMean << ';' << binderCumulantStandardError << ';'
+					<< batchedSpinUpdatesPerNanosecond << ';' << singleGridSpinUpdatesPerNanosecond << '\n';
+				std::cout << isingL << ';' << numberOfReplicas << ';' << beta << ';' << binderCumulantMean << ';' << binderCumulantStandardError << ';'
+					<< batchedSpinUpdatesPerNanosecond << ';' << singleGridSpinUpdatesPerNanosecond << '\n';
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << '\n';
+		}
+	}
+
+	outputFileStream.close();
+}
+
+/**********************************************************************/
+
+void IsingHeterogeneousSchedulerRun()
+{
+	// Scans of several grid lengths spread over the CPU threads and every Vulkan device. Without a device everything runs on the CPU
+	std::vector<sIsingJob> jobs;
+	for (uint32_t isingL : { 20, 40, 80, 160, 320 })
+	{
+		jobs.push_back({ .isingL = isingL, .startBeta = 0.50, .endBeta = 0.35, .betaDecrement = 0.01 });
+	}
+	const uint32_t numberOfSweepsPerTemperature = 10000;
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts = 100;
+	const uint32_t sweepsPerSpinSumSample = 2;
+	const char* outputFilename = "HeterogeneousScheduler.txt";
+
+	std::vector<sIsingJobResult> results;
+	std::unique_ptr<cHeterogeneousScheduler> pTheScheduler;
+	try
+	{
+		pTheScheduler = std::make_unique<cHeterogeneousScheduler>();
+		pTheScheduler->Run(jobs, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample, results);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << '\n';
+		return;
+	}
+
+	// The throughput of every backend at every grid length and where every job ran
+	std::ofstream outputFileStream(outputFilename, std::ios_base::out);
+	if (!outputFileStream.is_open())
+	{
+		std::cout << "Failed to write to file.\n";
+		return;
+	}
+	outputFileStream << "Grid length;Backend;Spin updates per ns;Ran the job;Computation time\n";
+	std::cout << "Grid length;Backend;Spin updates per ns;Ran the job;Computation time\n";
+	for (uint32_t i = 0; i < (uint32_t)jobs.size(); i++)
+	{
+		for (uint32_t j = 0; j < pTheScheduler->GetNumberOfBackends(); j++)
+		{
+			const bool bRanTheJob = (results[i].backendIndex == j);
+			outputFileStream << jobs[i].isingL << ';' << pTheScheduler->GetBackendName(j) << ';' << pTheScheduler->GetSpinUpdatesPerSecond(j, jobs[i].isingL) * 1e-9 << ';'
+				<< bRanTheJob << ';' << (bRanTheJob ? results[i].computationTime : 0.0) << '\n';
+			std::cout << jobs[i].isingL << ';' << pTheScheduler->GetBackendName(j) << ';' << pTheScheduler->GetSpinUpdatesPerSecond(j, jobs[i].isingL) * 1e-9 << ';'
+				<< bRanTheJob << ';' << (bRanTheJob ? results[i].computationTime : 0.0) << '\n';
+		}
+	}
+	outputFileStream.close();
+
+	for (uint32_t i = 0; i < (uint32_t)jobs.size(); i++)
+	{
+		const sIsingParameters isingParameters =
+		{
+			.isingL = jobs[i].isingL,
+			.startBeta = jobs[i].startBeta,
+			.endBeta = jobs[i].endBeta,
+			.betaDecrement = jobs[i].betaDecrement,
+			.numberOfSweepsPerTemperature = numberOfSweepsPerTemperature,
+			.numberOfSweepsToWaitBeforeSpinSumSamplingStarts = numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+			.sweepsPerSpinSumSample = sweepsPerSpinSumSample,
+			.GPUOrCPUIdentifierText = pTheScheduler->GetBackendName(results[i].backendIndex).c_str()
+		};
+		const std::string outputFilenameOfTheJob = "output" + std::to_string(i) + ".txt";
+		SaveBinderCumulantData(outputFilenameOfTheJob.c_str(), isingParameters, results[i].computationTime, results[i].betaValues, results[i].binderCumulants);
+	}
+}
+
+/**********************************************************************/
+
+void IsingSwendsenWangBondCheckRun()
+{
+	// Check that the Swendsen-Wang bonds are active with the probability 1 - exp(-2 * beta) and independent of each other,
+	// from a small beta where the threshold has many binary digits to a large one where almost every bond is active
+	std::array<double, 5> betaValues = { 0.01, 0.2, 0.44, 1.0, 3.0 };
+	const uint32_t numberOfBondWords = 2'000'000;
+	const double maxZScore = 5.0;
+
+	for (double beta : betaValues)
+	{
+		// Throws if a count is off
+		CheckSwendsenWangBondsStatistically(beta, numberOfBondWords, maxZScore);
+		std::cout << "Beta " << beta << ": the bonds are active with the probability " << 1.0 - std::exp(-2.0 * beta) << " and independent.\n";
+	}
+
+	std::cout << "Every bond count is within " << maxZScore << " standard deviations of independent bonds.\n";
 }
 
 /**********************************************************************/
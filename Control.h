@@ -1,4 +1,5 @@
 #pragma once
+#include "Setup.h"
 #include "TMultiGraph.h"
 #include "TLegend.h"
 #include <vector>
@@ -12,7 +13,20 @@ enum eIsingRunCommands
 	ISING_LOAD_AND_PLOT_BINDER_CUMULANT_DATA_USER_INPUT_RUN,
 	ISING_GPU_HARDCODED_MULTIPLE_GRIDS_AND_AUTO_SAVE_RUN,
 	ISING_CPU_HARDCODED_MULTIPLE_GRIDS_AND_AUTO_SAVE_RUN,
-	ISING_LOAD_AND_PLOT_BINDER_CUMULANT_DATA_HARDCODED_RUN
+	ISING_LOAD_AND_PLOT_BINDER_CUMULANT_DATA_HARDCODED_RUN,
+	ISING_CPU_THREAD_SCALING_RUN,
+	ISING_CPU_UPDATE_ALGORITHM_COMPARISON_RUN,
+	ISING_CPU_PARALLEL_TEMPERING_RUN,
+	ISING_CPU_HARDCODED_MULTIPLE_GRIDS_TEMPERATURE_PARALLEL_AND_AUTO_SAVE_RUN,
+	ISING_ACCEPTANCE_TABLE_CHECK_RUN,
+	ISING_GPU_SCHEDULING_MODE_COMPARISON_RUN,
+	ISING_GPU_SPIN_SUM_REDUCTION_COMPARISON_RUN,
+	ISING_GPU_COMPUTE_SHADER_TYPE_COMPARISON_RUN,
+	ISING_GPU_STARTUP_BENCHMARK_RUN,
+	ISING_GPU_RANDOM_NUMBER_GENERATOR_COMPARISON_RUN,
+	ISING_GPU_BATCHED_REPLICAS_RUN,
+	ISING_HETEROGENEOUS_SCHEDULER_RUN,
+	ISING_SWENDSEN_WANG_BOND_CHECK_RUN
 };
 
 struct sIsingParameters
@@ -25,6 +39,8 @@ struct sIsingParameters
 	uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts;
 	uint32_t sweepsPerSpinSumSample;
 	const char* GPUOrCPUIdentifierText;
+	uint32_t numberOfCPUThreads = 1;											// Used by the multi-spin-coded CPU engine
+	eUpdateAlgorithmType updateAlgorithmType = UPDATE_ALGORITHM_TYPE_METROPOLIS;		// The CPU runs can use Wolff cluster updates instead
 };
 
 void IsingGPUUserInputRun();
@@ -35,14 +51,40 @@ void IsingCPUUserInputRun();
 
 void IsingCPUHardcodedRun();
 
+void IsingCPUParallelTemperingRun();
+
 void IsingLoadAndPlotBinderCumulantDataUserInputRun();
 
 void IsingGPUHardcodedMultipleGridsAndAutoSaveRun();
 
 void IsingCPUHardcodedMultipleGridsAndAutoSaveRun();
 
+void IsingCPUHardcodedMultipleGridsTemperatureParallelAndAutoSaveRun();
+
 void IsingLoadAndPlotBinderCumulantDataHardcodedRun();
 
+void IsingCPUThreadScalingRun();
+
+void IsingCPUUpdateAlgorithmComparisonRun();
+
+void IsingAcceptanceTableCheckRun();
+
+void IsingGPUSchedulingModeComparisonRun();
+
+void IsingGPUSpinSumReductionComparisonRun();
+
+void IsingGPUComputeShaderTypeComparisonRun();
+
+void IsingGPUStartupBenchmarkRun();
+
+void IsingGPURandomNumberGeneratorComparisonRun();
+
+void IsingGPUBatchedReplicasRun();
+
+void IsingHeterogeneousSchedulerRun();
+
+void IsingSwendsenWangBondCheckRun();
+
 void SaveBinderCumulantData(const char* filename, sIsingParameters isingParameters, double computationTime, std::vector<double>& betaValues, std::vector<double>& binderCumulants);
 
 void LoadAndAddBinderCumulantDataToRootMultiGraph(const char* filename, TMultiGraph* rootMultiGraph, TLegend* rootMultiGraphLegend, int numberUsedToSetGraphMarkerStyleAndColor);
\ No newline at end of file
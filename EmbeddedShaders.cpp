@@ -0,0 +1,215 @@
+#include "EmbeddedShaders.h"
+#include <cstring>
+
+// The kernels are embedded from the word lists glslc writes with -mfmt=num, CompileShaders writes them next to this file, for example
+//   glslc --target-env=vulkan1.2 -mfmt=num IsingKernelOneBitPerSpin.comp -o IsingKernelOneBitPerSpin.spv.inc
+// and for the variant without subgroup arithmetic
+//   glslc --target-env=vulkan1.2 -mfmt=num -DNO_SUBGROUP_ARITHMETIC IsingKernelOneBitPerSpin.comp -o IsingKernelOneBitPerSpinNoSubgroupArithmetic.spv.inc
+// A kernel without a generated list is not embedded, LoadShaderModule then reads its .spv file from the directory of the executable.
+// The kernels include Philox.glsl, glslc finds it next to them
+
+#if __has_include("IsingKernelOneBitPerSpin.spv.inc")
+static const uint32_t isingKernelOneBitPerSpinSpirv[] =
+{
+#include "IsingKernelOneBitPerSpin.spv.inc"
+};
+#endif
+
+#if __has_include("IsingKernelOneBitPerSpinNoSubgroupArithmetic.spv.inc")
+static const uint32_t isingKernelOneBitPerSpinNoSubgroupArithmeticSpirv[] =
+{
+#include "IsingKernelOneBitPerSpinNoSubgroupArithmetic.spv.inc"
+};
+#endif
+
+#if __has_include("IsingKernelOneIntPerSpin.spv.inc")
+static const uint32_t isingKernelOneIntPerSpinSpirv[] =
+{
+#include "IsingKernelOneIntPerSpin.spv.inc"
+};
+#endif
+
+#if __has_include("IsingKernelOneIntPerSpinNoSubgroupArithmetic.spv.inc")
+static const uint32_t isingKernelOneIntPerSpinNoSubgroupArithmeticSpirv[] =
+{
+#include "IsingKernelOneIntPerSpinNoSubgroupArithmetic.spv.inc"
+};
+#endif
+
+#if __has_include("IsingKernelMultiSpinCoded.spv.inc")
+static const uint32_t isingKernelMultiSpinCodedSpirv[] =
+{
+#include "IsingKernelMultiSpinCoded.spv.inc"
+};
+#endif
+
+#if __has_include("IsingKernelMultiSpinCodedNoSubgroupArithmetic.spv.inc")
+static const uint32_t isingKernelMultiSpinCodedNoSubgroupArithmeticSpirv[] =
+{
+#include "IsingKernelMultiSpinCodedNoSubgroupArithmetic.spv.inc"
+};
+#endif
+
+#if __has_include("IsingKernelSharedMemoryTiled.spv.inc")
+static const uint32_t isingKernelSharedMemoryTiledSpirv[] =
+{
+#include "IsingKernelSharedMemoryTiled.spv.inc"
+};
+#endif
+
+#if __has_include("IsingKernelSharedMemoryTiledNoSubgroupArithmetic.spv.inc")
+static const uint32_t isingKernelSharedMemoryTiledNoSubgroupArithmeticSpirv[] =
+{
+#include "IsingKernelSharedMemoryTiledNoSubgroupArithmetic.spv.inc"
+};
+#endif
+
+#if __has_include("IsingKernelOneBytePerSpinSublattices.spv.inc")
+static const uint32_t isingKernelOneBytePerSpinSublatticesSpirv[] =
+{
+#include "IsingKernelOneBytePerSpinSublattices.spv.inc"
+};
+#endif
+
+#if __has_include("IsingKernelOneBytePerSpinSublatticesNoSubgroupArithmetic.spv.inc")
+static const uint32_t isingKernelOneBytePerSpinSublatticesNoSubgroupArithmeticSpirv[] =
+{
+#include "IsingKernelOneBytePerSpinSublatticesNoSubgroupArithmetic.spv.inc"
+};
+#endif
+
+#if __has_include("IsingKernelBatchedReplicas.spv.inc")
+static const uint32_t isingKernelBatchedReplicasSpirv[] =
+{
+#include "IsingKernelBatchedReplicas.spv.inc"
+};
+#endif
+
+#if __has_include("IsingKernelBatchedReplicasNoSubgroupArithmetic.spv.inc")
+static const uint32_t isingKernelBatchedReplicasNoSubgroupArithmeticSpirv[] =
+{
+#include "IsingKernelBatchedReplicasNoSubgroupArithmetic.spv.inc"
+};
+#endif
+
+#if __has_include("XYKernel.spv.inc")
+static const uint32_t xyKernelSpirv[] =
+{
+#include "XYKernel.spv.inc"
+};
+#endif
+
+#if __has_include("XYKernelNoSubgroupArithmetic.spv.inc")
+static const uint32_t xyKernelNoSubgroupArithmeticSpirv[] =
+{
+#include "XYKernelNoSubgroupArithmetic.spv.inc"
+};
+#endif
+
+#if __has_include("SpinSumMomentReduction.spv.inc")
+static const uint32_t spinSumMomentReductionSpirv[] =
+{
+#include "SpinSumMomentReduction.spv.inc"
+};
+#endif
+
+/**********************************************************************/
+
+sEmbeddedSpirv FindEmbeddedSpirv(const char* spvFilename)
+{
+	// Unused when no word list was generated
+	(void)spvFilename;
+
+#if __has_include("IsingKernelOneBitPerSpin.spv.inc")
+	if (std::strcmp(spvFilename, "IsingKernelOneBitPerSpin.spv") == 0)
+	{
+		return { .pCode = isingKernelOneBitPerSpinSpirv, .codeByteSize = sizeof(isingKernelOneBitPerSpinSpirv) };
+	}
+#endif
+#if __has_include("IsingKernelOneBitPerSpinNoSubgroupArithmetic.spv.inc")
+	if (std::strcmp(spvFilename, "IsingKernelOneBitPerSpinNoSubgroupArithmetic.spv") == 0)
+	{
+		return { .pCode = isingKernelOneBitPerSpinNoSubgroupArithmeticSpirv, .codeByteSize = sizeof(isingKernelOneBitPerSpinNoSubgroupArithmeticSpirv) };
+	}
+#endif
+#if __has_include("IsingKernelOneIntPerSpin.spv.inc")
+	if (std::strcmp(spvFilename, "IsingKernelOneIntPerSpin.spv") == 0)
+	{
+		return { .pCode = isingKernelOneIntPerSpinSpirv, .codeByteSize = sizeof(isingKernelOneIntPerSpinSpirv) };
+	}
+#endif
+#if __has_include("IsingKernelOneIntPerSpinNoSubgroupArithmetic.spv.inc")
+	if (std::strcmp(spvFilename, "IsingKernelOneIntPerSpinNoSubgroupArithmetic.spv") == 0)
+	{
+		return { .pCode = isingKernelOneIntPerSpinNoSubgroupArithmeticSpirv, .codeByteSize = sizeof(isingKernelOneIntPerSpinNoSubgroupArithmeticSpirv) };
+	}
+#endif
+#if __has_include("IsingKernelMultiSpinCoded.spv.inc")
+	if (std::strcmp(spvFilename, "IsingKernelMultiSpinCoded.spv") == 0)
+	{
+		return { .pCode = isingKernelMultiSpinCodedSpirv, .codeByteSize = sizeof(isingKernelMultiSpinCodedSpirv) };
+	}
+#endif
+#if __has_include("IsingKernelMultiSpinCodedNoSubgroupArithmetic.spv.inc")
+	if (std::strcmp(spvFilename, "IsingKernelMultiSpinCodedNoSubgroupArithmetic.spv") == 0)
+	{
+		return { .pCode = isingKernelMultiSpinCodedNoSubgroupArithmeticSpirv, .codeByteSize = sizeof(isingKernelMultiSpinCodedNoSubgroupArithmeticSpirv) };
+	}
+#endif
+#if __has_include("IsingKernelSharedMemoryTiled.spv.inc")
+	if (std::strcmp(spvFilename, "IsingKernelSharedMemoryTiled.spv") == 0)
+	{
+		return { .pCode = isingKernelSharedMemoryTiledSpirv, .codeByteSize = sizeof(isingKernelSharedMemoryTiledSpirv) };
+	}
+#endif
+#if __has_include("IsingKernelSharedMemoryTiledNoSubgroupArithmetic.spv.inc")
+	if (std::strcmp(spvFilename, "IsingKernelSharedMemoryTiledNoSubgroupArithmetic.spv") == 0)
+	{
+		return { .pCode = isingKernelSharedMemoryTiledNoSubgroupArithmeticSpirv, .codeByteSize = sizeof(isingKernelSharedMemoryTiledNoSubgroupArithmeticSpirv) };
+	}
+#endif
+#if __has_include("IsingKernelOneBytePerSpinSublattices.spv.inc")
+	if (std::strcmp(spvFilename, "IsingKernelOneBytePerSpinSublattices.spv") == 0)
+	{
+		return { .pCode = isingKernelOneBytePerSpinSublatticesSpirv, .codeByteSize = sizeof(isingKernelOneBytePerSpinSublatticesSpirv) };
+	}
+#endif
+#if __has_include("IsingKernelOneBytePerSpinSublatticesNoSubgroupArithmetic.spv.inc")
+	if (std::strcmp(spvFilename, "IsingKernelOneBytePerSpinSublatticesNoSubgroupArithmetic.spv") == 0)
+	{
+		return { .pCode = isingKernelOneBytePerSpinSublatticesNoSubgroupArithmeticSpirv, .codeByteSize = sizeof(isingKernelOneBytePerSpinSublatticesNoSubgroupArithmeticSpirv) };
+	}
+#endif
+#if __has_include("IsingKernelBatchedReplicas.spv.inc")
+	if (std::strcmp(spvFilename, "IsingKernelBatchedReplicas.spv") == 0)
+	{
+		return { .pCode = isingKernelBatchedReplicasSpirv, .codeByteSize = sizeof(isingKernelBatchedReplicasSpirv) };
+	}
+#endif
+#if __has_include("IsingKernelBatchedReplicasNoSubgroupArithmetic.spv.inc")
+	if (std::strcmp(spvFilename, "IsingKernelBatchedReplicasNoSubgroupArithmetic.spv") == 0)
+	{
+		return { .pCode = isingKernelBatchedReplicasNoSubgroupArithmeticSpirv, .codeByteSize = sizeof(isingKernelBatchedReplicasNoSubgroupArithmeticSpirv) };
+	}
+#endif
+#if __has_include("XYKernel.spv.inc")
+	if (std::strcmp(spvFilename, "XYKernel.spv") == 0)
+	{
+		return { .pCode = xyKernelSpirv, .codeByteSize = sizeof(xyKernelSpirv) };
+	}
+#endif
+#if __has_include("XYKernelNoSubgroupArithmetic.spv.inc")
+	if (std::strcmp(spvFilename, "XYKernelNoSubgroupArithmetic.spv") == 0)
+	{
+		return { .pCode = xyKernelNoSubgroupArithmeticSpirv, .codeByteSize = sizeof(xyKernelNoSubgroupArithmeticSpirv) };
+	}
+#endif
+#if __has_include("SpinSumMomentReduction.spv.inc")
+	if (std::strcmp(spvFilename, "SpinSumMomentReduction.spv") == 0)
+	{
+		return { .pCode = spinSumMomentReductionSpirv, .codeByteSize = sizeof(spinSumMomentReductionSpirv) };
+	}
+#endif
+
+	return {};
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/* The SPIR-V of a kernel, compiled into the executable */
+struct sEmbeddedSpirv
+{
+	const uint32_t* pCode = nullptr;
+	size_t codeByteSize = 0;
+};
+
+// The embedded SPIR-V of a .spv file. pCode is nullptr if the kernel was not embedded when the executable was built
+sEmbeddedSpirv FindEmbeddedSpirv(const char* spvFilename);
@@ -0,0 +1,375 @@
+#include "HeterogeneousScheduler.h"
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+
+/**********************************************************************/
+
+uint32_t GetNumberOfBetas(const sIsingJob& job)
+{
+	// Also false for NaN. A decrement of 0 would give infinitely many betas and a negative one would scan away from endBeta
+	if (!(job.betaDecrement > 0.0))
+	{
+		throw std::runtime_error("The beta decrement of a job must be positive!");
+	}
+	return (uint32_t)std::max(0.0, std::floor((job.startBeta - job.endBeta) / job.betaDecrement));
+}
+
+/**********************************************************************/
+
+cHeterogeneousScheduler::cHeterogeneousScheduler(const bool bUseVulkanDevices)
+{
+	// A device whose engine throws is left out, so a broken driver costs its devices and not the run
+	std::vector<sSchedulerBackend> vulkanBackends;
+	const std::vector<std::string> computeDeviceNames = bUseVulkanDevices ? cVulkanEngine::FindTheComputeDevices() : std::vector<std::string>();
+	for (uint32_t i = 0; i < (uint32_t)computeDeviceNames.size(); i++)
+	{
+		try
+		{
+			sSchedulerBackend backend;
+			backend.backendType = SCHEDULER_BACKEND_TYPE_VULKAN_DEVICE;
+			backend.name = computeDeviceNames[i];
+			backend.deviceIndex = i;
+			backend.pTheVulkanEngine = std::make_shared<cVulkanEngine>(true, i);
+			vulkanBackends.push_back(std::move(backend));
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << computeDeviceNames[i] << ": " << e.what() << '\n';
+		}
+	}
+
+	const uint32_t numberOfHardwareThreads = std::max(1U, std::thread::hardware_concurrency());
+	const uint32_t numberOfCPUThreads = std::max(1U, numberOfHardwareThreads - std::min(numberOfHardwareThreads, (uint32_t)vulkanBackends.size()));
+
+	sSchedulerBackend cpuBackend;
+	cpuBackend.backendType = SCHEDULER_BACKEND_TYPE_CPU_THREADS;
+	cpuBackend.name = "CPU (" + std::to_string(numberOfCPUThreads) + " threads)";
+	cpuBackend.pTheTemperatureScheduler = std::make_unique<cTemperatureScheduler>(numberOfCPUThreads);
+	backends.push_back(std::move(cpuBackend));
+
+	for (sSchedulerBackend& vulkanBackend : vulkanBackends)
+	{
+		backends.push_back(std::move(vulkanBackend));
+	}
+}
+
+/**********************************************************************/
+
+uint32_t cHeterogeneousScheduler::GetNumberOfBackends() const
+{
+	return (uint32_t)backends.size();
+}
+
+/**********************************************************************/
+
+const std::string& cHeterogeneousScheduler::GetBackendName(const uint32_t backendIndex) const
+{
+	return backends[backendIndex].name;
+}
+
+/**********************************************************************/
+
+double cHeterogeneousScheduler::GetSpinUpdatesPerSecond(const uint32_t backendIndex, const uint32_t isingL) const
+{
+	const auto spinUpdatesPerSecond = backends[backendIndex].spinUpdatesPerSecond.find(isingL);
+	return (spinUpdatesPerSecond != backends[backendIndex].spinUpdatesPerSecond.end()) ? spinUpdatesPerSecond->second : 0.0;
+}
+
+/**********************************************************************/
+
+double cHeterogeneousScheduler::MeasureTheThroughput(sSchedulerBackend& backend, const uint32_t isingL)
+{
+	const double probeBeta = 0.44;																				// Close to the critical point, where the scans spend their time
+	const uint32_t isingN = isingL * isingL;
+	const uint32_t numberOfProbeSweeps = std::clamp((uint32_t)(spinUpdatesPerProbe / isingN), 10U, 10000U);
+
+	try
+	{
+		if (backend.backendType == SCHEDULER_BACKEND_TYPE_CPU_THREADS)
+		{
+			// One probe per thread, the CPU backend runs its jobs on all threads at once too
+			const uint32_t numberOfThreads = backend.pTheTemperatureScheduler->GetNumberOfThreads();
+			const std::vector<sTemperatureWorkItem> workItems(numberOfThreads, { .isingL = isingL, .beta = probeBeta });
+			std::vector<double> binderCumulants;
+
+			std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+			backend.pTheTemperatureScheduler->Run(workItems, numberOfProbeSweeps, 0, 1, binderCumulants);
+			std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
+			std::chrono::duration<double> probeTime = timePoint2 - timePoint1;
+
+			return ((double)numberOfThreads * numberOfProbeSweeps * isingN) / probeTime.count();
+		}
+
+		// The first temperature pays for the pipeline and the recording of the sweep blocks, only the second one is timed
+		cSetup TheSetup(backend.pTheVulkanEngine, isingL, numberOfProbeSweeps, 0, 1, COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN);
+		DoTheIsingGridSweepsGPU(&TheSetup, isingL, probeBeta, numberOfProbeSweeps, 0, 1);
+
+		std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+		DoTheIsingGridSweepsGPU(&TheSetup, isingL, probeBeta, numberOfProbeSweeps, 0, 1);
+		std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
+		std::chrono::duration<double> probeTime = timePoint2 - timePoint1;
+
+		return ((double)numberOfProbeSweeps * isingN) / probeTime.count();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << backend.name << ": " << e.what() << '\n';
+		return 0.0;
+	}
+}
+
+/**********************************************************************/
+
+std::vector<std::vector<uint32_t>> cHeterogeneousScheduler::PlaceTheJobs(const std::vector<sIsingJob>& jobs, const uint32_t numberOfSweepsPerTemperature)
+{
+	// Probe every grid length on every backend once, later runs reuse the throughputs (and what the devices measured on their jobs)
+	for (sSchedulerBackend& backend : backends)
+	{
+		for (const sIsingJob& job : jobs)
+		{
+			if (backend.spinUpdatesPerSecond.find(job.isingL) == backend.spinUpdatesPerSecond.end())
+			{
+				backend.spinUpdatesPerSecond[job.isingL] = MeasureTheThroughput(backend, job.isingL);
+			}
+		}
+	}
+
+	// The longest jobs first, so the short ones fill the gaps at the end
+	std::vector<uint32_t> jobIndicesByCost(jobs.size());
+	std::iota(jobIndicesByCost.begin(), jobIndicesByCost.end(), 0);
+	auto JobCost = [&](const uint32_t jobIndex)
+		{
+			return (double)jobs[jobIndex].isingL * jobs[jobIndex].isingL * numberOfSweepsPerTemperature * GetNumberOfBetas(jobs[jobIndex]);
+		};
+	std::stable_sort(jobIndicesByCost.begin(), jobIndicesByCost.end(), [&](const uint32_t a, const uint32_t b) { return JobCost(a) > JobCost(b); });
+
+	std::vector<std::vector<uint32_t>> jobIndicesOfEveryBackend(backends.size());
+	std::vector<double> finishTimes(backends.size(), 0.0);
+	for (uint32_t jobIndex : jobIndicesByCost)
+	{
+		const sIsingJob& job = jobs[jobIndex];
+		uint32_t bestBackendIndex = 0;
+		double bestFinishTime = std::numeric_limits<double>::infinity();
+		for (uint32_t i = 0; i < (uint32_t)backends.size(); i++)
+		{
+			const double spinUpdatesPerSecond = backends[i].spinUpdatesPerSecond[job.isingL];
+			if (spinUpdatesPerSecond <= 0.0)
+			{
+				continue;
+			}
+
+			// The betas of a job run one after the other on a device. On the CPU they run side by side, but no faster than one beta on one thread
+			double finishTime = finishTimes[i] + JobCost(jobIndex) / spinUpdatesPerSecond;
+			if (backends[i].backendType == SCHEDULER_BACKEND_TYPE_CPU_THREADS)
+			{
+				const double oneBetaOnOneThreadTime = ((double)job.isingL * job.isingL * numberOfSweepsPerTemperature) /
+					(spinUpdatesPerSecond / backends[i].pTheTemperatureScheduler->GetNumberOfThreads());
+				finishTime = std::max(finishTime, oneBetaOnOneThreadTime);
+			}
+
+			if (finishTime < bestFinishTime)
+			{
+				bestFinishTime = finishTime;
+				bestBackendIndex = i;
+			}
+		}
+
+		// If every probe failed the job goes to the CPU, whose exception then reaches the caller
+		if (bestFinishTime != std::numeric_limits<double>::infinity())
+		{
+			finishTimes[bestBackendIndex] = bestFinishTime;
+		}
+		jobIndicesOfEveryBackend[bestBackendIndex].push_back(jobIndex);
+	}
+
+	// Back in the order of the jobs, so the CPU threads walk the jobs like the caller listed them
+	for (std::vector<uint32_t>& jobIndices : jobIndicesOfEveryBackend)
+	{
+		std::sort(jobIndices.begin(), jobIndices.end());
+	}
+
+	return jobIndicesOfEveryBackend;
+}
+
+/**********************************************************************/
+
+void cHeterogeneousScheduler::RunTheJobsOnTheCPU(const std::vector<sIsingJob>& jobs, const std::vector<uint32_t>& jobIndices,
+	const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample,
+	std::vector<sIsingJobResult>& results)
+{
+	if (jobIndices.empty())
+	{
+		return;
+	}
+
+	// The work items of a job are kept together and in beta order, so the threads mostly walk down beta like a serial run
+	std::vector<sTemperatureWorkItem> workItems;
+	std::vector<uint32_t> firstWorkItemIndices;
+	for (uint32_t jobIndex : jobIndices)
+	{
+		firstWorkItemIndices.push_back((uint32_t)workItems.size());
+		double beta = jobs[jobIndex].startBeta;
+		for (uint32_t i = 0; i < GetNumberOfBetas(jobs[jobIndex]); i++)
+		{
+			workItems.push_back({ .isingL = jobs[jobIndex].isingL, .beta = beta });
+			beta -= jobs[jobIndex].betaDecrement;
+		}
+	}
+
+	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+	std::vector<double> binderCumulants;
+	backends[0].pTheTemperatureScheduler->Run(workItems, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample,
+		binderCumulants);
+	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
+	std::chrono::duration<double> computationTime = timePoint2 - timePoint1;
+
+	for (uint32_t i = 0; i < (uint32_t)jobIndices.size(); i++)
+	{
+		sIsingJobResult& result = results[jobIndices[i]];
+		const uint32_t numberOfBetas = GetNumberOfBetas(jobs[jobIndices[i]]);
+		result.betaValues.resize(numberOfBetas);
+		result.binderCumulants.resize(numberOfBetas);
+		for (uint32_t j = 0; j < numberOfBetas; j++)
+		{
+			result.betaValues[j] = workItems[firstWorkItemIndices[i] + j].beta;
+			result.binderCumulants[j] = binderCumulants[firstWorkItemIndices[i] + j];
+		}
+		result.backendIndex = 0;
+		result.computationTime = computationTime.count();
+	}
+}
+
+/**********************************************************************/
+
+void cHeterogeneousScheduler::RunTheJobsOnTheVulkanDevice(const uint32_t backendIndex, const std::vector<sIsingJob>& jobs, const std::vector<uint32_t>& jobIndices,
+	const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample,
+	std::vector<sIsingJobResult>& results, std::vector<uint32_t>& failedJobIndices)
+{
+	sSchedulerBackend& backend = backends[backendIndex];
+	for (uint32_t jobIndex : jobIndices)
+	{
+		const sIsingJob& job = jobs[jobIndex];
+		const uint32_t numberOfBetas = GetNumberOfBetas(job);
+		sIsingJobResult result;
+		result.betaValues.resize(numberOfBetas);
+		result.binderCumulants.resize(numberOfBetas);
+		result.backendIndex = backendIndex;
+
+		try
+		{
+			std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+			cSetup TheSetup(backend.pTheVulkanEngine, job.isingL, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+				sweepsPerSpinSumSample, COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN);
+
+			// Submit the next beta before the samples of the last one are reduced, so the device sweeps while the host reduces
+			double beta = job.startBeta;
+			for (uint32_t j = 0; j < numberOfBetas; j++)
+			{
+				const uint64_t temperatureNumber = SubmitTheIsingGridSweepsGPU(&TheSetup, job.isingL, beta, numberOfSweepsPerTemperature,
+					numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+
+				result.betaValues[j] = beta;
+				if (j > 0)
+				{
+					result.binderCumulants[j - 1] = CalculateBinderCumulantGPU(&TheSetup, job.isingL, temperatureNumber - 1);
+				}
+
+				beta -= job.betaDecrement;
+			}
+			if (numberOfBetas > 0)
+			{
+				result.binderCumulants[numberOfBetas - 1] = CalculateBinderCumulantGPU(&TheSetup, job.isingL, TheSetup.GetLastSubmittedTemperatureNumber());
+			}
+
+			std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
+			std::chrono::duration<double> computationTime = timePoint2 - timePoint1;
+			result.computationTime = computationTime.count();
+
+			// What the job measured replaces the probe for the next run
+			if (numberOfBetas > 0)
+			{
+				backend.spinUpdatesPerSecond[job.isingL] = ((double)job.isingL * job.isingL * numberOfSweepsPerTemperature * numberOfBetas) / result.computationTime;
+			}
+			results[jobIndex] = std::move(result);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << backend.name << ": " << e.what() << '\n';
+			backend.spinUpdatesPerSecond[job.isingL] = 0.0;
+			failedJobIndices.push_back(jobIndex);
+		}
+	}
+}
+
+/**********************************************************************/
+
+void cHeterogeneousScheduler::Run(const std::vector<sIsingJob>& jobs, const uint32_t numberOfSweepsPerTemperature,
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, std::vector<sIsingJobResult>& results)
+{
+	// A job without betas throws here, before any backend is probed for it
+	for (const sIsingJob& job : jobs)
+	{
+		GetNumberOfBetas(job);
+	}
+
+	results.assign(jobs.size(), {});
+	const std::vector<std::vector<uint32_t>> jobIndicesOfEveryBackend = PlaceTheJobs(jobs, numberOfSweepsPerTemperature);
+
+	// Every device gets a host thread of its own, the CPU backend runs on the calling thread. Every job writes its own result, so they need no lock
+	std::vector<std::vector<uint32_t>> failedJobIndicesOfEveryBackend(backends.size());
+	std::vector<std::thread> deviceThreads;
+	auto JoinTheDeviceThreads = [&]()
+		{
+			for (std::thread& deviceThread : deviceThreads)
+			{
+				if (deviceThread.joinable())
+				{
+					deviceThread.join();
+				}
+			}
+		};
+
+	// A joinable std::thread that is destroyed calls std::terminate, so the device threads are joined before a throw of the CPU backend leaves
+	try
+	{
+		for (uint32_t i = 1; i < (uint32_t)backends.size(); i++)
+		{
+			if (!jobIndicesOfEveryBackend[i].empty())
+			{
+				deviceThreads.emplace_back([&, i]()
+					{
+						RunTheJobsOnTheVulkanDevice(i, jobs, jobIndicesOfEveryBackend[i], numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+							sweepsPerSpinSumSample, results, failedJobIndicesOfEveryBackend[i]);
+					});
+			}
+		}
+
+		RunTheJobsOnTheCPU(jobs, jobIndicesOfEveryBackend[0], numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample,
+			results);
+	}
+	catch (...)
+	{
+		JoinTheDeviceThreads();
+		throw;
+	}
+
+	JoinTheDeviceThreads();
+
+	// The jobs a device failed at run again on the CPU
+	std::vector<uint32_t> failedJobIndices;
+	for (const std::vector<uint32_t>& failedJobIndicesOfOneBackend : failedJobIndicesOfEveryBackend)
+	{
+		failedJobIndices.insert(failedJobIndices.end(), failedJobIndicesOfOneBackend.begin(), failedJobIndicesOfOneBackend.end());
+	}
+	if (!failedJobIndices.empty())
+	{
+		std::sort(failedJobIndices.begin(), failedJobIndices.end());
+		std::cout << failedJobIndices.size() << " jobs fall back to the CPU.\n";
+		RunTheJobsOnTheCPU(jobs, failedJobIndices, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample,
+			results);
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "Setup.h"
+#include "TemperatureScheduler.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+/* One temperature scan of one grid length, from startBeta down to endBeta like the scans of sIsingParameters */
+struct sIsingJob
+{
+	uint32_t isingL = 0;
+	double startBeta = 0.0;
+	double endBeta = 0.0;
+	double betaDecrement = 0.0;
+};
+
+/* What a job gave back and where it ran */
+struct sIsingJobResult
+{
+	std::vector<double> betaValues;
+	std::vector<double> binderCumulants;
+	uint32_t backendIndex = 0;														// The backend the job finished on, after a fallback the CPU
+	double computationTime = 0.0;													// In seconds, the jobs of the CPU share the time of their scheduler run
+};
+
+enum eSchedulerBackendType
+{
+	SCHEDULER_BACKEND_TYPE_CPU_THREADS,
+	SCHEDULER_BACKEND_TYPE_VULKAN_DEVICE
+};
+
+/* A place the jobs can run: the CPU threads of a cTemperatureScheduler or one Vulkan device, a software implementation like lavapipe included */
+struct sSchedulerBackend
+{
+	eSchedulerBackendType backendType = SCHEDULER_BACKEND_TYPE_CPU_THREADS;
+	std::string name;
+	uint32_t deviceIndex = 0;														// The index into cVulkanEngine::FindTheComputeDevices
+	std::unique_ptr<cTemperatureScheduler> pTheTemperatureScheduler;				// Only for SCHEDULER_BACKEND_TYPE_CPU_THREADS
+	std::shared_ptr<cVulkanEngine> pTheVulkanEngine;								// Only for SCHEDULER_BACKEND_TYPE_VULKAN_DEVICE
+	std::map<uint32_t, double> spinUpdatesPerSecond;								// Measured per grid length, 0 if the backend failed at the grid length
+};
+
+/* Spreads (grid length, beta range) jobs over the CPU threads and every Vulkan device there is. Every backend gets a short probe of every grid length
+   the first time it is asked for, and every job goes to the backend that would finish it first given what is placed there already, the longest jobs
+   first. A job stays on one backend, so its betas keep the warm starts of a serial scan. Without a Vulkan driver or device the CPU is the only backend,
+   and a job that throws on a device is run again on the CPU */
+class cHeterogeneousScheduler
+{
+private:
+	std::vector<sSchedulerBackend> backends;										// The CPU threads first
+
+	// Sweep a short temperature of the grid length on the backend and return its spin updates per second, 0 if the backend throws
+	double MeasureTheThroughput(sSchedulerBackend& backend, const uint32_t isingL);
+	// The job indices of every backend
+	std::vector<std::vector<uint32_t>> PlaceTheJobs(const std::vector<sIsingJob>& jobs, const uint32_t numberOfSweepsPerTemperature);
+	// All jobs of the CPU go into one run of its cTemperatureScheduler, so its threads are shared between them
+	void RunTheJobsOnTheCPU(const std::vector<sIsingJob>& jobs, const std::vector<uint32_t>& jobIndices, const uint32_t numberOfSweepsPerTemperature,
+		const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, std::vector<sIsingJobResult>& results);
+	// One cSetup after the other on the device, the indices of the jobs that threw go to failedJobIndices
+	void RunTheJobsOnTheVulkanDevice(const uint32_t backendIndex, const std::vector<sIsingJob>& jobs, const std::vector<uint32_t>& jobIndices,
+		const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample,
+		std::vector<sIsingJobResult>& results, std::vector<uint32_t>& failedJobIndices);
+
+public:
+	// Every hardware thread but one per Vulkan device goes to the CPU backend, the devices need a host thread each to submit and reduce
+	cHeterogeneousScheduler(const bool bUseVulkanDevices = true);
+
+	uint32_t GetNumberOfBackends() const;
+	const std::string& GetBackendName(const uint32_t backendIndex) const;
+	// 0 if the grid length was not probed on the backend yet
+	double GetSpinUpdatesPerSecond(const uint32_t backendIndex, const uint32_t isingL) const;
+	// results[i] is the result of jobs[i]
+	void Run(const std::vector<sIsingJob>& jobs, const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+		const uint32_t sweepsPerSpinSumSample, std::vector<sIsingJobResult>& results);
+
+	// The spin updates of a probe, so every probe takes about as long whatever the grid length
+	static constexpr double spinUpdatesPerProbe = 16'000'000.0;
+};
+
+// The number of betas of a job, counted like the serial scans count them. Throws if the beta decrement is not positive
+uint32_t GetNumberOfBetas(const sIsingJob& job);
@@ -0,0 +1,779 @@
+#include "MultiSpinCoding.h"
+#include "AcceptanceTable.h"
+#include "Setup.h"
+#include <bit>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MULTI_SPIN_CODING_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts AVX2 and AVX-512 intrinsics anywhere, GCC and Clang only in functions compiled for that instruction set
+#if defined(MULTI_SPIN_CODING_X86) && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+/* The words one half row update reads and writes */
+struct sHalfRowWords
+{
+	uint64_t* pCenterWords = nullptr;
+	const uint64_t* pAboveWords = nullptr;
+	const uint64_t* pBelowWords = nullptr;
+	const uint64_t* pSideWords = nullptr;
+	const uint64_t* pShiftedNeighbourWords = nullptr;
+	uint32_t wordsPerHalfRow = 0;
+	uint64_t lastWordMask = 0;
+	uint32_t acceptanceThreshold4 = 0;
+	uint32_t acceptanceThreshold8 = 0;
+};
+
+/**********************************************************************/
+
+// Same generator as XORShift in Setup.cpp, but visible to the compiler so it can be inlined into the hot loop
+// https://www.jstatsoft.org/article/view/v008i14
+static inline uint32_t XORShiftStep(uint32_t rngState)
+{
+	rngState ^= (rngState << 13);
+	rngState ^= (rngState >> 17);
+	rngState ^= (rngState << 5);
+	return rngState;
+}
+
+/**********************************************************************/
+
+// Count the anti-aligned neighbours of the 64 spins in word w of a half row with two half adders and one full adder
+static inline void CountTheAntiAlignedNeighbours(const sHalfRowWords& halfRowWords, const uint32_t w, uint64_t& twoOrMore, uint64_t& exactlyOne)
+{
+	const uint64_t centerWord = halfRowWords.pCenterWords[w];
+
+	// A set bit means that the neighbour is anti-aligned with the center spin
+	const uint64_t a1 = centerWord ^ halfRowWords.pAboveWords[w];
+	const uint64_t a2 = centerWord ^ halfRowWords.pBelowWords[w];
+	const uint64_t a3 = centerWord ^ halfRowWords.pSideWords[w];
+	const uint64_t a4 = centerWord ^ halfRowWords.pShiftedNeighbourWords[w];
+
+	const uint64_t sum12 = a1 ^ a2, carry12 = a1 & a2;
+	const uint64_t sum34 = a3 ^ a4, carry34 = a3 & a4;
+	twoOrMore = carry12 | carry34 | (sum12 & sum34);																// deltaE <= 0
+	exactlyOne = (sum12 ^ sum34) & ~(carry12 | carry34);															// deltaE = +4
+}
+
+/**********************************************************************/
+
+// Flip the accepted spins of word w at once and return the change of the spin sum. The change of the energy goes into energyChange
+static inline int FlipTheAcceptedSpins(const sHalfRowWords& halfRowWords, const uint32_t w, uint64_t flipMask, int& energyChange)
+{
+	const uint64_t centerWord = halfRowWords.pCenterWords[w];
+	flipMask &= (w == halfRowWords.wordsPerHalfRow - 1) ? halfRowWords.lastWordMask : ~0ULL;
+	halfRowWords.pCenterWords[w] = centerWord ^ flipMask;
+
+	// A flip with k anti-aligned neighbours changes the energy by 8 - 4 * k. The spins of one colour are never neighbours, so the changes add up
+	const int numberOfAntiAlignedBondsOfTheFlippedSpins = std::popcount(flipMask & (centerWord ^ halfRowWords.pAboveWords[w])) +
+		std::popcount(flipMask & (centerWord ^ halfRowWords.pBelowWords[w])) + std::popcount(flipMask & (centerWord ^ halfRowWords.pSideWords[w])) +
+		std::popcount(flipMask & (centerWord ^ halfRowWords.pShiftedNeighbourWords[w]));
+	energyChange += 8 * std::popcount(flipMask) - 4 * numberOfAntiAlignedBondsOfTheFlippedSpins;
+
+	// +1 spins that flip lower the spin sum by 2, -1 spins that flip raise it by 2
+	return 2 * (std::popcount(flipMask & ~centerWord) - std::popcount(flipMask & centerWord));
+}
+
+/**********************************************************************/
+
+// The scalar code path draws one random number per spin that needs one
+static int UpdateHalfRowWordsScalar(const sHalfRowWords& halfRowWords, uint32_t& randomState, int& energyChange)
+{
+	int spinSumChange = 0;
+	uint32_t localRandomState = randomState;
+
+	for (uint32_t w = 0; w < halfRowWords.wordsPerHalfRow; w++)
+	{
+		uint64_t twoOrMore, exactlyOne;
+		CountTheAntiAlignedNeighbours(halfRowWords, w, twoOrMore, exactlyOne);
+		const uint64_t wordMask = (w == halfRowWords.wordsPerHalfRow - 1) ? halfRowWords.lastWordMask : ~0ULL;
+
+		uint64_t flipMask = twoOrMore;
+
+		// The remaining spins (deltaE = +4 or +8) need a random number each
+		uint64_t candidates = ~twoOrMore & wordMask;
+		while (candidates != 0)
+		{
+			const int bit = std::countr_zero(candidates);
+			const uint64_t bitMask = 1ULL << bit;
+			candidates &= candidates - 1;
+
+			localRandomState = XORShiftStep(localRandomState);
+			const uint32_t acceptanceThreshold = (exactlyOne & bitMask) ? halfRowWords.acceptanceThreshold4 : halfRowWords.acceptanceThreshold8;
+			if (localRandomState < acceptanceThreshold)
+			{
+				flipMask |= bitMask;
+			}
+		}
+
+		spinSumChange += FlipTheAcceptedSpins(halfRowWords, w, flipMask, energyChange);
+	}
+
+	randomState = localRandomState;
+	return spinSumChange;
+}
+
+/**********************************************************************/
+
+#if defined(MULTI_SPIN_CODING_X86)
+
+// XORShift on 8 independent streams
+TARGET_AVX2 static inline __m256i XORShiftStepAVX2(__m256i rngStates)
+{
+	rngStates = _mm256_xor_si256(rngStates, _mm256_slli_epi32(rngStates, 13));
+	rngStates = _mm256_xor_si256(rngStates, _mm256_srli_epi32(rngStates, 17));
+	rngStates = _mm256_xor_si256(rngStates, _mm256_slli_epi32(rngStates, 5));
+	return rngStates;
+}
+
+/**********************************************************************/
+
+// The AVX2 code path draws a random number for all 64 spins of a word, 8 at a time, and keeps the branches out of the acceptance test
+TARGET_AVX2 static int UpdateHalfRowWordsAVX2(const sHalfRowWords& halfRowWords, uint32_t* pVectorRandomStates, int& energyChange)
+{
+	__m256i randomStates[8];
+	for (uint32_t v = 0; v < 8; v++)
+	{
+		randomStates[v] = _mm256_load_si256((const __m256i*)(pVectorRandomStates + 8 * v));
+	}
+
+	// AVX2 only compares signed integers, so flip the sign bits of both sides to compare them as unsigned
+	const __m256i signBits = _mm256_set1_epi32((int)0x80000000U);
+	const __m256i biasedAcceptanceThreshold4 = _mm256_set1_epi32((int)(halfRowWords.acceptanceThreshold4 ^ 0x80000000U));
+	const __m256i biasedAcceptanceThreshold8 = _mm256_set1_epi32((int)(halfRowWords.acceptanceThreshold8 ^ 0x80000000U));
+	const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+	int spinSumChange = 0;
+	for (uint32_t w = 0; w < halfRowWords.wordsPerHalfRow; w++)
+	{
+		uint64_t twoOrMore, exactlyOne;
+		CountTheAntiAlignedNeighbours(halfRowWords, w, twoOrMore, exactlyOne);
+
+		const uint64_t wordMask = (w == halfRowWords.wordsPerHalfRow - 1) ? halfRowWords.lastWordMask : ~0ULL;
+
+		uint64_t flipMask = twoOrMore;
+		if ((~twoOrMore & wordMask) != 0)
+		{
+			for (uint32_t v = 0; v < 8; v++)
+			{
+				randomStates[v] = XORShiftStepAVX2(randomStates[v]);
+
+				// Spread 8 bits of exactlyOne over the 8 lanes to pick the threshold of every lane
+				const __m256i exactlyOneBits = _mm256_and_si256(_mm256_set1_epi32((int)(exactlyOne >> (8 * v))), laneBits);
+				const __m256i bExactlyOne = _mm256_cmpeq_epi32(exactlyOneBits, laneBits);
+				const __m256i biasedAcceptanceThreshold = _mm256_blendv_epi8(biasedAcceptanceThreshold8, biasedAcceptanceThreshold4, bExactlyOne);
+
+				const __m256i bAccepted = _mm256_cmpgt_epi32(biasedAcceptanceThreshold, _mm256_xor_si256(randomStates[v], signBits));
+				flipMask |= (uint64_t)(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(bAccepted)) << (8 * v);
+			}
+		}
+
+		spinSumChange += FlipTheAcceptedSpins(halfRowWords, w, flipMask, energyChange);
+	}
+
+	for (uint32_t v = 0; v < 8; v++)
+	{
+		_mm256_store_si256((__m256i*)(pVectorRandomStates + 8 * v), randomStates[v]);
+	}
+	return spinSumChange;
+}
+
+/**********************************************************************/
+
+// XORShift on 16 independent streams
+TARGET_AVX512 static inline __m512i XORShiftStepAVX512(__m512i rngStates)
+{
+	rngStates = _mm512_xor_si512(rngStates, _mm512_slli_epi32(rngStates, 13));
+	rngStates = _mm512_xor_si512(rngStates, _mm512_srli_epi32(rngStates, 17));
+	rngStates = _mm512_xor_si512(rngStates, _mm512_slli_epi32(rngStates, 5));
+	return rngStates;
+}
+
+/**********************************************************************/
+
+// Same as the AVX2 code path with 16 spins at a time. The mask registers pick the thresholds and take the unsigned comparisons directly
+TARGET_AVX512 static int UpdateHalfRowWordsAVX512(const sHalfRowWords& halfRowWords, uint32_t* pVectorRandomStates, int& energyChange)
+{
+	__m512i randomStates[4];
+	for (uint32_t v = 0; v < 4; v++)
+	{
+		randomStates[v] = _mm512_load_si512((const void*)(pVectorRandomStates + 16 * v));
+	}
+
+	const __m512i acceptanceThreshold4 = _mm512_set1_epi32((int)halfRowWords.acceptanceThreshold4);
+	const __m512i acceptanceThreshold8 = _mm512_set1_epi32((int)halfRowWords.acceptanceThreshold8);
+
+	int spinSumChange = 0;
+	for (uint32_t w = 0; w < halfRowWords.wordsPerHalfRow; w++)
+	{
+		uint64_t twoOrMore, exactlyOne;
+		CountTheAntiAlignedNeighbours(halfRowWords, w, twoOrMore, exactlyOne);
+
+		const uint64_t wordMask = (w == halfRowWords.wordsPerHalfRow - 1) ? halfRowWords.lastWordMask : ~0ULL;
+
+		uint64_t flipMask = twoOrMore;
+		if ((~twoOrMore & wordMask) != 0)
+		{
+			for (uint32_t v = 0; v < 4; v++)
+			{
+				randomStates[v] = XORShiftStepAVX512(randomStates[v]);
+
+				const __m512i acceptanceThreshold = _mm512_mask_blend_epi32((__mmask16)(exactlyOne >> (16 * v)), acceptanceThreshold8, acceptanceThreshold4);
+				flipMask |= (uint64_t)_mm512_cmplt_epu32_mask(randomStates[v], acceptanceThreshold) << (16 * v);
+			}
+		}
+
+		spinSumChange += FlipTheAcceptedSpins(halfRowWords, w, flipMask, energyChange);
+	}
+
+	for (uint32_t v = 0; v < 4; v++)
+	{
+		_mm512_store_si512((void*)(pVectorRandomStates + 16 * v), randomStates[v]);
+	}
+	return spinSumChange;
+}
+
+#endif
+
+/**********************************************************************/
+
+eSIMDInstructionSet DetectSIMDInstructionSet()
+{
+#if defined(MULTI_SPIN_CODING_X86) && defined(_MSC_VER)
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 0);
+	if (cpuInfo[0] < 7)
+	{
+		return SIMD_INSTRUCTION_SET_NONE;
+	}
+
+	// The OS has to save the AVX registers (and the AVX-512 ones) on context switches
+	__cpuid(cpuInfo, 1);
+	const bool bOSXSAVE = (cpuInfo[2] & (1 << 27)) != 0;
+	if (!bOSXSAVE)
+	{
+		return SIMD_INSTRUCTION_SET_NONE;
+	}
+	const unsigned long long enabledStateComponents = _xgetbv(0);
+
+	__cpuidex(cpuInfo, 7, 0);
+	const bool bAVX2 = (cpuInfo[1] & (1 << 5)) != 0 && (enabledStateComponents & 0x6) == 0x6;
+	const bool bAVX512F = (cpuInfo[1] & (1 << 16)) != 0 && (enabledStateComponents & 0xE6) == 0xE6;
+
+	if (bAVX512F)
+	{
+		return SIMD_INSTRUCTION_SET_AVX512;
+	}
+	if (bAVX2)
+	{
+		return SIMD_INSTRUCTION_SET_AVX2;
+	}
+	return SIMD_INSTRUCTION_SET_NONE;
+#elif defined(MULTI_SPIN_CODING_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+	{
+		return SIMD_INSTRUCTION_SET_AVX512;
+	}
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return SIMD_INSTRUCTION_SET_AVX2;
+	}
+	return SIMD_INSTRUCTION_SET_NONE;
+#else
+	return SIMD_INSTRUCTION_SET_NONE;
+#endif
+}
+
+/**********************************************************************/
+
+const char* GetSIMDInstructionSetName(const eSIMDInstructionSet simdInstructionSet)
+{
+	switch (simdInstructionSet)
+	{
+	case SIMD_INSTRUCTION_SET_AVX2:
+		return "AVX2";
+	case SIMD_INSTRUCTION_SET_AVX512:
+		return "AVX-512";
+	default:
+		return "Scalar";
+	}
+}
+
+/**********************************************************************/
+
+sCPUCacheSizes DetectCPUCacheSizes()
+{
+	sCPUCacheSizes cacheSizes;
+
+#if defined(_WIN32)
+	DWORD bufferByteSize = 0;
+	GetLogicalProcessorInformation(nullptr, &bufferByteSize);
+	std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> processorInformation(bufferByteSize / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+	if (!processorInformation.empty() && GetLogicalProcessorInformation(processorInformation.data(), &bufferByteSize))
+	{
+		for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& information : processorInformation)
+		{
+			if (information.Relationship != RelationCache)
+			{
+				continue;
+			}
+			if (information.Cache.Level == 1 && information.Cache.Type == CacheData)
+			{
+				cacheSizes.level1DataCacheByteSize = information.Cache.Size;
+			}
+			else if (information.Cache.Level == 2)
+			{
+				cacheSizes.level2CacheByteSize = information.Cache.Size;
+			}
+		}
+	}
+#elif defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+	cacheSizes.level1DataCacheByteSize = (uint32_t)std::max(0L, sysconf(_SC_LEVEL1_DCACHE_SIZE));
+	cacheSizes.level2CacheByteSize = (uint32_t)std::max(0L, sysconf(_SC_LEVEL2_CACHE_SIZE));
+#endif
+
+	return cacheSizes;
+}
+
+/**********************************************************************/
+
+// Blocking only pays off once a strip no longer fits into the level 2 cache. The wavefront of a block touches about sweepsPerBlock + 2 rows,
+// so pick the number of sweeps per block that keeps them in half of the level 1 data cache
+static uint32_t ChooseSweepsPerBlock(const uint32_t wordsPerHalfRow, const uint32_t highestStripHeight, const sCPUCacheSizes& cacheSizes)
+{
+	const uint64_t level1DataCacheByteSize = (cacheSizes.level1DataCacheByteSize != 0) ? cacheSizes.level1DataCacheByteSize : 32768;
+	const uint64_t level2CacheByteSize = (cacheSizes.level2CacheByteSize != 0) ? cacheSizes.level2CacheByteSize : 262144;
+	const uint64_t rowByteSize = 2 * (uint64_t)wordsPerHalfRow * sizeof(uint64_t);									// Both colours
+
+	if (highestStripHeight * rowByteSize <= level2CacheByteSize / 2)
+	{
+		return 1;
+	}
+
+	// Clamped to 3 rows before the 2 rows of the wavefront are taken off, so a row wider than the cache gives 1 sweep per block instead of wrapping around
+	const uint64_t rowsInHalfTheLevel1DataCache = level1DataCacheByteSize / 2 / rowByteSize;
+	return (uint32_t)(std::clamp<uint64_t>(rowsInHalfTheLevel1DataCache, 3, 66) - 2);
+}
+
+/**********************************************************************/
+
+cMultiSpinCodedIsingLattice::cMultiSpinCodedIsingLattice(const uint32_t isingL, const uint32_t numberOfThreads)
+{
+	if (isingL < 2 || isingL % 2 == 1)
+	{
+		throw std::runtime_error("The multi-spin-coded CPU engine needs an even grid length!");
+	}
+
+	this->isingL = isingL;
+	spinsPerHalfRow = isingL / 2;
+	wordsPerHalfRow = (spinsPerHalfRow + 63) / 64;
+	bitsInTheLastWord = spinsPerHalfRow - 64 * (wordsPerHalfRow - 1);
+	lastWordMask = (bitsInTheLastWord == 64) ? ~0ULL : ((1ULL << bitsInTheLastWord) - 1);
+	spinWords.assign((size_t)2 * isingL * wordsPerHalfRow, 0);
+	spinSumSamplesOfTheChunk.resize(cObservableAccumulator::spinSumSamplesPerChunk);
+
+	// Give every thread a strip of at least 8 rows, more threads than that only add synchronization
+	const uint32_t minimumRowsPerThread = 8;
+	this->numberOfThreads = std::max(1U, std::min(numberOfThreads, isingL / minimumRowsPerThread));
+	pThreadPool = std::make_unique<cThreadPool>(this->numberOfThreads);
+	pThreadStates = std::make_unique<sMultiSpinCodingThreadState[]>(this->numberOfThreads);
+
+	for (uint32_t i = 0; i < this->numberOfThreads; i++)
+	{
+		sMultiSpinCodingThreadState& threadState = pThreadStates[i];
+		threadState.firstRowNumber = (uint32_t)(((uint64_t)isingL * i) / this->numberOfThreads);
+		threadState.endRowNumber = (uint32_t)(((uint64_t)isingL * (i + 1)) / this->numberOfThreads);
+		threadState.shiftedNeighbourWords.assign(wordsPerHalfRow, 0);
+	}
+
+	const uint32_t randomSeed = (uint32_t)std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()) % std::numeric_limits<uint32_t>::max();
+	SetRandomSeed(randomSeed);
+
+	simdInstructionSet = DetectSIMDInstructionSet();
+
+	uint32_t lowestStripHeight = isingL;
+	uint32_t highestStripHeight = 0;
+	for (uint32_t i = 0; i < this->numberOfThreads; i++)
+	{
+		lowestStripHeight = std::min(lowestStripHeight, pThreadStates[i].endRowNumber - pThreadStates[i].firstRowNumber);
+		highestStripHeight = std::max(highestStripHeight, pThreadStates[i].endRowNumber - pThreadStates[i].firstRowNumber);
+	}
+	maxSweepsPerBlock = std::max(1U, lowestStripHeight / 2);
+	SetSweepsPerBlock(ChooseSweepsPerBlock(wordsPerHalfRow, highestStripHeight, DetectCPUCacheSizes()));
+}
+
+/**********************************************************************/
+
+void cMultiSpinCodedIsingLattice::SetRandomSeed(const uint32_t randomSeed)
+{
+	std::default_random_engine randomNumberGenerator(randomSeed);
+
+	for (uint32_t i = 0; i < numberOfThreads; i++)
+	{
+		sMultiSpinCodingThreadState& threadState = pThreadStates[i];
+		threadState.randomState = (uint32_t)randomNumberGenerator() | 1;										// XORShift must not be seeded with 0
+		for (uint32_t j = 0; j < 64; j++)
+		{
+			threadState.vectorRandomStates[j] = (uint32_t)randomNumberGenerator() | 1;
+		}
+	}
+}
+
+/**********************************************************************/
+
+uint64_t* cMultiSpinCodedIsingLattice::GetHalfRow(const uint32_t colour, const uint32_t rowNumber)
+{
+	return spinWords.data() + ((size_t)colour * isingL + rowNumber) * wordsPerHalfRow;
+}
+
+/**********************************************************************/
+
+void cMultiSpinCodedIsingLattice::ImportSpinBatches(const uint32_t* pArraySpinBatches)
+{
+	std::fill(spinWords.begin(), spinWords.end(), 0);
+
+	for (uint32_t rowNumber = 0; rowNumber < isingL; rowNumber++)
+	{
+		for (uint32_t columnNumber = 0; columnNumber < isingL; columnNumber++)
+		{
+			const uint32_t spinIndex = rowNumber * isingL + columnNumber;
+			if ((pArraySpinBatches[spinIndex / 32] & (1U << (31 - spinIndex % 32))) != 0)
+			{
+				const uint32_t colour = (rowNumber + columnNumber) % 2;
+				const uint32_t halfRowIndex = columnNumber / 2;
+				GetHalfRow(colour, rowNumber)[halfRowIndex / 64] |= 1ULL << (halfRowIndex % 64);
+			}
+		}
+	}
+}
+
+/**********************************************************************/
+
+void cMultiSpinCodedIsingLattice::ExportSpinBatches(uint32_t* pArraySpinBatches) const
+{
+	const uint32_t isingN = isingL * isingL;
+	const uint32_t numberOfSpinBatches = (isingN + 31) / 32;
+	std::fill(pArraySpinBatches, pArraySpinBatches + numberOfSpinBatches, 0U);
+
+	for (uint32_t rowNumber = 0; rowNumber < isingL; rowNumber++)
+	{
+		for (uint32_t columnNumber = 0; columnNumber < isingL; columnNumber++)
+		{
+			const uint32_t colour = (rowNumber + columnNumber) % 2;
+			const uint32_t halfRowIndex = columnNumber / 2;
+			const uint64_t word = spinWords[((size_t)colour * isingL + rowNumber) * wordsPerHalfRow + halfRowIndex / 64];
+			if ((word >> (halfRowIndex % 64)) & 1ULL)
+			{
+				const uint32_t spinIndex = rowNumber * isingL + columnNumber;
+				pArraySpinBatches[spinIndex / 32] |= 1U << (31 - spinIndex % 32);
+			}
+		}
+	}
+}
+
+/**********************************************************************/
+
+void cMultiSpinCodedIsingLattice::SetBeta(const double beta)
+{
+	// An anti-aligned neighbour count of 1 is the neighbour spin sum 2 * spin, of 0 it is 4 * spin
+	const cAcceptanceTable TheAcceptanceTable(beta);
+	acceptanceThreshold4 = TheAcceptanceTable.GetAcceptanceThreshold(1, 2);
+	acceptanceThreshold8 = TheAcceptanceTable.GetAcceptanceThreshold(1, 4);
+}
+
+/**********************************************************************/
+
+int cMultiSpinCodedIsingLattice::UpdateHalfRow(const uint32_t colour, const uint32_t rowNumber, sMultiSpinCodingThreadState& threadState, int& energyChange)
+{
+	const uint32_t otherColour = 1 - colour;
+	uint64_t* pCenterWords = GetHalfRow(colour, rowNumber);
+	const uint64_t* pAboveWords = GetHalfRow(otherColour, (rowNumber + isingL - 1) % isingL);
+	const uint64_t* pBelowWords = GetHalfRow(otherColour, (rowNumber + 1) % isingL);
+	const uint64_t* pSideWords = GetHalfRow(otherColour, rowNumber);
+	const uint32_t lastWord = wordsPerHalfRow - 1;
+	uint64_t* pShiftedNeighbourWords = threadState.shiftedNeighbourWords.data();
+
+	// The same-row neighbour with the same half row index is to the right if the row starts with this colour (and to the left otherwise).
+	// The other same-row neighbour sits one half row index to the left (or to the right), so shift the other colour's half row by one bit
+	if ((rowNumber + colour) % 2 == 0)
+	{
+		// Neighbour at half row index - 1
+		pShiftedNeighbourWords[0] = (pSideWords[0] << 1) | ((pSideWords[lastWord] >> (bitsInTheLastWord - 1)) & 1ULL);
+		for (uint32_t w = 1; w < wordsPerHalfRow; w++)
+		{
+			pShiftedNeighbourWords[w] = (pSideWords[w] << 1) | (pSideWords[w - 1] >> 63);
+		}
+	}
+	else
+	{
+		// Neighbour at half row index + 1
+		for (uint32_t w = 0; w < lastWord; w++)
+		{
+			pShiftedNeighbourWords[w] = (pSideWords[w] >> 1) | (pSideWords[w + 1] << 63);
+		}
+		pShiftedNeighbourWords[lastWord] = (pSideWords[lastWord] >> 1) | ((pSideWords[0] & 1ULL) << (bitsInTheLastWord - 1));
+	}
+
+	const sHalfRowWords halfRowWords = { .pCenterWords = pCenterWords, .pAboveWords = pAboveWords, .pBelowWords = pBelowWords,
+		.pSideWords = pSideWords, .pShiftedNeighbourWords = pShiftedNeighbourWords, .wordsPerHalfRow = wordsPerHalfRow, .lastWordMask = lastWordMask,
+		.acceptanceThreshold4 = acceptanceThreshold4, .acceptanceThreshold8 = acceptanceThreshold8 };
+
+	switch (simdInstructionSet)
+	{
+#if defined(MULTI_SPIN_CODING_X86)
+	case SIMD_INSTRUCTION_SET_AVX512:
+		return UpdateHalfRowWordsAVX512(halfRowWords, threadState.vectorRandomStates, energyChange);
+	case SIMD_INSTRUCTION_SET_AVX2:
+		return UpdateHalfRowWordsAVX2(halfRowWords, threadState.vectorRandomStates, energyChange);
+#endif
+	default:
+		return UpdateHalfRowWordsScalar(halfRowWords, threadState.randomState, energyChange);
+	}
+}
+
+/**********************************************************************/
+
+uint32_t cMultiSpinCodedIsingLattice::GetNumberOfThreads() const
+{
+	return numberOfThreads;
+}
+
+/**********************************************************************/
+
+void cMultiSpinCodedIsingLattice::SetSIMDInstructionSet(const eSIMDInstructionSet simdInstructionSet)
+{
+	this->simdInstructionSet = std::min(simdInstructionSet, DetectSIMDInstructionSet());
+}
+
+/**********************************************************************/
+
+eSIMDInstructionSet cMultiSpinCodedIsingLattice::GetSIMDInstructionSet() const
+{
+	return simdInstructionSet;
+}
+
+/**********************************************************************/
+
+void cMultiSpinCodedIsingLattice::SetSweepsPerBlock(const uint32_t sweepsPerBlock)
+{
+	this->sweepsPerBlock = std::clamp(sweepsPerBlock, 1U, maxSweepsPerBlock);
+	for (uint32_t i = 0; i < numberOfThreads; i++)
+	{
+		pThreadStates[i].spinSumChangeOfEverySweepInTheBlock.assign(this->sweepsPerBlock, 0);
+		pThreadStates[i].energyChangeOfEverySweepInTheBlock.assign(this->sweepsPerBlock, 0);
+	}
+}
+
+/**********************************************************************/
+
+uint32_t cMultiSpinCodedIsingLattice::GetSweepsPerBlock() const
+{
+	return sweepsPerBlock;
+}
+
+/**********************************************************************/
+
+void cMultiSpinCodedIsingLattice::UpdateTrapezoid(const uint32_t firstSweepNumberOfTheBlock, const uint32_t numberOfSweepsInTheBlock,
+	sMultiSpinCodingThreadState& threadState)
+{
+	const uint32_t firstRowNumber = threadState.firstRowNumber;
+	const uint32_t endRowNumber = threadState.endRowNumber;
+
+	// At step t sweep j updates the row t - j. Sweep j needs the rows t - j - 1, t - j and t - j + 1 of sweep j - 1,
+	// which were updated in the two steps before and earlier in this step
+	for (uint32_t t = firstRowNumber; t < endRowNumber; t++)
+	{
+		for (uint32_t j = 0; j < numberOfSweepsInTheBlock && firstRowNumber + 2 * j <= t; j++)
+		{
+			threadState.spinSumChangeOfEverySweepInTheBlock[j] += UpdateHalfRow((firstSweepNumberOfTheBlock + j) % 2, t - j, threadState,
+				threadState.energyChangeOfEverySweepInTheBlock[j]);
+		}
+	}
+}
+
+/**********************************************************************/
+
+void cMultiSpinCodedIsingLattice::UpdateTriangle(const uint32_t firstSweepNumberOfTheBlock, const uint32_t numberOfSweepsInTheBlock,
+	sMultiSpinCodingThreadState& threadState)
+{
+	// Sweep j updates the rows [firstRowNumber - j, firstRowNumber + j) the trapezoids left out
+	for (uint32_t j = 1; j < numberOfSweepsInTheBlock; j++)
+	{
+		for (uint32_t i = 0; i < 2 * j; i++)
+		{
+			const uint32_t rowNumber = (threadState.firstRowNumber + isingL - j + i) % isingL;
+			threadState.spinSumChangeOfEverySweepInTheBlock[j] += UpdateHalfRow((firstSweepNumberOfTheBlock + j) % 2, rowNumber, threadState,
+				threadState.energyChangeOfEverySweepInTheBlock[j]);
+		}
+	}
+}
+
+/**********************************************************************/
+
+void cMultiSpinCodedIsingLattice::DoTheSweepsOfOneThread(const uint32_t threadIndex, int* pSpinSumSamplesOfTheChunk, int* pEnergySamplesOfTheChunk,
+	const uint32_t firstSweepNumberOfTheChunk,
+	const uint32_t endSweepNumberOfTheChunk, const uint32_t firstSpinSumOutputsIndexOfTheChunk, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+	const uint32_t sweepsPerSpinSumSample)
+{
+	sMultiSpinCodingThreadState& threadState = pThreadStates[threadIndex];
+	const sMultiSpinCodingThreadState& threadStateAbove = pThreadStates[(threadIndex + numberOfThreads - 1) % numberOfThreads];
+	const sMultiSpinCodingThreadState& threadStateBelow = pThreadStates[(threadIndex + 1) % numberOfThreads];
+
+	uint32_t blockNumber = 0;
+	for (uint32_t firstSweepNumberOfTheBlock = firstSweepNumberOfTheChunk; firstSweepNumberOfTheBlock < endSweepNumberOfTheChunk; firstSweepNumberOfTheBlock += sweepsPerBlock)
+	{
+		const uint32_t numberOfSweepsInTheBlock = std::min(sweepsPerBlock, endSweepNumberOfTheChunk - firstSweepNumberOfTheBlock);
+		std::fill(threadState.spinSumChangeOfEverySweepInTheBlock.begin(), threadState.spinSumChangeOfEverySweepInTheBlock.end(), 0);
+		std::fill(threadState.energyChangeOfEverySweepInTheBlock.begin(), threadState.energyChangeOfEverySweepInTheBlock.end(), 0);
+
+		// The triangle of the strip below reaches into the end of this strip, so it has to be done with the last block
+		if (numberOfThreads > 1)
+		{
+			while (threadStateBelow.numberOfFinishedSweepBlocks.load(std::memory_order_acquire) < blockNumber)
+			{
+				std::this_thread::yield();
+			}
+		}
+		UpdateTrapezoid(firstSweepNumberOfTheBlock, numberOfSweepsInTheBlock, threadState);
+		threadState.numberOfFinishedTrapezoids.store(blockNumber + 1, std::memory_order_release);
+
+		// The triangle of this strip reaches into the end of the strip above, so its trapezoid has to be done
+		if (numberOfThreads > 1)
+		{
+			while (threadStateAbove.numberOfFinishedTrapezoids.load(std::memory_order_acquire) < blockNumber + 1)
+			{
+				std::this_thread::yield();
+			}
+		}
+		UpdateTriangle(firstSweepNumberOfTheBlock, numberOfSweepsInTheBlock, threadState);
+		threadState.numberOfFinishedSweepBlocks.store(blockNumber + 1, std::memory_order_release);
+		blockNumber++;
+
+		// Like DoTheIsingGridSweepsCPU, every sweep updates one colour of the checkerboard.
+		// Add the change of this strip to the samples. The spin sum at the start of the temperature is added after all threads are done
+		for (uint32_t j = 0; j < numberOfSweepsInTheBlock; j++)
+		{
+			const uint32_t sweepNumber = firstSweepNumberOfTheBlock + j;
+			threadState.spinSumChangeSinceTheStartOfTheTemperature += threadState.spinSumChangeOfEverySweepInTheBlock[j];
+			threadState.energyChangeSinceTheStartOfTheTemperature += threadState.energyChangeOfEverySweepInTheBlock[j];
+
+			if (sweepNumber >= numberOfSweepsToWaitBeforeSpinSumSamplingStarts
+				&& (sweepNumber - numberOfSweepsToWaitBeforeSpinSumSamplingStarts) % sweepsPerSpinSumSample == 0)
+			{
+				const uint32_t spinSumOutputsIndex = (sweepNumber - numberOfSweepsToWaitBeforeSpinSumSamplingStarts) / sweepsPerSpinSumSample;
+				std::atomic_ref<int>(pSpinSumSamplesOfTheChunk[spinSumOutputsIndex - firstSpinSumOutputsIndexOfTheChunk])
+					.fetch_add(threadState.spinSumChangeSinceTheStartOfTheTemperature, std::memory_order_relaxed);
+				if (pEnergySamplesOfTheChunk != nullptr)
+				{
+					std::atomic_ref<int>(pEnergySamplesOfTheChunk[spinSumOutputsIndex - firstSpinSumOutputsIndexOfTheChunk])
+						.fetch_add(threadState.energyChangeSinceTheStartOfTheTemperature, std::memory_order_relaxed);
+				}
+			}
+		}
+	}
+}
+
+/**********************************************************************/
+
+void DoTheIsingGridSweepsMultiSpinCodedCPU(cMultiSpinCodedIsingLattice* pTheLattice, uint32_t* pArraySpinBatches, int* pArraySpinSumOutputs,
+	int& TheSpinSum, const double beta, const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+	const uint32_t sweepsPerSpinSumSample, cObservableAccumulator* pObservableAccumulator)
+{
+	const uint32_t numberOfSpinSumSamples = (numberOfSweepsPerTemperature > numberOfSweepsToWaitBeforeSpinSumSamplingStarts) ?
+		(numberOfSweepsPerTemperature - numberOfSweepsToWaitBeforeSpinSumSamplingStarts - 1) / sweepsPerSpinSumSample + 1 : 0;
+	if (pObservableAccumulator != nullptr)
+	{
+		pObservableAccumulator->Reset(pTheLattice->isingL);
+	}
+
+	pTheLattice->ImportSpinBatches(pArraySpinBatches);
+	pTheLattice->SetBeta(beta);
+
+	// The energies are only needed by the accumulator. The engine tracks their changes, so the grid is only summed up once per temperature
+	const int energyAtTheStartOfTheTemperature = (pObservableAccumulator != nullptr) ? CalculateTheEnergyCPU(pArraySpinBatches, pTheLattice->isingL) : 0;
+
+	for (uint32_t i = 0; i < pTheLattice->numberOfThreads; i++)
+	{
+		pTheLattice->pThreadStates[i].spinSumChangeSinceTheStartOfTheTemperature = 0;
+		pTheLattice->pThreadStates[i].energyChangeSinceTheStartOfTheTemperature = 0;
+	}
+
+	// The whole time series is one chunk. Without it the samples go through a small buffer, one chunk of sweeps at a time
+	const uint32_t spinSumSamplesPerChunk = (pArraySpinSumOutputs != nullptr) ? numberOfSpinSumSamples : cObservableAccumulator::spinSumSamplesPerChunk;
+	uint32_t firstSweepNumberOfTheChunk = 0;
+	for (uint32_t firstSpinSumOutputsIndexOfTheChunk = 0; firstSweepNumberOfTheChunk < numberOfSweepsPerTemperature; firstSpinSumOutputsIndexOfTheChunk += spinSumSamplesPerChunk)
+	{
+		const uint32_t endSweepNumberOfTheChunk = (pArraySpinSumOutputs != nullptr) ? numberOfSweepsPerTemperature : (uint32_t)std::min<uint64_t>(numberOfSweepsPerTemperature,
+			numberOfSweepsToWaitBeforeSpinSumSamplingStarts + (uint64_t)(firstSpinSumOutputsIndexOfTheChunk + spinSumSamplesPerChunk) * sweepsPerSpinSumSample);
+		const uint32_t numberOfSpinSumSamplesInTheChunk = std::min(spinSumSamplesPerChunk, numberOfSpinSumSamples - std::min(numberOfSpinSumSamples, firstSpinSumOutputsIndexOfTheChunk));
+		int* pSpinSumSamplesOfTheChunk = (pArraySpinSumOutputs != nullptr) ? pArraySpinSumOutputs + firstSpinSumOutputsIndexOfTheChunk : pTheLattice->spinSumSamplesOfTheChunk.data();
+		std::fill(pSpinSumSamplesOfTheChunk, pSpinSumSamplesOfTheChunk + numberOfSpinSumSamplesInTheChunk, 0);
+		int* pEnergySamplesOfTheChunk = nullptr;
+		if (pObservableAccumulator != nullptr)
+		{
+			pTheLattice->energySamplesOfTheChunk.resize(std::max<size_t>(pTheLattice->energySamplesOfTheChunk.size(), numberOfSpinSumSamplesInTheChunk));
+			pEnergySamplesOfTheChunk = pTheLattice->energySamplesOfTheChunk.data();
+			std::fill(pEnergySamplesOfTheChunk, pEnergySamplesOfTheChunk + numberOfSpinSumSamplesInTheChunk, 0);
+		}
+
+		for (uint32_t i = 0; i < pTheLattice->numberOfThreads; i++)
+		{
+			pTheLattice->pThreadStates[i].numberOfFinishedTrapezoids.store(0, std::memory_order_relaxed);
+			pTheLattice->pThreadStates[i].numberOfFinishedSweepBlocks.store(0, std::memory_order_relaxed);
+		}
+
+		pTheLattice->pThreadPool->RunOnEveryThread([&](const uint32_t threadIndex)
+			{
+				pTheLattice->DoTheSweepsOfOneThread(threadIndex, pSpinSumSamplesOfTheChunk, pEnergySamplesOfTheChunk, firstSweepNumberOfTheChunk, endSweepNumberOfTheChunk,
+					firstSpinSumOutputsIndexOfTheChunk, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+			});
+
+		// Reduce the per-thread changes
+		for (uint32_t i = 0; i < numberOfSpinSumSamplesInTheChunk; i++)
+		{
+			pSpinSumSamplesOfTheChunk[i] += TheSpinSum;
+		}
+		if (pObservableAccumulator != nullptr)
+		{
+			for (uint32_t i = 0; i < numberOfSpinSumSamplesInTheChunk; i++)
+			{
+				pEnergySamplesOfTheChunk[i] += energyAtTheStartOfTheTemperature;
+			}
+			pObservableAccumulator->AddSamples(pSpinSumSamplesOfTheChunk, pEnergySamplesOfTheChunk, numberOfSpinSumSamplesInTheChunk);
+		}
+		firstSweepNumberOfTheChunk = endSweepNumberOfTheChunk;
+	}
+
+	for (uint32_t i = 0; i < pTheLattice->numberOfThreads; i++)
+	{
+		TheSpinSum += pTheLattice->pThreadStates[i].spinSumChangeSinceTheStartOfTheTemperature;
+	}
+
+	pTheLattice->ExportSpinBatches(pArraySpinBatches);
+}
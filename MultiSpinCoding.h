@@ -0,0 +1,117 @@
+#pragma once
+#include "ThreadPool.h"
+#include "ObservableAccumulator.h"
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+enum eSIMDInstructionSet
+{
+	SIMD_INSTRUCTION_SET_NONE,																// The scalar fallback, one random number per candidate spin
+	SIMD_INSTRUCTION_SET_AVX2,																// 8 spins per instruction
+	SIMD_INSTRUCTION_SET_AVX512																// 16 spins per instruction (AVX-512F)
+};
+
+/* The state a sweep thread owns. Aligned to a cache line so the threads do not share one */
+struct alignas(64) sMultiSpinCodingThreadState
+{
+	uint32_t firstRowNumber = 0;													// The thread updates the rows [firstRowNumber, endRowNumber)
+	uint32_t endRowNumber = 0;
+	uint32_t randomState = 1;														// Every thread has its own XORShift stream
+	int spinSumChangeSinceTheStartOfTheTemperature = 0;
+	int energyChangeSinceTheStartOfTheTemperature = 0;
+	std::atomic<uint32_t> numberOfFinishedTrapezoids{ 0 };							// Read by the threads owning the neighbouring strips
+	std::atomic<uint32_t> numberOfFinishedSweepBlocks{ 0 };
+	std::vector<int> spinSumChangeOfEverySweepInTheBlock;
+	std::vector<int> energyChangeOfEverySweepInTheBlock;
+	std::vector<uint64_t> shiftedNeighbourWords;									// Scratch half row holding the horizontally shifted neighbours
+	alignas(64) uint32_t vectorRandomStates[64] = {};								// One XORShift stream per bit of a word, used by the SIMD code paths
+};
+
+/* The data cache sizes in bytes (0 if unknown) */
+struct sCPUCacheSizes
+{
+	uint32_t level1DataCacheByteSize = 0;
+	uint32_t level2CacheByteSize = 0;
+};
+
+/* An Ising grid stored for word-parallel (multi-spin-coded) Metropolis sweeps on the CPU.
+   The two checkerboard colours are kept apart, so a "half row" holds the isingL / 2 spins of one colour in one row.
+   Bit b of word w in the half row (colour, row) is the spin at column 2 * (64 * w + b) + ((row + colour) % 2).
+   A set bit is a +1 spin, just like in pArraySpinBatches. The padding bits at the end of every half row are kept at 0.
+   With more than one thread the rows are split into strips, one per thread.
+   The sweeps are done in blocks of sweepsPerBlock sweeps. Every block first updates a trapezoid of every strip (sweep j of the block updates
+   the rows [firstRowNumber + j, endRowNumber - j)) as a wavefront, so a band of a few rows is taken through all sweeps of the block while it is in the cache.
+   Then the triangles left around the strip boundaries are updated. The result is the same as that of sweeping the whole grid sweep by sweep */
+class cMultiSpinCodedIsingLattice
+{
+	// Do the sweeps (same sampling semantics as DoTheIsingGridSweepsCPU)
+	friend void DoTheIsingGridSweepsMultiSpinCodedCPU(cMultiSpinCodedIsingLattice* pTheLattice, uint32_t* pArraySpinBatches, int* pArraySpinSumOutputs,
+		int& TheSpinSum, const double beta, const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+		const uint32_t sweepsPerSpinSumSample, cObservableAccumulator* pObservableAccumulator);
+
+private:
+	uint32_t isingL = 0;
+	uint32_t spinsPerHalfRow = 0;
+	uint32_t wordsPerHalfRow = 0;
+	uint32_t bitsInTheLastWord = 0;													// The number of used bits in the last word of a half row
+	uint64_t lastWordMask = 0;														// The used bits in the last word of a half row
+	std::vector<uint64_t> spinWords;												// Indexed as [colour][row][word]
+	uint32_t acceptanceThreshold4 = 0;												// A raw 32-bit random number below this accepts a flip with deltaE = +4
+	uint32_t acceptanceThreshold8 = 0;												// A raw 32-bit random number below this accepts a flip with deltaE = +8
+
+	std::unique_ptr<cThreadPool> pThreadPool;
+	std::unique_ptr<sMultiSpinCodingThreadState[]> pThreadStates;
+	uint32_t numberOfThreads = 1;
+	uint32_t sweepsPerBlock = 1;
+	uint32_t maxSweepsPerBlock = 1;													// Half the height of the lowest strip, so the triangles of one strip never meet
+	eSIMDInstructionSet simdInstructionSet = SIMD_INSTRUCTION_SET_NONE;
+	std::vector<int> spinSumSamplesOfTheChunk;										// Used when the samples only go into an observable accumulator
+	std::vector<int> energySamplesOfTheChunk;										// Only used with an observable accumulator, as long as the longest chunk
+
+	uint64_t* GetHalfRow(const uint32_t colour, const uint32_t rowNumber);
+	// Update every spin of one colour in one row. Returns the change of the spin sum, the change of the energy is added to energyChange
+	int UpdateHalfRow(const uint32_t colour, const uint32_t rowNumber, sMultiSpinCodingThreadState& threadState, int& energyChange);
+	// Update the trapezoid of the strip of one thread, sweep j of the block goes into spinSumChangeOfEverySweepInTheBlock[j] and energyChangeOfEverySweepInTheBlock[j]
+	void UpdateTrapezoid(const uint32_t firstSweepNumberOfTheBlock, const uint32_t numberOfSweepsInTheBlock, sMultiSpinCodingThreadState& threadState);
+	// Update the triangle around the first row of the strip of one thread
+	void UpdateTriangle(const uint32_t firstSweepNumberOfTheBlock, const uint32_t numberOfSweepsInTheBlock, sMultiSpinCodingThreadState& threadState);
+	// Run the sweeps [firstSweepNumberOfTheChunk, endSweepNumberOfTheChunk) of one temperature on the strip of one thread.
+	// The samples are counted from the start of the temperature, the one with the index firstSpinSumOutputsIndexOfTheChunk goes into pSpinSumSamplesOfTheChunk[0].
+	// pEnergySamplesOfTheChunk gets the energy changes the same way, it is nullptr if the energies are not needed
+	void DoTheSweepsOfOneThread(const uint32_t threadIndex, int* pSpinSumSamplesOfTheChunk, int* pEnergySamplesOfTheChunk, const uint32_t firstSweepNumberOfTheChunk,
+		const uint32_t endSweepNumberOfTheChunk, const uint32_t firstSpinSumOutputsIndexOfTheChunk, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+		const uint32_t sweepsPerSpinSumSample);
+
+public:
+	// The number of threads is capped so that every strip has at least a few rows. The best SIMD instruction set of the CPU is picked at runtime,
+	// the number of sweeps per block is picked from the cache sizes
+	cMultiSpinCodedIsingLattice(const uint32_t isingL, const uint32_t numberOfThreads = 1);
+
+	// Convert from and to the pArraySpinBatches format (32 spins per uint32_t in row-major order, most significant bit first)
+	void ImportSpinBatches(const uint32_t* pArraySpinBatches);
+	void ExportSpinBatches(uint32_t* pArraySpinBatches) const;
+
+	void SetBeta(const double beta);
+	// Reseed the XORShift streams of every thread. The constructor seeds them from the clock, so lattices made in the same second share their streams
+	void SetRandomSeed(const uint32_t randomSeed);
+	uint32_t GetNumberOfThreads() const;
+	// Instruction sets the CPU does not support fall back to the best one it does
+	void SetSIMDInstructionSet(const eSIMDInstructionSet simdInstructionSet);
+	eSIMDInstructionSet GetSIMDInstructionSet() const;
+	// 1 turns the blocking off. Capped at half the height of the lowest strip
+	void SetSweepsPerBlock(const uint32_t sweepsPerBlock);
+	uint32_t GetSweepsPerBlock() const;
+};
+
+// The sizes of the caches of one core
+sCPUCacheSizes DetectCPUCacheSizes();
+// The best SIMD instruction set the CPU and the OS support
+eSIMDInstructionSet DetectSIMDInstructionSet();
+const char* GetSIMDInstructionSetName(const eSIMDInstructionSet simdInstructionSet);
+
+// pArraySpinSumOutputs can be nullptr if the samples only go into pObservableAccumulator
+void DoTheIsingGridSweepsMultiSpinCodedCPU(cMultiSpinCodedIsingLattice* pTheLattice, uint32_t* pArraySpinBatches, int* pArraySpinSumOutputs,
+	int& TheSpinSum, const double beta, const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+	const uint32_t sweepsPerSpinSumSample, cObservableAccumulator* pObservableAccumulator = nullptr);
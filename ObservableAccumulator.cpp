@@ -0,0 +1,167 @@
+#include "ObservableAccumulator.h"
+#include <limits>
+#include <stdexcept>
+
+/**********************************************************************/
+
+void sKahanSum::Add(const double value)
+{
+	const double compensatedValue = value - compensation;
+	const double newSum = sum + compensatedValue;
+	compensation = (newSum - sum) - compensatedValue;
+	sum = newSum;
+}
+
+/**********************************************************************/
+
+cObservableAccumulator::cObservableAccumulator(const uint32_t isingL)
+{
+	Reset(isingL);
+}
+
+/**********************************************************************/
+
+void cObservableAccumulator::Reset(const uint32_t isingL)
+{
+	inverseIsingN = 1.0 / ((double)isingL * isingL);
+	numberOfSamples = 0;
+	numberOfEnergySamples = 0;
+	absoluteMagnetizationSum = {};
+	magnetization2Sum = {};
+	magnetization4Sum = {};
+	energyMean = 0.0;
+	energySquaredDeviationSum = 0.0;
+}
+
+/**********************************************************************/
+
+void cObservableAccumulator::AddSample(const int spinSum)
+{
+	const double magnetization = spinSum * inverseIsingN;														// The average spin per site
+	const double magnetization2 = magnetization * magnetization;
+	absoluteMagnetizationSum.Add(magnetization < 0.0 ? -magnetization : magnetization);
+	magnetization2Sum.Add(magnetization2);
+	magnetization4Sum.Add(magnetization2 * magnetization2);
+	numberOfSamples++;
+}
+
+/**********************************************************************/
+
+void cObservableAccumulator::AddSample(const int spinSum, const int energy)
+{
+	AddSample(spinSum);
+
+	const double energyPerSite = energy * inverseIsingN;
+	numberOfEnergySamples++;
+	const double deviation = energyPerSite - energyMean;
+	energyMean += deviation / numberOfEnergySamples;
+	energySquaredDeviationSum += deviation * (energyPerSite - energyMean);
+}
+
+/**********************************************************************/
+
+void cObservableAccumulator::AddSamples(const int* pArraySpinSumOutputs, const uint32_t numberOfElementsInTheSpinSumOutputArray)
+{
+	for (uint32_t i = 0; i < numberOfElementsInTheSpinSumOutputArray; i++)
+	{
+		AddSample(pArraySpinSumOutputs[i]);
+	}
+}
+
+/**********************************************************************/
+
+void cObservableAccumulator::AddSamples(const int* pArraySpinSumOutputs, const int* pArrayEnergyOutputs, const uint32_t numberOfElementsInTheSpinSumOutputArray)
+{
+	for (uint32_t i = 0; i < numberOfElementsInTheSpinSumOutputArray; i++)
+	{
+		AddSample(pArraySpinSumOutputs[i], pArrayEnergyOutputs[i]);
+	}
+}
+
+/**********************************************************************/
+
+void cObservableAccumulator::AddMomentSums(const uint64_t numberOfSummedSamples, const double absoluteMagnetizationSumToAdd, const double magnetization2SumToAdd,
+	const double magnetization4SumToAdd)
+{
+	absoluteMagnetizationSum.Add(absoluteMagnetizationSumToAdd);
+	magnetization2Sum.Add(magnetization2SumToAdd);
+	magnetization4Sum.Add(magnetization4SumToAdd);
+	numberOfSamples += numberOfSummedSamples;
+}
+
+/**********************************************************************/
+
+uint64_t cObservableAccumulator::GetNumberOfSamples() const
+{
+	return numberOfSamples;
+}
+
+/**********************************************************************/
+
+uint64_t cObservableAccumulator::GetNumberOfEnergySamples() const
+{
+	return numberOfEnergySamples;
+}
+
+/**********************************************************************/
+
+double cObservableAccumulator::GetMeanAbsoluteMagnetization() const
+{
+	return absoluteMagnetizationSum.sum / numberOfSamples;
+}
+
+/**********************************************************************/
+
+double cObservableAccumulator::GetMeanMagnetization2() const
+{
+	return magnetization2Sum.sum / numberOfSamples;
+}
+
+/**********************************************************************/
+
+double cObservableAccumulator::GetMeanMagnetization4() const
+{
+	return magnetization4Sum.sum / numberOfSamples;
+}
+
+/**********************************************************************/
+
+double cObservableAccumulator::GetMeanEnergy() const
+{
+	if (numberOfEnergySamples == 0)
+	{
+		throw std::runtime_error("No energy samples were added to the observable accumulator!");
+	}
+	return energyMean;
+}
+
+/**********************************************************************/
+
+double cObservableAccumulator::GetMeanEnergy2() const
+{
+	return GetEnergyVariance() + GetMeanEnergy() * GetMeanEnergy();
+}
+
+/**********************************************************************/
+
+double cObservableAccumulator::GetEnergyVariance() const
+{
+	if (numberOfEnergySamples == 0)
+	{
+		throw std::runtime_error("No energy samples were added to the observable accumulator!");
+	}
+	return energySquaredDeviationSum / numberOfEnergySamples;
+}
+
+/**********************************************************************/
+
+double cObservableAccumulator::GetBinderCumulant() const
+{
+	if (numberOfSamples == 0)
+	{
+		return std::numeric_limits<double>::quiet_NaN();
+	}
+	const double m4Average = GetMeanMagnetization4();															// The state average
+	const double m2Average = GetMeanMagnetization2();															// The state average
+	return 1.0 - (m4Average / (3.0 * m2Average * m2Average));
+}
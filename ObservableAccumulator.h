@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+
+/* A sum of doubles that carries its rounding error along (Kahan summation) */
+struct sKahanSum
+{
+	double sum = 0.0;
+	double compensation = 0.0;
+
+	void Add(const double value);
+};
+
+/* The running averages of the observables of one temperature, updated sample by sample in O(1) memory, so the spin sum time series is optional.
+   The magnetization moments (per spin) are Kahan sums. The energy (per spin) uses Welford's algorithm, so its variance does not cancel away.
+   Every CPU engine adds the energy with the spin sum, the GPU only adds the spin sum */
+class cObservableAccumulator
+{
+private:
+	double inverseIsingN = 1.0;
+	uint64_t numberOfSamples = 0;
+	uint64_t numberOfEnergySamples = 0;
+	sKahanSum absoluteMagnetizationSum;
+	sKahanSum magnetization2Sum;
+	sKahanSum magnetization4Sum;
+	double energyMean = 0.0;
+	double energySquaredDeviationSum = 0.0;											// Welford's M2, the sum of the squared deviations from the running mean
+
+public:
+	// The engines that sample on several threads add their samples in chunks of this many
+	static constexpr uint32_t spinSumSamplesPerChunk = 4096;
+
+	cObservableAccumulator(const uint32_t isingL = 1);
+
+	// Forget every sample. Called by the engines at the start of every temperature
+	void Reset(const uint32_t isingL);
+	void AddSample(const int spinSum);
+	void AddSample(const int spinSum, const int energy);
+	void AddSamples(const int* pArraySpinSumOutputs, const uint32_t numberOfElementsInTheSpinSumOutputArray);
+	void AddSamples(const int* pArraySpinSumOutputs, const int* pArrayEnergyOutputs, const uint32_t numberOfElementsInTheSpinSumOutputArray);
+	// The moment sums (per spin) of samples that were summed elsewhere, by the moment reduction of the GPU
+	void AddMomentSums(const uint64_t numberOfSummedSamples, const double absoluteMagnetizationSumToAdd, const double magnetization2SumToAdd,
+		const double magnetization4SumToAdd);
+
+	uint64_t GetNumberOfSamples() const;
+	uint64_t GetNumberOfEnergySamples() const;
+	double GetMeanAbsoluteMagnetization() const;
+	double GetMeanMagnetization2() const;
+	double GetMeanMagnetization4() const;
+	// Throw if the engine did not add energies, so a missing energy is not mistaken for a zero one
+	double GetMeanEnergy() const;
+	double GetMeanEnergy2() const;
+	double GetEnergyVariance() const;
+	// NaN without samples, on purpose rather than through the 0 / 0 of the empty means
+	double GetBinderCumulant() const;
+};
@@ -0,0 +1,155 @@
+#include "ParallelTempering.h"
+#include "Setup.h"
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+/**********************************************************************/
+
+cParallelTemperingEnsemble::cParallelTemperingEnsemble(const uint32_t isingL, const std::vector<double>& betaValues, const uint32_t sweepsPerReplicaExchange,
+	const uint32_t numberOfThreads)
+{
+	if (isingL < 2 || isingL % 2 == 1)
+	{
+		throw std::runtime_error("The parallel tempering CPU engine needs an even grid length!");
+	}
+	if (betaValues.empty())
+	{
+		throw std::runtime_error("The parallel tempering CPU engine needs at least one beta value!");
+	}
+
+	this->isingL = isingL;
+	isingN = isingL * isingL;
+	this->betaValues = betaValues;
+	this->sweepsPerReplicaExchange = std::max(2U, sweepsPerReplicaExchange + sweepsPerReplicaExchange % 2);
+
+	const uint32_t numberOfTemperatures = (uint32_t)betaValues.size();
+	const uint32_t numberOfSpinBatches = (isingN + 31) / 32;
+	const uint32_t randomSeed = (uint32_t)std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()) % std::numeric_limits<uint32_t>::max();
+	std::default_random_engine randomNumberGenerator(randomSeed);
+
+	// Every replica starts with all spins +1 at its own beta
+	replicas.resize(numberOfTemperatures);
+	replicaIndexOfEveryBeta.resize(numberOfTemperatures);
+	for (uint32_t i = 0; i < numberOfTemperatures; i++)
+	{
+		sParallelTemperingReplica& replica = replicas[i];
+		replica.pTheLattice = std::make_unique<cMultiSpinCodedIsingLattice>(isingL, 1);
+		replica.pTheLattice->SetRandomSeed((uint32_t)randomNumberGenerator());
+		replica.spinBatches.assign(numberOfSpinBatches, ~0U);
+		replica.TheSpinSum = isingN;
+		replica.TheEnergy = -2 * (int)isingN;
+		replica.betaIndex = i;
+		replica.spinSumOfEverySweep.resize(this->sweepsPerReplicaExchange);
+		replicaIndexOfEveryBeta[i] = i;
+	}
+
+	numberOfSwapAttempts.assign(numberOfTemperatures, 0);
+	numberOfAcceptedSwaps.assign(numberOfTemperatures, 0);
+	randomState = (uint32_t)randomNumberGenerator() | 1;														// XORShift must not be seeded with 0
+
+	// More threads than replicas would only sleep
+	pThreadPool = std::make_unique<cThreadPool>(std::max(1U, std::min(numberOfThreads, numberOfTemperatures)));
+}
+
+/**********************************************************************/
+
+uint32_t cParallelTemperingEnsemble::GetNumberOfTemperatures() const
+{
+	return (uint32_t)betaValues.size();
+}
+
+/**********************************************************************/
+
+double cParallelTemperingEnsemble::GetSwapAcceptanceRate(const uint32_t pairIndex) const
+{
+	if (pairIndex + 1 >= betaValues.size() || numberOfSwapAttempts[pairIndex] == 0)
+	{
+		return 0.0;
+	}
+
+	return (double)numberOfAcceptedSwaps[pairIndex] / numberOfSwapAttempts[pairIndex];
+}
+
+/**********************************************************************/
+
+void cParallelTemperingEnsemble::SweepOneReplica(const uint32_t replicaIndex, int* pArraySpinSumOutputs, const uint32_t firstSweepNumber,
+	const uint32_t numberOfSweepsInTheInterval, const uint32_t numberOfSpinSumSamplesPerBeta, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+	const uint32_t sweepsPerSpinSumSample)
+{
+	sParallelTemperingReplica& replica = replicas[replicaIndex];
+
+	// Keep the spin sum of every sweep and pick the samples by the sweep number counted from the start of the temperature
+	DoTheIsingGridSweepsMultiSpinCodedCPU(replica.pTheLattice.get(), replica.spinBatches.data(), replica.spinSumOfEverySweep.data(), replica.TheSpinSum,
+		betaValues[replica.betaIndex], numberOfSweepsInTheInterval, 0, 1);
+
+	int* pSpinSumOutputsOfTheBeta = pArraySpinSumOutputs + (size_t)replica.betaIndex * numberOfSpinSumSamplesPerBeta;
+	for (uint32_t i = 0; i < numberOfSweepsInTheInterval; i++)
+	{
+		const uint32_t sweepNumber = firstSweepNumber + i;
+		if (sweepNumber >= numberOfSweepsToWaitBeforeSpinSumSamplingStarts && (sweepNumber - numberOfSweepsToWaitBeforeSpinSumSamplingStarts) % sweepsPerSpinSumSample == 0)
+		{
+			pSpinSumOutputsOfTheBeta[(sweepNumber - numberOfSweepsToWaitBeforeSpinSumSamplingStarts) / sweepsPerSpinSumSample] = replica.spinSumOfEverySweep[i];
+		}
+	}
+
+	replica.TheEnergy = CalculateTheEnergyCPU(replica.spinBatches.data(), isingL);
+}
+
+/**********************************************************************/
+
+void cParallelTemperingEnsemble::AttemptReplicaExchanges(const uint32_t firstPairIndex)
+{
+	for (uint32_t pairIndex = firstPairIndex; pairIndex + 1 < betaValues.size(); pairIndex += 2)
+	{
+		sParallelTemperingReplica& lowerReplica = replicas[replicaIndexOfEveryBeta[pairIndex]];
+		sParallelTemperingReplica& upperReplica = replicas[replicaIndexOfEveryBeta[pairIndex + 1]];
+		const double exponent = (betaValues[pairIndex] - betaValues[pairIndex + 1]) * (double)(lowerReplica.TheEnergy - upperReplica.TheEnergy);
+
+		numberOfSwapAttempts[pairIndex]++;
+		randomState = XORShift(randomState);
+		if (exponent >= 0.0 || randomState < std::exp(exponent) * 4294967296.0)
+		{
+			numberOfAcceptedSwaps[pairIndex]++;
+			std::swap(replicaIndexOfEveryBeta[pairIndex], replicaIndexOfEveryBeta[pairIndex + 1]);
+			std::swap(lowerReplica.betaIndex, upperReplica.betaIndex);
+		}
+	}
+}
+
+/**********************************************************************/
+
+void DoTheIsingGridSweepsParallelTemperingCPU(cParallelTemperingEnsemble* pTheEnsemble, int* pArraySpinSumOutputs,
+	const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample)
+{
+	const uint32_t numberOfTemperatures = pTheEnsemble->GetNumberOfTemperatures();
+	const uint32_t numberOfSpinSumSamplesPerBeta = (numberOfSweepsPerTemperature > numberOfSweepsToWaitBeforeSpinSumSamplingStarts) ?
+		(numberOfSweepsPerTemperature - numberOfSweepsToWaitBeforeSpinSumSamplingStarts - 1) / sweepsPerSpinSumSample + 1 : 0;
+	std::fill(pArraySpinSumOutputs, pArraySpinSumOutputs + (size_t)numberOfTemperatures * numberOfSpinSumSamplesPerBeta, 0);
+	std::fill(pTheEnsemble->numberOfSwapAttempts.begin(), pTheEnsemble->numberOfSwapAttempts.end(), 0);
+	std::fill(pTheEnsemble->numberOfAcceptedSwaps.begin(), pTheEnsemble->numberOfAcceptedSwaps.end(), 0);
+
+	uint32_t exchangeIntervalNumber = 0;
+	for (uint32_t firstSweepNumber = 0; firstSweepNumber < numberOfSweepsPerTemperature; firstSweepNumber += pTheEnsemble->sweepsPerReplicaExchange)
+	{
+		const uint32_t numberOfSweepsInTheInterval = std::min(pTheEnsemble->sweepsPerReplicaExchange, numberOfSweepsPerTemperature - firstSweepNumber);
+
+		// The threads take the next replica until all are swept, so the index of the thread does not matter
+		pTheEnsemble->nextReplicaIndexToSweep.store(0, std::memory_order_relaxed);
+		pTheEnsemble->pThreadPool->RunOnEveryThread([&](const uint32_t)
+			{
+				uint32_t replicaIndex;
+				while ((replicaIndex = pTheEnsemble->nextReplicaIndexToSweep.fetch_add(1, std::memory_order_relaxed)) < numberOfTemperatures)
+				{
+					pTheEnsemble->SweepOneReplica(replicaIndex, pArraySpinSumOutputs, firstSweepNumber, numberOfSweepsInTheInterval,
+						numberOfSpinSumSamplesPerBeta, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+				}
+			});
+
+		pTheEnsemble->AttemptReplicaExchanges(exchangeIntervalNumber % 2);
+		exchangeIntervalNumber++;
+	}
+}
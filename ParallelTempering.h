@@ -0,0 +1,61 @@
+#pragma once
+#include "ThreadPool.h"
+#include "MultiSpinCoding.h"
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+/* One replica of the parallel tempering ensemble. It keeps its own grid, the beta it currently runs at moves between the replicas */
+struct sParallelTemperingReplica
+{
+	std::unique_ptr<cMultiSpinCodedIsingLattice> pTheLattice;
+	std::vector<uint32_t> spinBatches;												// The grid in the pArraySpinBatches format
+	int TheSpinSum = 0;
+	int TheEnergy = 0;																// Sum over the bonds of -s_i * s_j
+	uint32_t betaIndex = 0;															// Index into betaValues
+	std::vector<int> spinSumOfEverySweep;											// Scratch, holds the spin sums of one exchange interval
+};
+
+/* Replica exchange (parallel tempering) on the CPU. There is one replica per beta value. Every exchange interval all replicas are swept
+   concurrently on a thread pool (every replica on one thread with the multi-spin-coded engine), then neighbouring betas try to swap their replicas
+   with the Metropolis probability min(1, exp((beta_k - beta_k+1) * (E_k - E_k+1))). The even and the odd pairs take turns.
+   A swap only exchanges the beta labels, the grids stay where they are. The spin sums are written per beta, not per replica */
+class cParallelTemperingEnsemble
+{
+	// Do the sweeps of every beta at once (same sampling semantics as DoTheIsingGridSweepsCPU, counted per beta).
+	// pArraySpinSumOutputs is indexed as [betaIndex][sample]
+	friend void DoTheIsingGridSweepsParallelTemperingCPU(cParallelTemperingEnsemble* pTheEnsemble, int* pArraySpinSumOutputs,
+		const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample);
+
+private:
+	uint32_t isingL = 0;
+	uint32_t isingN = 0;
+	std::vector<double> betaValues;
+	std::vector<sParallelTemperingReplica> replicas;
+	std::vector<uint32_t> replicaIndexOfEveryBeta;
+	uint32_t sweepsPerReplicaExchange = 2;
+	std::vector<uint64_t> numberOfSwapAttempts;										// Indexed by the lower beta index of the pair
+	std::vector<uint64_t> numberOfAcceptedSwaps;
+	uint32_t randomState = 1;														// Used for the swap decisions
+
+	std::unique_ptr<cThreadPool> pThreadPool;
+	std::atomic<uint32_t> nextReplicaIndexToSweep{ 0 };
+
+	// Sweep one replica through the exchange interval that starts at firstSweepNumber and write the sampled spin sums
+	void SweepOneReplica(const uint32_t replicaIndex, int* pArraySpinSumOutputs, const uint32_t firstSweepNumber, const uint32_t numberOfSweepsInTheInterval,
+		const uint32_t numberOfSpinSumSamplesPerBeta, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample);
+	// Try to swap the replicas of the beta pairs (firstPairIndex, firstPairIndex + 1), (firstPairIndex + 2, firstPairIndex + 3) and so on
+	void AttemptReplicaExchanges(const uint32_t firstPairIndex);
+
+public:
+	// Needs an even grid length. The sweeps per exchange are rounded up to an even number so every interval ends on a whole checkerboard sweep
+	cParallelTemperingEnsemble(const uint32_t isingL, const std::vector<double>& betaValues, const uint32_t sweepsPerReplicaExchange, const uint32_t numberOfThreads = 1);
+
+	uint32_t GetNumberOfTemperatures() const;
+	// The fraction of accepted swaps between betaValues[pairIndex] and betaValues[pairIndex + 1] since the last call of DoTheIsingGridSweepsParallelTemperingCPU started
+	double GetSwapAcceptanceRate(const uint32_t pairIndex) const;
+};
+
+void DoTheIsingGridSweepsParallelTemperingCPU(cParallelTemperingEnsemble* pTheEnsemble, int* pArraySpinSumOutputs,
+	const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample);
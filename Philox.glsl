@@ -0,0 +1,21 @@
+// Philox4x32-10, the counter-based generator of Salmon et al., "Parallel random numbers: as easy as 1, 2, 3" (SC11).
+// The four random numbers are a pure function of the counter and the key, so the kernels need no random state between dispatches.
+// Included by the Ising kernels with GL_GOOGLE_include_directive, glslc resolves it next to the kernel
+uvec4 Philox4x32(uvec4 counter, uvec2 key)
+{
+	const uint M0 = 0xD2511F53u;
+	const uint M1 = 0xCD9E8D57u;
+	const uint W0 = 0x9E3779B9u;																			// The golden ratio
+	const uint W1 = 0xBB67AE85u;																			// sqrt(3) - 1
+
+	for (uint round = 0; round < 10; round++)
+	{
+		uint hi0, lo0, hi1, lo1;
+		umulExtended(M0, counter.x, hi0, lo0);
+		umulExtended(M1, counter.z, hi1, lo1);
+		counter = uvec4(hi1 ^ counter.y ^ key.x, lo1, hi0 ^ counter.w ^ key.y, lo0);
+		key += uvec2(W0, W1);
+	}
+
+	return counter;
+}
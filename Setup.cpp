@@ -1,4 +1,5 @@
 #include "Setup.h"
+#include "EmbeddedShaders.h"
 #include <vulkan/vulkan.h>
 #include <fstream>
 #include <iostream>
@@ -16,6 +17,13 @@
 #include <iomanip>
 #include <cstring>
 #include <cstdlib>
+#include <algorithm>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
 
 //#define VKB_VALIDATION_LAYERS
 
@@ -164,35 +172,98 @@ uint32_t FindVulkanMemoryType(sVulkanContext& vulkanContext, uint32_t availableM
 
 /**********************************************************************/
 
-VkShaderModule LoadShaderModule(sVulkanContext& vulkanContext, const char* const spvFilename)
+std::filesystem::path GetExecutableDirectory()
 {
-	// Read the file in binary starting from the end
-	std::ifstream infile(spvFilename, std::ios_base::binary | std::ios_base::ate);
-	if (!infile.is_open())
+#if defined(_WIN32)
+	std::array<wchar_t, MAX_PATH> executablePath = {};
+	const DWORD executablePathLength = GetModuleFileNameW(nullptr, executablePath.data(), (DWORD)executablePath.size());
+	if (executablePathLength > 0 && executablePathLength < executablePath.size())
+	{
+		return std::filesystem::path(executablePath.data()).parent_path();
+	}
+#else
+	std::error_code errorCode;
+	const std::filesystem::path executablePath = std::filesystem::read_symlink("/proc/self/exe", errorCode);
+	if (!errorCode)
 	{
-		throw std::runtime_error("Failed to load SPIR-V file!");
+		return executablePath.parent_path();
 	}
+#endif
+
+	return std::filesystem::current_path();
+}
+
+/**********************************************************************/
+
+// Runs CompileShaders from the directory of the sources once per process, for an executable that was built without running it.
+// It writes the .spv files into the directory of the executable, a failure is left to the read of the missing file
+void CompileShadersOnce()
+{
+	static std::once_flag compileShadersOnceFlag;
+	std::call_once(compileShadersOnceFlag, []()
+	{
+		const std::filesystem::path sourceDirectory = std::filesystem::path(__FILE__).parent_path();
+#if defined(_WIN32)
+		const std::string compileShadersCommand = "call \"" + (sourceDirectory / "CompileShaders.bat").string() + "\" \"" + GetExecutableDirectory().string() + "\"";
+#else
+		const std::string compileShadersCommand = "sh \"" + (sourceDirectory / "CompileShaders.sh").string() + "\" \"" + GetExecutableDirectory().string() + "\"";
+#endif
+		std::cout << "SPIR-V file missing, running " << compileShadersCommand << std::endl;
+		if (std::system(compileShadersCommand.c_str()) != 0)
+		{
+			std::cout << "CompileShaders failed, is glslc on the path?" << std::endl;
+		}
+	});
+}
 
-	// Get the filesize in bytes
-	size_t fileSize = infile.tellg();
+/**********************************************************************/
+
+VkShaderModule LoadShaderModule(sVulkanContext& vulkanContext, const char* const spvFilename)
+{
+	// The kernels are embedded into the executable, the .spv files are only needed for the ones that were not
+	const sEmbeddedSpirv embeddedSpirv = FindEmbeddedSpirv(spvFilename);
+	std::vector<uint32_t> fileBuffer;
+	if (embeddedSpirv.pCode == nullptr)
+	{
+		// Read the file in binary starting from the end, from the directory of the executable so the working directory does not matter.
+		// Then from the working directory, where the .spv files are when the executable is started from the sources
+		const std::filesystem::path spvFilePath = GetExecutableDirectory() / spvFilename;
+		if (!std::filesystem::exists(spvFilePath) && !std::filesystem::exists(spvFilename))
+		{
+			CompileShadersOnce();
+		}
+		std::ifstream infile(spvFilePath, std::ios_base::binary | std::ios_base::ate);
+		if (!infile.is_open())
+		{
+			infile.open(spvFilename, std::ios_base::binary | std::ios_base::ate);
+		}
+		if (!infile.is_open())
+		{
+			throw std::runtime_error(std::string("Failed to load SPIR-V file ") + spvFilename + ", run CompileShaders first!");
+		}
 
-	std::vector<char> fileBuffer(fileSize);
-	infile.seekg(0);
-	infile.read(fileBuffer.data(), fileSize);
+		// Get the filesize in bytes
+		size_t fileSize = infile.tellg();
+
+		// uint32_t words, so the code is aligned like vkCreateShaderModule needs it
+		fileBuffer.resize((fileSize + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+		infile.seekg(0);
+		infile.read(reinterpret_cast<char*>(fileBuffer.data()), fileSize);
+		infile.close();
+	}
 
 	const VkShaderModuleCreateInfo shaderModuleCI =
 	{
 		VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
 		nullptr,
 		0,
-		fileBuffer.size(),
-		reinterpret_cast<uint32_t*>(fileBuffer.data())
+		(embeddedSpirv.pCode != nullptr) ? embeddedSpirv.codeByteSize : fileBuffer.size() * sizeof(uint32_t),
+		(embeddedSpirv.pCode != nullptr) ? embeddedSpirv.pCode : fileBuffer.data()
 	};
 
 	VkShaderModule shaderModule;
 	VK_CHECK(vkCreateShaderModule(vulkanContext.device, &shaderModuleCI, nullptr, &shaderModule));
 
-	infile.close();
 	return shaderModule;
 }
 
@@ -274,7 +345,7 @@ void CreateVulkanBufferAndMemoryAndBindBuffer(sVulkanContext& vulkanContext, VkD
 
 /**********************************************************************/
 
-void cSetup::DestroyVulkanBufferAndMore(sVulkanBufferAndMore& bufferAndMore)
+void cVulkanEngine::DestroyVulkanBufferAndMore(sVulkanBufferAndMore& bufferAndMore)
 {
 	vkQueueWaitIdle(context.computeQueue);
 	if (bufferAndMore.pVulkanBufferMemory != nullptr)
@@ -296,7 +367,7 @@ void cSetup::DestroyVulkanBufferAndMore(sVulkanBufferAndMore& bufferAndMore)
 
 /**********************************************************************/
 
-void cSetup::PrepareVulkanInstance(const std::vector<const char*>& requiredInstanceExtensions, const std::vector<const char*>& requiredValidationLayers)
+void cVulkanEngine::PrepareVulkanInstance(const std::vector<const char*>& requiredInstanceExtensions, const std::vector<const char*>& requiredValidationLayers)
 {
 	Log(""); // Start logging
 
@@ -406,7 +477,7 @@ void cSetup::PrepareVulkanInstance(const std::vector<const char*>& requiredInsta
 
 /**********************************************************************/
 
-void cSetup::PrepareVulkanDevice(const std::vector<const char*> requiredDeviceExtensions)
+void cVulkanEngine::PrepareVulkanDevice(const std::vector<const char*> requiredDeviceExtensions, const uint32_t deviceIndex)
 {
 	// ---- Find a GPU and a queue index of a graphics and compute queue ----
 	uint32_t numberOfGPUs = 0;
@@ -420,6 +491,8 @@ void cSetup::PrepareVulkanDevice(const std::vector<const char*> requiredDeviceEx
 	std::vector<VkPhysicalDevice> gpus(numberOfGPUs);
 	VK_CHECK(vkEnumeratePhysicalDevices(context.instance, &numberOfGPUs, gpus.data()));
 
+	uint32_t computeQueueCount = 1;
+	uint32_t numberOfComputeDevicesSkipped = 0;
 	for (uint32_t i = 0; i < numberOfGPUs && (context.computeQueueIndex < 0); i++)
 	{
 		context.gpu = gpus[i];
@@ -442,7 +515,14 @@ void cSetup::PrepareVulkanDevice(const std::vector<const char*> requiredDeviceEx
 		{
 			if (queueFamilyProperties[j].queueFlags & VK_QUEUE_COMPUTE_BIT)
 			{
+				if (numberOfComputeDevicesSkipped < deviceIndex)
+				{
+					numberOfComputeDevicesSkipped++;
+					break;
+				}
 				context.computeQueueIndex = j;
+				context.timestampValidBits = queueFamilyProperties[j].timestampValidBits;
+				computeQueueCount = queueFamilyProperties[j].queueCount;
 				break;
 			}
 		}
@@ -459,6 +539,22 @@ void cSetup::PrepareVulkanDevice(const std::vector<const char*> requiredDeviceEx
 		desiredLocalWorkGroupSize : context.gpuProperties.limits.maxComputeWorkGroupInvocations;
 	context.maxWorkGroupCountPerDispatchInX = context.gpuProperties.limits.maxComputeWorkGroupCount[0];
 
+	// The subgroup reduction of the spin sum needs subgroup arithmetic in compute shaders
+	VkPhysicalDeviceSubgroupProperties subgroupProperties =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+		.pNext = nullptr
+	};
+	VkPhysicalDeviceProperties2 gpuProperties2 =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		.pNext = &subgroupProperties
+	};
+	vkGetPhysicalDeviceProperties2(context.gpu, &gpuProperties2);
+	context.subgroupSize = subgroupProperties.subgroupSize;
+	context.bSubgroupArithmeticIsSupported = (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+		(subgroupProperties.supportedOperations & VK_SUBGROUP_FEATURE_ARITHMETIC_BIT);
+
 	// ---- Validate required device extensions ----
 	uint32_t numberOfAvailableDeviceExtensions = 0;
 	VK_CHECK(vkEnumerateDeviceExtensionProperties(context.gpu, nullptr, &numberOfAvailableDeviceExtensions, nullptr));
@@ -473,8 +569,21 @@ void cSetup::PrepareVulkanDevice(const std::vector<const char*> requiredDeviceEx
 
 	std::vector<const char*> activeDeviceExtensions(requiredDeviceExtensions);
 
+	// The heap budgets size the big buffers of the large lattices, without the extension they are estimated from the heap sizes
+	for (const VkExtensionProperties& availableDeviceExtensionProperty : availableDeviceExtensionProperties)
+	{
+		if (strcmp(availableDeviceExtensionProperty.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+		{
+			activeDeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+			context.bMemoryBudgetIsSupported = true;
+			break;
+		}
+	}
+
 	// ---- Device create info ----
-	const float computeQueuePriority = 1.0f;
+	// The samples of the spin sum sample ring are drained on a second queue of the compute queue family, so the copies run next to the sweeps.
+	// The same family, so the suballocated buffers need no queue family ownership transfer
+	const std::array<float, 2> computeQueuePriorities = { 1.0f, 1.0f };
 
 	VkDeviceQueueCreateInfo computeQueueCI =
 	{
@@ -482,14 +591,40 @@ void cSetup::PrepareVulkanDevice(const std::vector<const char*> requiredDeviceEx
 		nullptr,
 		0,
 		(uint32_t)context.computeQueueIndex,
-		1,
-		&computeQueuePriority
+		(computeQueueCount > 1) ? 2u : 1u,
+		computeQueuePriorities.data()
+	};
+
+	// The byte per spin kernel needs 8 bit storage buffer access, an optional feature of Vulkan 1.2. The moment reduction needs shaderFloat64
+	VkPhysicalDeviceVulkan12Features supportedVulkan12Features =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+		.pNext = nullptr
+	};
+	VkPhysicalDeviceFeatures2 supportedFeatures2 =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		.pNext = &supportedVulkan12Features
+	};
+	vkGetPhysicalDeviceFeatures2(context.gpu, &supportedFeatures2);
+	context.bStorageBuffer8BitAccessIsSupported = (supportedVulkan12Features.storageBuffer8BitAccess == VK_TRUE);
+	context.bShaderFloat64IsSupported = (supportedFeatures2.features.shaderFloat64 == VK_TRUE);
+	VkPhysicalDeviceFeatures enabledFeatures = {};
+	enabledFeatures.shaderFloat64 = context.bShaderFloat64IsSupported ? VK_TRUE : VK_FALSE;
+
+	// The finished temperatures are counted with a timeline semaphore (core in Vulkan 1.2, every 1.2 device supports it)
+	VkPhysicalDeviceVulkan12Features vulkan12Features =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+		.pNext = nullptr,
+		.storageBuffer8BitAccess = context.bStorageBuffer8BitAccessIsSupported ? VK_TRUE : VK_FALSE,
+		.timelineSemaphore = VK_TRUE
 	};
 
 	const VkDeviceCreateInfo deviceCI =
 	{
 		VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-		nullptr,
+		&vulkan12Features,
 		0,
 		1,
 		&computeQueueCI,
@@ -497,241 +632,340 @@ void cSetup::PrepareVulkanDevice(const std::vector<const char*> requiredDeviceEx
 		nullptr,										// Is ignored
 		(uint32_t)activeDeviceExtensions.size(),
 		activeDeviceExtensions.data(),
-		nullptr
+		&enabledFeatures
 	};
 
 	VK_CHECK(vkCreateDevice(context.gpu, &deviceCI, nullptr, &context.device));
 
 	// Get the queues
-	vkGetDeviceQueue(context.device, context.computeQueueIndex, 0, &context.computeQueue);;
+	vkGetDeviceQueue(context.device, context.computeQueueIndex, 0, &context.computeQueue);
+	context.sampleDrainQueue = context.computeQueue;
+	if (computeQueueCount > 1)
+	{
+		vkGetDeviceQueue(context.device, context.computeQueueIndex, 1, &context.sampleDrainQueue);
+	}
 }
 
 /**********************************************************************/
 
-void cSetup::PrepareVulkanSSBSpinBuffer(const uint32_t isingL)
+sVulkanMemoryRequirements cSetup::CalculateTheVulkanBufferByteSizes(const uint32_t isingL, const uint32_t numberOfSweepsPerTemperature,
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample)
 {
-	const uint32_t isingN = isingL * isingL;
-	const VkDeviceSize bufferByteSize = isingN * sizeof(uint32_t);
-	context.SSBSpinBufferByteSize = bufferByteSize;
-	int* pIsingGrid = new int[isingN];
+	const VkDeviceSize isingN = (VkDeviceSize)isingL * isingL;
+	if (computeShaderType == COMPUTE_SHADER_TYPE_1_INT_PER_SPIN || computeShaderType == COMPUTE_SHADER_TYPE_SHARED_MEMORY_TILED)
+	{
+		context.SSBSpinBufferByteSize = isingN * sizeof(int);
+	}
+	else if (computeShaderType == COMPUTE_SHADER_TYPE_BATCHED_REPLICAS)
+	{
+		context.SSBSpinBufferByteSize = numberOfReplicas * isingN * sizeof(int);
+	}
+	else if (computeShaderType == COMPUTE_SHADER_TYPE_1_BYTE_PER_SPIN_SUBLATTICES)
+	{
+		context.SSBSpinBufferByteSize = isingN * sizeof(int8_t);
+	}
+	else if (computeShaderType == COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN)
+	{
+		context.SSBSpinBatchesBufferByteSize = (isingN + 31) / 32 * sizeof(uint32_t);
+	}
+	else if (computeShaderType == COMPUTE_SHADER_TYPE_MULTI_SPIN_CODED)
+	{
+		context.SSBSpinWordsBufferByteSize = (VkDeviceSize)2 * isingL * ((isingL / 2 + 31) / 32) * sizeof(uint32_t);		// Both colours
+	}
+	if (randomNumberGeneratorType == RANDOM_NUMBER_GENERATOR_TYPE_XORSHIFT_STATE_PER_SPIN)
+	{
+		context.SSBRandomNumbersBufferByteSize = numberOfReplicas * isingN * sizeof(uint32_t);
+	}
+	context.SSBSpinSumBufferByteSize = numberOfReplicas * sizeof(sSpinSumStorageBufferObject);
 
-	// Align the spins
-	for (uint32_t i = 0; i < isingN; i++)
+	// One element for every sampled sweep of every replica, the same count per replica as the CPU runs use
+	const VkDeviceSize numberOfSpinSumSamples = (numberOfSweepsPerTemperature - numberOfSweepsToWaitBeforeSpinSumSamplingStarts - 1) / sweepsPerSpinSumSample + 1;
+	context.SSBSpinSumSamplesBufferByteSize = numberOfReplicas * numberOfSpinSumSamples * sizeof(int);
+	if (gpuSchedulingMode == GPU_SCHEDULING_MODE_REPLAY_SWEEP_BLOCKS && context.SSBSpinSumSamplesBufferByteSize > maxSpinSumSamplesBufferByteSize)
 	{
-		pIsingGrid[i] = 1;
+		// A half holds more samples than one sweep block writes, so a block never writes to a half it has to wait for the drain of. See SubmitTheSweepBlock
+		spinSumSampleRingHalfCapacity = std::max((uint32_t)(maxSpinSumSamplesBufferByteSize / (2 * numberOfReplicas * sizeof(int))), 2 * sweepsPerSweepBlock);
+		context.SSBSpinSumSamplesBufferByteSize = (VkDeviceSize)numberOfReplicas * 2 * spinSumSampleRingHalfCapacity * sizeof(int);
+		context.spinSumSampleDrainBufferByteSize = (VkDeviceSize)numberOfReplicas * spinSumSampleRingHalfCapacity * sizeof(int);
+	}
+	// With a ring the output buffers hold what the ring held at the end of the temperature
+	context.spinSumOutputBufferByteSize = context.SSBSpinSumSamplesBufferByteSize;
+	context.uniformBufferByteSize = (computeShaderType == COMPUTE_SHADER_TYPE_BATCHED_REPLICAS) ? sizeof(sBatchedReplicasUniformBufferObject) : sizeof(sUniformBufferObject);
+	// The reduction needs every sample of the temperature in the samples buffer, the ring only holds the last ones.
+	// Without its pipeline the moments buffers are left out, so the host sums the moments
+	if (context.bShaderFloat64IsSupported && spinSumSampleRingHalfCapacity == 0 && pTheVulkanEngine->GetMomentReductionPipeline() != VK_NULL_HANDLE)
+	{
+		context.SSBSpinSumMomentsBufferByteSize = sSpinSumMomentsStorageBufferObject::numberOfWorkGroups * sizeof(sSpinSumMomentsStorageBufferObject);
 	}
 
-	// Copy the spin grid to the staging buffer
-	assert(context.persistentStagingBuffer != VK_NULL_HANDLE);
-	void* pStagingBuffer = reinterpret_cast<char*>(context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory) +
-		context.persistentStagingBufferByteOffsetIntoTheBigHostVisibleBuffer;
-	std::memcpy(pStagingBuffer, pIsingGrid, bufferByteSize);
+	const VkDeviceSize slack = sVulkanMemoryRequirements::suballocationAlignmentSlack;
+	sVulkanMemoryRequirements memoryRequirements;
+	for (VkDeviceSize bufferByteSize : { context.SSBSpinBufferByteSize, context.SSBSpinBatchesBufferByteSize, context.SSBSpinWordsBufferByteSize,
+		context.SSBRandomNumbersBufferByteSize, context.SSBSpinSumBufferByteSize, context.SSBSpinSumSamplesBufferByteSize, context.SSBSpinSumMomentsBufferByteSize })
+	{
+		memoryRequirements.deviceLocalByteSize += (bufferByteSize > 0) ? bufferByteSize + slack : 0;
+	}
+	// The uniform buffer and its two staging buffers, and the spin sum output buffers and spin sum moments output buffers of both temperature slots
+	memoryRequirements.hostVisibleByteSize = 3 * (context.uniformBufferByteSize + slack) + 2 * (context.spinSumOutputBufferByteSize + slack);
+	if (context.SSBSpinSumMomentsBufferByteSize > 0)
+	{
+		memoryRequirements.hostVisibleByteSize += 2 * (context.SSBSpinSumMomentsBufferByteSize + slack);
+	}
+	if (context.spinSumSampleDrainBufferByteSize > 0)
+	{
+		memoryRequirements.hostVisibleByteSize += 2 * (context.spinSumSampleDrainBufferByteSize + slack);
+	}
+	return memoryRequirements;
+}
 
-	// Suballocate the spin buffer from the device local buffer
-	context.SSBSpinBuffer = SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, bufferByteSize, context.SSBSpinBufferByteOffsetIntoTheBigDeviceLocalBuffer);
+/**********************************************************************/
 
-	// Prepare the command pool, command buffer and copy region
-	VkCommandPool commandPool;
-	VkCommandBuffer commandBuffer;
-	CreateAndBeginOneTimeVulkanCommandBuffer(context, commandPool, commandBuffer);
+void cSetup::CheckTheCapacityOfTheDevice(const uint32_t isingL, const sVulkanMemoryRequirements& memoryRequirements) const
+{
+	const sVulkanContext& engineContext = pTheVulkanEngine->context;
+	const VkPhysicalDeviceLimits& limits = engineContext.gpuProperties.limits;
+	auto Megabytes = [](const VkDeviceSize byteSize) { return (byteSize + 999'999) / 1'000'000; };
+	std::ostringstream capacityReport;
 
-	const VkBufferCopy bufferCopyRegion =
+	// The spin sum and the spin indices of the kernels are 32 bit
+	if ((uint64_t)isingL * isingL > (uint64_t)std::numeric_limits<int>::max())
 	{
-		.srcOffset = 0,
-		.dstOffset = 0,
-		.size = bufferByteSize
-	};
-
-	vkCmdCopyBuffer(commandBuffer, context.persistentStagingBuffer, context.SSBSpinBuffer, 1, &bufferCopyRegion);
-
-	VK_CHECK(vkEndCommandBuffer(commandBuffer));
+		capacityReport << "  The " << (uint64_t)isingL * isingL << " spins overflow the 32 bit spin sum of the kernels, the grid length can be at most 46340.\n";
+	}
+	else if (CalculateNumberOfWorkGroupsInX(isingL) >= context.maxWorkGroupCountPerDispatchInX)
+	{
+		capacityReport << "  A sweep needs " << CalculateNumberOfWorkGroupsInX(isingL) << " workgroups, the device dispatches fewer than "
+			<< context.maxWorkGroupCountPerDispatchInX << ".\n";
+	}
 
-	// Submit the command buffer
-	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	const std::array<std::pair<const char*, VkDeviceSize>, 5> storageBufferByteSizes =
+	{ {
+		{ "spin", context.SSBSpinBufferByteSize },
+		{ "spin batches", context.SSBSpinBatchesBufferByteSize },
+		{ "spin words", context.SSBSpinWordsBufferByteSize },
+		{ "random numbers", context.SSBRandomNumbersBufferByteSize },
+		{ "spin sum samples", context.SSBSpinSumSamplesBufferByteSize }
+	} };
+	for (const auto& storageBufferByteSize : storageBufferByteSizes)
+	{
+		if (storageBufferByteSize.second > limits.maxStorageBufferRange)
+		{
+			capacityReport << "  The " << storageBufferByteSize.first << " buffer needs " << Megabytes(storageBufferByteSize.second)
+				<< " MB, the largest storage buffer of the device is " << limits.maxStorageBufferRange / 1'000'000 << " MB.\n";
+		}
+	}
 
-	VK_CHECK(vkQueueSubmit(context.computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
-	VK_CHECK(vkQueueWaitIdle(context.computeQueue));
+	// Only the big buffers the lattice does not fit into are replaced, by big buffers of exactly the size it needs
+	const VkDeviceSize deviceLocalByteSizeToAllocate = (memoryRequirements.deviceLocalByteSize > engineContext.bigDeviceLocalBufferBytesLeft) ?
+		memoryRequirements.deviceLocalByteSize : 0;
+	const VkDeviceSize hostVisibleByteSizeToAllocate = (memoryRequirements.hostVisibleByteSize > engineContext.bigHostVisibleVulkanBufferBytesLeft) ?
+		memoryRequirements.hostVisibleByteSize : 0;
+	const uint32_t deviceLocalHeapIndex = pTheVulkanEngine->GetMemoryHeapIndex(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	const uint32_t hostVisibleHeapIndex = pTheVulkanEngine->GetMemoryHeapIndex(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	if (deviceLocalHeapIndex == hostVisibleHeapIndex)
+	{
+		// One heap for both, like on integrated GPUs
+		const VkDeviceSize heapBudget = pTheVulkanEngine->GetMemoryHeapBudget(deviceLocalHeapIndex);
+		if (deviceLocalByteSizeToAllocate + hostVisibleByteSizeToAllocate > heapBudget)
+		{
+			capacityReport << "  The buffers need " << Megabytes(deviceLocalByteSizeToAllocate + hostVisibleByteSizeToAllocate)
+				<< " MB of memory, the budget of the heap leaves " << heapBudget / 1'000'000 << " MB.\n";
+		}
+	}
+	else
+	{
+		const VkDeviceSize deviceLocalHeapBudget = pTheVulkanEngine->GetMemoryHeapBudget(deviceLocalHeapIndex);
+		if (deviceLocalByteSizeToAllocate > deviceLocalHeapBudget)
+		{
+			capacityReport << "  The device local buffers need " << Megabytes(deviceLocalByteSizeToAllocate) << " MB, the budget of the device local heap leaves "
+				<< deviceLocalHeapBudget / 1'000'000 << " MB.\n";
+		}
+		const VkDeviceSize hostVisibleHeapBudget = pTheVulkanEngine->GetMemoryHeapBudget(hostVisibleHeapIndex);
+		if (hostVisibleByteSizeToAllocate > hostVisibleHeapBudget)
+		{
+			capacityReport << "  The host visible buffers need " << Megabytes(hostVisibleByteSizeToAllocate) << " MB, the budget of the host visible heap leaves "
+				<< hostVisibleHeapBudget / 1'000'000 << " MB.\n";
+		}
+	}
 
-	// Resource destruction
-	vkDestroyCommandPool(context.device, commandPool, nullptr);
-	delete[] pIsingGrid;
+	if (!capacityReport.str().empty())
+	{
+		throw std::runtime_error("The grid of length " + std::to_string(isingL) + " does not fit on " + engineContext.gpuProperties.deviceName + ":\n" + capacityReport.str());
+	}
 }
 
 /**********************************************************************/
 
-void cSetup::PrepareVulkanSSBRandomNumbersBuffer(const uint32_t isingL)
+void cSetup::UploadToDeviceLocalBuffer(VkBuffer buffer, VkDeviceSize bufferByteSize,
+	const std::function<void(void* pChunk, VkDeviceSize chunkByteOffset, VkDeviceSize chunkByteSize)>& WriteChunk)
 {
-	const uint32_t isingN = isingL * isingL;
-	const uint32_t randomSeed = (uint32_t) std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()) % std::numeric_limits<uint32_t>::max();
-	std::default_random_engine randomNumberGenerator(randomSeed);
+	assert(context.persistentStagingBufferAndMore.pVulkanBufferMemory != nullptr);
+	assert(context.persistentStagingBufferByteSize % sizeof(uint32_t) == 0);
+	for (VkDeviceSize chunkByteOffset = 0; chunkByteOffset < bufferByteSize; chunkByteOffset += context.persistentStagingBufferByteSize)
+	{
+		const VkDeviceSize chunkByteSize = std::min(context.persistentStagingBufferByteSize, bufferByteSize - chunkByteOffset);
+		WriteChunk(context.persistentStagingBufferAndMore.pVulkanBufferMemory, chunkByteOffset, chunkByteSize);
+
+		// Prepare the command pool, command buffer and copy region
+		VkCommandPool commandPool;
+		VkCommandBuffer commandBuffer;
+		CreateAndBeginOneTimeVulkanCommandBuffer(context, commandPool, commandBuffer);
+		try
+		{
+			const VkBufferCopy bufferCopyRegion =
+			{
+				.srcOffset = 0,
+				.dstOffset = chunkByteOffset,
+				.size = chunkByteSize
+			};
 
-	const VkDeviceSize bufferByteSize = isingN * sizeof(uint32_t);
-	context.SSBRandomNumbersBufferByteSize = bufferByteSize;
-	uint32_t* pRandomNumbers = new uint32_t [isingN];
+			vkCmdCopyBuffer(commandBuffer, context.persistentStagingBufferAndMore.buffer, buffer, 1, &bufferCopyRegion);
 
-	for (uint32_t i = 0; i < isingN; i++)
-	{
-		pRandomNumbers[i] = randomNumberGenerator();
-	}
+			VK_CHECK(vkEndCommandBuffer(commandBuffer));
 
-	assert(context.persistentStagingBuffer != VK_NULL_HANDLE);
-	void* pStagingBuffer = reinterpret_cast<char*>(context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory) + context.persistentStagingBufferByteOffsetIntoTheBigHostVisibleBuffer;
-	std::memcpy(pStagingBuffer, pRandomNumbers, bufferByteSize);
+			// Submit the command buffer, the next chunk overwrites the staging buffer
+			VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &commandBuffer;
 
-	context.SSBRandomNumbersBuffer = SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, bufferByteSize, context.SSBRandomNumbersBufferByteOffsetIntoTheBigDeviceLocalBuffer);
+			VK_CHECK(vkQueueSubmit(context.computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
+			VK_CHECK(vkQueueWaitIdle(context.computeQueue));
+		}
+		catch (...)
+		{
+			vkDestroyCommandPool(context.device, commandPool, nullptr);
+			throw;
+		}
 
-	// Prepare the command pool, command buffer and copy region
-	VkCommandPool commandPool;
-	VkCommandBuffer commandBuffer;
-	CreateAndBeginOneTimeVulkanCommandBuffer(context, commandPool, commandBuffer);
+		// Resource destruction
+		vkDestroyCommandPool(context.device, commandPool, nullptr);
+	}
+}
 
-	const VkBufferCopy bufferCopyRegion =
-	{
-		.srcOffset = 0,
-		.dstOffset = 0,
-		.size = bufferByteSize
-	};
+/**********************************************************************/
 
-	vkCmdCopyBuffer(commandBuffer, context.persistentStagingBuffer, context.SSBRandomNumbersBuffer, 1, &bufferCopyRegion);
+void cSetup::PrepareVulkanSSBSpinBuffer()
+{
+	// Suballocate the spin buffer from the device local buffer
+	context.SSBSpinBuffer = pTheVulkanEngine->SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, context.SSBSpinBufferByteSize, context.SSBSpinBufferByteOffsetIntoTheBigDeviceLocalBuffer);
 
-	VK_CHECK(vkEndCommandBuffer(commandBuffer));
+	// Align the spins. All of them are +1, so the row by row grid needs no reordering into the colour by colour grid of COMPUTE_SHADER_TYPE_1_BYTE_PER_SPIN_SUBLATTICES
+	if (computeShaderType == COMPUTE_SHADER_TYPE_1_BYTE_PER_SPIN_SUBLATTICES)
+	{
+		UploadToDeviceLocalBuffer(context.SSBSpinBuffer, context.SSBSpinBufferByteSize, [](void* pChunk, VkDeviceSize, VkDeviceSize chunkByteSize)
+			{
+				std::fill_n(reinterpret_cast<int8_t*>(pChunk), chunkByteSize / sizeof(int8_t), (int8_t)1);
+			});
+		return;
+	}
+	UploadToDeviceLocalBuffer(context.SSBSpinBuffer, context.SSBSpinBufferByteSize, [](void* pChunk, VkDeviceSize, VkDeviceSize chunkByteSize)
+		{
+			std::fill_n(reinterpret_cast<int*>(pChunk), chunkByteSize / sizeof(int), 1);
+		});
+}
 
-	// Submit the command buffer
-	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+/**********************************************************************/
 
-	VK_CHECK(vkQueueSubmit(context.computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
-	VK_CHECK(vkQueueWaitIdle(context.computeQueue));
+void cSetup::PrepareVulkanSSBRandomNumbersBuffer()
+{
+	context.SSBRandomNumbersBuffer = pTheVulkanEngine->SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, context.SSBRandomNumbersBufferByteSize, context.SSBRandomNumbersBufferByteOffsetIntoTheBigDeviceLocalBuffer);
 
-	// Resource destruction
-	vkDestroyCommandPool(context.device, commandPool, nullptr);
-	delete[] pRandomNumbers;
+	UploadTheXORShiftStates();
 }
 
 /**********************************************************************/
 
-void cSetup::PrepareVulkanSSBSpinSumBuffer(const uint32_t isingL)
+void cSetup::UploadTheXORShiftStates()
 {
-	const VkDeviceSize bufferByteSize = sizeof(int);
-	context.SSBSpinSumBufferByteSize = bufferByteSize;
-	const uint32_t isingN = isingL * isingL;
-	const int startSpinSum = isingN;
-	
-	assert(context.persistentStagingBuffer != VK_NULL_HANDLE);
-	void* pStagingBuffer = reinterpret_cast<char*>(context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory) + context.persistentStagingBufferByteOffsetIntoTheBigHostVisibleBuffer;
-	std::memcpy(pStagingBuffer, &startSpinSum, bufferByteSize);
+	std::default_random_engine randomNumberGenerator((uint32_t)(randomSeed ^ (randomSeed >> 32)));
 
-	context.SSBSpinSumBuffer = SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		bufferByteSize, context.SSBSpinSumBufferByteOffsetIntoTheBigDeviceLocalBuffer
-	);
+	// The chunks are written in order, so the random numbers are the same as with one upload
+	UploadToDeviceLocalBuffer(context.SSBRandomNumbersBuffer, context.SSBRandomNumbersBufferByteSize, [&](void* pChunk, VkDeviceSize, VkDeviceSize chunkByteSize)
+		{
+			uint32_t* pRandomNumbers = reinterpret_cast<uint32_t*>(pChunk);
+			for (VkDeviceSize i = 0; i < chunkByteSize / sizeof(uint32_t); i++)
+			{
+				pRandomNumbers[i] = randomNumberGenerator();
+			}
+		});
+}
 
-	// Prepare the command pool, command buffer and copy region
-	VkCommandPool commandPool;
-	VkCommandBuffer commandBuffer;
-	CreateAndBeginOneTimeVulkanCommandBuffer(context, commandPool, commandBuffer);
+/**********************************************************************/
 
-	const VkBufferCopy bufferCopyRegion =
+void cSetup::PrepareVulkanSSBSpinSumBuffer(const uint32_t isingL)
+{
+	const sSpinSumStorageBufferObject startSpinSumStorageBufferObject =
 	{
-		.srcOffset = 0,
-		.dstOffset = 0,
-		.size = bufferByteSize
+		.spinSum = (int)(isingL * isingL),
+		.pendingSweepNumber = sSpinSumStorageBufferObject::noPendingSweep,
+		.dispatchNumbers = {},
+		.spinSumChanges = {}
 	};
-	
-	vkCmdCopyBuffer(commandBuffer, context.persistentStagingBuffer, context.SSBSpinSumBuffer, 1, &bufferCopyRegion);
-
-	VK_CHECK(vkEndCommandBuffer(commandBuffer));
-
-	// Submit the command buffer
-	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
 
-	VK_CHECK(vkQueueSubmit(context.computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
-	VK_CHECK(vkQueueWaitIdle(context.computeQueue));
+	context.SSBSpinSumBuffer = pTheVulkanEngine->SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		context.SSBSpinSumBufferByteSize, context.SSBSpinSumBufferByteOffsetIntoTheBigDeviceLocalBuffer
+	);
 
-	// Resource destruction
-	vkDestroyCommandPool(context.device, commandPool, nullptr);
+	// One spin sum per replica, the staging buffer holds a lot more than the most replicas
+	UploadToDeviceLocalBuffer(context.SSBSpinSumBuffer, context.SSBSpinSumBufferByteSize, [&](void* pChunk, VkDeviceSize, VkDeviceSize chunkByteSize)
+		{
+			std::fill_n(reinterpret_cast<sSpinSumStorageBufferObject*>(pChunk), chunkByteSize / sizeof(sSpinSumStorageBufferObject), startSpinSumStorageBufferObject);
+		});
 }
 
 /**********************************************************************/
 
-void cSetup::PrepareVulkanSpinSumOutputBuffer(const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample)
+void cSetup::PrepareVulkanSSBSpinSumSamplesBuffer()
 {
-	context.spinSumOutputBufferByteSize = (VkDeviceSize)
-		std::ceil((double)(numberOfSweepsPerTemperature - numberOfSweepsToWaitBeforeSpinSumSamplingStarts - 1) / sweepsPerSpinSumSample)
-		* sizeof(int);
-	
-	context.spinSumOutputBuffer = SuballocateBufferFromTheBigHostVisibleVulkanBuffer(
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT, context.spinSumOutputBufferByteSize, context.spinSumOutputBufferByteOffsetIntoTheBigHostVisibleBuffer
+	// Every element is written by the kernels before it is copied, so the buffer needs no start values
+	context.SSBSpinSumSamplesBuffer = pTheVulkanEngine->SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, context.SSBSpinSumSamplesBufferByteSize,
+		context.SSBSpinSumSamplesBufferByteOffsetIntoTheBigDeviceLocalBuffer
 	);
 }
 
 /**********************************************************************/
 
-void cSetup::PrepareDescriptorSet(const uint32_t isingL, eComputeShaderType computeShaderType)
+void cSetup::PrepareVulkanSpinSumOutputBuffer()
 {
-	// Descriptor set layout
-	std::array<VkDescriptorSetLayoutBinding, 4> descriptorSetLayoutBindings;
-	// binding = 0 <=> spin buffer or spin batches buffer
-	descriptorSetLayoutBindings[0] =
-	{
-		0,
-		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		1,
-		VK_SHADER_STAGE_COMPUTE_BIT,
-		nullptr
-	};
-	// binding = 1 <=> random numbers buffer
-	descriptorSetLayoutBindings[1] =
-	{
-		1,
-		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		1,
-		VK_SHADER_STAGE_COMPUTE_BIT,
-		nullptr
-	};
-	// binding = 2 <=> spin sum buffer
-	descriptorSetLayoutBindings[2] =
-	{
-		2,
-		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		1,
-		VK_SHADER_STAGE_COMPUTE_BIT,
-		nullptr
-	};
-	// binding = 3 <=> uniform buffer
-	descriptorSetLayoutBindings[3] =
+	for (uint32_t i = 0; i < 2; i++)
 	{
-		3,
-		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-		1,
-		VK_SHADER_STAGE_COMPUTE_BIT,
-		nullptr
-	};
+		context.spinSumOutputBuffers[i] = pTheVulkanEngine->SuballocateBufferFromTheBigHostVisibleVulkanBuffer(
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT, context.spinSumOutputBufferByteSize, context.spinSumOutputBufferByteOffsetsIntoTheBigHostVisibleBuffer[i]
+		);
+	}
+}
 
-	const VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI =
+/**********************************************************************/
+
+void cSetup::PrepareVulkanSpinSumMomentsBuffers()
+{
+	// Every workgroup of the reduction writes its sums before they are copied, so the buffers need no start values
+	context.SSBSpinSumMomentsBuffer = pTheVulkanEngine->SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, context.SSBSpinSumMomentsBufferByteSize,
+		context.SSBSpinSumMomentsBufferByteOffsetIntoTheBigDeviceLocalBuffer
+	);
+	for (uint32_t i = 0; i < 2; i++)
 	{
-		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		nullptr,
-		0,
-		(uint32_t)descriptorSetLayoutBindings.size(),
-		descriptorSetLayoutBindings.data()
-	};
+		context.spinSumMomentsOutputBuffers[i] = pTheVulkanEngine->SuballocateBufferFromTheBigHostVisibleVulkanBuffer(
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT, context.SSBSpinSumMomentsBufferByteSize, context.spinSumMomentsOutputBufferByteOffsetsIntoTheBigHostVisibleBuffer[i]
+		);
+	}
+}
 
-	VK_CHECK(vkCreateDescriptorSetLayout(context.device, &descriptorSetLayoutCI, nullptr, &context.descriptorSetLayout));
+/**********************************************************************/
 
+void cSetup::PrepareDescriptorSet(const uint32_t isingL, eComputeShaderType computeShaderType)
+{
 	// Descriptor pool
 	std::array<VkDescriptorPoolSize, 2> descriptorPoolSizes;
 	descriptorPoolSizes[0] =
 	{
 		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		3
+		5
 	};
 	descriptorPoolSizes[1] =
 	{
@@ -763,9 +997,10 @@ void cSetup::PrepareDescriptorSet(const uint32_t isingL, eComputeShaderType comp
 
 	VK_CHECK(vkAllocateDescriptorSets(context.device, &descriptorSetAllocateInfo, &context.descriptorSet));
 
-	// Write the descriptor set (binding 0, 1, 2, and 3)
+	// Write the descriptor set (binding 0, 1, 2, 3 and 4, and 5 with shaderFloat64)
 	VkDescriptorBufferInfo SSBSpinBufferOrSpinBatchesBufferDescriptorBufferInfo;
-	if (computeShaderType == COMPUTE_SHADER_TYPE_1_INT_PER_SPIN)
+	if (computeShaderType == COMPUTE_SHADER_TYPE_1_INT_PER_SPIN || computeShaderType == COMPUTE_SHADER_TYPE_SHARED_MEMORY_TILED ||
+		computeShaderType == COMPUTE_SHADER_TYPE_1_BYTE_PER_SPIN_SUBLATTICES || computeShaderType == COMPUTE_SHADER_TYPE_BATCHED_REPLICAS)
 	{
 		SSBSpinBufferOrSpinBatchesBufferDescriptorBufferInfo =
 		{
@@ -783,12 +1018,22 @@ void cSetup::PrepareDescriptorSet(const uint32_t isingL, eComputeShaderType comp
 			context.SSBSpinBatchesBufferByteSize
 		};
 	}
+	else if (computeShaderType == COMPUTE_SHADER_TYPE_MULTI_SPIN_CODED)
+	{
+		SSBSpinBufferOrSpinBatchesBufferDescriptorBufferInfo =
+		{
+			context.SSBSpinWordsBuffer,
+			0,
+			context.SSBSpinWordsBufferByteSize
+		};
+	}
 
+	// The Philox kernels never touch binding 1, but it is statically used, so it must hold a valid buffer. The spin sum buffer stands in
 	const VkDescriptorBufferInfo SSBRandomNumbersBufferDescriptorBufferInfo =
 	{
-		context.SSBRandomNumbersBuffer,
+		(context.SSBRandomNumbersBuffer != VK_NULL_HANDLE) ? context.SSBRandomNumbersBuffer : context.SSBSpinSumBuffer,
 		0,
-		context.SSBRandomNumbersBufferByteSize
+		(context.SSBRandomNumbersBuffer != VK_NULL_HANDLE) ? context.SSBRandomNumbersBufferByteSize : context.SSBSpinSumBufferByteSize
 	};
 
 	const VkDescriptorBufferInfo SSBSpinSumBufferDescriptorBufferInfo =
@@ -805,7 +1050,21 @@ void cSetup::PrepareDescriptorSet(const uint32_t isingL, eComputeShaderType comp
 		context.uniformBufferByteSize
 	};
 
-	std::array<VkWriteDescriptorSet, 4> descriptorSetWrites;
+	const VkDescriptorBufferInfo SSBSpinSumSamplesBufferDescriptorBufferInfo =
+	{
+		context.SSBSpinSumSamplesBuffer,
+		0,
+		context.SSBSpinSumSamplesBufferByteSize
+	};
+
+	const VkDescriptorBufferInfo SSBSpinSumMomentsBufferDescriptorBufferInfo =
+	{
+		context.SSBSpinSumMomentsBuffer,
+		0,
+		context.SSBSpinSumMomentsBufferByteSize
+	};
+
+	std::array<VkWriteDescriptorSet, 6> descriptorSetWrites;
 
 	// binding = 0 <=> spin buffer
 	descriptorSetWrites[0] =
@@ -867,22 +1126,121 @@ void cSetup::PrepareDescriptorSet(const uint32_t isingL, eComputeShaderType comp
 		nullptr
 	};
 
-	vkUpdateDescriptorSets(context.device, (uint32_t)descriptorSetWrites.size(), descriptorSetWrites.data(), 0, nullptr);
-}
-
-/**********************************************************************/
-
-void cSetup::PrepareComputePipeline(eComputeShaderType computeShaderType)
-{
-	// Push constant info
-	const VkPushConstantRange pushConstantRange =
+	// binding = 4 <=> spin sum samples buffer
+	descriptorSetWrites[4] =
 	{
-		VK_SHADER_STAGE_COMPUTE_BIT,
-		0,
-		sizeof(sPushConstantObject)
+		VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		nullptr,
+		context.descriptorSet,
+		4,
+		0,
+		1,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		nullptr,
+		&SSBSpinSumSamplesBufferDescriptorBufferInfo,
+		nullptr
+	};
+
+	// binding = 5 <=> spin sum moments buffer, only used by the moment reduction
+	descriptorSetWrites[5] =
+	{
+		VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		nullptr,
+		context.descriptorSet,
+		5,
+		0,
+		1,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		nullptr,
+		&SSBSpinSumMomentsBufferDescriptorBufferInfo,
+		nullptr
+	};
+
+	const uint32_t numberOfDescriptorSetWrites = (context.SSBSpinSumMomentsBuffer != VK_NULL_HANDLE) ? 6 : 5;
+	vkUpdateDescriptorSets(context.device, numberOfDescriptorSetWrites, descriptorSetWrites.data(), 0, nullptr);
+}
+
+/**********************************************************************/
+
+void cVulkanEngine::PrepareDescriptorSetLayoutAndPipelineLayout()
+{
+	// Descriptor set layout
+	std::array<VkDescriptorSetLayoutBinding, 6> descriptorSetLayoutBindings;
+	// binding = 0 <=> spin buffer or spin batches buffer
+	descriptorSetLayoutBindings[0] =
+	{
+		0,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		nullptr
+	};
+	// binding = 1 <=> random numbers buffer
+	descriptorSetLayoutBindings[1] =
+	{
+		1,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		nullptr
+	};
+	// binding = 2 <=> spin sum buffer
+	descriptorSetLayoutBindings[2] =
+	{
+		2,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		nullptr
+	};
+	// binding = 3 <=> uniform buffer
+	descriptorSetLayoutBindings[3] =
+	{
+		3,
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+		1,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		nullptr
+	};
+	// binding = 4 <=> spin sum samples buffer
+	descriptorSetLayoutBindings[4] =
+	{
+		4,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		nullptr
+	};
+	// binding = 5 <=> spin sum moments buffer
+	descriptorSetLayoutBindings[5] =
+	{
+		5,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		nullptr
+	};
+
+	const VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI =
+	{
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		nullptr,
+		0,
+		(uint32_t)descriptorSetLayoutBindings.size(),
+		descriptorSetLayoutBindings.data()
+	};
+
+	VK_CHECK(vkCreateDescriptorSetLayout(context.device, &descriptorSetLayoutCI, nullptr, &context.descriptorSetLayout));
+
+	// Push constant info
+	const VkPushConstantRange pushConstantRange =
+	{
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		0,
+		sizeof(sPushConstantObject)
 	};
 
-	// Create the compute pipeline layout first
+	// The compute pipeline layout
 	const VkPipelineLayoutCreateInfo pipelineLayoutCI =
 	{
 		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
@@ -895,22 +1253,53 @@ void cSetup::PrepareComputePipeline(eComputeShaderType computeShaderType)
 	};
 
 	VK_CHECK(vkCreatePipelineLayout(context.device, &pipelineLayoutCI, nullptr, &context.computePipelineLayout));
+}
+
+/**********************************************************************/
 
-	// Use specialization constants to pass in context.localWorkGroupSizeInX to the kernel
-	const VkSpecializationMapEntry specializationMapEntry =
+VkPipeline cVulkanEngine::GetComputePipeline(eComputeShaderType computeShaderType, eSpinSumReductionType spinSumReductionType, const sTiledKernelParameters& tiledKernelParameters,
+	eRandomNumberGeneratorType randomNumberGeneratorType)
+{
+	// The other kernels do not have constants 2 to 4, so their tile is left out of the key and they share one pipeline for every tile
+	std::array<uint32_t, 6> computePipelineKey = { (uint32_t)computeShaderType, (uint32_t)spinSumReductionType, 0, 0, 0, (uint32_t)randomNumberGeneratorType };
+	if (computeShaderType == COMPUTE_SHADER_TYPE_SHARED_MEMORY_TILED)
 	{
-		0,
-		0,
-		sizeof(uint32_t)
-	};
+		computePipelineKey[2] = tiledKernelParameters.tileWidth;
+		computePipelineKey[3] = tiledKernelParameters.tileHeight;
+		computePipelineKey[4] = tiledKernelParameters.sweepsPerDispatch;
+	}
+
+	// Also held while the pipeline is created, so a cSetup waits for the precompile thread instead of compiling the same pipeline again
+	std::lock_guard<std::mutex> lock(computePipelinesMutex);
+	const auto computePipelineIterator = computePipelines.find(computePipelineKey);
+	if (computePipelineIterator != computePipelines.end())
+	{
+		return computePipelineIterator->second;
+	}
+
+	// Use specialization constants to pass in context.localWorkGroupSizeInX, the spin sum reduction type, the tile of the tiled kernel
+	// and the random number generator type to the kernel
+	const std::array<uint32_t, 6> specializationData = { context.localWorkGroupSizeInX, (uint32_t)spinSumReductionType,
+		tiledKernelParameters.tileWidth, tiledKernelParameters.tileHeight, tiledKernelParameters.sweepsPerDispatch, (uint32_t)randomNumberGeneratorType };
+	const std::array<VkSpecializationMapEntry, 6> specializationMapEntries =
+	{ {
+		{ 0, 0, sizeof(uint32_t) },
+		{ 1, 1 * sizeof(uint32_t), sizeof(uint32_t) },
+		{ 2, 2 * sizeof(uint32_t), sizeof(uint32_t) },
+		{ 3, 3 * sizeof(uint32_t), sizeof(uint32_t) },
+		{ 4, 4 * sizeof(uint32_t), sizeof(uint32_t) },
+		{ 5, 5 * sizeof(uint32_t), sizeof(uint32_t) }
+	} };
 	const VkSpecializationInfo specializationInfo =
 	{
-		1,
-		&specializationMapEntry,
-		sizeof(uint32_t),
-		&context.localWorkGroupSizeInX
+		(uint32_t)specializationMapEntries.size(),
+		specializationMapEntries.data(),
+		sizeof(specializationData),
+		specializationData.data()
 	};
 
+	// Every kernel is also compiled without GL_KHR_shader_subgroup_arithmetic, a device without the extension could not load the SPIR-V that enables it
+	const bool bUseSubgroupArithmetic = (spinSumReductionType == SPIN_SUM_REDUCTION_TYPE_SUBGROUP_ARITHMETIC);
 	VkPipelineShaderStageCreateInfo shaderStageCI;
 
 	if (computeShaderType == COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN)
@@ -921,7 +1310,7 @@ void cSetup::PrepareComputePipeline(eComputeShaderType computeShaderType)
 			nullptr,
 			0,
 			VK_SHADER_STAGE_COMPUTE_BIT,
-			LoadShaderModule(context, "IsingKernelOneBitPerSpin.spv"),
+			LoadShaderModule(context, bUseSubgroupArithmetic ? "IsingKernelOneBitPerSpin.spv" : "IsingKernelOneBitPerSpinNoSubgroupArithmetic.spv"),
 			"main",
 			&specializationInfo
 		};
@@ -934,7 +1323,59 @@ void cSetup::PrepareComputePipeline(eComputeShaderType computeShaderType)
 			nullptr,
 			0,
 			VK_SHADER_STAGE_COMPUTE_BIT,
-			LoadShaderModule(context, "IsingKernelOneIntPerSpin.spv"),
+			LoadShaderModule(context, bUseSubgroupArithmetic ? "IsingKernelOneIntPerSpin.spv" : "IsingKernelOneIntPerSpinNoSubgroupArithmetic.spv"),
+			"main",
+			&specializationInfo
+		};
+	}
+	else if (computeShaderType == COMPUTE_SHADER_TYPE_MULTI_SPIN_CODED)
+	{
+		shaderStageCI =
+		{
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			nullptr,
+			0,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			LoadShaderModule(context, bUseSubgroupArithmetic ? "IsingKernelMultiSpinCoded.spv" : "IsingKernelMultiSpinCodedNoSubgroupArithmetic.spv"),
+			"main",
+			&specializationInfo
+		};
+	}
+	else if (computeShaderType == COMPUTE_SHADER_TYPE_SHARED_MEMORY_TILED)
+	{
+		shaderStageCI =
+		{
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			nullptr,
+			0,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			LoadShaderModule(context, bUseSubgroupArithmetic ? "IsingKernelSharedMemoryTiled.spv" : "IsingKernelSharedMemoryTiledNoSubgroupArithmetic.spv"),
+			"main",
+			&specializationInfo
+		};
+	}
+	else if (computeShaderType == COMPUTE_SHADER_TYPE_1_BYTE_PER_SPIN_SUBLATTICES)
+	{
+		shaderStageCI =
+		{
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			nullptr,
+			0,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			LoadShaderModule(context, bUseSubgroupArithmetic ? "IsingKernelOneBytePerSpinSublattices.spv" : "IsingKernelOneBytePerSpinSublatticesNoSubgroupArithmetic.spv"),
+			"main",
+			&specializationInfo
+		};
+	}
+	else if (computeShaderType == COMPUTE_SHADER_TYPE_BATCHED_REPLICAS)
+	{
+		shaderStageCI =
+		{
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			nullptr,
+			0,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			LoadShaderModule(context, bUseSubgroupArithmetic ? "IsingKernelBatchedReplicas.spv" : "IsingKernelBatchedReplicasNoSubgroupArithmetic.spv"),
 			"main",
 			&specializationInfo
 		};
@@ -952,10 +1393,90 @@ void cSetup::PrepareComputePipeline(eComputeShaderType computeShaderType)
 		0
 	};
 
-	VK_CHECK(vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, nullptr, &context.computePipeline));
+	VkPipeline computePipeline;
+	VK_CHECK(vkCreateComputePipelines(context.device, pipelineCache, 1, &computePipelineCI, nullptr, &computePipeline));
 
 	// Destroy the shader module
 	vkDestroyShaderModule(context.device, shaderStageCI.module, nullptr);
+
+	computePipelines[computePipelineKey] = computePipeline;
+	return computePipeline;
+}
+
+/**********************************************************************/
+
+VkPipeline cVulkanEngine::GetMomentReductionPipeline()
+{
+	std::lock_guard<std::mutex> lock(computePipelinesMutex);
+	if (momentReductionPipeline != VK_NULL_HANDLE || bMomentReductionPipelineFailed)
+	{
+		return momentReductionPipeline;
+	}
+
+	// The reduction only has the workgroup size as a specialization constant
+	const VkSpecializationMapEntry specializationMapEntry = { 0, 0, sizeof(uint32_t) };
+	const VkSpecializationInfo specializationInfo =
+	{
+		1,
+		&specializationMapEntry,
+		sizeof(context.localWorkGroupSizeInX),
+		&context.localWorkGroupSizeInX
+	};
+
+	// Without its SPIR-V or if the driver rejects it the host sums the moments, the reduction only saves reading the samples
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	try
+	{
+		shaderModule = LoadShaderModule(context, "SpinSumMomentReduction.spv");
+	}
+	catch (const std::exception&)
+	{
+		bMomentReductionPipelineFailed = true;
+		return VK_NULL_HANDLE;
+	}
+
+	const VkPipelineShaderStageCreateInfo shaderStageCI =
+	{
+		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		nullptr,
+		0,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		shaderModule,
+		"main",
+		&specializationInfo
+	};
+
+	const VkComputePipelineCreateInfo computePipelineCI =
+	{
+		VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		nullptr,
+		0,
+		shaderStageCI,
+		context.computePipelineLayout,
+		VK_NULL_HANDLE,
+		0
+	};
+
+	if (vkCreateComputePipelines(context.device, pipelineCache, 1, &computePipelineCI, nullptr, &momentReductionPipeline) != VK_SUCCESS)
+	{
+		momentReductionPipeline = VK_NULL_HANDLE;
+		bMomentReductionPipelineFailed = true;
+	}
+
+	vkDestroyShaderModule(context.device, shaderModule, nullptr);
+
+	return momentReductionPipeline;
+}
+
+/**********************************************************************/
+
+void cSetup::PrepareComputePipeline(eComputeShaderType computeShaderType)
+{
+	context.computePipeline = pTheVulkanEngine->GetComputePipeline(computeShaderType, spinSumReductionType, tiledKernelParameters, randomNumberGeneratorType);
+	if (context.SSBSpinSumMomentsBuffer != VK_NULL_HANDLE)
+	{
+		context.momentReductionPipeline = pTheVulkanEngine->GetMomentReductionPipeline();
+	}
 }
 
 /**********************************************************************/
@@ -986,71 +1507,951 @@ void cSetup::PrepareCommandPoolAndCommandBuffer()
 
 /**********************************************************************/
 
-void cSetup::WriteToUniformBufferAndUpdateDescriptorSet(const double beta, const uint32_t isingL)
+sUniformBufferObject cSetup::CreateUniformBufferObject(const double beta, const uint32_t isingL, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+	const uint32_t sweepsPerSpinSumSample) const
 {
 	const uint32_t isingN = isingL * isingL;
 	
 	// Prepare the UBO with data
+	const cAcceptanceTable TheAcceptanceTable(beta);
 	sUniformBufferObject ubo;
-	ubo.transitionProbability4 = (uint32_t)std::ceil(std::exp(-beta * 4.0) * 100'000'000);
-	ubo.transitionProbability8 = (uint32_t)std::ceil(std::exp(-beta * 8.0) * 100'000'000);
+	std::copy(TheAcceptanceTable.GetAcceptanceThresholds().begin(), TheAcceptanceTable.GetAcceptanceThresholds().end(), ubo.acceptanceThresholds);
 	ubo.isingL = isingL;
 	ubo.isingN = isingN;
+	ubo.numberOfSweepsToWaitBeforeSpinSumSamplingStarts = numberOfSweepsToWaitBeforeSpinSumSamplingStarts;
+	ubo.sweepsPerSpinSumSample = sweepsPerSpinSumSample;
+	ubo.randomSeed[0] = (uint32_t)randomSeed;
+	ubo.randomSeed[1] = (uint32_t)(randomSeed >> 32);
+	ubo.temperatureNumber = (uint32_t)lastSubmittedTemperatureNumber;											// Both callers count the temperature first
+	ubo.spinSumSamplesBufferCapacity = (uint32_t)(context.SSBSpinSumSamplesBufferByteSize / sizeof(int) / numberOfReplicas);
+
+	return ubo;
+}
+
+/**********************************************************************/
+
+void cSetup::WriteTheUniformBufferObject(void* pUniformBuffer, const std::vector<double>& betaOfEveryReplica, const uint32_t isingL,
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample) const
+{
+	const sUniformBufferObject ubo = CreateUniformBufferObject(betaOfEveryReplica[0], isingL, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+	if (computeShaderType != COMPUTE_SHADER_TYPE_BATCHED_REPLICAS)
+	{
+		std::memcpy(pUniformBuffer, &ubo, sizeof(ubo));
+		return;
+	}
+
+	// The thresholds of the replicas that are not swept stay 0
+	sBatchedReplicasUniformBufferObject batchedReplicasUbo;
+	batchedReplicasUbo.ubo = ubo;
+	batchedReplicasUbo.numberOfReplicas = numberOfReplicas;
+	for (uint32_t i = 0; i < numberOfReplicas; i++)
+	{
+		const cAcceptanceTable TheAcceptanceTable(betaOfEveryReplica[i]);
+		std::copy(TheAcceptanceTable.GetAcceptanceThresholds().begin(), TheAcceptanceTable.GetAcceptanceThresholds().end(),
+			batchedReplicasUbo.replicaAcceptanceThresholds + 12 * i);
+	}
+	std::memcpy(pUniformBuffer, &batchedReplicasUbo, sizeof(batchedReplicasUbo));
+}
+
+/**********************************************************************/
 
-	// Copy to the VkBuffer
+void cSetup::WriteToUniformBuffer(const double beta, const uint32_t isingL, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+	const uint32_t sweepsPerSpinSumSample)
+{
+	// Copy to the VkBuffer. Binding 3 of the descriptor set already points at it, updating the descriptor set would invalidate the recorded sweep blocks
 	assert(context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory != nullptr);
 	void* pUniformBuffer = reinterpret_cast<char*>(context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory) + context.uniformBufferByteOffsetIntoTheBigHostVisibleBuffer;
-	std::memcpy(pUniformBuffer, &ubo, sizeof(ubo));
-	
-	// Update the descriptor set
-	const VkDescriptorBufferInfo uniformBufferDescriptorBufferInfo =
-	{
-		context.uniformBuffer,
-		0,
-		sizeof(sUniformBufferObject)
-	};
+	WriteTheUniformBufferObject(pUniformBuffer, std::vector<double>(numberOfReplicas, beta), isingL, numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+		sweepsPerSpinSumSample);
+}
+
+/**********************************************************************/
+
+const sGPUSweepTimes& cSetup::GetGPUSweepTimes() const
+{
+	return gpuSweepTimes;
+}
+
+/**********************************************************************/
+
+eSpinSumReductionType cSetup::GetSpinSumReductionType() const
+{
+	return spinSumReductionType;
+}
+
+/**********************************************************************/
+
+void cSetup::ResetGPUSweepTimes()
+{
+	gpuSweepTimes = {};
+}
+
+/**********************************************************************/
 
-	const VkWriteDescriptorSet descriptorSetWrite =
+void cSetup::SetRandomSeed(const uint64_t randomSeed)
+{
+	// The Philox key goes into the UBO of the next temperature, the XORShift states are uploaded again
+	if (lastSubmittedTemperatureNumber > 0)
 	{
-		VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-		nullptr,
-		context.descriptorSet,
-		3,
-		0,
-		1,
-		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-		nullptr,
-		&uniformBufferDescriptorBufferInfo,
-		nullptr
-	};
-	
-	vkUpdateDescriptorSets(context.device, 1, &descriptorSetWrite, 0, nullptr);
+		WaitForTheTemperature(lastSubmittedTemperatureNumber);
+	}
+	this->randomSeed = randomSeed;
+	if (randomNumberGeneratorType == RANDOM_NUMBER_GENERATOR_TYPE_XORSHIFT_STATE_PER_SPIN)
+	{
+		UploadTheXORShiftStates();
+	}
+}
+
+/**********************************************************************/
+
+uint64_t cSetup::GetRandomSeed() const
+{
+	return randomSeed;
+}
+
+/**********************************************************************/
+
+uint32_t cSetup::GetNumberOfReplicas() const
+{
+	return numberOfReplicas;
+}
+
+/**********************************************************************/
+
+uint64_t cSetup::GetLastSubmittedTemperatureNumber() const
+{
+	return lastSubmittedTemperatureNumber;
+}
+
+/**********************************************************************/
+
+bool cSetup::IsTheTemperatureFinished(const uint64_t temperatureNumber) const
+{
+	uint64_t finishedTemperatureNumber = 0;
+	VK_CHECK(vkGetSemaphoreCounterValue(context.device, context.temperatureTimelineSemaphore, &finishedTemperatureNumber));
+	return finishedTemperatureNumber >= temperatureNumber;
+}
+
+/**********************************************************************/
+
+void cSetup::WaitForTheTemperature(const uint64_t temperatureNumber)
+{
+	assert(temperatureNumber <= lastSubmittedTemperatureNumber);
+	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+
+	const VkSemaphoreWaitInfo semaphoreWaitInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.semaphoreCount = 1,
+		.pSemaphores = &context.temperatureTimelineSemaphore,
+		.pValues = &temperatureNumber
+	};
+	VK_CHECK(vkWaitSemaphores(context.device, &semaphoreWaitInfo, std::numeric_limits<uint64_t>::max()));
+	AddTheDeviceTimesOfTheFinishedCommandBuffers();
+	const uint32_t temperatureSlotIndex = temperatureNumber % 2;
+	if (temperatureNumbersOfTheTemperatureSlots[temperatureSlotIndex] == temperatureNumber)
+	{
+		GatherTheSpinSumSamplesOfTheRing(temperatureSlotIndex);
+	}
+
+	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
+	gpuSweepTimes.wallTime += std::chrono::duration<double>(timePoint2 - timePoint1).count();
+}
+
+/**********************************************************************/
+
+void cSetup::PrepareTimestampQueryPool()
+{
+	if (context.timestampValidBits == 0)
+	{
+		return;
+	}
+
+	const VkQueryPoolCreateInfo queryPoolCI =
+	{
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = 12,																		// Slot 0, slot 1, the tails (the first one also every command buffer of a temperature) and the ends of the temperature slots
+		.pipelineStatistics = 0
+	};
+
+	VK_CHECK(vkCreateQueryPool(context.device, &queryPoolCI, nullptr, &context.timestampQueryPool));
+}
+
+/**********************************************************************/
+
+void cSetup::PrepareTemperatureTimelineSemaphore()
+{
+	const VkSemaphoreTypeCreateInfo semaphoreTypeCI =
+	{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.pNext = nullptr,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0
+	};
+
+	const VkSemaphoreCreateInfo semaphoreCI =
+	{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &semaphoreTypeCI,
+		.flags = 0
+	};
+
+	VK_CHECK(vkCreateSemaphore(context.device, &semaphoreCI, nullptr, &context.temperatureTimelineSemaphore));
+}
+
+/**********************************************************************/
+
+void cSetup::PrepareSpinSumSampleRing()
+{
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		context.spinSumSampleDrainBuffers[i] = pTheVulkanEngine->SuballocateBufferFromTheBigHostVisibleVulkanBuffer(
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT, context.spinSumSampleDrainBufferByteSize, context.spinSumSampleDrainBufferByteOffsetsIntoTheBigHostVisibleBuffer[i]
+		);
+	}
+
+	// The sample drain queue is of the compute queue family
+	const VkCommandPoolCreateInfo commandPoolCI =
+	{
+		VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		nullptr,
+		0,
+		(uint32_t)context.computeQueueIndex
+	};
+
+	VK_CHECK(vkCreateCommandPool(context.device, &commandPoolCI, nullptr, &context.sampleDrainCommandPool));
+
+	const VkCommandBufferAllocateInfo commandBufferAllocateInfo =
+	{
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		nullptr,
+		context.sampleDrainCommandPool,
+		VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		(uint32_t)context.sampleDrainCommandBuffers.size()
+	};
+
+	VK_CHECK(vkAllocateCommandBuffers(context.device, &commandBufferAllocateInfo, context.sampleDrainCommandBuffers.data()));
+
+	// Every drain of a half copies the same regions, so both drains are recorded once. Half i of the ring of replica r goes to block r of drain buffer i
+	const VkCommandBufferBeginInfo commandBufferBeginInfo =
+	{
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		nullptr,
+		0,
+		nullptr
+	};
+
+	const VkDeviceSize ringHalfByteSize = (VkDeviceSize)spinSumSampleRingHalfCapacity * sizeof(int);
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		std::vector<VkBufferCopy> bufferCopyRegions(numberOfReplicas);
+		for (uint32_t j = 0; j < numberOfReplicas; j++)
+		{
+			bufferCopyRegions[j] =
+			{
+				.srcOffset = (2 * j + i) * ringHalfByteSize,
+				.dstOffset = j * ringHalfByteSize,
+				.size = ringHalfByteSize
+			};
+		}
+
+		// Barrier to make the drained samples visible to the host
+		const VkBufferMemoryBarrier spinSumSampleDrainBufferMemoryBarrier =
+		{
+			VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			nullptr,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_ACCESS_HOST_READ_BIT,
+			0,
+			0,
+			context.spinSumSampleDrainBuffers[i],
+			0,
+			context.spinSumSampleDrainBufferByteSize
+		};
+
+		VK_CHECK(vkBeginCommandBuffer(context.sampleDrainCommandBuffers[i], &commandBufferBeginInfo));
+		vkCmdCopyBuffer(context.sampleDrainCommandBuffers[i], context.SSBSpinSumSamplesBuffer, context.spinSumSampleDrainBuffers[i],
+			(uint32_t)bufferCopyRegions.size(), bufferCopyRegions.data());
+		vkCmdPipelineBarrier(context.sampleDrainCommandBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+			0, 0, nullptr, 1, &spinSumSampleDrainBufferMemoryBarrier, 0, nullptr);
+		VK_CHECK(vkEndCommandBuffer(context.sampleDrainCommandBuffers[i]));
+	}
+
+	// The sweep blocks and the drains wait for each other on the device with these two
+	const VkSemaphoreTypeCreateInfo semaphoreTypeCI =
+	{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.pNext = nullptr,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0
+	};
+
+	const VkSemaphoreCreateInfo semaphoreCI =
+	{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &semaphoreTypeCI,
+		.flags = 0
+	};
+
+	VK_CHECK(vkCreateSemaphore(context.device, &semaphoreCI, nullptr, &context.sweepBlockTimelineSemaphore));
+	VK_CHECK(vkCreateSemaphore(context.device, &semaphoreCI, nullptr, &context.sampleDrainTimelineSemaphore));
+}
+
+/**********************************************************************/
+
+void cSetup::PrepareSweepBlockCommandBuffers(const uint32_t isingL)
+{
+	// The tail block is recorded again when the number of sweeps per temperature changes
+	const VkCommandPoolCreateInfo commandPoolCI =
+	{
+		VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		nullptr,
+		VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		(uint32_t)context.computeQueueIndex
+	};
+
+	VK_CHECK(vkCreateCommandPool(context.device, &commandPoolCI, nullptr, &context.sweepBlockCommandPool));
+
+	std::array<VkCommandBuffer, 8> commandBuffers;
+	const VkCommandBufferAllocateInfo commandBufferAllocateInfo =
+	{
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		nullptr,
+		context.sweepBlockCommandPool,
+		VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		(uint32_t)commandBuffers.size()
+	};
+
+	VK_CHECK(vkAllocateCommandBuffers(context.device, &commandBufferAllocateInfo, commandBuffers.data()));
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		context.sweepBlockCommandBuffers[i] = commandBuffers[i];
+		context.startOfTemperatureCommandBuffers[i] = commandBuffers[2 + i];
+		context.tailSweepBlockCommandBuffers[i] = commandBuffers[4 + i];
+		context.endOfTemperatureCommandBuffers[i] = commandBuffers[6 + i];
+	}
+
+	// Signaled, so the first wait on a slot does not block
+	const VkFenceCreateInfo fenceCI =
+	{
+		VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		nullptr,
+		VK_FENCE_CREATE_SIGNALED_BIT
+	};
+
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		VK_CHECK(vkCreateFence(context.device, &fenceCI, nullptr, &context.sweepBlockFences[i]));
+	}
+
+	// Record the blocks of both slots and the start and end of the temperature of both temperature slots once
+	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		RecordSweepBlockCommandBuffer(context.sweepBlockCommandBuffers[i], isingL, 2 * i, sweepsPerSweepBlock);
+	}
+
+	const VkCommandBufferBeginInfo commandBufferBeginInfo =
+	{
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		nullptr,
+		0,
+		nullptr
+	};
+
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		VK_CHECK(vkBeginCommandBuffer(context.startOfTemperatureCommandBuffers[i], &commandBufferBeginInfo));
+		RecordTheStartOfTheTemperature(context.startOfTemperatureCommandBuffers[i], i);
+		VK_CHECK(vkEndCommandBuffer(context.startOfTemperatureCommandBuffers[i]));
+
+		const uint32_t firstTimestampQueryIndex = 8 + 2 * i;
+		VK_CHECK(vkBeginCommandBuffer(context.endOfTemperatureCommandBuffers[i], &commandBufferBeginInfo));
+		if (context.timestampQueryPool != VK_NULL_HANDLE)
+		{
+			vkCmdResetQueryPool(context.endOfTemperatureCommandBuffers[i], context.timestampQueryPool, firstTimestampQueryIndex, 2);
+			vkCmdWriteTimestamp(context.endOfTemperatureCommandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, context.timestampQueryPool, firstTimestampQueryIndex);
+		}
+		RecordTheEndOfTheTemperature(context.endOfTemperatureCommandBuffers[i], i);
+		if (context.timestampQueryPool != VK_NULL_HANDLE)
+		{
+			vkCmdWriteTimestamp(context.endOfTemperatureCommandBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, context.timestampQueryPool, firstTimestampQueryIndex + 1);
+		}
+		VK_CHECK(vkEndCommandBuffer(context.endOfTemperatureCommandBuffers[i]));
+	}
+
+	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
+	gpuSweepTimes.hostRecordingTime += std::chrono::duration<double>(timePoint2 - timePoint1).count();
+}
+
+/**********************************************************************/
+
+void cSetup::RecordSweepBlockCommandBuffer(VkCommandBuffer commandBuffer, const uint32_t isingL, const uint32_t firstTimestampQueryIndex, const uint32_t numberOfSweeps)
+{
+	const uint32_t numberOfWorkGroupsInX = CalculateNumberOfWorkGroupsInX(isingL);
+	assert(numberOfSweeps <= sweepsPerSweepBlock);
+
+	// The next dispatch reads the spins, the random numbers and the spin sum change the last one wrote
+	const VkMemoryBarrier computeToComputeMemoryBarrier =
+	{
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		nullptr,
+		VK_ACCESS_SHADER_WRITE_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+	};
+
+	// No one time submit flag, the command buffer is submitted again and again
+	const VkCommandBufferBeginInfo commandBufferBeginInfo =
+	{
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		nullptr,
+		0,
+		nullptr
+	};
+
+	VK_CHECK(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+
+	// -----------------------------------------------------------------
+	// Record commands
+	if (context.timestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(commandBuffer, context.timestampQueryPool, firstTimestampQueryIndex, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, context.timestampQueryPool, firstTimestampQueryIndex);
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context.computePipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context.computePipelineLayout, 0, 1, &context.descriptorSet, 0, nullptr);
+	for (uint32_t i = 0; i < numberOfSweeps / GetSweepsPerDispatch(); i++)
+	{
+		// The kernels pick the samples themselves, so every dispatch is the same apart from its push constants.
+		// Odd steps move the tile borders of the tiled kernel every dispatch, the other kernels ignore the tile origin
+		const sPushConstantObject pushConstantObject = { .phase = i % 2, .tileOriginX = (7 * i) % isingL, .tileOriginY = (11 * i) % isingL };
+
+		vkCmdPushConstants(commandBuffer, context.computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstantObject), &pushConstantObject);
+
+		// One row of workgroups per replica
+		vkCmdDispatch(commandBuffer, numberOfWorkGroupsInX, numberOfReplicas, 1);
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &computeToComputeMemoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	if (context.timestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, context.timestampQueryPool, firstTimestampQueryIndex + 1);
+	}
+	// -----------------------------------------------------------------
+
+	VK_CHECK(vkEndCommandBuffer(commandBuffer));
+}
+
+/**********************************************************************/
+
+void cSetup::RecordTheStartOfTheTemperature(VkCommandBuffer commandBuffer, const uint32_t temperatureSlotIndex)
+{
+	// The temperature before this one may still be reading the UBO or copying the samples buffer the sweeps write to
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	const VkBufferCopy bufferCopyRegion =
+	{
+		.srcOffset = 0,
+		.dstOffset = 0,
+		.size = context.uniformBufferByteSize
+	};
+	vkCmdCopyBuffer(commandBuffer, context.uniformStagingBuffers[temperatureSlotIndex], context.uniformBuffer, 1, &bufferCopyRegion);
+
+	// The sweeps read the new UBO and the spin sum the fold of the temperature before wrote
+	const VkMemoryBarrier startOfTemperatureMemoryBarrier =
+	{
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		nullptr,
+		VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+	};
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &startOfTemperatureMemoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+/**********************************************************************/
+
+void cSetup::RecordTheEndOfTheTemperature(VkCommandBuffer commandBuffer, const uint32_t temperatureSlotIndex)
+{
+	// Barrier between the fold and the copy of the samples, and their moment reduction
+	const bool bReduceTheMoments = (context.momentReductionPipeline != VK_NULL_HANDLE);
+	const VkBufferMemoryBarrier SSBSpinSumSamplesBufferMemoryBarrier =
+	{
+		VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		nullptr,
+		VK_ACCESS_SHADER_WRITE_BIT,
+		bReduceTheMoments ? VkAccessFlags(VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT) : VkAccessFlags(VK_ACCESS_TRANSFER_READ_BIT),
+		0,
+		0,
+		context.SSBSpinSumSamplesBuffer,
+		0,
+		context.SSBSpinSumSamplesBufferByteSize
+	};
+
+	// Barrier to make the copied samples visible to the host
+	const VkBufferMemoryBarrier spinSumOutputBufferMemoryBarrier =
+	{
+		VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		nullptr,
+		VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_ACCESS_HOST_READ_BIT,
+		0,
+		0,
+		context.spinSumOutputBuffers[temperatureSlotIndex],
+		0,
+		context.spinSumOutputBufferByteSize
+	};
+
+	// One invocation per replica folds the change of the last sweep, writes its sample and gets the spin sum ready for the next temperature
+	const sPushConstantObject pushConstantObject = { .phase = sPushConstantObject::foldPhase };
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context.computePipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context.computePipelineLayout, 0, 1, &context.descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, context.computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstantObject), &pushConstantObject);
+	vkCmdDispatch(commandBuffer, 1, numberOfReplicas, 1);
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		bReduceTheMoments ? VkPipelineStageFlags(VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) : VkPipelineStageFlags(VK_PIPELINE_STAGE_TRANSFER_BIT),
+		0, 0, nullptr, 1, &SSBSpinSumSamplesBufferMemoryBarrier, 0, nullptr);
+
+	const VkBufferCopy bufferCopyRegion =
+	{
+		.srcOffset = 0,
+		.dstOffset = 0,
+		.size = context.SSBSpinSumSamplesBufferByteSize
+	};
+	vkCmdCopyBuffer(commandBuffer, context.SSBSpinSumSamplesBuffer, context.spinSumOutputBuffers[temperatureSlotIndex], 1, &bufferCopyRegion);
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+		0, 0, nullptr, 1, &spinSumOutputBufferMemoryBarrier, 0, nullptr);
+
+	if (!bReduceTheMoments)
+	{
+		return;
+	}
+
+	// Every workgroup of the reduction sums the moments of its share of the samples, the host adds the sums of the workgroups
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context.momentReductionPipeline);
+	vkCmdDispatch(commandBuffer, sSpinSumMomentsStorageBufferObject::numberOfWorkGroups, 1, 1);
+
+	const VkBufferMemoryBarrier SSBSpinSumMomentsBufferMemoryBarrier =
+	{
+		VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		nullptr,
+		VK_ACCESS_SHADER_WRITE_BIT,
+		VK_ACCESS_TRANSFER_READ_BIT,
+		0,
+		0,
+		context.SSBSpinSumMomentsBuffer,
+		0,
+		context.SSBSpinSumMomentsBufferByteSize
+	};
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 1, &SSBSpinSumMomentsBufferMemoryBarrier, 0, nullptr);
+
+	const VkBufferCopy momentsBufferCopyRegion =
+	{
+		.srcOffset = 0,
+		.dstOffset = 0,
+		.size = context.SSBSpinSumMomentsBufferByteSize
+	};
+	vkCmdCopyBuffer(commandBuffer, context.SSBSpinSumMomentsBuffer, context.spinSumMomentsOutputBuffers[temperatureSlotIndex], 1, &momentsBufferCopyRegion);
+
+	const VkBufferMemoryBarrier spinSumMomentsOutputBufferMemoryBarrier =
+	{
+		VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		nullptr,
+		VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_ACCESS_HOST_READ_BIT,
+		0,
+		0,
+		context.spinSumMomentsOutputBuffers[temperatureSlotIndex],
+		0,
+		context.SSBSpinSumMomentsBufferByteSize
+	};
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+		0, 0, nullptr, 1, &spinSumMomentsOutputBufferMemoryBarrier, 0, nullptr);
+}
+
+/**********************************************************************/
+
+uint32_t cSetup::CalculateNumberOfWorkGroupsInX(const uint32_t isingL) const
+{
+	const uint32_t isingN = isingL * isingL;
+	uint32_t numberOfInvocations = (isingN + 1) / 2;
+	if (computeShaderType == COMPUTE_SHADER_TYPE_MULTI_SPIN_CODED)
+	{
+		numberOfInvocations = isingL * ((isingL / 2 + 31) / 32);											// Every row of one colour has its words
+	}
+
+	uint32_t numberOfWorkGroupsInX = (numberOfInvocations + context.localWorkGroupSizeInX - 1) / context.localWorkGroupSizeInX;
+	if (computeShaderType == COMPUTE_SHADER_TYPE_SHARED_MEMORY_TILED)
+	{
+		// One workgroup per tile
+		numberOfWorkGroupsInX = ((isingL + tiledKernelParameters.tileWidth - 1) / tiledKernelParameters.tileWidth)
+			* ((isingL + tiledKernelParameters.tileHeight - 1) / tiledKernelParameters.tileHeight);
+	}
+	return numberOfWorkGroupsInX;
+}
+
+/**********************************************************************/
+
+uint32_t cSetup::GetSweepsPerDispatch() const
+{
+	return (computeShaderType == COMPUTE_SHADER_TYPE_SHARED_MEMORY_TILED) ? tiledKernelParameters.sweepsPerDispatch : 1;
+}
+
+/**********************************************************************/
+
+void cSetup::AddTheDeviceTimesOfTheFinishedCommandBuffers()
+{
+	uint64_t finishedTemperatureNumber = 0;
+	VK_CHECK(vkGetSemaphoreCounterValue(context.device, context.temperatureTimelineSemaphore, &finishedTemperatureNumber));
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		if (bTemperatureSlotDeviceTimeIsPending[i] && temperatureNumbersOfTheTemperatureSlots[i] <= finishedTemperatureNumber)
+		{
+			if (bTemperatureSlotHasATail[i])
+			{
+				AddTheDeviceTime(4 + 2 * i);
+			}
+			AddTheDeviceTime(8 + 2 * i);
+			bTemperatureSlotDeviceTimeIsPending[i] = false;
+		}
+	}
+
+	// The sweep blocks of a finished temperature are done too, but they may have been submitted again since
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		if (bSweepBlockIsInFlight[i] && vkGetFenceStatus(context.device, context.sweepBlockFences[i]) == VK_SUCCESS)
+		{
+			AddTheDeviceTime(2 * i);
+			bSweepBlockIsInFlight[i] = false;
+		}
+	}
+}
+
+/**********************************************************************/
+
+void cSetup::AddTheDeviceTime(const uint32_t firstTimestampQueryIndex)
+{
+	if (context.timestampQueryPool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	std::array<uint64_t, 2> timestamps;
+	VK_CHECK(vkGetQueryPoolResults(context.device, context.timestampQueryPool, firstTimestampQueryIndex, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t),
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+	// Only the low timestampValidBits bits count, the difference wraps around with them
+	const uint64_t timestampMask = (context.timestampValidBits >= 64) ? ~0ULL : ((1ULL << context.timestampValidBits) - 1);
+	const uint64_t numberOfTicks = (timestamps[1] - timestamps[0]) & timestampMask;
+	gpuSweepTimes.deviceTime += numberOfTicks * (double)context.gpuProperties.limits.timestampPeriod * 1e-9;		// timestampPeriod is in nanoseconds
+}
+
+/**********************************************************************/
+
+// The number of sampled sweeps before sweepNumber, which is also the number of the sample of the first sampled sweep from sweepNumber on
+uint64_t CountTheSampledSweepsBefore(const uint64_t sweepNumber, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample)
+{
+	if (sweepNumber <= numberOfSweepsToWaitBeforeSpinSumSamplingStarts)
+	{
+		return 0;
+	}
+	return (sweepNumber - numberOfSweepsToWaitBeforeSpinSumSamplingStarts - 1) / sweepsPerSpinSumSample + 1;
+}
+
+/**********************************************************************/
+
+void cSetup::DoTheSweepsByReplayingSweepBlocks(const uint32_t isingL, const uint32_t numberOfSweepsPerTemperature,
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, const uint32_t temperatureSlotIndex)
+{
+	const uint32_t numberOfWholeSweepBlocks = numberOfSweepsPerTemperature / sweepsPerSweepBlock;
+	const uint32_t numberOfSweepsInTheTail = numberOfSweepsPerTemperature % sweepsPerSweepBlock;
+
+	// The samples of the temperature two before this one were gathered when it was waited for
+	if (spinSumSampleRingHalfCapacity > 0)
+	{
+		const uint64_t numberOfSpinSumSamples = CountTheSampledSweepsBefore(numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+			sweepsPerSpinSumSample);
+		numberOfSpinSumSamplesOfTheTemperatureSlots[temperatureSlotIndex] = numberOfSpinSumSamples;
+		spinSumSampleAccumulators[temperatureSlotIndex].assign(numberOfReplicas, cObservableAccumulator(isingL));
+		numberOfDrainedRingHalvesOfTheTemperatureSlots[temperatureSlotIndex] = 0;
+		lastSampleDrainNumbersOfTheTemperatureSlots[temperatureSlotIndex] = sampleDrainNumber;
+		sampleDrainNumbersOfTheRingHalvesBeforeTheTemperature = sampleDrainNumbersOfTheRingHalves;
+		bTemperatureSlotSamplesAreGathered[temperatureSlotIndex] = false;
+	}
+
+	// The UBO of the temperature is copied on the queue, once the temperature before it is done with the old one
+	VkSubmitInfo startOfTemperatureSubmitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	startOfTemperatureSubmitInfo.commandBufferCount = 1;
+	startOfTemperatureSubmitInfo.pCommandBuffers = &context.startOfTemperatureCommandBuffers[temperatureSlotIndex];
+	VK_CHECK(vkQueueSubmit(context.computeQueue, 1, &startOfTemperatureSubmitInfo, VK_NULL_HANDLE));
+	gpuSweepTimes.numberOfSubmissions++;
+
+	// Two blocks are queued at a time. A slot is only submitted again once its last submission is done
+	for (uint32_t sweepBlockNumber = 0; sweepBlockNumber < numberOfWholeSweepBlocks; sweepBlockNumber++)
+	{
+		const uint32_t slotIndex = sweepBlockNumber % 2;
+		VK_CHECK(vkWaitForFences(context.device, 1, &context.sweepBlockFences[slotIndex], VK_TRUE, std::numeric_limits<uint64_t>::max()));
+		if (bSweepBlockIsInFlight[slotIndex])
+		{
+			AddTheDeviceTime(2 * slotIndex);
+		}
+
+		VK_CHECK(vkResetFences(context.device, 1, &context.sweepBlockFences[slotIndex]));
+		SubmitTheSweepBlock(context.sweepBlockCommandBuffers[slotIndex], context.sweepBlockFences[slotIndex], sweepBlockNumber * sweepsPerSweepBlock, sweepsPerSweepBlock,
+			numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample, temperatureSlotIndex);
+		bSweepBlockIsInFlight[slotIndex] = true;
+	}
+
+	// The tail starts at a multiple of sweepsPerSweepBlock, so with an even phase as well. It is only recorded again if its length changes,
+	// the temperature two before this one used it last and is done
+	bTemperatureSlotHasATail[temperatureSlotIndex] = (numberOfSweepsInTheTail > 0);
+	if (numberOfSweepsInTheTail > 0)
+	{
+		VkCommandBuffer tailSweepBlockCommandBuffer = context.tailSweepBlockCommandBuffers[temperatureSlotIndex];
+		if (context.numberOfSweepsInTheTailSweepBlocks[temperatureSlotIndex] != numberOfSweepsInTheTail)
+		{
+			std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+			VK_CHECK(vkResetCommandBuffer(tailSweepBlockCommandBuffer, 0));
+			RecordSweepBlockCommandBuffer(tailSweepBlockCommandBuffer, isingL, 4 + 2 * temperatureSlotIndex, numberOfSweepsInTheTail);
+			std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
+			gpuSweepTimes.hostRecordingTime += std::chrono::duration<double>(timePoint2 - timePoint1).count();
+			context.numberOfSweepsInTheTailSweepBlocks[temperatureSlotIndex] = numberOfSweepsInTheTail;
+		}
+
+		SubmitTheSweepBlock(tailSweepBlockCommandBuffer, VK_NULL_HANDLE, numberOfWholeSweepBlocks * sweepsPerSweepBlock, numberOfSweepsInTheTail,
+			numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample, temperatureSlotIndex);
+	}
+
+	// The end of the temperature signals the timeline semaphore with the temperature number once the samples are on the host. Nothing waits for it here
+	const uint64_t temperatureNumber = temperatureNumbersOfTheTemperatureSlots[temperatureSlotIndex];
+	const VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.pNext = nullptr,
+		.waitSemaphoreValueCount = 0,
+		.pWaitSemaphoreValues = nullptr,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &temperatureNumber
+	};
+
+	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	submitInfo.pNext = &timelineSemaphoreSubmitInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &context.endOfTemperatureCommandBuffers[temperatureSlotIndex];
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &context.temperatureTimelineSemaphore;
+	VK_CHECK(vkQueueSubmit(context.computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
+	gpuSweepTimes.numberOfSubmissions++;
+	bTemperatureSlotDeviceTimeIsPending[temperatureSlotIndex] = true;
+}
+
+/**********************************************************************/
+
+void cSetup::SubmitTheSweepBlock(VkCommandBuffer commandBuffer, VkFence fence, const uint32_t firstSweepNumber, const uint32_t numberOfSweeps,
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, const uint32_t temperatureSlotIndex)
+{
+	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	if (spinSumSampleRingHalfCapacity == 0)
+	{
+		VK_CHECK(vkQueueSubmit(context.computeQueue, 1, &submitInfo, fence));
+		gpuSweepTimes.numberOfSubmissions++;
+		return;
+	}
+
+	// The sample of a sweep is written by its own dispatch or the next one. So once the blocks submitted so far are done, every sample of the sweeps
+	// before firstSweepNumber - 2 * sweepsPerDispatch is written, and this block writes none of the sweeps from firstSweepNumber + numberOfSweeps on
+	const uint32_t sweepsPerDispatch = GetSweepsPerDispatch();
+	const uint64_t numberOfWrittenSpinSumSamples = CountTheSampledSweepsBefore((firstSweepNumber > 2 * sweepsPerDispatch) ? firstSweepNumber - 2 * sweepsPerDispatch : 0,
+		numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+	const uint64_t numberOfSpinSumSamplesAfterTheBlock = CountTheSampledSweepsBefore(firstSweepNumber + numberOfSweeps,
+		numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+	SubmitTheSpinSumSampleDrains(numberOfWrittenSpinSumSamples, temperatureSlotIndex);
+
+	// Lap n of the ring is the samples [n * halfCapacity, (n + 1) * halfCapacity) of the temperature, in half n % 2. A half holds more samples than a block
+	// writes, so the block writes to the last two laps at most, and every lap before them is drained by now. A lap overwrites the lap two before it,
+	// laps 0 and 1 the last drain of their half before the temperature
+	const uint64_t sampleDrainNumberBeforeTheTemperature = lastSampleDrainNumbersOfTheTemperatureSlots[temperatureSlotIndex]
+		- numberOfDrainedRingHalvesOfTheTemperatureSlots[temperatureSlotIndex];
+	uint64_t drainNumberToWaitFor = 0;
+	if (numberOfSpinSumSamplesAfterTheBlock > 0)
+	{
+		const uint64_t lastLap = (numberOfSpinSumSamplesAfterTheBlock - 1) / spinSumSampleRingHalfCapacity;
+		for (uint64_t lap = (lastLap > 0) ? lastLap - 1 : 0; lap <= lastLap; lap++)
+		{
+			uint64_t drainNumberOfTheLapBefore = sampleDrainNumbersOfTheRingHalvesBeforeTheTemperature[lap % 2];
+			if (lap >= 2)
+			{
+				assert(lap - 2 < numberOfDrainedRingHalvesOfTheTemperatureSlots[temperatureSlotIndex]);
+				drainNumberOfTheLapBefore = sampleDrainNumberBeforeTheTemperature + (lap - 2) + 1;
+			}
+			drainNumberToWaitFor = std::max(drainNumberToWaitFor, drainNumberOfTheLapBefore);
+		}
+	}
+
+	// Usually long done, so the block only waits on the device if the sample drain queue falls a whole half behind
+	const uint64_t sweepBlockNumber = ++sweepBlockSubmissionNumber;
+	const VkPipelineStageFlags waitDstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	const VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.pNext = nullptr,
+		.waitSemaphoreValueCount = 1,
+		.pWaitSemaphoreValues = &drainNumberToWaitFor,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &sweepBlockNumber
+	};
+
+	submitInfo.pNext = &timelineSemaphoreSubmitInfo;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &context.sampleDrainTimelineSemaphore;
+	submitInfo.pWaitDstStageMask = &waitDstStageMask;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &context.sweepBlockTimelineSemaphore;
+	VK_CHECK(vkQueueSubmit(context.computeQueue, 1, &submitInfo, fence));
+	gpuSweepTimes.numberOfSubmissions++;
+}
+
+/**********************************************************************/
+
+void cSetup::SubmitTheSpinSumSampleDrains(const uint64_t numberOfWrittenSpinSumSamples, const uint32_t temperatureSlotIndex)
+{
+	while ((numberOfDrainedRingHalvesOfTheTemperatureSlots[temperatureSlotIndex] + 1) * spinSumSampleRingHalfCapacity <= numberOfWrittenSpinSumSamples)
+	{
+		const uint64_t lap = numberOfDrainedRingHalvesOfTheTemperatureSlots[temperatureSlotIndex];
+		const uint32_t ringHalfIndex = lap % 2;
+
+		// The drain buffer and the drain command buffer of the half are free again once the host has copied out the last drain of the half.
+		// It was submitted a half of samples ago, so this rarely blocks
+		AccumulateTheDrainedSpinSumSamples(sampleDrainNumbersOfTheRingHalves[ringHalfIndex]);
+
+		// The drain waits on the device for the sweep blocks submitted so far, which write the last sample of the half
+		const uint64_t drainNumber = ++sampleDrainNumber;
+		const VkPipelineStageFlags waitDstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		const VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+			.pNext = nullptr,
+			.waitSemaphoreValueCount = 1,
+			.pWaitSemaphoreValues = &sweepBlockSubmissionNumber,
+			.signalSemaphoreValueCount = 1,
+			.pSignalSemaphoreValues = &drainNumber
+		};
+
+		VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+		submitInfo.pNext = &timelineSemaphoreSubmitInfo;
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &context.sweepBlockTimelineSemaphore;
+		submitInfo.pWaitDstStageMask = &waitDstStageMask;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &context.sampleDrainCommandBuffers[ringHalfIndex];
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &context.sampleDrainTimelineSemaphore;
+		VK_CHECK(vkQueueSubmit(context.sampleDrainQueue, 1, &submitInfo, VK_NULL_HANDLE));
+		gpuSweepTimes.numberOfSubmissions++;
+
+		pendingSpinSumSampleDrains.push_back({ .drainNumber = drainNumber, .ringHalfIndex = ringHalfIndex, .temperatureSlotIndex = temperatureSlotIndex });
+		sampleDrainNumbersOfTheRingHalves[ringHalfIndex] = drainNumber;
+		lastSampleDrainNumbersOfTheTemperatureSlots[temperatureSlotIndex] = drainNumber;
+		numberOfDrainedRingHalvesOfTheTemperatureSlots[temperatureSlotIndex]++;
+	}
+}
+
+/**********************************************************************/
+
+void cSetup::AccumulateTheDrainedSpinSumSamples(const uint64_t drainNumber)
+{
+	while (!pendingSpinSumSampleDrains.empty() && pendingSpinSumSampleDrains.front().drainNumber <= drainNumber)
+	{
+		const sSpinSumSampleDrain spinSumSampleDrain = pendingSpinSumSampleDrains.front();
+		const VkSemaphoreWaitInfo semaphoreWaitInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.semaphoreCount = 1,
+			.pSemaphores = &context.sampleDrainTimelineSemaphore,
+			.pValues = &spinSumSampleDrain.drainNumber
+		};
+		VK_CHECK(vkWaitSemaphores(context.device, &semaphoreWaitInfo, std::numeric_limits<uint64_t>::max()));
+
+		// Block r of the drain buffer is the half of replica r
+		const int* pSpinSumSampleDrainBuffer = reinterpret_cast<const int*>(reinterpret_cast<const char*>(context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory)
+			+ context.spinSumSampleDrainBufferByteOffsetsIntoTheBigHostVisibleBuffer[spinSumSampleDrain.ringHalfIndex]);
+		std::vector<cObservableAccumulator>& observableAccumulators = spinSumSampleAccumulators[spinSumSampleDrain.temperatureSlotIndex];
+		for (uint32_t i = 0; i < numberOfReplicas; i++)
+		{
+			observableAccumulators[i].AddSamples(pSpinSumSampleDrainBuffer + (size_t)i * spinSumSampleRingHalfCapacity, spinSumSampleRingHalfCapacity);
+		}
+		pendingSpinSumSampleDrains.pop_front();
+	}
+}
+
+/**********************************************************************/
+
+void cSetup::GatherTheSpinSumSamplesOfTheRing(const uint32_t temperatureSlotIndex)
+{
+	if (spinSumSampleRingHalfCapacity == 0 || bTemperatureSlotSamplesAreGathered[temperatureSlotIndex])
+	{
+		return;
+	}
+	AccumulateTheDrainedSpinSumSamples(lastSampleDrainNumbersOfTheTemperatureSlots[temperatureSlotIndex]);
+
+	// The samples after the drained laps are at most two laps, so they are still in the ring, which the end of the temperature copied to the output buffer
+	const uint64_t ringCapacity = 2 * (uint64_t)spinSumSampleRingHalfCapacity;
+	const uint64_t numberOfSpinSumSamples = numberOfSpinSumSamplesOfTheTemperatureSlots[temperatureSlotIndex];
+	const uint64_t firstSpinSumSampleInTheRing = numberOfDrainedRingHalvesOfTheTemperatureSlots[temperatureSlotIndex] * spinSumSampleRingHalfCapacity;
+	assert(numberOfSpinSumSamples - firstSpinSumSampleInTheRing <= ringCapacity);
+	const int* pSpinSumOutputBuffer = reinterpret_cast<const int*>(reinterpret_cast<const char*>(context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory)
+		+ context.spinSumOutputBufferByteOffsetsIntoTheBigHostVisibleBuffer[temperatureSlotIndex]);
+	std::vector<cObservableAccumulator>& observableAccumulators = spinSumSampleAccumulators[temperatureSlotIndex];
+	for (uint32_t i = 0; i < numberOfReplicas; i++)
+	{
+		for (uint64_t j = firstSpinSumSampleInTheRing; j < numberOfSpinSumSamples; j++)
+		{
+			observableAccumulators[i].AddSample(pSpinSumOutputBuffer[i * ringCapacity + j % ringCapacity]);
+		}
+	}
+	bTemperatureSlotSamplesAreGathered[temperatureSlotIndex] = true;
 }
 
 /**********************************************************************/
 
-void DoTheIsingGridSweepsGPU(cSetup* pTheSetup, const uint32_t isingL, const double beta,
-	const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample)
+const int* cSetup::GetTheSpinSumSamples(const uint32_t temperatureSlotIndex, size_t& numberOfSpinSumSamples) const
 {
-	const uint32_t isingN = isingL * isingL;
-	uint32_t numberOfWorkGroupsInX = (uint32_t)std::ceil(isingN / (2.0 * pTheSetup->context.localWorkGroupSizeInX));
-	assert(numberOfWorkGroupsInX < pTheSetup->context.maxWorkGroupCountPerDispatchInX);
+	assert(spinSumSampleRingHalfCapacity == 0);
+	numberOfSpinSumSamples = context.spinSumOutputBufferByteSize / sizeof(int);
+	return reinterpret_cast<const int*>(reinterpret_cast<const char*>(context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory)
+		+ context.spinSumOutputBufferByteOffsetsIntoTheBigHostVisibleBuffer[temperatureSlotIndex]);
+}
+
+/**********************************************************************/
 
-	// Write descriptor set
-	pTheSetup->WriteToUniformBufferAndUpdateDescriptorSet(beta, isingL);
+void cSetup::DoTheSweepsByRecordingEveryTemperature(const uint32_t isingL, const uint32_t numberOfSweepsPerTemperature, const uint32_t temperatureSlotIndex)
+{
+	const uint32_t numberOfWorkGroupsInX = CalculateNumberOfWorkGroupsInX(isingL);
 
-	// Barrier to synchronize access to the spin sum buffer
-	const VkBufferMemoryBarrier SSBSpinSumBufferMemoryBarrier =
+	// The next dispatch reads the spins, the random numbers and the spin sum change the last one wrote
+	const VkMemoryBarrier computeToComputeMemoryBarrier =
 	{
-		VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER,
 		nullptr,
-		VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
-		VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
-		0,
-		0,
-		pTheSetup->context.SSBSpinSumBuffer,
-		0,
-		pTheSetup->context.SSBSpinSumBufferByteSize
+		VK_ACCESS_SHADER_WRITE_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
 	};
 
 	// Begin the command buffer
@@ -1062,86 +2463,184 @@ void DoTheIsingGridSweepsGPU(cSetup* pTheSetup, const uint32_t isingL, const dou
 		nullptr
 	};
 
-	VK_CHECK(vkBeginCommandBuffer(pTheSetup->context.commandBuffer, &commandBufferBeginInfo));
+	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> recordingTimePoint = std::chrono::steady_clock::now();
+	VK_CHECK(vkBeginCommandBuffer(context.commandBuffer, &commandBufferBeginInfo));
 
 	// -----------------------------------------------------------------
 	// Record commands
-	vkCmdBindPipeline(pTheSetup->context.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pTheSetup->context.computePipeline);
+	if (context.timestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(context.commandBuffer, context.timestampQueryPool, 4, 2);
+		vkCmdWriteTimestamp(context.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, context.timestampQueryPool, 4);
+	}
+	vkCmdBindPipeline(context.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context.computePipeline);
 	vkCmdBindDescriptorSets(
-		pTheSetup->context.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pTheSetup->context.computePipelineLayout,
-		0, 1, &pTheSetup->context.descriptorSet, 0, nullptr);
-	for (uint32_t i = 0; i < numberOfSweepsPerTemperature; i++)
+		context.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context.computePipelineLayout,
+		0, 1, &context.descriptorSet, 0, nullptr);
+	for (uint32_t i = 0; i < numberOfSweepsPerTemperature / GetSweepsPerDispatch(); i++)
 	{
-		const sPushConstantObject pushConstantObject = { .phase = i % 2 };
+		// The kernels write the sampled spin sums themselves
+		const sPushConstantObject pushConstantObject = { .phase = i % 2, .tileOriginX = (7 * i) % isingL, .tileOriginY = (11 * i) % isingL };
 
 		vkCmdPushConstants(
-			pTheSetup->context.commandBuffer, pTheSetup->context.computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstantObject), &pushConstantObject
+			context.commandBuffer, context.computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstantObject), &pushConstantObject
 		);
 
-		vkCmdDispatch(pTheSetup->context.commandBuffer, numberOfWorkGroupsInX, 1, 1);
+		vkCmdDispatch(context.commandBuffer, numberOfWorkGroupsInX, numberOfReplicas, 1);
 
-		vkCmdPipelineBarrier(
-			pTheSetup->context.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, // MUST BE OUTSIDE IF!!!
-			0, 0, nullptr, 1, &SSBSpinSumBufferMemoryBarrier, 0, nullptr
-		);
+		vkCmdPipelineBarrier(context.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &computeToComputeMemoryBarrier, 0, nullptr, 0, nullptr);
 
-		// Check if the magnetization (spin sum) should be stored
-		if (i >= numberOfSweepsToWaitBeforeSpinSumSamplingStarts && (i - numberOfSweepsToWaitBeforeSpinSumSamplingStarts) % sweepsPerSpinSumSample == 0)
+		if ((i+1) % 500000 == 0)
 		{
-			const VkDeviceSize dst_offset = ((i - numberOfSweepsToWaitBeforeSpinSumSamplingStarts) / sweepsPerSpinSumSample) * sizeof(int);
-			const VkBufferCopy copy_region =
+			if (context.timestampQueryPool != VK_NULL_HANDLE)
 			{
-				0,
-				dst_offset,
-				sizeof(int)
-			};
-			vkCmdCopyBuffer(pTheSetup->context.commandBuffer, pTheSetup->context.SSBSpinSumBuffer, pTheSetup->context.spinSumOutputBuffer, 1, &copy_region);
-		}
-
-		vkCmdPipelineBarrier(pTheSetup->context.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // MUST BE OUTSIDE IF!!!
-			0, 0, nullptr, 1, &SSBSpinSumBufferMemoryBarrier, 0, nullptr);
+				vkCmdWriteTimestamp(context.commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, context.timestampQueryPool, 5);
+			}
+			VK_CHECK(vkEndCommandBuffer(context.commandBuffer));
+			gpuSweepTimes.hostRecordingTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - recordingTimePoint).count();
 
-		if ((i+1) % 500000 == 0)
-		{
-			VK_CHECK(vkEndCommandBuffer(pTheSetup->context.commandBuffer));
 			VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
 			submitInfo.commandBufferCount = 1;
-			submitInfo.pCommandBuffers = &pTheSetup->context.commandBuffer;
-			VK_CHECK(vkQueueSubmit(pTheSetup->context.computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
-			VK_CHECK(vkQueueWaitIdle(pTheSetup->context.computeQueue));
-			VK_CHECK(vkResetCommandPool(pTheSetup->context.device, pTheSetup->context.commandPool, 0));
-			VK_CHECK(vkBeginCommandBuffer(pTheSetup->context.commandBuffer, &commandBufferBeginInfo));
-			vkCmdBindPipeline(pTheSetup->context.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pTheSetup->context.computePipeline);
+			submitInfo.pCommandBuffers = &context.commandBuffer;
+			VK_CHECK(vkQueueSubmit(context.computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
+			VK_CHECK(vkQueueWaitIdle(context.computeQueue));
+			gpuSweepTimes.numberOfSubmissions++;
+			AddTheDeviceTime(4);
+
+			recordingTimePoint = std::chrono::steady_clock::now();
+			VK_CHECK(vkResetCommandPool(context.device, context.commandPool, 0));
+			VK_CHECK(vkBeginCommandBuffer(context.commandBuffer, &commandBufferBeginInfo));
+			if (context.timestampQueryPool != VK_NULL_HANDLE)
+			{
+				vkCmdResetQueryPool(context.commandBuffer, context.timestampQueryPool, 4, 2);
+				vkCmdWriteTimestamp(context.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, context.timestampQueryPool, 4);
+			}
+			vkCmdBindPipeline(context.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context.computePipeline);
 			vkCmdBindDescriptorSets(
-				pTheSetup->context.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pTheSetup->context.computePipelineLayout, 0, 1, &pTheSetup->context.descriptorSet, 0, nullptr
+				context.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context.computePipelineLayout, 0, 1, &context.descriptorSet, 0, nullptr
 			);
 		}
 	}
+	RecordTheEndOfTheTemperature(context.commandBuffer, temperatureSlotIndex);
+	if (context.timestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(context.commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, context.timestampQueryPool, 5);
+	}
 	// -----------------------------------------------------------------
 
 	// End and submit
-	VK_CHECK(vkEndCommandBuffer(pTheSetup->context.commandBuffer));
+	VK_CHECK(vkEndCommandBuffer(context.commandBuffer));
+	gpuSweepTimes.hostRecordingTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - recordingTimePoint).count();
 
 	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &pTheSetup->context.commandBuffer;
+	submitInfo.pCommandBuffers = &context.commandBuffer;
 
-	VK_CHECK(vkQueueSubmit(pTheSetup->context.computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
-	VK_CHECK(vkQueueWaitIdle(pTheSetup->context.computeQueue));
+	VK_CHECK(vkQueueSubmit(context.computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
+	VK_CHECK(vkQueueWaitIdle(context.computeQueue));
+	gpuSweepTimes.numberOfSubmissions++;
+	AddTheDeviceTime(4);
 	
 	// Reset the command pool (and buffer)
-	VK_CHECK(vkResetCommandPool(pTheSetup->context.device, pTheSetup->context.commandPool, 0));
+	VK_CHECK(vkResetCommandPool(context.device, context.commandPool, 0));
+}
+
+/**********************************************************************/
+
+uint64_t SubmitTheIsingGridSweepsGPU(cSetup* pTheSetup, const uint32_t isingL, const double beta,
+	const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample)
+{
+	return SubmitTheIsingGridSweepsGPU(pTheSetup, isingL, std::vector<double>(pTheSetup->numberOfReplicas, beta), numberOfSweepsPerTemperature,
+		numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+}
+
+/**********************************************************************/
+
+uint64_t SubmitTheIsingGridSweepsGPU(cSetup* pTheSetup, const uint32_t isingL, const std::vector<double>& betaOfEveryReplica,
+	const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample)
+{
+	if (betaOfEveryReplica.size() != pTheSetup->numberOfReplicas)
+	{
+		throw std::runtime_error("Every replica needs its own beta!");
+	}
+
+	const uint64_t temperatureNumber = pTheSetup->lastSubmittedTemperatureNumber + 1;
+	const uint32_t temperatureSlotIndex = temperatureNumber % 2;
+
+	// The temperature two before this one used the same slot. Its command buffers and its staging buffer must be done before they are used again
+	if (temperatureNumber > 2)
+	{
+		pTheSetup->WaitForTheTemperature(temperatureNumber - 2);
+	}
+
+	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint1 = std::chrono::steady_clock::now();
+	pTheSetup->lastSubmittedTemperatureNumber = temperatureNumber;
+	pTheSetup->temperatureNumbersOfTheTemperatureSlots[temperatureSlotIndex] = temperatureNumber;
+
+	if (pTheSetup->gpuSchedulingMode == GPU_SCHEDULING_MODE_REPLAY_SWEEP_BLOCKS)
+	{
+		// The temperature before this one may still read the UBO, so the UBO goes through the staging buffer of the slot
+		void* pUniformStagingBuffer = reinterpret_cast<char*>(pTheSetup->context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory)
+			+ pTheSetup->context.uniformStagingBufferByteOffsetsIntoTheBigHostVisibleBuffer[temperatureSlotIndex];
+		pTheSetup->WriteTheUniformBufferObject(pUniformStagingBuffer, betaOfEveryReplica, isingL, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+
+		pTheSetup->DoTheSweepsByReplayingSweepBlocks(isingL, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample,
+			temperatureSlotIndex);
+	}
+	else
+	{
+		// Every temperature is done when its call returns, so the UBO can be written directly
+		void* pUniformBuffer = reinterpret_cast<char*>(pTheSetup->context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory)
+			+ pTheSetup->context.uniformBufferByteOffsetIntoTheBigHostVisibleBuffer;
+		pTheSetup->WriteTheUniformBufferObject(pUniformBuffer, betaOfEveryReplica, isingL, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+		pTheSetup->DoTheSweepsByRecordingEveryTemperature(isingL, numberOfSweepsPerTemperature, temperatureSlotIndex);
+
+		// Nothing of the temperature is in flight any more, so the host moves the timeline on itself
+		const VkSemaphoreSignalInfo semaphoreSignalInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+			.pNext = nullptr,
+			.semaphore = pTheSetup->context.temperatureTimelineSemaphore,
+			.value = temperatureNumber
+		};
+		VK_CHECK(vkSignalSemaphore(pTheSetup->context.device, &semaphoreSignalInfo));
+	}
+
+	std::chrono::time_point<std::chrono::steady_clock, std::chrono::duration<double>> timePoint2 = std::chrono::steady_clock::now();
+	pTheSetup->gpuSweepTimes.wallTime += std::chrono::duration<double>(timePoint2 - timePoint1).count();
+
+	return temperatureNumber;
+}
+
+/**********************************************************************/
+
+void DoTheIsingGridSweepsGPU(cSetup* pTheSetup, const uint32_t isingL, const double beta,
+	const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample)
+{
+	const uint64_t temperatureNumber = SubmitTheIsingGridSweepsGPU(pTheSetup, isingL, beta, numberOfSweepsPerTemperature,
+		numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+	pTheSetup->WaitForTheTemperature(temperatureNumber);
 }
 
 /**********************************************************************/
 
+void DoTheIsingGridSweepsGPU(cSetup* pTheSetup, const uint32_t isingL, const std::vector<double>& betaOfEveryReplica,
+	const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample)
+{
+	const uint64_t temperatureNumber = SubmitTheIsingGridSweepsGPU(pTheSetup, isingL, betaOfEveryReplica, numberOfSweepsPerTemperature,
+		numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+	pTheSetup->WaitForTheTemperature(temperatureNumber);
+}
+
 /**********************************************************************/
 
-void cSetup::PrepareBigDeviceLocalVulkanBufferAndMore(VkDeviceSize bufferByteSize)
+void cVulkanEngine::PrepareBigDeviceLocalVulkanBufferAndMore(VkDeviceSize bufferByteSize)
 {
 	const VkBufferUsageFlags bufferUsageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
 	context.bigDeviceLocalBufferUsageFlags = bufferUsageFlags;
 	context.bigDeviceLocalBufferBytesLeft = bufferByteSize;
+	context.bigDeviceLocalBufferNextAvailableByte = 0;
 
 	const VkBufferCreateInfo bufferCI =
 	{
@@ -1170,11 +2669,18 @@ void cSetup::PrepareBigDeviceLocalVulkanBufferAndMore(VkDeviceSize bufferByteSiz
 	};
 
 	VK_CHECK(vkAllocateMemory(context.device, &bufferMemoryAllocateInfo, nullptr, &context.bigDeviceLocalBufferAndMore.bufferMemory));
+
+	// Counted against the heap budget when the extension is not there
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(context.gpu, &memoryProperties);
+	context.bigDeviceLocalBufferAndMore.memoryByteSize = bufferMemoryRequirements.size;
+	context.bigDeviceLocalBufferAndMore.memoryHeapIndex = memoryProperties.memoryTypes[bufferMemoryAllocateInfo.memoryTypeIndex].heapIndex;
+	bigBufferBytesOfEveryHeap[context.bigDeviceLocalBufferAndMore.memoryHeapIndex] += bufferMemoryRequirements.size;
 }
 
 /**********************************************************************/
 
-VkBuffer cSetup::SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(VkBufferUsageFlags bufferUsage, VkDeviceSize bufferByteSize, VkDeviceSize& memoryByteOffset)
+VkBuffer cVulkanEngine::SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(VkBufferUsageFlags bufferUsage, VkDeviceSize bufferByteSize, VkDeviceSize& memoryByteOffset)
 {
 	assert(bufferByteSize < context.bigDeviceLocalBufferBytesLeft);
 	assert(bufferUsage & context.bigDeviceLocalBufferUsageFlags);
@@ -1211,6 +2717,7 @@ VkBuffer cSetup::SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(VkBufferUsag
 		VkDeviceSize aligmentByteAdjusment = bufferMemoryRequirements.alignment -
 			(context.bigDeviceLocalBufferNextAvailableByte % bufferMemoryRequirements.alignment);
 
+		context.bigDeviceLocalBufferBytesLeft -= aligmentByteAdjusment;
 		context.bigDeviceLocalBufferNextAvailableByte += aligmentByteAdjusment;
 
 		VK_CHECK(vkBindBufferMemory(context.device, buffer, context.bigDeviceLocalBufferAndMore.bufferMemory,
@@ -1227,11 +2734,12 @@ VkBuffer cSetup::SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(VkBufferUsag
 
 /**********************************************************************/
 
-void cSetup::PrepareBigHostVisibleVulkanBufferAndMore(VkDeviceSize bufferByteSize)
+void cVulkanEngine::PrepareBigHostVisibleVulkanBufferAndMore(VkDeviceSize bufferByteSize)
 {
 	const VkBufferUsageFlags bufferUsageFlags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 	context.bigHostVisibleVulkanBufferUsageFlags = bufferUsageFlags;
 	context.bigHostVisibleVulkanBufferBytesLeft = bufferByteSize;
+	context.bigHostVisibleVulkanBufferNextAvailableByte = 0;
 
 	const VkBufferCreateInfo bufferCI =
 	{
@@ -1260,12 +2768,19 @@ void cSetup::PrepareBigHostVisibleVulkanBufferAndMore(VkDeviceSize bufferByteSiz
 	};
 
 	VK_CHECK(vkAllocateMemory(context.device, &bufferMemoryAllocateInfo, nullptr, &context.bigHostVisibleVulkanBufferAndMore.bufferMemory));
+
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(context.gpu, &memoryProperties);
+	context.bigHostVisibleVulkanBufferAndMore.memoryByteSize = bufferMemoryRequirements.size;
+	context.bigHostVisibleVulkanBufferAndMore.memoryHeapIndex = memoryProperties.memoryTypes[bufferMemoryAllocateInfo.memoryTypeIndex].heapIndex;
+	bigBufferBytesOfEveryHeap[context.bigHostVisibleVulkanBufferAndMore.memoryHeapIndex] += bufferMemoryRequirements.size;
+
 	VK_CHECK(vkMapMemory(context.device, context.bigHostVisibleVulkanBufferAndMore.bufferMemory, 0, bufferByteSize, 0, &context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory));
 }
 
 /**********************************************************************/
 
-VkBuffer cSetup::SuballocateBufferFromTheBigHostVisibleVulkanBuffer(VkBufferUsageFlags bufferUsage, VkDeviceSize bufferByteSize, VkDeviceSize& memoryByteOffset)
+VkBuffer cVulkanEngine::SuballocateBufferFromTheBigHostVisibleVulkanBuffer(VkBufferUsageFlags bufferUsage, VkDeviceSize bufferByteSize, VkDeviceSize& memoryByteOffset)
 {
 	assert(bufferByteSize < context.bigHostVisibleVulkanBufferBytesLeft);
 	assert(bufferUsage & context.bigHostVisibleVulkanBufferUsageFlags);
@@ -1297,144 +2812,669 @@ VkBuffer cSetup::SuballocateBufferFromTheBigHostVisibleVulkanBuffer(VkBufferUsag
 		context.bigHostVisibleVulkanBufferBytesLeft -= bufferMemoryRequirements.size;
 		context.bigHostVisibleVulkanBufferNextAvailableByte += bufferMemoryRequirements.size;
 	}
-	else
+	else
+	{
+		const VkDeviceSize aligmentByteAdjusment = bufferMemoryRequirements.alignment -
+			(context.bigHostVisibleVulkanBufferNextAvailableByte % bufferMemoryRequirements.alignment);
+
+		context.bigHostVisibleVulkanBufferBytesLeft -= aligmentByteAdjusment;
+		context.bigHostVisibleVulkanBufferNextAvailableByte += aligmentByteAdjusment;
+
+		VK_CHECK(vkBindBufferMemory(context.device, buffer, context.bigHostVisibleVulkanBufferAndMore.bufferMemory,
+			context.bigHostVisibleVulkanBufferNextAvailableByte));
+
+		memoryByteOffset = context.bigHostVisibleVulkanBufferNextAvailableByte;
+
+		context.bigHostVisibleVulkanBufferBytesLeft -= bufferMemoryRequirements.size;
+		context.bigHostVisibleVulkanBufferNextAvailableByte += bufferMemoryRequirements.size;
+	}
+
+	return buffer;
+}
+
+/**********************************************************************/
+
+void cSetup::PrepareVulkanSSBSpinBatchesBuffer()
+{
+	context.SSBSpinBatchesBuffer = pTheVulkanEngine->SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, context.SSBSpinBatchesBufferByteSize, context.SSBSpinBatchesBufferByteOffsetIntoTheBigDeviceLocalBuffer
+	);
+
+	// All spins are 1
+	UploadToDeviceLocalBuffer(context.SSBSpinBatchesBuffer, context.SSBSpinBatchesBufferByteSize, [](void* pChunk, VkDeviceSize, VkDeviceSize chunkByteSize)
+		{
+			std::fill_n(reinterpret_cast<uint32_t*>(pChunk), chunkByteSize / sizeof(uint32_t), ~0U);
+		});
+}
+
+/**********************************************************************/
+
+void cSetup::PrepareVulkanSSBSpinWordsBuffer(const uint32_t isingL)
+{
+	const uint32_t spinsPerHalfRow = isingL / 2;
+	const uint32_t wordsPerHalfRow = (spinsPerHalfRow + 31) / 32;
+	const uint32_t bitsInTheLastWord = spinsPerHalfRow - 32 * (wordsPerHalfRow - 1);
+	const uint32_t lastWordMask = (bitsInTheLastWord < 32) ? ((1U << bitsInTheLastWord) - 1) : ~0U;
+
+	context.SSBSpinWordsBuffer = pTheVulkanEngine->SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, context.SSBSpinWordsBufferByteSize, context.SSBSpinWordsBufferByteOffsetIntoTheBigDeviceLocalBuffer
+	);
+
+	// All spins are 1, the padding bits at the end of every half row are 0
+	UploadToDeviceLocalBuffer(context.SSBSpinWordsBuffer, context.SSBSpinWordsBufferByteSize, [&](void* pChunk, VkDeviceSize chunkByteOffset, VkDeviceSize chunkByteSize)
+		{
+			uint32_t* pSpinWords = reinterpret_cast<uint32_t*>(pChunk);
+			const VkDeviceSize firstSpinWordIndex = chunkByteOffset / sizeof(uint32_t);
+			for (VkDeviceSize i = 0; i < chunkByteSize / sizeof(uint32_t); i++)
+			{
+				pSpinWords[i] = ((firstSpinWordIndex + i) % wordsPerHalfRow == wordsPerHalfRow - 1) ? lastWordMask : ~0U;
+			}
+		});
+}
+
+/**********************************************************************/
+
+uint32_t cVulkanEngine::GetMemoryHeapIndex(VkMemoryPropertyFlags memoryProperties) const
+{
+	VkPhysicalDeviceMemoryProperties physicalDeviceMemoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(context.gpu, &physicalDeviceMemoryProperties);
+
+	for (uint32_t i = 0; i < physicalDeviceMemoryProperties.memoryTypeCount; i++)
+	{
+		if ((physicalDeviceMemoryProperties.memoryTypes[i].propertyFlags & memoryProperties) == memoryProperties)
+		{
+			return physicalDeviceMemoryProperties.memoryTypes[i].heapIndex;
+		}
+	}
+
+	throw std::runtime_error("Failed to find suitable memory type!");
+}
+
+/**********************************************************************/
+
+VkDeviceSize cVulkanEngine::GetMemoryHeapBudget(const uint32_t memoryHeapIndex) const
+{
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT memoryBudgetProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+	VkPhysicalDeviceMemoryProperties2 memoryProperties2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2 };
+	if (context.bMemoryBudgetIsSupported)
+	{
+		memoryProperties2.pNext = &memoryBudgetProperties;
+	}
+	vkGetPhysicalDeviceMemoryProperties2(context.gpu, &memoryProperties2);
+
+	// The budget includes what the other processes use, so it is the better estimate
+	if (context.bMemoryBudgetIsSupported)
+	{
+		const VkDeviceSize heapBudget = memoryBudgetProperties.heapBudget[memoryHeapIndex];
+		const VkDeviceSize heapUsage = memoryBudgetProperties.heapUsage[memoryHeapIndex];
+		return (heapBudget > heapUsage) ? heapBudget - heapUsage : 0;
+	}
+
+	// Without it leave a fifth of the heap to the driver and the other processes
+	const VkDeviceSize heapSize = memoryProperties2.memoryProperties.memoryHeaps[memoryHeapIndex].size / 5 * 4;
+	return (heapSize > bigBufferBytesOfEveryHeap[memoryHeapIndex]) ? heapSize - bigBufferBytesOfEveryHeap[memoryHeapIndex] : 0;
+}
+
+/**********************************************************************/
+
+void cVulkanEngine::PushSuballocationMark(const sVulkanMemoryRequirements& memoryRequirements)
+{
+	suballocationMarks.push_back(
+		{
+			.bigDeviceLocalBufferBytesLeft = context.bigDeviceLocalBufferBytesLeft,
+			.bigDeviceLocalBufferNextAvailableByte = context.bigDeviceLocalBufferNextAvailableByte,
+			.bigHostVisibleVulkanBufferBytesLeft = context.bigHostVisibleVulkanBufferBytesLeft,
+			.bigHostVisibleVulkanBufferNextAvailableByte = context.bigHostVisibleVulkanBufferNextAvailableByte,
+			.bigDeviceLocalBufferAndMore = context.bigDeviceLocalBufferAndMore,
+			.bigHostVisibleVulkanBufferAndMore = context.bigHostVisibleVulkanBufferAndMore
+		});
+
+	// A lattice that does not fit into what is left of the big buffers gets big buffers of its own, sized for it. The big buffers they replace are
+	// kept in the mark, so the lattices of a run that shrinks again go back to them
+	try
+	{
+		if (memoryRequirements.deviceLocalByteSize > context.bigDeviceLocalBufferBytesLeft)
+		{
+			suballocationMarks.back().bHasItsOwnBigDeviceLocalBuffer = true;
+			context.bigDeviceLocalBufferAndMore = {};
+			PrepareBigDeviceLocalVulkanBufferAndMore(memoryRequirements.deviceLocalByteSize);
+		}
+		if (memoryRequirements.hostVisibleByteSize > context.bigHostVisibleVulkanBufferBytesLeft)
+		{
+			suballocationMarks.back().bHasItsOwnBigHostVisibleBuffer = true;
+			context.bigHostVisibleVulkanBufferAndMore = {};
+			PrepareBigHostVisibleVulkanBufferAndMore(memoryRequirements.hostVisibleByteSize);
+		}
+	}
+	catch (...)
+	{
+		PopSuballocationMark();
+		throw;
+	}
+}
+
+/**********************************************************************/
+
+void cVulkanEngine::PopSuballocationMark()
+{
+	assert(!suballocationMarks.empty());
+	const sVulkanSuballocationMark& suballocationMark = suballocationMarks.back();
+	if (suballocationMark.bHasItsOwnBigDeviceLocalBuffer)
+	{
+		bigBufferBytesOfEveryHeap[context.bigDeviceLocalBufferAndMore.memoryHeapIndex] -= context.bigDeviceLocalBufferAndMore.memoryByteSize;
+		DestroyVulkanBufferAndMore(context.bigDeviceLocalBufferAndMore);
+		context.bigDeviceLocalBufferAndMore = suballocationMark.bigDeviceLocalBufferAndMore;
+	}
+	if (suballocationMark.bHasItsOwnBigHostVisibleBuffer)
+	{
+		bigBufferBytesOfEveryHeap[context.bigHostVisibleVulkanBufferAndMore.memoryHeapIndex] -= context.bigHostVisibleVulkanBufferAndMore.memoryByteSize;
+		DestroyVulkanBufferAndMore(context.bigHostVisibleVulkanBufferAndMore);
+		context.bigHostVisibleVulkanBufferAndMore = suballocationMark.bigHostVisibleVulkanBufferAndMore;
+	}
+	context.bigDeviceLocalBufferBytesLeft = suballocationMark.bigDeviceLocalBufferBytesLeft;
+	context.bigDeviceLocalBufferNextAvailableByte = suballocationMark.bigDeviceLocalBufferNextAvailableByte;
+	context.bigHostVisibleVulkanBufferBytesLeft = suballocationMark.bigHostVisibleVulkanBufferBytesLeft;
+	context.bigHostVisibleVulkanBufferNextAvailableByte = suballocationMark.bigHostVisibleVulkanBufferNextAvailableByte;
+	suballocationMarks.pop_back();
+}
+
+/**********************************************************************/
+
+void cVulkanEngine::PreparePipelineCache()
+{
+	std::ostringstream pipelineCacheFilename;
+	pipelineCacheFilename << "IsingPipelineCache-" << std::hex << std::setfill('0') << std::setw(4) << context.gpuProperties.vendorID << '-'
+		<< std::setw(4) << context.gpuProperties.deviceID << '-' << std::setw(8) << context.gpuProperties.driverVersion << '-';
+	for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+	{
+		pipelineCacheFilename << std::setw(2) << (uint32_t)context.gpuProperties.pipelineCacheUUID[i];
+	}
+	pipelineCacheFilename << ".bin";
+	pipelineCacheFilePath = GetExecutableDirectory() / pipelineCacheFilename.str();
+
+	// A missing file or one that is not a cache of this device starts with an empty cache
+	std::vector<char> pipelineCacheData;
+	std::ifstream infile(pipelineCacheFilePath, std::ios_base::binary | std::ios_base::ate);
+	if (infile.is_open())
+	{
+		pipelineCacheData.resize((size_t)infile.tellg());
+		infile.seekg(0);
+		infile.read(pipelineCacheData.data(), pipelineCacheData.size());
+		infile.close();
+	}
+
+	// The header: the header length, the header version, the vendor ID, the device ID and the pipeline cache UUID
+	const size_t pipelineCacheHeaderByteSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+	if (pipelineCacheData.size() < pipelineCacheHeaderByteSize ||
+		std::memcmp(pipelineCacheData.data() + 4 * sizeof(uint32_t), context.gpuProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		pipelineCacheData.clear();
+	}
+
+	const VkPipelineCacheCreateInfo pipelineCacheCI =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.initialDataSize = pipelineCacheData.size(),
+		.pInitialData = pipelineCacheData.empty() ? nullptr : pipelineCacheData.data()
+	};
+
+	VK_CHECK(vkCreatePipelineCache(context.device, &pipelineCacheCI, nullptr, &pipelineCache));
+}
+
+/**********************************************************************/
+
+void cVulkanEngine::SavePipelineCache()
+{
+	size_t pipelineCacheDataByteSize = 0;
+	if (vkGetPipelineCacheData(context.device, pipelineCache, &pipelineCacheDataByteSize, nullptr) != VK_SUCCESS || pipelineCacheDataByteSize == 0)
+	{
+		return;
+	}
+	std::vector<char> pipelineCacheData(pipelineCacheDataByteSize);
+	if (vkGetPipelineCacheData(context.device, pipelineCache, &pipelineCacheDataByteSize, pipelineCacheData.data()) != VK_SUCCESS)
+	{
+		return;
+	}
+
+	// Not being able to write the cache only costs the next run its compile time
+	std::ofstream outfile(pipelineCacheFilePath, std::ios_base::binary | std::ios_base::trunc);
+	if (!outfile.is_open())
+	{
+		std::cout << "Failed to write the pipeline cache.\n";
+		return;
+	}
+	outfile.write(pipelineCacheData.data(), pipelineCacheDataByteSize);
+	outfile.close();
+}
+
+/**********************************************************************/
+
+void cVulkanEngine::PrecompileComputePipelines()
+{
+	const eSpinSumReductionType spinSumReductionType = context.bSubgroupArithmeticIsSupported ?
+		SPIN_SUM_REDUCTION_TYPE_SUBGROUP_ARITHMETIC : SPIN_SUM_REDUCTION_TYPE_WORKGROUP_SHARED_MEMORY;
+	const std::array<eComputeShaderType, 6> computeShaderTypes = { COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN, COMPUTE_SHADER_TYPE_1_INT_PER_SPIN,
+		COMPUTE_SHADER_TYPE_MULTI_SPIN_CODED, COMPUTE_SHADER_TYPE_SHARED_MEMORY_TILED, COMPUTE_SHADER_TYPE_1_BYTE_PER_SPIN_SUBLATTICES,
+		COMPUTE_SHADER_TYPE_BATCHED_REPLICAS };
+	for (eComputeShaderType computeShaderType : computeShaderTypes)
+	{
+		if (computeShaderType == COMPUTE_SHADER_TYPE_1_BYTE_PER_SPIN_SUBLATTICES && !context.bStorageBuffer8BitAccessIsSupported)
+		{
+			continue;
+		}
+		try
+		{
+			GetComputePipeline(computeShaderType, spinSumReductionType, {}, RANDOM_NUMBER_GENERATOR_TYPE_XORSHIFT_STATE_PER_SPIN);
+		}
+		catch (const std::exception&)
+		{
+			// A kernel that fails here fails again for the cSetup that uses it, which reports it
+		}
+	}
+	if (context.bShaderFloat64IsSupported)
+	{
+		try
+		{
+			GetMomentReductionPipeline();
+		}
+		catch (const std::exception&)
+		{
+		}
+	}
+}
+
+/**********************************************************************/
+
+cVulkanEngine::cVulkanEngine(const bool bUsePipelineCache, const uint32_t deviceIndex)
+{
+	PrepareVulkanInstance({}, { "VK_LAYER_KHRONOS_validation" });
+	PrepareVulkanDevice({}, deviceIndex);
+	PrepareBigDeviceLocalVulkanBufferAndMore(48'000'000);
+	PrepareBigHostVisibleVulkanBufferAndMore(48'000'000);
+	// Every cSetup uploads its buffers through it in its constructor only, so one is enough for all of them. It is not suballocated,
+	// since the big buffers are replaced for the large lattices
+	context.persistentStagingBufferByteSize = 24'000'000;
+	CreateVulkanBufferAndMemoryAndBindBuffer(context, context.persistentStagingBufferAndMore.bufferMemory, context.persistentStagingBufferAndMore.buffer,
+		context.persistentStagingBufferByteSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_SHARING_MODE_EXCLUSIVE, 1, reinterpret_cast<uint32_t*>(&context.computeQueueIndex),
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	VK_CHECK(vkMapMemory(context.device, context.persistentStagingBufferAndMore.bufferMemory, 0, context.persistentStagingBufferByteSize, 0,
+		&context.persistentStagingBufferAndMore.pVulkanBufferMemory));
+	PrepareDescriptorSetLayoutAndPipelineLayout();
+	if (bUsePipelineCache)
+	{
+		PreparePipelineCache();
+		precompileThread = std::thread([this]() { PrecompileComputePipelines(); });
+	}
+}
+
+/**********************************************************************/
+
+cVulkanEngine::~cVulkanEngine()
+{
+	assert(suballocationMarks.empty());
+	if (precompileThread.joinable())
+	{
+		precompileThread.join();
+	}
+	if (context.device != VK_NULL_HANDLE)
+	{
+		vkDeviceWaitIdle(context.device);
+	}
+	for (const auto& computePipeline : computePipelines)
+	{
+		vkDestroyPipeline(context.device, computePipeline.second, nullptr);
+	}
+	if (momentReductionPipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(context.device, momentReductionPipeline, nullptr);
+	}
+	if (pipelineCache != VK_NULL_HANDLE)
+	{
+		SavePipelineCache();
+		vkDestroyPipelineCache(context.device, pipelineCache, nullptr);
+	}
+	if (context.computePipelineLayout != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineLayout(context.device, context.computePipelineLayout, nullptr);
+	}
+	if (context.descriptorSetLayout != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorSetLayout(context.device, context.descriptorSetLayout, nullptr);
+	}
+	DestroyVulkanBufferAndMore(context.persistentStagingBufferAndMore);
+	DestroyVulkanBufferAndMore(context.bigDeviceLocalBufferAndMore);
+	DestroyVulkanBufferAndMore(context.bigHostVisibleVulkanBufferAndMore);
+	if (context.device != VK_NULL_HANDLE)
+	{
+		vkDestroyDevice(context.device, nullptr);
+	}
+	if (context.debugMessenger != VK_NULL_HANDLE)
+	{
+		PFN_vkDestroyDebugUtilsMessengerEXT destroy_debug_utils_messenger =
+			(PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(context.instance, "vkDestroyDebugUtilsMessengerEXT");
+		if (destroy_debug_utils_messenger != nullptr)
+		{
+			destroy_debug_utils_messenger(context.instance, context.debugMessenger, nullptr);
+		}
+		else
+		{
+			std::cout << "Failed to get address to 'vkDestroyDebugUtilsMessengerEXT' function!\n";
+		}
+	}
+	if (context.instance != VK_NULL_HANDLE)
 	{
-		const VkDeviceSize aligmentByteAdjusment = bufferMemoryRequirements.alignment -
-			(context.bigHostVisibleVulkanBufferNextAvailableByte % bufferMemoryRequirements.alignment);
-
-		context.bigHostVisibleVulkanBufferNextAvailableByte += aligmentByteAdjusment;
-
-		VK_CHECK(vkBindBufferMemory(context.device, buffer, context.bigHostVisibleVulkanBufferAndMore.bufferMemory,
-			context.bigHostVisibleVulkanBufferNextAvailableByte));
-
-		memoryByteOffset = context.bigHostVisibleVulkanBufferNextAvailableByte;
-
-		context.bigHostVisibleVulkanBufferBytesLeft -= bufferMemoryRequirements.size;
-		context.bigHostVisibleVulkanBufferNextAvailableByte += bufferMemoryRequirements.size;
+		vkDestroyInstance(context.instance, nullptr);
 	}
-
-	return buffer;
 }
 
 /**********************************************************************/
 
-void cSetup::PrepareVulkanSSBSpinBatchesBuffer(const uint32_t isingL)
+std::vector<std::string> cVulkanEngine::FindTheComputeDevices()
 {
-	const uint32_t isingN = isingL * isingL;
-	const uint32_t numberOfSpinBatches = (uint32_t)std::ceil(isingN / 32.0f);
-	const uint32_t bufferByteSize = numberOfSpinBatches * 4;
-	context.SSBSpinBatchesBufferByteSize = bufferByteSize;
-
-	uint32_t* spinBatches = new uint32_t[numberOfSpinBatches];
-	for (uint32_t i = 0; i < numberOfSpinBatches; i++)
+	// A bare instance without layers, a machine without a Vulkan driver fails here instead of in the engine
+	const VkApplicationInfo applicationInfo =
 	{
-		spinBatches[i] = ~0U;																// All spins are 1
-	}
-
-	assert(bufferByteSize <= context.persistentStagingBufferByteSize);
-	void* pStagingBuffer = reinterpret_cast<char*>(context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory)
-		+ context.persistentStagingBufferByteOffsetIntoTheBigHostVisibleBuffer;
-	std::memcpy(pStagingBuffer, spinBatches, bufferByteSize);
-	delete[] spinBatches;
-
-	assert(bufferByteSize <= context.bigDeviceLocalBufferBytesLeft);
-
-	context.SSBSpinBatchesBuffer = SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, bufferByteSize, context.SSBSpinBatchesBufferByteOffsetIntoTheBigDeviceLocalBuffer
-	);
-
-	// Prepare the command pool, command buffer and copy region
-	VkCommandPool commandPool;
-	VkCommandBuffer commandBuffer;
-	CreateAndBeginOneTimeVulkanCommandBuffer(context, commandPool, commandBuffer);
+		VK_STRUCTURE_TYPE_APPLICATION_INFO,
+		nullptr,
+		"Ising GPU",
+		1,													// App version
+		nullptr,
+		1,													// Engine version
+		VK_API_VERSION_1_3									// API version
+	};
 
-	const VkBufferCopy bufferCopyRegion =
+	const VkInstanceCreateInfo instanceCI =
 	{
-		.srcOffset = 0,
-		.dstOffset = 0,
-		.size = bufferByteSize
+		VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+		nullptr,
+		0,
+		&applicationInfo,
+		0,
+		nullptr,
+		0,
+		nullptr
 	};
 
-	vkCmdCopyBuffer(commandBuffer, context.persistentStagingBuffer, context.SSBSpinBatchesBuffer, 1, &bufferCopyRegion);
+	std::vector<std::string> computeDeviceNames;
+	VkInstance instance = VK_NULL_HANDLE;
+	if (vkCreateInstance(&instanceCI, nullptr, &instance) != VK_SUCCESS)
+	{
+		return computeDeviceNames;
+	}
 
-	VK_CHECK(vkEndCommandBuffer(commandBuffer));
+	uint32_t numberOfGPUs = 0;
+	std::vector<VkPhysicalDevice> gpus;
+	if (vkEnumeratePhysicalDevices(instance, &numberOfGPUs, nullptr) == VK_SUCCESS && numberOfGPUs > 0)
+	{
+		gpus.resize(numberOfGPUs);
+		if (vkEnumeratePhysicalDevices(instance, &numberOfGPUs, gpus.data()) != VK_SUCCESS)
+		{
+			numberOfGPUs = 0;
+		}
+	}
 
-	// Submit the command buffer
-	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	// The same devices in the same order PrepareVulkanDevice counts them in
+	for (uint32_t i = 0; i < numberOfGPUs; i++)
+	{
+		uint32_t numberOfQueueFamilies = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(gpus[i], &numberOfQueueFamilies, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilyProperties(numberOfQueueFamilies);
+		vkGetPhysicalDeviceQueueFamilyProperties(gpus[i], &numberOfQueueFamilies, queueFamilyProperties.data());
 
-	VK_CHECK(vkQueueSubmit(context.computeQueue, 1, &submitInfo, VK_NULL_HANDLE));
-	VK_CHECK(vkQueueWaitIdle(context.computeQueue));
+		for (uint32_t j = 0; j < numberOfQueueFamilies; j++)
+		{
+			if (queueFamilyProperties[j].queueFlags & VK_QUEUE_COMPUTE_BIT)
+			{
+				VkPhysicalDeviceProperties gpuProperties;
+				vkGetPhysicalDeviceProperties(gpus[i], &gpuProperties);
+				computeDeviceNames.push_back(std::string(gpuProperties.deviceName) + ((gpuProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) ? " (software)" : ""));
+				break;
+			}
+		}
+	}
 
-	// Resource destruction
-	vkDestroyCommandPool(context.device, commandPool, nullptr);
+	vkDestroyInstance(instance, nullptr);
+	return computeDeviceNames;
 }
 
 /**********************************************************************/
 
 cSetup::cSetup(const uint32_t ising_L, const uint32_t numberOfSweepsPerTemperature,
-	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, eComputeShaderType computeShaderType)
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, eComputeShaderType computeShaderType,
+	eGPUSchedulingMode gpuSchedulingMode, eSpinSumReductionType spinSumReductionType, const sTiledKernelParameters& tiledKernelParameters,
+	eRandomNumberGeneratorType randomNumberGeneratorType, const uint32_t numberOfReplicas)
+	: cSetup(std::make_shared<cVulkanEngine>(), ising_L, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample,
+		computeShaderType, gpuSchedulingMode, spinSumReductionType, tiledKernelParameters, randomNumberGeneratorType, numberOfReplicas)
 {
-	PrepareVulkanInstance({}, { "VK_LAYER_KHRONOS_validation" });
-	PrepareVulkanDevice({});
-	PrepareBigDeviceLocalVulkanBufferAndMore(48'000'000);
-	PrepareBigHostVisibleVulkanBufferAndMore(48'000'000);
-	context.persistentStagingBufferByteSize = 24'000'000;
-	context.persistentStagingBuffer = SuballocateBufferFromTheBigHostVisibleVulkanBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT, context.persistentStagingBufferByteSize, context.persistentStagingBufferByteOffsetIntoTheBigHostVisibleBuffer
-	);
-	context.uniformBufferByteSize = sizeof(sUniformBufferObject);
-	context.uniformBuffer = SuballocateBufferFromTheBigHostVisibleVulkanBuffer(
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, context.uniformBufferByteSize, context.uniformBufferByteOffsetIntoTheBigHostVisibleBuffer
-	);
-	if (computeShaderType == COMPUTE_SHADER_TYPE_1_INT_PER_SPIN)
+}
+
+/**********************************************************************/
+
+cSetup::cSetup(std::shared_ptr<cVulkanEngine> pTheVulkanEngine, const uint32_t ising_L, const uint32_t numberOfSweepsPerTemperature,
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, eComputeShaderType computeShaderType,
+	eGPUSchedulingMode gpuSchedulingMode, eSpinSumReductionType spinSumReductionType, const sTiledKernelParameters& tiledKernelParameters,
+	eRandomNumberGeneratorType randomNumberGeneratorType, const uint32_t numberOfReplicas)
+{
+	if (!pTheVulkanEngine)
 	{
-		PrepareVulkanSSBSpinBuffer(ising_L);
+		throw std::runtime_error("A cSetup needs a Vulkan engine!");
 	}
-	else if (computeShaderType == COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN)
+	if (computeShaderType == COMPUTE_SHADER_TYPE_MULTI_SPIN_CODED && ising_L % 2 == 1)
+	{
+		throw std::runtime_error("The multi-spin-coded compute shader needs an even grid length!");
+	}
+	if (computeShaderType == COMPUTE_SHADER_TYPE_1_BYTE_PER_SPIN_SUBLATTICES)
+	{
+		if (ising_L % 2 == 1)
+		{
+			throw std::runtime_error("The byte per spin compute shader needs an even grid length!");
+		}
+		if (!pTheVulkanEngine->context.bStorageBuffer8BitAccessIsSupported)
+		{
+			throw std::runtime_error("The byte per spin compute shader needs a device with 8 bit storage buffer access!");
+		}
+	}
+	if (numberOfReplicas == 0 || numberOfReplicas > sBatchedReplicasUniformBufferObject::maxNumberOfReplicas)
+	{
+		throw std::runtime_error("The number of replicas must be between 1 and sBatchedReplicasUniformBufferObject::maxNumberOfReplicas!");
+	}
+	if (numberOfReplicas > 1 && computeShaderType != COMPUTE_SHADER_TYPE_BATCHED_REPLICAS)
+	{
+		throw std::runtime_error("Only the batched replicas compute shader sweeps more than one replica!");
+	}
+	if (computeShaderType == COMPUTE_SHADER_TYPE_SHARED_MEMORY_TILED)
+	{
+		const uint32_t sweepsPerDispatch = tiledKernelParameters.sweepsPerDispatch;
+		if (ising_L % 2 == 1)
+		{
+			throw std::runtime_error("The tiled compute shader needs an even grid length!");
+		}
+		if (tiledKernelParameters.tileWidth < 3 || tiledKernelParameters.tileHeight < 3)
+		{
+			throw std::runtime_error("The tiles of the tiled compute shader need an interior!");
+		}
+		// A power of two, so the sweep blocks hold a whole and even number of dispatches
+		if (sweepsPerDispatch == 0 || sweepsPerDispatch > sTiledKernelParameters::maxSweepsPerTiledDispatch || (sweepsPerDispatch & (sweepsPerDispatch - 1)) != 0)
+		{
+			throw std::runtime_error("The sweeps per dispatch of the tiled compute shader must be a power of two up to maxSweepsPerTiledDispatch!");
+		}
+		if (numberOfSweepsPerTemperature % sweepsPerDispatch != 0)
+		{
+			throw std::runtime_error("The number of sweeps per temperature must be a multiple of the sweeps per dispatch of the tiled compute shader!");
+		}
+		// The tile spins, their XORShift states and the partial spin sums of the workgroup. Philox needs no states
+		const uint32_t tileWordsPerSpin = (randomNumberGeneratorType == RANDOM_NUMBER_GENERATOR_TYPE_PHILOX) ? 1 : 2;
+		const uint32_t sharedMemoryByteSize = tiledKernelParameters.tileWidth * tiledKernelParameters.tileHeight * tileWordsPerSpin * sizeof(uint32_t)
+			+ pTheVulkanEngine->context.localWorkGroupSizeInX * sizeof(int);
+		if (sharedMemoryByteSize > pTheVulkanEngine->context.gpuProperties.limits.maxComputeSharedMemorySize)
+		{
+			throw std::runtime_error("The tile of the tiled compute shader does not fit into shared memory!");
+		}
+	}
+	this->tiledKernelParameters = tiledKernelParameters;
+	this->randomNumberGeneratorType = randomNumberGeneratorType;
+	this->numberOfReplicas = numberOfReplicas;
+	randomSeed = (uint64_t)std::chrono::system_clock::now().time_since_epoch().count();
+
+	this->pTheVulkanEngine = pTheVulkanEngine;
+	this->computeShaderType = computeShaderType;
+	this->gpuSchedulingMode = gpuSchedulingMode;
+	context = pTheVulkanEngine->context;
+	const sVulkanMemoryRequirements memoryRequirements = CalculateTheVulkanBufferByteSizes(ising_L, numberOfSweepsPerTemperature,
+		numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+	CheckTheCapacityOfTheDevice(ising_L, memoryRequirements);
+
+	// The mark may replace the big buffers, so they are taken from the engine once more. PushSuballocationMark pops the mark itself if it throws
+	pTheVulkanEngine->PushSuballocationMark(memoryRequirements);
+	try
+	{
+		context.bigDeviceLocalBufferAndMore = pTheVulkanEngine->context.bigDeviceLocalBufferAndMore;
+		context.bigHostVisibleVulkanBufferAndMore = pTheVulkanEngine->context.bigHostVisibleVulkanBufferAndMore;
+
+		context.uniformBuffer = pTheVulkanEngine->SuballocateBufferFromTheBigHostVisibleVulkanBuffer(
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, context.uniformBufferByteSize, context.uniformBufferByteOffsetIntoTheBigHostVisibleBuffer
+		);
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			context.uniformStagingBuffers[i] = pTheVulkanEngine->SuballocateBufferFromTheBigHostVisibleVulkanBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT, context.uniformBufferByteSize, context.uniformStagingBufferByteOffsetsIntoTheBigHostVisibleBuffer[i]
+			);
+		}
+		if (computeShaderType == COMPUTE_SHADER_TYPE_1_INT_PER_SPIN || computeShaderType == COMPUTE_SHADER_TYPE_SHARED_MEMORY_TILED ||
+			computeShaderType == COMPUTE_SHADER_TYPE_1_BYTE_PER_SPIN_SUBLATTICES || computeShaderType == COMPUTE_SHADER_TYPE_BATCHED_REPLICAS)
+		{
+			PrepareVulkanSSBSpinBuffer();
+		}
+		else if (computeShaderType == COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN)
+		{
+			PrepareVulkanSSBSpinBatchesBuffer();
+		}
+		else if (computeShaderType == COMPUTE_SHADER_TYPE_MULTI_SPIN_CODED)
+		{
+			PrepareVulkanSSBSpinWordsBuffer(ising_L);
+		}
+		if (randomNumberGeneratorType == RANDOM_NUMBER_GENERATOR_TYPE_XORSHIFT_STATE_PER_SPIN)
+		{
+			PrepareVulkanSSBRandomNumbersBuffer();
+		}
+		PrepareVulkanSSBSpinSumBuffer(ising_L);
+		PrepareVulkanSSBSpinSumSamplesBuffer();
+		PrepareVulkanSpinSumOutputBuffer();
+		if (context.SSBSpinSumMomentsBufferByteSize > 0)
+		{
+			PrepareVulkanSpinSumMomentsBuffers();
+		}
+		PrepareDescriptorSet(ising_L, computeShaderType);
+		this->spinSumReductionType = spinSumReductionType;
+		if (spinSumReductionType == SPIN_SUM_REDUCTION_TYPE_SUBGROUP_ARITHMETIC && !context.bSubgroupArithmeticIsSupported)
+		{
+			this->spinSumReductionType = SPIN_SUM_REDUCTION_TYPE_WORKGROUP_SHARED_MEMORY;
+		}
+		PrepareComputePipeline(computeShaderType);
+		PrepareCommandPoolAndCommandBuffer();
+		PrepareTimestampQueryPool();
+		PrepareTemperatureTimelineSemaphore();
+		if (gpuSchedulingMode == GPU_SCHEDULING_MODE_REPLAY_SWEEP_BLOCKS)
+		{
+			PrepareSweepBlockCommandBuffers(ising_L);
+		}
+		if (spinSumSampleRingHalfCapacity > 0)
+		{
+			PrepareSpinSumSampleRing();
+		}
+	}
+	catch (...)
 	{
-		PrepareVulkanSSBSpinBatchesBuffer(ising_L);
+		// The destructor is not called for a constructor that throws, so what was created so far is destroyed here and the mark popped
+		DestroyTheVulkanObjects();
+		throw;
 	}
-	PrepareVulkanSSBRandomNumbersBuffer(ising_L);
-	PrepareVulkanSSBSpinSumBuffer(ising_L);
-	PrepareVulkanSpinSumOutputBuffer(numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
-	PrepareDescriptorSet(ising_L, computeShaderType);
-	PrepareComputePipeline(computeShaderType);
-	PrepareCommandPoolAndCommandBuffer();
 }
 
 /**********************************************************************/
 
 cSetup::~cSetup()
 {
-	if (context.persistentStagingBuffer != VK_NULL_HANDLE)
-	{
-		vkDestroyBuffer(context.device, context.persistentStagingBuffer, nullptr);
-	}
+	DestroyTheVulkanObjects();
+}
+
+/**********************************************************************/
+
+void cSetup::DestroyTheVulkanObjects()
+{
+	// The last temperatures may still be in flight
+	vkDeviceWaitIdle(context.device);
 	if (context.commandPool != VK_NULL_HANDLE)
 	{
 		vkDestroyCommandPool(context.device, context.commandPool, nullptr);
 	}
-	if (context.computePipeline != VK_NULL_HANDLE)
+	if (context.sweepBlockCommandPool != VK_NULL_HANDLE)
 	{
-		vkDestroyPipeline(context.device, context.computePipeline, nullptr);
+		vkDestroyCommandPool(context.device, context.sweepBlockCommandPool, nullptr);
 	}
-	if (context.computePipelineLayout != VK_NULL_HANDLE)
+	for (VkFence sweepBlockFence : context.sweepBlockFences)
 	{
-		vkDestroyPipelineLayout(context.device, context.computePipelineLayout, nullptr);
+		if (sweepBlockFence != VK_NULL_HANDLE)
+		{
+			vkDestroyFence(context.device, sweepBlockFence, nullptr);
+		}
+	}
+	if (context.timestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(context.device, context.timestampQueryPool, nullptr);
+	}
+	if (context.temperatureTimelineSemaphore != VK_NULL_HANDLE)
+	{
+		vkDestroySemaphore(context.device, context.temperatureTimelineSemaphore, nullptr);
+	}
+	if (context.sampleDrainCommandPool != VK_NULL_HANDLE)
+	{
+		vkDestroyCommandPool(context.device, context.sampleDrainCommandPool, nullptr);
+	}
+	for (VkSemaphore ringTimelineSemaphore : { context.sweepBlockTimelineSemaphore, context.sampleDrainTimelineSemaphore })
+	{
+		if (ringTimelineSemaphore != VK_NULL_HANDLE)
+		{
+			vkDestroySemaphore(context.device, ringTimelineSemaphore, nullptr);
+		}
+	}
+	for (VkBuffer spinSumSampleDrainBuffer : context.spinSumSampleDrainBuffers)
+	{
+		if (spinSumSampleDrainBuffer != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(context.device, spinSumSampleDrainBuffer, nullptr);
+		}
 	}
 	if (context.descriptorPool != VK_NULL_HANDLE)
 	{
 		vkDestroyDescriptorPool(context.device, context.descriptorPool, nullptr);
 	}
-	if (context.descriptorSetLayout != VK_NULL_HANDLE)
+	for (VkBuffer spinSumOutputBuffer : context.spinSumOutputBuffers)
 	{
-		vkDestroyDescriptorSetLayout(context.device, context.descriptorSetLayout, nullptr);
+		if (spinSumOutputBuffer != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(context.device, spinSumOutputBuffer, nullptr);
+		}
+	}
+	for (VkBuffer spinSumMomentsOutputBuffer : context.spinSumMomentsOutputBuffers)
+	{
+		if (spinSumMomentsOutputBuffer != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(context.device, spinSumMomentsOutputBuffer, nullptr);
+		}
 	}
-	if (context.spinSumOutputBuffer != VK_NULL_HANDLE)
+	if (context.SSBSpinSumMomentsBuffer != VK_NULL_HANDLE)
 	{
-		vkDestroyBuffer(context.device, context.spinSumOutputBuffer, nullptr);
+		vkDestroyBuffer(context.device, context.SSBSpinSumMomentsBuffer, nullptr);
+	}
+	for (VkBuffer uniformStagingBuffer : context.uniformStagingBuffers)
+	{
+		if (uniformStagingBuffer != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(context.device, uniformStagingBuffer, nullptr);
+		}
 	}
 	if (context.uniformBuffer != VK_NULL_HANDLE)
 	{
@@ -1444,6 +3484,10 @@ cSetup::~cSetup()
 	{
 		vkDestroyBuffer(context.device, context.SSBSpinSumBuffer, nullptr);
 	}
+	if (context.SSBSpinSumSamplesBuffer != VK_NULL_HANDLE)
+	{
+		vkDestroyBuffer(context.device, context.SSBSpinSumSamplesBuffer, nullptr);
+	}
 	if (context.SSBSpinBuffer != VK_NULL_HANDLE)
 	{
 		vkDestroyBuffer(context.device, context.SSBSpinBuffer, nullptr);
@@ -1456,69 +3500,129 @@ cSetup::~cSetup()
 	{
 		vkDestroyBuffer(context.device, context.SSBSpinBatchesBuffer, nullptr);
 	}
-	DestroyVulkanBufferAndMore(context.bigDeviceLocalBufferAndMore);
-	DestroyVulkanBufferAndMore(context.bigHostVisibleVulkanBufferAndMore);
-	if (context.device != VK_NULL_HANDLE)
+	if (context.SSBSpinWordsBuffer != VK_NULL_HANDLE)
 	{
-		vkDestroyDevice(context.device, nullptr);
+		vkDestroyBuffer(context.device, context.SSBSpinWordsBuffer, nullptr);
 	}
-	if (context.debugMessenger != VK_NULL_HANDLE)
+	// The pipeline, the layouts and the big buffers belong to the engine
+	pTheVulkanEngine->PopSuballocationMark();
+}
+
+/**********************************************************************/
+
+double CalculateBinderCumulantGPU(cSetup* pTheSetup, const uint32_t isingL)
+{
+	return CalculateBinderCumulantGPU(pTheSetup, isingL, pTheSetup->lastSubmittedTemperatureNumber);
+}
+
+/**********************************************************************/
+
+double CalculateBinderCumulantGPU(cSetup* pTheSetup, const uint32_t isingL, const uint64_t temperatureNumber)
+{
+	return CalculateTheObservablesGPU(pTheSetup, isingL, temperatureNumber).GetBinderCumulant();
+}
+
+/**********************************************************************/
+
+cObservableAccumulator CalculateTheObservablesGPU(cSetup* pTheSetup, const uint32_t isingL, const uint64_t temperatureNumber)
+{
+	// The temperature two after this one writes its samples to the same spin sum output buffer
+	if (temperatureNumber == 0 || temperatureNumber + 2 <= pTheSetup->lastSubmittedTemperatureNumber)
 	{
-		PFN_vkDestroyDebugUtilsMessengerEXT destroy_debug_utils_messenger =
-			(PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(context.instance, "vkDestroyDebugUtilsMessengerEXT");
-		if (destroy_debug_utils_messenger != nullptr)
-		{
-			destroy_debug_utils_messenger(context.instance, context.debugMessenger, nullptr);
-		}
-		else
+		throw std::runtime_error("The samples of the temperature are no longer in a spin sum output buffer!");
+	}
+	pTheSetup->WaitForTheTemperature(temperatureNumber);
+
+	const uint32_t temperatureSlotIndex = temperatureNumber % 2;
+	cObservableAccumulator TheObservableAccumulator(isingL);
+
+	// There is no moment reduction with a ring, the ring only holds the last samples. The host summed the moments replica by replica
+	// as the halves were drained, their sums are added up here
+	if (pTheSetup->spinSumSampleRingHalfCapacity > 0)
+	{
+		for (const cObservableAccumulator& TheReplicaObservableAccumulator : pTheSetup->spinSumSampleAccumulators[temperatureSlotIndex])
 		{
-			std::cout << "Failed to get address to 'vkDestroyDebugUtilsMessengerEXT' function!\n";
+			const uint64_t numberOfReplicaSamples = TheReplicaObservableAccumulator.GetNumberOfSamples();
+			TheObservableAccumulator.AddMomentSums(numberOfReplicaSamples, TheReplicaObservableAccumulator.GetMeanAbsoluteMagnetization() * numberOfReplicaSamples,
+				TheReplicaObservableAccumulator.GetMeanMagnetization2() * numberOfReplicaSamples, TheReplicaObservableAccumulator.GetMeanMagnetization4() * numberOfReplicaSamples);
 		}
+		return TheObservableAccumulator;
 	}
-	if (context.instance != VK_NULL_HANDLE)
+
+	size_t numberOfSpinSumSamples = 0;
+	const int* pSpinSumSamples = pTheSetup->GetTheSpinSumSamples(temperatureSlotIndex, numberOfSpinSumSamples);
+
+	// With shaderFloat64 the moments were summed on the GPU, only the sums of the workgroups are added here
+	if (pTheSetup->context.momentReductionPipeline != VK_NULL_HANDLE)
 	{
-		vkDestroyInstance(context.instance, nullptr);
+		const sSpinSumMomentsStorageBufferObject* pWorkgroupMoments = reinterpret_cast<const sSpinSumMomentsStorageBufferObject*>(
+			reinterpret_cast<const char*>(pTheSetup->context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory)
+			+ pTheSetup->context.spinSumMomentsOutputBufferByteOffsetsIntoTheBigHostVisibleBuffer[temperatureSlotIndex]);
+		sKahanSum absoluteMagnetizationSum;
+		sKahanSum magnetization2Sum;
+		sKahanSum magnetization4Sum;
+		for (uint32_t i = 0; i < sSpinSumMomentsStorageBufferObject::numberOfWorkGroups; i++)
+		{
+			absoluteMagnetizationSum.Add(pWorkgroupMoments[i].absoluteMagnetizationSum);
+			magnetization2Sum.Add(pWorkgroupMoments[i].magnetization2Sum);
+			magnetization4Sum.Add(pWorkgroupMoments[i].magnetization4Sum);
+		}
+		TheObservableAccumulator.AddMomentSums(numberOfSpinSumSamples, absoluteMagnetizationSum.sum, magnetization2Sum.sum, magnetization4Sum.sum);
+		return TheObservableAccumulator;
 	}
+
+	TheObservableAccumulator.AddSamples(pSpinSumSamples, static_cast<uint32_t>(numberOfSpinSumSamples));
+
+	return TheObservableAccumulator;
 }
 
 /**********************************************************************/
 
-double CalculateBinderCumulantGPU(cSetup* pTheSetup, const uint32_t isingL)
+std::vector<cObservableAccumulator> AccumulateTheSpinSumSamplesOfEveryReplicaGPU(cSetup* pTheSetup, const uint32_t isingL, const uint64_t temperatureNumber)
 {
-	const uint32_t isingN = isingL * isingL;
-	const uint32_t numberOfElementsInTheSpinSumOutputBuffer = static_cast<uint32_t>(pTheSetup->context.spinSumOutputBufferByteSize / sizeof(int));
-	double m4Sum = 0;
-	double m2Sum = 0;
-	int* pSpinSumOutputBuffer = reinterpret_cast<int*>(reinterpret_cast<char*>(pTheSetup->context.bigHostVisibleVulkanBufferAndMore.pVulkanBufferMemory)
-		+ pTheSetup->context.spinSumOutputBufferByteOffsetIntoTheBigHostVisibleBuffer);
-	
-	for (uint32_t i = 0; i < numberOfElementsInTheSpinSumOutputBuffer; i++)
+	if (temperatureNumber == 0 || temperatureNumber + 2 <= pTheSetup->lastSubmittedTemperatureNumber)
+	{
+		throw std::runtime_error("The samples of the temperature are no longer in a spin sum output buffer!");
+	}
+	pTheSetup->WaitForTheTemperature(temperatureNumber);
+
+	// With a ring the drained halves were added as they came
+	const uint32_t temperatureSlotIndex = temperatureNumber % 2;
+	if (pTheSetup->spinSumSampleRingHalfCapacity > 0)
 	{
-		const double averageSpinPerSite = (double)(*pSpinSumOutputBuffer) / (double)isingN;						// The average spin per site
-		m4Sum += std::pow(averageSpinPerSite, 4);
-		m2Sum += std::pow(averageSpinPerSite, 2);
-		pSpinSumOutputBuffer++;
+		return pTheSetup->spinSumSampleAccumulators[temperatureSlotIndex];
 	}
 
-	// Calculate the Binder Cumulant
-	const double m4Average = m4Sum / numberOfElementsInTheSpinSumOutputBuffer;									// The state average
-	const double m2Average = m2Sum / numberOfElementsInTheSpinSumOutputBuffer;									// The state average
-	const double binderCumulant = 1.0 - (m4Average / (3.0 * std::pow(m2Average, 2)));
+	// The kernel writes the samples replica by replica
+	size_t numberOfSpinSumSamples = 0;
+	const int* pSpinSumSamples = pTheSetup->GetTheSpinSumSamples(temperatureSlotIndex, numberOfSpinSumSamples);
+	const size_t numberOfSpinSumSamplesPerReplica = numberOfSpinSumSamples / pTheSetup->numberOfReplicas;
 
-	return binderCumulant;
+	std::vector<cObservableAccumulator> observableAccumulators(pTheSetup->numberOfReplicas, cObservableAccumulator(isingL));
+	for (uint32_t i = 0; i < pTheSetup->numberOfReplicas; i++)
+	{
+		observableAccumulators[i].AddSamples(pSpinSumSamples + i * numberOfSpinSumSamplesPerReplica, static_cast<uint32_t>(numberOfSpinSumSamplesPerReplica));
+	}
+	return observableAccumulators;
 }
 
 /**********************************************************************/
 
 void DoTheIsingGridSweepsCPU(uint32_t* pArraySpinBatches, int* pArraySpinSumOutputs, int& TheSpinSum, const uint32_t isingL, const double beta, const uint32_t numberOfSweepsPerTemperature,
-	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample)
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, cObservableAccumulator* pObservableAccumulator)
 {
 	// ------------------------------------------------------------------------------------------
-	const uint32_t transitionProbability4 = (uint32_t)std::ceil(std::exp(-1.0 * beta * 4.0) * 100'000'000);			// The transition probability if deltaE = +4.
-	const uint32_t transitionProbability8 = (uint32_t)std::ceil(std::exp(-1.0 * beta * 8.0) * 100'000'000);			// The transition probability if deltaE = +8.
+	const cAcceptanceTable TheAcceptanceTable(beta);
+	const std::array<uint32_t, 10> acceptanceThresholds = TheAcceptanceTable.GetAcceptanceThresholds();			// A local copy for the hot loop
 	uint32_t spinSumOutputsIndex = 0;																				// Used to index into pArraySpinSumOutputs
 	const uint32_t randomSeed = (uint32_t)std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()) % std::numeric_limits<uint32_t>::max();
 	std::default_random_engine randomNumberGenerator(randomSeed);
+	int TheEnergy = 0;																								// Only tracked for pObservableAccumulator
+	if (pObservableAccumulator != nullptr)
+	{
+		pObservableAccumulator->Reset(isingL);
+		TheEnergy = CalculateTheEnergyCPU(pArraySpinBatches, isingL);
+	}
 	
 	// ------------------------------------------------------------------------------------------
 
@@ -1571,11 +3675,12 @@ void DoTheIsingGridSweepsCPU(uint32_t* pArraySpinBatches, int* pArraySpinSumOutp
 					belowSpinSpin = -1;
 				}
 				
-				const int deltaE = 2 * centerSpinSpin * (rightSpinSpin + leftSpinSpin
-					+ aboveSpinSpin + belowSpinSpin);															// The change in energy if the spin is flipped
+				const int neighbourSpinSum = rightSpinSpin + leftSpinSpin + aboveSpinSpin + belowSpinSpin;
+				const int deltaE = 2 * centerSpinSpin * neighbourSpinSum;												// The change in energy if the spin is flipped
+				const uint32_t acceptanceThreshold = acceptanceThresholds[(centerSpinSpin + 1) / 2 * 5 + (neighbourSpinSum + 4) / 2];
 
 				bool bFlipSpin = false;
-				if (deltaE <= 0)
+				if (acceptanceThreshold == cAcceptanceTable::acceptanceThresholdAlways)
 				{
 					bFlipSpin = true;
 				}
@@ -1584,11 +3689,7 @@ void DoTheIsingGridSweepsCPU(uint32_t* pArraySpinBatches, int* pArraySpinSumOutp
 					uint32_t randomNumber = XORShift(randomState);
 					randomState = randomNumber;
 
-					if (randomNumber % 100'000'000 < transitionProbability4 && deltaE == 4)
-					{
-						bFlipSpin = true;
-					}
-					else if (randomNumber % 100'000'000 < transitionProbability8 && deltaE == 8)
+					if (randomNumber < acceptanceThreshold)
 					{
 						bFlipSpin = true;
 					}
@@ -1605,6 +3706,7 @@ void DoTheIsingGridSweepsCPU(uint32_t* pArraySpinBatches, int* pArraySpinSumOutp
 						pArraySpinBatches[centerSpinSpinBatch] += (1 << (31 - centerSpinSpinBatchBit));							// Flip the spin
 					}
 					TheSpinSum = TheSpinSum - 2 * centerSpinSpin;
+					TheEnergy += deltaE;
 				}
 			}
 		}
@@ -1613,7 +3715,14 @@ void DoTheIsingGridSweepsCPU(uint32_t* pArraySpinBatches, int* pArraySpinSumOutp
 		if (sweepNumber >= numberOfSweepsToWaitBeforeSpinSumSamplingStarts
 			&& (sweepNumber - numberOfSweepsToWaitBeforeSpinSumSamplingStarts) % sweepsPerSpinSumSample == 0)
 		{
-			pArraySpinSumOutputs[spinSumOutputsIndex] = TheSpinSum;
+			if (pArraySpinSumOutputs != nullptr)
+			{
+				pArraySpinSumOutputs[spinSumOutputsIndex] = TheSpinSum;
+			}
+			if (pObservableAccumulator != nullptr)
+			{
+				pObservableAccumulator->AddSample(TheSpinSum, TheEnergy);
+			}
 			spinSumOutputsIndex++;
 		}
 	}
@@ -1623,23 +3732,80 @@ void DoTheIsingGridSweepsCPU(uint32_t* pArraySpinBatches, int* pArraySpinSumOutp
 
 double CalculateBinderCumulantCPU(int* pArraySpinSumOutputs, const uint32_t isingL, const uint32_t numberOfElementsInTheSpinSumOutputArray)
 {
-	const uint32_t isingN = isingL * isingL;
-	double m4Sum = 0;
-	double m2Sum = 0;
+	cObservableAccumulator TheObservableAccumulator(isingL);
+	TheObservableAccumulator.AddSamples(pArraySpinSumOutputs, numberOfElementsInTheSpinSumOutputArray);
+
+	return TheObservableAccumulator.GetBinderCumulant();
+}
+
+/**********************************************************************/
+
+int CalculateTheEnergyCPU(const uint32_t* pArraySpinBatches, const uint32_t isingL)
+{
+	auto GetSpin = [&](const uint32_t rowNumber, const uint32_t columnNumber)
+		{
+			const uint32_t spinIndex = rowNumber * isingL + columnNumber;
+			return ((pArraySpinBatches[spinIndex / 32] >> (31 - spinIndex % 32)) & 1U) ? 1 : -1;
+		};
+
+	int energy = 0;
+	for (uint32_t rowNumber = 0; rowNumber < isingL; rowNumber++)
+	{
+		const uint32_t belowRowNumber = (rowNumber + 1) % isingL;
+		for (uint32_t columnNumber = 0; columnNumber < isingL; columnNumber++)
+		{
+			const uint32_t rightColumnNumber = (columnNumber + 1) % isingL;
+			energy -= GetSpin(rowNumber, columnNumber) * (GetSpin(rowNumber, rightColumnNumber) + GetSpin(belowRowNumber, columnNumber));
+		}
+	}
+
+	return energy;
+}
+
+/**********************************************************************/
+
+double CalculateIntegratedAutocorrelationTimeCPU(int* pArraySpinSumOutputs, const uint32_t numberOfElementsInTheSpinSumOutputArray)
+{
+	const uint32_t n = numberOfElementsInTheSpinSumOutputArray;
+	std::vector<double> squaredSpinSums(n);
+	double mean = 0.0;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		squaredSpinSums[i] = (double)pArraySpinSumOutputs[i] * (double)pArraySpinSumOutputs[i];
+		mean += squaredSpinSums[i];
+	}
+	mean /= n;
 
-	for (uint32_t i = 0; i < numberOfElementsInTheSpinSumOutputArray; i++)
+	double variance = 0.0;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		variance += (squaredSpinSums[i] - mean) * (squaredSpinSums[i] - mean);
+	}
+	variance /= n;
+	if (variance == 0.0)
 	{
-		const double averageSpinPerSite = (double)(pArraySpinSumOutputs[i]) / (double)isingN;				// The average spin per site
-		m4Sum += std::pow(averageSpinPerSite, 4);
-		m2Sum += std::pow(averageSpinPerSite, 2);
+		return 0.5;
 	}
 
-	// Calculate the Binder Cumulant
-	const double m4Average = m4Sum / numberOfElementsInTheSpinSumOutputArray;									// The state average
-	const double m2Average = m2Sum / numberOfElementsInTheSpinSumOutputArray;									// The state average
-	const double binderCumulant = 1.0 - (m4Average / (3.0 * std::pow(m2Average, 2)));
+	// Sum the normalized autocorrelation function until the window reaches 6 times the running estimate (Sokal's automatic windowing)
+	double integratedAutocorrelationTime = 0.5;
+	for (uint32_t t = 1; t < n; t++)
+	{
+		double autocovariance = 0.0;
+		for (uint32_t i = 0; i + t < n; i++)
+		{
+			autocovariance += (squaredSpinSums[i] - mean) * (squaredSpinSums[i + t] - mean);
+		}
+		autocovariance /= (n - t);
+
+		integratedAutocorrelationTime += autocovariance / variance;
+		if (t >= 6.0 * integratedAutocorrelationTime)
+		{
+			break;
+		}
+	}
 
-	return binderCumulant;
+	return integratedAutocorrelationTime;
 }
 
 /**********************************************************************/
@@ -1,13 +1,81 @@
 #pragma once
 #include <vulkan/vulkan.h>
+#include "ObservableAccumulator.h"
+#include "AcceptanceTable.h"
 #include <vector>
+#include <string>
+#include <array>
+#include <map>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <filesystem>
+#include <functional>
 #include <stdexcept>
 #include <iostream>
 
 enum eComputeShaderType
 {
 	COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN,
-	COMPUTE_SHADER_TYPE_1_INT_PER_SPIN
+	COMPUTE_SHADER_TYPE_1_INT_PER_SPIN,
+	COMPUTE_SHADER_TYPE_MULTI_SPIN_CODED,												// 32 spins of one checkerboard colour per uint, one invocation per uint. Needs an even grid length
+	COMPUTE_SHADER_TYPE_SHARED_MEMORY_TILED,											// 1 int per spin, several sweeps of the tile interiors in shared memory per dispatch. Needs an even grid length
+	COMPUTE_SHADER_TYPE_1_BYTE_PER_SPIN_SUBLATTICES,									// 1 byte per spin, the checkerboard colours stored apart. Needs an even grid length and 8 bit storage buffer access
+	COMPUTE_SHADER_TYPE_BATCHED_REPLICAS												// 1 int per spin, every dispatch sweeps several independent grids, each with its own beta, spin sum and samples. For small grids
+};
+
+enum eUpdateAlgorithmType
+{
+	UPDATE_ALGORITHM_TYPE_METROPOLIS,																// Local checkerboard Metropolis updates
+	UPDATE_ALGORITHM_TYPE_WOLFF,																	// Wolff single-cluster updates (CPU only), beats critical slowing down near beta = 0.44
+	UPDATE_ALGORITHM_TYPE_SWENDSEN_WANG																// Swendsen-Wang multi-cluster updates (CPU only, multithreaded)
+};
+
+enum eCPUSweepEngineType
+{
+	CPU_SWEEP_ENGINE_TYPE_BIT_BY_BIT,														// DoTheIsingGridSweepsCPU
+	CPU_SWEEP_ENGINE_TYPE_MULTI_SPIN_CODED,													// DoTheIsingGridSweepsMultiSpinCodedCPU (needs an even grid length)
+	CPU_SWEEP_ENGINE_TYPE_WOLFF,																// DoTheIsingGridSweepsWolffCPU
+	CPU_SWEEP_ENGINE_TYPE_SWENDSEN_WANG														// DoTheIsingGridSweepsSwendsenWangCPU
+};
+
+enum eGPUSchedulingMode
+{
+	GPU_SCHEDULING_MODE_RECORD_EVERY_TEMPERATURE,											// Record every sweep of a temperature into one command buffer and submit it
+	GPU_SCHEDULING_MODE_REPLAY_SWEEP_BLOCKS													// Record a block of sweeps once per cSetup and submit it again and again, beta only changes the UBO
+};
+
+enum eSpinSumReductionType
+{
+	SPIN_SUM_REDUCTION_TYPE_GLOBAL_ATOMICS,													// Every accepted flip adds to the spin sum with its own global atomic
+	SPIN_SUM_REDUCTION_TYPE_WORKGROUP_SHARED_MEMORY,										// A tree reduction in shared memory, one global atomic per workgroup
+	SPIN_SUM_REDUCTION_TYPE_SUBGROUP_ARITHMETIC												// subgroupAdd, then the subgroup sums in shared memory, one global atomic per workgroup
+};
+
+enum eRandomNumberGeneratorType
+{
+	RANDOM_NUMBER_GENERATOR_TYPE_XORSHIFT_STATE_PER_SPIN,									// One XORShift state per spin (per word for the multi-spin-coded kernel) in the random numbers buffer
+	RANDOM_NUMBER_GENERATOR_TYPE_PHILOX														// Philox4x32-10 keyed on the seed and counted by the site, the sweep and the temperature, no random numbers buffer
+};
+
+/* The specialization constants of COMPUTE_SHADER_TYPE_SHARED_MEMORY_TILED */
+struct sTiledKernelParameters
+{
+	uint32_t tileWidth = 32;					// At least 3, so a tile has an interior
+	uint32_t tileHeight = 32;					// At least 3
+	uint32_t sweepsPerDispatch = 4;				// A power of two up to maxSweepsPerTiledDispatch. The number of sweeps per temperature must be a multiple of it
+
+	static constexpr uint32_t maxSweepsPerTiledDispatch = 16;
+};
+
+/* Where the time of the GPU sweeps goes, summed over every call of DoTheIsingGridSweepsGPU since the last reset */
+struct sGPUSweepTimes
+{
+	double hostRecordingTime = 0.0;				// Seconds spent recording command buffers. The sweep blocks are recorded in the constructor, which is counted too
+	double deviceTime = 0.0;					// Seconds between the first and the last timestamp of every submitted command buffer, 0 if the queue has no timestamps
+	double wallTime = 0.0;						// Seconds the host spent submitting the sweeps and waiting for them
+	uint32_t numberOfSubmissions = 0;
 };
 
 struct sVulkanBufferAndMore
@@ -16,9 +84,12 @@ struct sVulkanBufferAndMore
 	VkDeviceMemory bufferMemory = VK_NULL_HANDLE;
 	void* pVulkanBufferMemory = nullptr;
 	VkDeviceSize memoryOffset = 0;
+	VkDeviceSize memoryByteSize = 0;									// Only kept for the big buffers, counted against the heap budget
+	uint32_t memoryHeapIndex = 0;
 };
 
-/* The Vulkan context */
+/* The Vulkan context. A cSetup copies the device level handles of its cVulkanEngine into its own context, the suballocation counters
+   of the big buffers are only kept in the context of the engine */
 struct sVulkanContext
 {
 	VkInstance instance                                    = VK_NULL_HANDLE;
@@ -28,6 +99,7 @@ struct sVulkanContext
 	VkDevice device                                        = VK_NULL_HANDLE;
 	VkQueue computeQueue                                   = VK_NULL_HANDLE;
 	int computeQueueIndex                                  = -1;
+	VkQueue sampleDrainQueue                               = VK_NULL_HANDLE;		// A second queue of the compute queue family if it has one, else the compute queue
 	VkDescriptorSetLayout descriptorSetLayout              = VK_NULL_HANDLE;
 	VkDescriptorPool descriptorPool                        = VK_NULL_HANDLE;
 	VkDescriptorSet descriptorSet                          = VK_NULL_HANDLE;
@@ -37,6 +109,12 @@ struct sVulkanContext
 	VkCommandBuffer commandBuffer				           = VK_NULL_HANDLE;
 	uint32_t localWorkGroupSizeInX			               = 1;
 	uint32_t maxWorkGroupCountPerDispatchInX               = 1;
+	uint32_t subgroupSize                                  = 1;
+	bool bSubgroupArithmeticIsSupported                    = false;				// In compute shaders
+	bool bMemoryBudgetIsSupported                          = false;				// VK_EXT_memory_budget is enabled
+	bool bStorageBuffer8BitAccessIsSupported               = false;				// The 8 bit storage of VK_KHR_8bit_storage (core in Vulkan 1.2) is enabled
+	bool bShaderFloat64IsSupported                         = false;				// shaderFloat64 is enabled, the moments of the samples are then reduced on the device
+	VkPipeline momentReductionPipeline                     = VK_NULL_HANDLE;		// Of a cSetup, VK_NULL_HANDLE without shaderFloat64
 
 	sVulkanBufferAndMore bigDeviceLocalBufferAndMore;
 	VkDeviceSize bigDeviceLocalBufferBytesLeft = 0;
@@ -50,8 +128,7 @@ struct sVulkanContext
 	VkDeviceSize bigHostVisibleVulkanBufferNextAvailableByte = 0;
 	VkBufferUsageFlags bigHostVisibleVulkanBufferUsageFlags = 0;
 
-	VkBuffer persistentStagingBuffer = VK_NULL_HANDLE;
-	VkDeviceSize persistentStagingBufferByteOffsetIntoTheBigHostVisibleBuffer = 0;
+	sVulkanBufferAndMore persistentStagingBufferAndMore;								// An allocation of its own, the uploads larger than it are done in chunks
 	VkDeviceSize persistentStagingBufferByteSize = 0;
 
 	VkBuffer SSBSpinBuffer = VK_NULL_HANDLE;
@@ -66,35 +143,229 @@ struct sVulkanContext
 	VkDeviceSize SSBSpinSumBufferByteOffsetIntoTheBigDeviceLocalBuffer = 0;
 	VkDeviceSize SSBSpinSumBufferByteSize = 0;
 
+	VkBuffer SSBSpinSumSamplesBuffer = VK_NULL_HANDLE;									// The kernels write the sampled spin sums here, copied to a spin sum output buffer once per temperature
+	VkDeviceSize SSBSpinSumSamplesBufferByteOffsetIntoTheBigDeviceLocalBuffer = 0;
+	VkDeviceSize SSBSpinSumSamplesBufferByteSize = 0;
+
 	VkBuffer uniformBuffer = VK_NULL_HANDLE;
 	VkDeviceSize uniformBufferByteOffsetIntoTheBigHostVisibleBuffer = 0;
 	VkDeviceSize uniformBufferByteSize = 0;
 
-	VkBuffer spinSumOutputBuffer = VK_NULL_HANDLE;
-	VkDeviceSize spinSumOutputBufferByteOffsetIntoTheBigHostVisibleBuffer = 0;
+	// The UBO of the next temperature of each temperature slot, copied to uniformBuffer on the queue once the temperature before it is done with the UBO
+	std::array<VkBuffer, 2> uniformStagingBuffers = {};
+	std::array<VkDeviceSize, 2> uniformStagingBufferByteOffsetsIntoTheBigHostVisibleBuffer = {};
+
+	// One per temperature slot, so the host can read the samples of one temperature while the GPU sweeps the next one
+	std::array<VkBuffer, 2> spinSumOutputBuffers = {};
+	std::array<VkDeviceSize, 2> spinSumOutputBufferByteOffsetsIntoTheBigHostVisibleBuffer = {};
 	VkDeviceSize spinSumOutputBufferByteSize = 0;
 
+	VkBuffer SSBSpinSumMomentsBuffer = VK_NULL_HANDLE;									// The moment reduction writes the sums of its workgroups here, only with shaderFloat64
+	VkDeviceSize SSBSpinSumMomentsBufferByteOffsetIntoTheBigDeviceLocalBuffer = 0;
+	VkDeviceSize SSBSpinSumMomentsBufferByteSize = 0;
+
+	// The moments of the samples of each temperature slot, copied from SSBSpinSumMomentsBuffer once per temperature
+	std::array<VkBuffer, 2> spinSumMomentsOutputBuffers = {};
+	std::array<VkDeviceSize, 2> spinSumMomentsOutputBufferByteOffsetsIntoTheBigHostVisibleBuffer = {};
+
 	VkBuffer SSBSpinBatchesBuffer = VK_NULL_HANDLE;
 	VkDeviceSize SSBSpinBatchesBufferByteOffsetIntoTheBigDeviceLocalBuffer = 0;
 	VkDeviceSize SSBSpinBatchesBufferByteSize = 0;
+
+	VkBuffer SSBSpinWordsBuffer = VK_NULL_HANDLE;										// The grid of COMPUTE_SHADER_TYPE_MULTI_SPIN_CODED
+	VkDeviceSize SSBSpinWordsBufferByteOffsetIntoTheBigDeviceLocalBuffer = 0;
+	VkDeviceSize SSBSpinWordsBufferByteSize = 0;
+
+	uint32_t timestampValidBits = 0;													// 0 if the compute queue cannot write timestamps
+	VkQueryPool timestampQueryPool = VK_NULL_HANDLE;									// Two timestamps for each sweep block slot and for the tail and the end of the temperature of each temperature slot
+
+	// The sweep blocks have their own pool, resetting context.commandPool must not throw their recording away
+	VkCommandPool sweepBlockCommandPool = VK_NULL_HANDLE;
+	std::array<VkCommandBuffer, 2> sweepBlockCommandBuffers = {};						// Two copies of the same block, a command buffer must not be submitted while it is pending
+	std::array<VkFence, 2> sweepBlockFences = {};
+
+	// Two temperatures can be in flight, each in its own temperature slot with its own command buffers
+	std::array<VkCommandBuffer, 2> startOfTemperatureCommandBuffers = {};				// Copies the UBO of the temperature from its staging buffer
+	std::array<VkCommandBuffer, 2> tailSweepBlockCommandBuffers = {};					// The sweeps of a temperature that do not fill a whole block
+	std::array<uint32_t, 2> numberOfSweepsInTheTailSweepBlocks = {};					// What the tail of each slot is recorded for, 0 before the first recording
+	std::array<VkCommandBuffer, 2> endOfTemperatureCommandBuffers = {};					// Folds the last sweep and copies the samples to the spin sum output buffer of the slot
+	VkSemaphore temperatureTimelineSemaphore = VK_NULL_HANDLE;							// Reaches the temperature number of a temperature once its samples are on the host
+
+	// Only with a spin sum sample ring. Each half of the ring is copied to its drain buffer on the sample drain queue once the kernels have filled it
+	std::array<VkBuffer, 2> spinSumSampleDrainBuffers = {};
+	std::array<VkDeviceSize, 2> spinSumSampleDrainBufferByteOffsetsIntoTheBigHostVisibleBuffer = {};
+	VkDeviceSize spinSumSampleDrainBufferByteSize = 0;
+	VkCommandPool sampleDrainCommandPool = VK_NULL_HANDLE;
+	std::array<VkCommandBuffer, 2> sampleDrainCommandBuffers = {};						// Copy one half of the ring of every replica to the drain buffer of the half
+	VkSemaphore sweepBlockTimelineSemaphore = VK_NULL_HANDLE;							// Reaches the number of a sweep block submission once the block is done
+	VkSemaphore sampleDrainTimelineSemaphore = VK_NULL_HANDLE;							// Reaches the number of a drain once its samples are in the drain buffer
 };
 
 /* The uniform buffer object */
 struct sUniformBufferObject
 {
-	uint32_t transitionProbability4;				// The transition probability if a spin flip gives +4 energy
-	uint32_t transitionProbability8;				// The transition probability if a spin flip gives +8 energy
+	uint32_t acceptanceThresholds[12] = {};		// The 10 thresholds of cAcceptanceTable, padded to 3 uvec4 (std140 pads the elements of a uint array to 16 bytes)
 	uint32_t isingL;
 	uint32_t isingN;
+	uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts;
+	uint32_t sweepsPerSpinSumSample;
+	uint32_t randomSeed[2];							// The key of the Philox random numbers, the low word first
+	uint32_t temperatureNumber;						// The Philox counter of the temperature
+	uint32_t spinSumSamplesBufferCapacity;			// The samples of one replica the samples buffer holds. The kernels write sample n to n % capacity, so with a ring they wrap
+};
+
+/* The uniform buffer object of COMPUTE_SHADER_TYPE_BATCHED_REPLICAS, the one of the other kernels followed by the thresholds of every replica.
+   The kernel declares every replica the UBO can hold, so the UBO has this size whatever the number of replicas */
+struct sBatchedReplicasUniformBufferObject
+{
+	static constexpr uint32_t maxNumberOfReplicas = 256;	// The array size of the kernel
+
+	sUniformBufferObject ubo;						// acceptanceThresholds are the ones of replica 0. The samples of a replica are one block of spinSumSamplesBufferCapacity
+	uint32_t numberOfReplicas;
+	uint32_t padding[3] = {};						// std140 aligns the uvec4 array to 16 bytes
+	uint32_t replicaAcceptanceThresholds[12 * maxNumberOfReplicas] = {};	// The padded thresholds of every replica, like acceptanceThresholds
+};
+
+/* The spin sum shader storage buffer object (binding 2). Every invocation adds its flips to the change of its phase with one atomic, and the first
+   invocation of the next dispatch folds that change into the spin sum and writes the sample, while no other invocation touches either */
+struct sSpinSumStorageBufferObject
+{
+	int spinSum;									// The spin sum after pendingSweepNumber - 1
+	uint32_t pendingSweepNumber;					// The sweep (counted from the start of the temperature) whose change is not folded yet, noPendingSweep at the start
+	uint32_t dispatchNumbers[2];					// The number of the next dispatch of each phase. Each dispatch reads its own and sets the other one, so no invocation
+													// reads a word that is written during its dispatch. The Philox counter of the sweep
+	int spinSumChanges[2 * sTiledKernelParameters::maxSweepsPerTiledDispatch];	// The spin sum change of the last sweep of each checkerboard phase. The tiled kernel
+																				// keeps the change of every sweep of the last dispatch of each parity
+
+	static constexpr uint32_t noPendingSweep = 0xFFFFFFFF;
+};
+
+/* The moment sums one workgroup of SpinSumMomentReduction.comp writes to the spin sum moments buffer (binding 5). Not used with the spin sum
+   sample ring, the ring only holds the last samples, so the host sums the moments of every drained half of the ring instead */
+struct sSpinSumMomentsStorageBufferObject
+{
+	double absoluteMagnetizationSum;				// Per spin, like cObservableAccumulator
+	double magnetization2Sum;
+	double magnetization4Sum;
+
+	static constexpr uint32_t numberOfWorkGroups = 64;	// Of the moment reduction, every workgroup strides over the samples
+};
+
+/* A drain of one half of the spin sum sample ring that the host has not copied out of its drain buffer yet */
+struct sSpinSumSampleDrain
+{
+	uint64_t drainNumber;							// The value of the sample drain timeline semaphore once the drain is done
+	uint32_t ringHalfIndex;							// Also the drain buffer
+	uint32_t temperatureSlotIndex;
 };
 
 /* Push constants */
 struct sPushConstantObject
 {
-	uint32_t phase = 0;
+	uint32_t phase = 0;								// 0 or 1 sweep that phase, foldPhase only folds the last sweep and writes its sample
+	uint32_t tileOriginX = 0;						// Only used by the tiled kernel, moved every dispatch so the tile borders move
+	uint32_t tileOriginY = 0;
+
+	static constexpr uint32_t foldPhase = 2;
 };
 
-/* The setup class */
+/* The bytes the buffers of one lattice take from each of the big buffers */
+struct sVulkanMemoryRequirements
+{
+	VkDeviceSize deviceLocalByteSize = 0;
+	VkDeviceSize hostVisibleByteSize = 0;
+
+	static constexpr VkDeviceSize suballocationAlignmentSlack = 65536;		// Added for every buffer, an upper bound for what its alignment can cost
+};
+
+/* The big buffers and their suballocation counters at one point in time */
+struct sVulkanSuballocationMark
+{
+	VkDeviceSize bigDeviceLocalBufferBytesLeft = 0;
+	VkDeviceSize bigDeviceLocalBufferNextAvailableByte = 0;
+	VkDeviceSize bigHostVisibleVulkanBufferBytesLeft = 0;
+	VkDeviceSize bigHostVisibleVulkanBufferNextAvailableByte = 0;
+
+	// A lattice that does not fit into the big buffers gets big buffers of its own, which are destroyed with the mark
+	bool bHasItsOwnBigDeviceLocalBuffer = false;
+	bool bHasItsOwnBigHostVisibleBuffer = false;
+	sVulkanBufferAndMore bigDeviceLocalBufferAndMore;
+	sVulkanBufferAndMore bigHostVisibleVulkanBufferAndMore;
+};
+
+/* The device level Vulkan state: the instance, the device and its queue, the big buffers every lattice suballocates from and the compute pipelines.
+   It is created once and shared by the cSetups of all lattices, which only create their buffers, descriptor set and command buffers against it */
+class cVulkanEngine
+{
+	friend class cSetup;
+
+private:
+	sVulkanContext context;																// Only the device level part is used
+	std::map<std::array<uint32_t, 6>, VkPipeline> computePipelines;						// Keyed by the shader type, the reduction type, the tile of the tiled kernel and the random number generator type
+	std::mutex computePipelinesMutex;													// The precompile thread adds to computePipelines too
+	std::vector<sVulkanSuballocationMark> suballocationMarks;							// One for every cSetup alive, the newest last
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;										// VK_NULL_HANDLE if the engine was created without one
+	VkPipeline momentReductionPipeline = VK_NULL_HANDLE;								// Created on first use, guarded by computePipelinesMutex
+	bool bMomentReductionPipelineFailed = false;										// So a reduction that failed is not tried again for every cSetup
+	std::filesystem::path pipelineCacheFilePath;
+	std::thread precompileThread;
+	std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> bigBufferBytesOfEveryHeap = {};		// What the big buffers take from every heap
+
+	// Init the Vulkan instance
+	void PrepareVulkanInstance(const std::vector<const char*>& requiredInstanceExtensions, const std::vector<const char*>& requiredValidationLayers);
+	// Find a physical GPU and init the logical device. deviceIndex counts the devices with a compute queue, in the order the driver lists them
+	void PrepareVulkanDevice(const std::vector<const char*> requiredDeviceExtensions, const uint32_t deviceIndex);
+	// Prepare a big device local buffer used for suballoction, it replaces the current one
+	void PrepareBigDeviceLocalVulkanBufferAndMore(VkDeviceSize bufferByteSize);
+	// Suballocate from the big device local buffer
+	VkBuffer SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(VkBufferUsageFlags bufferUsage, VkDeviceSize bufferByteSize, VkDeviceSize& memoryByteOffset);
+	// Prepare a big host visible buffer used for suballocation, it replaces the current one
+	void PrepareBigHostVisibleVulkanBufferAndMore(VkDeviceSize bufferByteSize);
+	// Suballocate from the big host visible buffer
+	VkBuffer SuballocateBufferFromTheBigHostVisibleVulkanBuffer(VkBufferUsageFlags bufferUsage, VkDeviceSize bufferByteSize, VkDeviceSize& memoryByteOffset);
+	// Init the descriptor set layout and the pipeline layout, the same for every compute shader type
+	void PrepareDescriptorSetLayoutAndPipelineLayout();
+	// Init the pipeline cache from its file next to the executable. The file name holds the device and the driver version, so
+	// every device and driver has its own file and a driver update starts with an empty cache
+	void PreparePipelineCache();
+	// Write the pipeline cache back to its file
+	void SavePipelineCache();
+	// Create the pipelines of every compute shader type with the default reduction type and tile, run on precompileThread
+	void PrecompileComputePipelines();
+	// Destroy a Vulkan buffer and more
+	void DestroyVulkanBufferAndMore(sVulkanBufferAndMore& bufferAndMore);
+	// The compute pipeline of a shader type, created on first use
+	VkPipeline GetComputePipeline(eComputeShaderType computeShaderType, eSpinSumReductionType spinSumReductionType, const sTiledKernelParameters& tiledKernelParameters,
+		eRandomNumberGeneratorType randomNumberGeneratorType);
+	// The pipeline of SpinSumMomentReduction.comp, created on first use. Needs shaderFloat64. VK_NULL_HANDLE if it could not be created,
+	// the cSetups then sum the moments on the host
+	VkPipeline GetMomentReductionPipeline();
+	// The heap of the memory with these properties, the first memory type with them like FindVulkanMemoryType picks it
+	uint32_t GetMemoryHeapIndex(VkMemoryPropertyFlags memoryProperties) const;
+	// The bytes that can still be allocated from a heap. With VK_EXT_memory_budget that is what the driver reports for this process,
+	// without it four fifths of the heap minus the big buffers of the engine
+	VkDeviceSize GetMemoryHeapBudget(const uint32_t memoryHeapIndex) const;
+	// A cSetup marks the big buffers when it is created and gives back everything suballocated after the mark when it is destroyed.
+	// So the cSetups of one engine must be destroyed in the reverse order of their creation, which scoped cSetups are.
+	// A big buffer with less room left than the lattice needs is replaced by one of exactly the size needed until the mark is popped
+	void PushSuballocationMark(const sVulkanMemoryRequirements& memoryRequirements);
+	void PopSuballocationMark();
+
+public:
+	// Without the pipeline cache every pipeline is compiled from SPIR-V on first use, like before there was one.
+	// deviceIndex picks the device from the list of FindTheComputeDevices
+	cVulkanEngine(const bool bUsePipelineCache = true, const uint32_t deviceIndex = 0);
+	~cVulkanEngine();
+
+	cVulkanEngine(const cVulkanEngine&) = delete;
+	cVulkanEngine& operator=(const cVulkanEngine&) = delete;
+
+	// The names of the devices with a compute queue, software implementations like lavapipe included. Empty if there is no Vulkan driver,
+	// so the callers can fall back to the CPU engines without creating an engine that throws
+	static std::vector<std::string> FindTheComputeDevices();
+};
+
+/* The setup class, the resources of one lattice */
 class cSetup
 {
 	friend uint32_t FindVulkanMemoryType(sVulkanContext& vulkanContext, uint32_t memory_type_bits, VkMemoryPropertyFlags memory_property_flags);
@@ -107,56 +378,194 @@ class cSetup
 	friend void DoTheIsingGridSweepsGPU(cSetup* pTheSetup, const uint32_t isingL, const double beta,
 		const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
 		const uint32_t sweepsPerSpinSumSample);
-	// Collect work from the GPU
+	// One beta per replica of COMPUTE_SHADER_TYPE_BATCHED_REPLICAS, the overloads with one beta give it to every replica
+	friend void DoTheIsingGridSweepsGPU(cSetup* pTheSetup, const uint32_t isingL, const std::vector<double>& betaOfEveryReplica,
+		const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+		const uint32_t sweepsPerSpinSumSample);
+	// Dispatch work to the GPU without waiting for it
+	friend uint64_t SubmitTheIsingGridSweepsGPU(cSetup* pTheSetup, const uint32_t isingL, const double beta,
+		const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+		const uint32_t sweepsPerSpinSumSample);
+	friend uint64_t SubmitTheIsingGridSweepsGPU(cSetup* pTheSetup, const uint32_t isingL, const std::vector<double>& betaOfEveryReplica,
+		const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+		const uint32_t sweepsPerSpinSumSample);
+	// Collect work from the GPU. The Binder cumulant of the samples of all replicas together, only meaningful if every replica had the same beta
 	friend double CalculateBinderCumulantGPU(cSetup* pTheSetup, const uint32_t isingL);
+	friend double CalculateBinderCumulantGPU(cSetup* pTheSetup, const uint32_t isingL, const uint64_t temperatureNumber);
+	// The moments of the samples of all replicas together, from the sums of the moment reduction if the cSetup has one
+	friend cObservableAccumulator CalculateTheObservablesGPU(cSetup* pTheSetup, const uint32_t isingL, const uint64_t temperatureNumber);
+	// The observables of every replica, one accumulator per replica. Independent series, so their spread gives the error bars
+	friend std::vector<cObservableAccumulator> AccumulateTheSpinSumSamplesOfEveryReplicaGPU(cSetup* pTheSetup, const uint32_t isingL,
+		const uint64_t temperatureNumber);
 
 private:
+	std::shared_ptr<cVulkanEngine> pTheVulkanEngine;
 	sVulkanContext context;
 
-	// Init the Vulkan instance
-	void PrepareVulkanInstance(const std::vector<const char*>& requiredInstanceExtensions, const std::vector<const char*>& requiredValidationLayers);
-	// Find a physical GPU and init the logical device
-	void PrepareVulkanDevice(const std::vector<const char*> requiredDeviceExtensions);
-	// Prepare a big device local buffer used for suballoction
-	void PrepareBigDeviceLocalVulkanBufferAndMore(VkDeviceSize bufferByteSize);
-	// Suballocate from the big device local buffer
-	VkBuffer SuballocateBufferFromTheBigDeviceLocalVulkanBuffer(VkBufferUsageFlags bufferUsage, VkDeviceSize bufferByteSize, VkDeviceSize& memoryByteOffset);
-	// Prepare a big host visible buffer used for suballocation
-	void PrepareBigHostVisibleVulkanBufferAndMore(VkDeviceSize bufferByteSize);
-	// Suballocate from the big host visible buffer
-	VkBuffer SuballocateBufferFromTheBigHostVisibleVulkanBuffer(VkBufferUsageFlags bufferUsage, VkDeviceSize bufferByteSize, VkDeviceSize& memoryByteOffset);
+	// Set the byte sizes of all buffers of the lattice in the context and return what they need from the big buffers
+	sVulkanMemoryRequirements CalculateTheVulkanBufferByteSizes(const uint32_t isingL, const uint32_t numberOfSweepsPerTemperature,
+		const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample);
+	// Throw a capacity report if the lattice does not fit on the device: its memory against the heap budgets, its storage buffers against
+	// maxStorageBufferRange, its workgroups against maxComputeWorkGroupCount and its spin sum against the 32 bit spin sum of the kernels
+	void CheckTheCapacityOfTheDevice(const uint32_t isingL, const sVulkanMemoryRequirements& memoryRequirements) const;
+	// Upload to a device local buffer through the persistent staging buffer, one chunk of at most its size at a time.
+	// WriteChunk writes the bytes [chunkByteOffset, chunkByteOffset + chunkByteSize) of the buffer to pChunk
+	void UploadToDeviceLocalBuffer(VkBuffer buffer, VkDeviceSize bufferByteSize,
+		const std::function<void(void* pChunk, VkDeviceSize chunkByteOffset, VkDeviceSize chunkByteSize)>& WriteChunk);
 	// Init the spin buffer (used with the compute shader of type COMPUTE_SHADER_TYPE_1_SPIN_PER_UINT)
-	void PrepareVulkanSSBSpinBuffer(const uint32_t isingL);
+	void PrepareVulkanSSBSpinBuffer();
 	// Init the spin batches buffer (used with the compute shader of type COMPUTE_SHADER_TYPE_32_SPINs_PER_UINT)
-	void PrepareVulkanSSBSpinBatchesBuffer(const uint32_t isingL);
-	// Init a shader storage buffer with random numbers
-	void PrepareVulkanSSBRandomNumbersBuffer(const uint32_t isingL);
+	void PrepareVulkanSSBSpinBatchesBuffer();
+	// Init the spin words buffer (used with the compute shader of type COMPUTE_SHADER_TYPE_MULTI_SPIN_CODED)
+	void PrepareVulkanSSBSpinWordsBuffer(const uint32_t isingL);
+	// Init a shader storage buffer with random numbers, only for RANDOM_NUMBER_GENERATOR_TYPE_XORSHIFT_STATE_PER_SPIN
+	void PrepareVulkanSSBRandomNumbersBuffer();
+	// Upload the XORShift states generated from randomSeed to the random numbers buffer
+	void UploadTheXORShiftStates();
 	// Init the shader storage buffer where the spin sum will be kept
 	void PrepareVulkanSSBSpinSumBuffer(const uint32_t ising_L);
-	// Init the output buffer that the sampled spin sums will be written to
-	void PrepareVulkanSpinSumOutputBuffer(const uint32_t numberOfSweepsPerTemperature,
-		const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample);
+	// Init the device local buffer the kernels write the sampled spin sums to
+	void PrepareVulkanSSBSpinSumSamplesBuffer();
+	// Init the output buffers of both temperature slots that the sampled spin sums will be written to
+	void PrepareVulkanSpinSumOutputBuffer();
+	// Init the device local buffer the moment reduction writes to and the output buffers of both temperature slots it is copied to
+	void PrepareVulkanSpinSumMomentsBuffers();
+	// Init the drain buffers, the drain command buffers and the timeline semaphores of the spin sum sample ring
+	void PrepareSpinSumSampleRing();
 	// Init the descriptor set
 	void PrepareDescriptorSet(const uint32_t ising_L, eComputeShaderType computeShaderType);
-	// Init the compute pipeline
+	// Get the compute pipeline from the engine, which only creates it for the first lattice
 	void PrepareComputePipeline(eComputeShaderType computeShaderType);
 	// Init command pool and buffer
 	void PrepareCommandPoolAndCommandBuffer();
-	// Destroy a Vulkan buffer and more
-	void DestroyVulkanBufferAndMore(sVulkanBufferAndMore& bufferAndMore);
+	// Init the timestamp query pool if the compute queue can write timestamps
+	void PrepareTimestampQueryPool();
+	// Init the sweep block command pool, buffers and fences and record the blocks of both slots and the start and end of the temperature of both temperature slots
+	void PrepareSweepBlockCommandBuffers(const uint32_t isingL);
+	// Init the timeline semaphore that counts the finished temperatures
+	void PrepareTemperatureTimelineSemaphore();
+	// Destroy every Vulkan object of this lattice that was created and pop its suballocation mark. Used by the destructor and by a constructor that throws
+	void DestroyTheVulkanObjects();
+	// Record numberOfSweeps sweeps, each one dispatch and one compute to compute barrier. Starts with the phase of an even sweep number
+	void RecordSweepBlockCommandBuffer(VkCommandBuffer commandBuffer, const uint32_t isingL, const uint32_t firstTimestampQueryIndex, const uint32_t numberOfSweeps);
+	// Record the copy of the UBO of a temperature slot from its staging buffer, after the last temperature is done with the UBO and the samples buffer
+	void RecordTheStartOfTheTemperature(VkCommandBuffer commandBuffer, const uint32_t temperatureSlotIndex);
+	// Record the fold of the last sweep of a temperature and the copy of the samples to the spin sum output buffer of the temperature slot.
+	// With shaderFloat64 also the moment reduction of the samples and the copy of its sums to the spin sum moments output buffer of the slot
+	void RecordTheEndOfTheTemperature(VkCommandBuffer commandBuffer, const uint32_t temperatureSlotIndex);
+	// The number of workgroups of one sweep phase, the kernels of all compute shader types have one invocation per spin or word of one colour
+	uint32_t CalculateNumberOfWorkGroupsInX(const uint32_t isingL) const;
+	// 1, or the sweeps per dispatch of the tiled kernel
+	uint32_t GetSweepsPerDispatch() const;
+	// Add the time between the two timestamps of a finished command buffer to gpuSweepTimes
+	void AddTheDeviceTime(const uint32_t firstTimestampQueryIndex);
+	// Add the device times of the sweep blocks and temperature slots that are done and not counted yet
+	void AddTheDeviceTimesOfTheFinishedCommandBuffers();
+	// The UBO of one temperature
+	sUniformBufferObject CreateUniformBufferObject(const double beta, const uint32_t isingL, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+		const uint32_t sweepsPerSpinSumSample) const;
+	// Write the UBO of one temperature to the uniform buffer or a staging buffer, with the thresholds of every replica for COMPUTE_SHADER_TYPE_BATCHED_REPLICAS
+	void WriteTheUniformBufferObject(void* pUniformBuffer, const std::vector<double>& betaOfEveryReplica, const uint32_t isingL,
+		const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample) const;
+	// GPU_SCHEDULING_MODE_RECORD_EVERY_TEMPERATURE, returns once the temperature is done. The kernels sample the spin sums by the UBO
+	void DoTheSweepsByRecordingEveryTemperature(const uint32_t isingL, const uint32_t numberOfSweepsPerTemperature, const uint32_t temperatureSlotIndex);
+	// GPU_SCHEDULING_MODE_REPLAY_SWEEP_BLOCKS, returns once the last two sweep blocks, the tail and the end of the temperature are queued
+	void DoTheSweepsByReplayingSweepBlocks(const uint32_t isingL, const uint32_t numberOfSweepsPerTemperature,
+		const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, const uint32_t temperatureSlotIndex);
+	// Submit one sweep block of a temperature that starts at firstSweepNumber. With a ring the block first drains the halves that are full
+	// and waits on the device for the drains of the halves it overwrites
+	void SubmitTheSweepBlock(VkCommandBuffer commandBuffer, VkFence fence, const uint32_t firstSweepNumber, const uint32_t numberOfSweeps,
+		const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, const uint32_t temperatureSlotIndex);
+	// Drain every half of the ring the kernels have filled with the samples of the temperature and that is not drained yet
+	void SubmitTheSpinSumSampleDrains(const uint64_t numberOfWrittenSpinSumSamples, const uint32_t temperatureSlotIndex);
+	// Block until the drains up to drainNumber are done and add their samples to the accumulators of their temperature slots
+	void AccumulateTheDrainedSpinSumSamples(const uint64_t drainNumber);
+	// Add the samples the ring still held at the end of the temperature of a slot to its accumulators. Once per temperature
+	void GatherTheSpinSumSamplesOfTheRing(const uint32_t temperatureSlotIndex);
+	// The samples of the last temperature of a slot, replica by replica, once it is finished. Only without a ring, the ring keeps accumulators
+	const int* GetTheSpinSumSamples(const uint32_t temperatureSlotIndex, size_t& numberOfSpinSumSamples) const;
+
+	eComputeShaderType computeShaderType = COMPUTE_SHADER_TYPE_1_BIT_PER_SPIN;
+	sTiledKernelParameters tiledKernelParameters;
+	eRandomNumberGeneratorType randomNumberGeneratorType = RANDOM_NUMBER_GENERATOR_TYPE_XORSHIFT_STATE_PER_SPIN;
+	uint64_t randomSeed = 0;
+	uint32_t numberOfReplicas = 1;														// More than 1 only for COMPUTE_SHADER_TYPE_BATCHED_REPLICAS
+	eGPUSchedulingMode gpuSchedulingMode = GPU_SCHEDULING_MODE_REPLAY_SWEEP_BLOCKS;
+	eSpinSumReductionType spinSumReductionType = SPIN_SUM_REDUCTION_TYPE_GLOBAL_ATOMICS;
+	sGPUSweepTimes gpuSweepTimes;
+	uint64_t lastSubmittedTemperatureNumber = 0;										// The temperature number of temperature n is n, counted from 1. Its slot is n % 2
+	std::array<uint64_t, 2> temperatureNumbersOfTheTemperatureSlots = {};				// The last temperature of each slot, 0 if the slot was never used
+	std::array<bool, 2> bTemperatureSlotDeviceTimeIsPending = {};						// The tail and end timestamps of the last temperature of the slot are not added yet
+	std::array<bool, 2> bTemperatureSlotHasATail = {};
+	std::array<bool, 2> bSweepBlockIsInFlight = {};										// Submitted and its timestamps not added yet, the last blocks of a temperature outlive its submission
+
+	// The spin sum sample ring, only with GPU_SCHEDULING_MODE_REPLAY_SWEEP_BLOCKS and more samples than fit in maxSpinSumSamplesBufferByteSize
+	uint32_t spinSumSampleRingHalfCapacity = 0;											// The samples of one replica in one half of the ring, 0 without a ring
+	uint64_t sweepBlockSubmissionNumber = 0;											// Of the last submitted sweep block, counted over the life of the cSetup
+	uint64_t sampleDrainNumber = 0;														// Of the last submitted drain, counted over the life of the cSetup
+	std::array<uint64_t, 2> sampleDrainNumbersOfTheRingHalves = {};						// The last drain of each half of the ring
+	std::array<uint64_t, 2> sampleDrainNumbersOfTheRingHalvesBeforeTheTemperature = {};	// The same at the start of the temperature being submitted
+	std::deque<sSpinSumSampleDrain> pendingSpinSumSampleDrains;							// Submitted and not copied out of their drain buffers yet, in drain order
+	std::array<std::vector<cObservableAccumulator>, 2> spinSumSampleAccumulators;		// Of the last temperature of each slot, one per replica. The series is not kept
+	std::array<uint64_t, 2> numberOfSpinSumSamplesOfTheTemperatureSlots = {};			// Per replica
+	std::array<uint64_t, 2> numberOfDrainedRingHalvesOfTheTemperatureSlots = {};
+	std::array<uint64_t, 2> lastSampleDrainNumbersOfTheTemperatureSlots = {};
+	std::array<bool, 2> bTemperatureSlotSamplesAreGathered = {};
 
 public:
+	// The number of sweeps in one replayed command buffer. Even, so every block starts with the same checkerboard phase
+	static constexpr uint32_t sweepsPerSweepBlock = 1024;
+	// A temperature with more samples replays its sweep blocks against a ring of this size at most, whatever the number of sweeps
+	static constexpr VkDeviceSize maxSpinSumSamplesBufferByteSize = 4'000'000;
+
+	// With an engine of its own
 	cSetup(const uint32_t isingL, const uint32_t numberOfSweepsPerTemperature,
-		const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, eComputeShaderType computeShaderType);
+		const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, eComputeShaderType computeShaderType,
+		eGPUSchedulingMode gpuSchedulingMode = GPU_SCHEDULING_MODE_REPLAY_SWEEP_BLOCKS,
+		eSpinSumReductionType spinSumReductionType = SPIN_SUM_REDUCTION_TYPE_SUBGROUP_ARITHMETIC, const sTiledKernelParameters& tiledKernelParameters = {},
+		eRandomNumberGeneratorType randomNumberGeneratorType = RANDOM_NUMBER_GENERATOR_TYPE_XORSHIFT_STATE_PER_SPIN, const uint32_t numberOfReplicas = 1);
+	// Against an engine shared with other lattices, so only the resources of this lattice are created
+	cSetup(std::shared_ptr<cVulkanEngine> pTheVulkanEngine, const uint32_t isingL, const uint32_t numberOfSweepsPerTemperature,
+		const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, eComputeShaderType computeShaderType,
+		eGPUSchedulingMode gpuSchedulingMode = GPU_SCHEDULING_MODE_REPLAY_SWEEP_BLOCKS,
+		eSpinSumReductionType spinSumReductionType = SPIN_SUM_REDUCTION_TYPE_SUBGROUP_ARITHMETIC, const sTiledKernelParameters& tiledKernelParameters = {},
+		eRandomNumberGeneratorType randomNumberGeneratorType = RANDOM_NUMBER_GENERATOR_TYPE_XORSHIFT_STATE_PER_SPIN, const uint32_t numberOfReplicas = 1);
 
 	~cSetup();
 
-	void WriteToUniformBufferAndUpdateDescriptorSet(const double beta, const uint32_t isingL);
+	// Only the contents of the UBO change, the descriptor set is written once, so the recorded sweep blocks stay valid.
+	// Must not be called while a temperature is in flight, SubmitTheIsingGridSweepsGPU goes through the staging buffers instead
+	void WriteToUniformBuffer(const double beta, const uint32_t isingL, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts,
+		const uint32_t sweepsPerSpinSumSample);
+	// 0 before the first temperature
+	uint64_t GetLastSubmittedTemperatureNumber() const;
+	// Does not block. True once the samples of the temperature are on the host
+	bool IsTheTemperatureFinished(const uint64_t temperatureNumber) const;
+	// Block until the samples of the temperature are on the host
+	void WaitForTheTemperature(const uint64_t temperatureNumber);
+	const sGPUSweepTimes& GetGPUSweepTimes() const;
+	// SPIN_SUM_REDUCTION_TYPE_SUBGROUP_ARITHMETIC falls back to SPIN_SUM_REDUCTION_TYPE_WORKGROUP_SHARED_MEMORY if the device does not support it
+	eSpinSumReductionType GetSpinSumReductionType() const;
+	void ResetGPUSweepTimes();
+	// The seed is taken from the clock in the constructor. A cSetup that gets the same seed right after its construction and then the same temperatures
+	// gives the same samples bit for bit, with Philox on every device. The XORShift states are generated on the host with std::default_random_engine,
+	// so only on the same platform. Waits for the temperatures in flight
+	void SetRandomSeed(const uint64_t randomSeed);
+	uint64_t GetRandomSeed() const;
+	uint32_t GetNumberOfReplicas() const;
 };
 
 uint32_t XORShift(uint32_t rngState);
 
+// pArraySpinSumOutputs can be nullptr if the samples only go into pObservableAccumulator. This engine also adds the energy of every sample
 void DoTheIsingGridSweepsCPU(uint32_t* pArraySpinBatches, int* pArraySpinSumOutputs, int& TheSpinSum, const uint32_t isingL,
-	const double beta, const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample);
+	const double beta, const uint32_t numberOfSweepsPerTemperature, const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample,
+	cObservableAccumulator* pObservableAccumulator = nullptr);
+
+// The energy of a grid in the pArraySpinBatches format, every bond counted once
+int CalculateTheEnergyCPU(const uint32_t* pArraySpinBatches, const uint32_t isingL);
+
+double CalculateBinderCumulantCPU(int* pArraySpinSumOutputs, const uint32_t isingL, const uint32_t numberOfElementsInTheSpinSumOutputArray);
 
-double CalculateBinderCumulantCPU(int* pArraySpinSumOutputs, const uint32_t isingL, const uint32_t numberOfElementsInTheSpinSumOutputArray);
\ No newline at end of file
+// The integrated autocorrelation time of the squared spin sum in samples (0.5 for uncorrelated samples)
+double CalculateIntegratedAutocorrelationTimeCPU(int* pArraySpinSumOutputs, const uint32_t numberOfElementsInTheSpinSumOutputArray);
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "TemperatureScheduler.h"
+#include <chrono>
+#include <random>
+#include <limits>
+#include <algorithm>
+
+/**********************************************************************/
+
+cTemperatureScheduler::cTemperatureScheduler(const uint32_t numberOfThreads, const eUpdateAlgorithmType updateAlgorithmType)
+{
+	pThreadPool = std::make_unique<cThreadPool>(std::max(1U, numberOfThreads));
+	workers.resize(pThreadPool->GetNumberOfThreads());
+	this->updateAlgorithmType = updateAlgorithmType;
+
+	const uint32_t randomSeed = (uint32_t)std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()) % std::numeric_limits<uint32_t>::max();
+	std::default_random_engine randomNumberGenerator(randomSeed);
+	for (sTemperatureSchedulerWorker& worker : workers)
+	{
+		worker.randomSeed = (uint32_t)randomNumberGenerator();
+	}
+}
+
+/**********************************************************************/
+
+uint32_t cTemperatureScheduler::GetNumberOfThreads() const
+{
+	return pThreadPool->GetNumberOfThreads();
+}
+
+/**********************************************************************/
+
+void cTemperatureScheduler::PrepareTheWorker(sTemperatureSchedulerWorker& worker, const uint32_t isingL)
+{
+	worker.pTheLattice.reset();
+	worker.pTheWolffClusterUpdater.reset();
+	worker.pTheSwendsenWangClusterUpdater.reset();
+
+	// The multi-spin-coded engine needs an even grid length
+	worker.cpuSweepEngineType = (isingL % 2 == 0) ? CPU_SWEEP_ENGINE_TYPE_MULTI_SPIN_CODED : CPU_SWEEP_ENGINE_TYPE_BIT_BY_BIT;
+	if (updateAlgorithmType == UPDATE_ALGORITHM_TYPE_WOLFF)
+	{
+		worker.cpuSweepEngineType = CPU_SWEEP_ENGINE_TYPE_WOLFF;
+	}
+	else if (updateAlgorithmType == UPDATE_ALGORITHM_TYPE_SWENDSEN_WANG)
+	{
+		worker.cpuSweepEngineType = CPU_SWEEP_ENGINE_TYPE_SWENDSEN_WANG;
+	}
+
+	if (worker.cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_MULTI_SPIN_CODED)
+	{
+		worker.pTheLattice = std::make_unique<cMultiSpinCodedIsingLattice>(isingL, 1);
+		worker.pTheLattice->SetRandomSeed(worker.randomSeed);
+	}
+	else if (worker.cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_WOLFF)
+	{
+		worker.pTheWolffClusterUpdater = std::make_unique<cWolffClusterUpdater>(isingL);
+		worker.pTheWolffClusterUpdater->SetRandomSeed(worker.randomSeed);
+	}
+	else if (worker.cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_SWENDSEN_WANG)
+	{
+		worker.pTheSwendsenWangClusterUpdater = std::make_unique<cSwendsenWangClusterUpdater>(isingL, 1);
+		worker.pTheSwendsenWangClusterUpdater->SetRandomSeed(worker.randomSeed);
+	}
+
+	// A new seed for the next grid length, so the engines of one worker do not repeat their streams
+	worker.randomSeed = XORShift(worker.randomSeed | 1);
+
+	const uint32_t isingN = isingL * isingL;
+	worker.spinBatches.assign((isingN + 31) / 32, ~0U);															// All spins are +1
+	worker.TheSpinSum = isingN;
+	worker.isingL = isingL;
+}
+
+/**********************************************************************/
+
+double cTemperatureScheduler::RunOneWorkItem(sTemperatureSchedulerWorker& worker, const sTemperatureWorkItem& workItem, const uint32_t numberOfSweepsPerTemperature,
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample)
+{
+	if (worker.isingL != workItem.isingL)
+	{
+		PrepareTheWorker(worker, workItem.isingL);
+	}
+
+	if (worker.cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_MULTI_SPIN_CODED)
+	{
+		DoTheIsingGridSweepsMultiSpinCodedCPU(worker.pTheLattice.get(), worker.spinBatches.data(), nullptr, worker.TheSpinSum, workItem.beta,
+			numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample, &worker.observableAccumulator);
+	}
+	else if (worker.cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_WOLFF)
+	{
+		DoTheIsingGridSweepsWolffCPU(worker.pTheWolffClusterUpdater.get(), worker.spinBatches.data(), nullptr, worker.TheSpinSum, workItem.beta,
+			numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample, &worker.observableAccumulator);
+	}
+	else if (worker.cpuSweepEngineType == CPU_SWEEP_ENGINE_TYPE_SWENDSEN_WANG)
+	{
+		DoTheIsingGridSweepsSwendsenWangCPU(worker.pTheSwendsenWangClusterUpdater.get(), worker.spinBatches.data(), nullptr, worker.TheSpinSum,
+			workItem.beta, numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample, &worker.observableAccumulator);
+	}
+	else
+	{
+		DoTheIsingGridSweepsCPU(worker.spinBatches.data(), nullptr, worker.TheSpinSum, workItem.isingL, workItem.beta,
+			numberOfSweepsPerTemperature, numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample, &worker.observableAccumulator);
+	}
+
+	return worker.observableAccumulator.GetBinderCumulant();
+}
+
+/**********************************************************************/
+
+void cTemperatureScheduler::Run(const std::vector<sTemperatureWorkItem>& workItems, const uint32_t numberOfSweepsPerTemperature,
+	const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, std::vector<double>& binderCumulants)
+{
+	binderCumulants.resize(workItems.size());
+
+	// Every work item writes its own element, so the results need no lock
+	pThreadPool->RunTasksWithWorkStealing((uint32_t)workItems.size(), [&](const uint32_t threadIndex, const uint32_t workItemIndex)
+		{
+			binderCumulants[workItemIndex] = RunOneWorkItem(workers[threadIndex], workItems[workItemIndex], numberOfSweepsPerTemperature,
+				numberOfSweepsToWaitBeforeSpinSumSamplingStarts, sweepsPerSpinSumSample);
+		});
+}
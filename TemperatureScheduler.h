@@ -0,0 +1,56 @@
+#pragma once
+#include "Setup.h"
+#include "ThreadPool.h"
+#include "MultiSpinCoding.h"
+#include "ClusterUpdates.h"
+#include "ObservableAccumulator.h"
+#include <cstdint>
+#include <vector>
+#include <memory>
+
+/* One point of a temperature scan */
+struct sTemperatureWorkItem
+{
+	uint32_t isingL = 0;
+	double beta = 0.0;
+};
+
+/* The grid, the observable accumulator and the engine one worker thread owns. They are kept from one work item to the next,
+   so a worker only allocates when the grid length changes and starts every beta from the grid the last one left behind */
+struct sTemperatureSchedulerWorker
+{
+	uint32_t isingL = 0;															// The grid length the worker is set up for, 0 before the first work item
+	std::vector<uint32_t> spinBatches;												// The grid in the pArraySpinBatches format
+	cObservableAccumulator observableAccumulator;									// No spin sum time series is kept, only the averages
+	int TheSpinSum = 0;
+	uint32_t randomSeed = 1;														// Every worker gets its own, engines made in the same second would share their streams
+	eCPUSweepEngineType cpuSweepEngineType = CPU_SWEEP_ENGINE_TYPE_BIT_BY_BIT;
+	std::unique_ptr<cMultiSpinCodedIsingLattice> pTheLattice;
+	std::unique_ptr<cWolffClusterUpdater> pTheWolffClusterUpdater;
+	std::unique_ptr<cSwendsenWangClusterUpdater> pTheSwendsenWangClusterUpdater;
+};
+
+/* Runs the independent (grid length, beta) points of temperature scans concurrently, one work item per thread at a time.
+   Every thread starts on its own run of neighbouring work items and steals from the end of the others once it is done, so the
+   warm starts of a serial scan are mostly kept. Every engine runs on one thread, the parallelism comes from the work items */
+class cTemperatureScheduler
+{
+private:
+	std::unique_ptr<cThreadPool> pThreadPool;
+	std::vector<sTemperatureSchedulerWorker> workers;
+	eUpdateAlgorithmType updateAlgorithmType = UPDATE_ALGORITHM_TYPE_METROPOLIS;
+
+	// Set up the engine and the grid (all spins +1) of a worker for a new grid length
+	void PrepareTheWorker(sTemperatureSchedulerWorker& worker, const uint32_t isingL);
+	// Sweep one work item and return its Binder cumulant
+	double RunOneWorkItem(sTemperatureSchedulerWorker& worker, const sTemperatureWorkItem& workItem, const uint32_t numberOfSweepsPerTemperature,
+		const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample);
+
+public:
+	cTemperatureScheduler(const uint32_t numberOfThreads, const eUpdateAlgorithmType updateAlgorithmType = UPDATE_ALGORITHM_TYPE_METROPOLIS);
+
+	uint32_t GetNumberOfThreads() const;
+	// binderCumulants[i] is the Binder cumulant of workItems[i], whatever order the work items finish in
+	void Run(const std::vector<sTemperatureWorkItem>& workItems, const uint32_t numberOfSweepsPerTemperature,
+		const uint32_t numberOfSweepsToWaitBeforeSpinSumSamplingStarts, const uint32_t sweepsPerSpinSumSample, std::vector<double>& binderCumulants);
+};
@@ -0,0 +1,135 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+/**********************************************************************/
+
+cThreadPool::cThreadPool(const uint32_t numberOfThreads)
+{
+	pTaskQueues = std::make_unique<sTaskQueue[]>(std::max(1U, numberOfThreads));
+
+	for (uint32_t i = 1; i < numberOfThreads; i++)
+	{
+		workerThreads.emplace_back(&cThreadPool::WorkerThreadLoop, this, i);
+	}
+}
+
+/**********************************************************************/
+
+cThreadPool::~cThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		bStopWorkers = true;
+	}
+	jobStartedConditionVariable.notify_all();
+
+	for (std::thread& workerThread : workerThreads)
+	{
+		workerThread.join();
+	}
+}
+
+/**********************************************************************/
+
+uint32_t cThreadPool::GetNumberOfThreads() const
+{
+	return (uint32_t)workerThreads.size() + 1;
+}
+
+/**********************************************************************/
+
+void cThreadPool::WorkerThreadLoop(const uint32_t threadIndex)
+{
+	uint64_t lastJobGeneration = 0;
+
+	while (true)
+	{
+		std::unique_lock<std::mutex> lock(jobMutex);
+		jobStartedConditionVariable.wait(lock, [&] { return bStopWorkers || jobGeneration != lastJobGeneration; });
+		if (bStopWorkers)
+		{
+			return;
+		}
+		lastJobGeneration = jobGeneration;
+		lock.unlock();
+
+		job(threadIndex);
+
+		lock.lock();
+		numberOfWorkersStillRunningTheJob--;
+		if (numberOfWorkersStillRunningTheJob == 0)
+		{
+			jobFinishedConditionVariable.notify_one();
+		}
+	}
+}
+
+/**********************************************************************/
+
+void cThreadPool::RunOnEveryThread(const std::function<void(const uint32_t)>& jobToRun)
+{
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		job = jobToRun;
+		numberOfWorkersStillRunningTheJob = (uint32_t)workerThreads.size();
+		jobGeneration++;
+	}
+	jobStartedConditionVariable.notify_all();
+
+	jobToRun(0);
+
+	std::unique_lock<std::mutex> lock(jobMutex);
+	jobFinishedConditionVariable.wait(lock, [&] { return numberOfWorkersStillRunningTheJob == 0; });
+}
+
+/**********************************************************************/
+
+void cThreadPool::RunTasksWithWorkStealing(const uint32_t numberOfTasks, const std::function<void(const uint32_t, const uint32_t)>& taskToRun)
+{
+	const uint32_t numberOfThreads = GetNumberOfThreads();
+	for (uint32_t i = 0; i < numberOfThreads; i++)
+	{
+		std::lock_guard<std::mutex> lock(pTaskQueues[i].taskMutex);
+		pTaskQueues[i].taskIndices.clear();
+		for (uint32_t taskIndex = (uint32_t)(((uint64_t)numberOfTasks * i) / numberOfThreads); taskIndex < (uint32_t)(((uint64_t)numberOfTasks * (i + 1)) / numberOfThreads); taskIndex++)
+		{
+			pTaskQueues[i].taskIndices.push_back(taskIndex);
+		}
+	}
+
+	RunOnEveryThread([&](const uint32_t threadIndex)
+		{
+			while (true)
+			{
+				uint32_t taskIndex = 0;
+				bool bFoundATask = false;
+				{
+					std::lock_guard<std::mutex> lock(pTaskQueues[threadIndex].taskMutex);
+					if (!pTaskQueues[threadIndex].taskIndices.empty())
+					{
+						taskIndex = pTaskQueues[threadIndex].taskIndices.front();
+						pTaskQueues[threadIndex].taskIndices.pop_front();
+						bFoundATask = true;
+					}
+				}
+				for (uint32_t i = 1; !bFoundATask && i < numberOfThreads; i++)
+				{
+					sTaskQueue& victimTaskQueue = pTaskQueues[(threadIndex + i) % numberOfThreads];
+					std::lock_guard<std::mutex> lock(victimTaskQueue.taskMutex);
+					if (!victimTaskQueue.taskIndices.empty())
+					{
+						taskIndex = victimTaskQueue.taskIndices.back();
+						victimTaskQueue.taskIndices.pop_back();
+						bFoundATask = true;
+					}
+				}
+
+				// Tasks never add tasks, so once every queue is empty this thread is done
+				if (!bFoundATask)
+				{
+					return;
+				}
+				taskToRun(threadIndex, taskIndex);
+			}
+		});
+}
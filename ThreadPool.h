@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <memory>
+
+/* The tasks a thread still has to run. The owner takes from the front, the other threads steal from the back */
+struct alignas(64) sTaskQueue
+{
+	std::mutex taskMutex;
+	std::deque<uint32_t> taskIndices;
+};
+
+/* A persistent pool of worker threads. The threads are created once and sleep between jobs,
+   so handing the same job to every thread once per temperature costs no thread creation */
+class cThreadPool
+{
+private:
+	std::vector<std::thread> workerThreads;
+	std::mutex jobMutex;
+	std::condition_variable jobStartedConditionVariable;
+	std::condition_variable jobFinishedConditionVariable;
+	std::function<void(const uint32_t)> job;
+	uint64_t jobGeneration = 0;														// Incremented for every new job so the workers can tell it apart from the last one
+	uint32_t numberOfWorkersStillRunningTheJob = 0;
+	bool bStopWorkers = false;
+	std::unique_ptr<sTaskQueue[]> pTaskQueues;										// One per thread, used by RunTasksWithWorkStealing
+
+	void WorkerThreadLoop(const uint32_t threadIndex);
+
+public:
+	cThreadPool(const uint32_t numberOfThreads);
+	~cThreadPool();
+
+	cThreadPool(const cThreadPool&) = delete;
+	cThreadPool& operator=(const cThreadPool&) = delete;
+
+	// The calling thread counts as thread 0
+	uint32_t GetNumberOfThreads() const;
+	// Run job(threadIndex) once on every thread and return when all of them are done
+	void RunOnEveryThread(const std::function<void(const uint32_t)>& jobToRun);
+	// Run task(threadIndex, taskIndex) once for every task index in [0, numberOfTasks) and return when all of them are done.
+	// Every thread starts on its own contiguous share of the task indices in order and steals from the back of the other shares when its own is done
+	void RunTasksWithWorkStealing(const uint32_t numberOfTasks, const std::function<void(const uint32_t, const uint32_t)>& taskToRun);
+};
@@ -32,6 +32,45 @@ int main(int argc, const char** argv)
 	case ISING_LOAD_AND_PLOT_BINDER_CUMULANT_DATA_HARDCODED_RUN:
 		IsingLoadAndPlotBinderCumulantDataHardcodedRun();
 		break;
+	case ISING_CPU_THREAD_SCALING_RUN:
+		IsingCPUThreadScalingRun();
+		break;
+	case ISING_CPU_UPDATE_ALGORITHM_COMPARISON_RUN:
+		IsingCPUUpdateAlgorithmComparisonRun();
+		break;
+	case ISING_CPU_PARALLEL_TEMPERING_RUN:
+		IsingCPUParallelTemperingRun();
+		break;
+	case ISING_CPU_HARDCODED_MULTIPLE_GRIDS_TEMPERATURE_PARALLEL_AND_AUTO_SAVE_RUN:
+		IsingCPUHardcodedMultipleGridsTemperatureParallelAndAutoSaveRun();
+		break;
+	case ISING_ACCEPTANCE_TABLE_CHECK_RUN:
+		IsingAcceptanceTableCheckRun();
+		break;
+	case ISING_GPU_SCHEDULING_MODE_COMPARISON_RUN:
+		IsingGPUSchedulingModeComparisonRun();
+		break;
+	case ISING_GPU_SPIN_SUM_REDUCTION_COMPARISON_RUN:
+		IsingGPUSpinSumReductionComparisonRun();
+		break;
+	case ISING_GPU_COMPUTE_SHADER_TYPE_COMPARISON_RUN:
+		IsingGPUComputeShaderTypeComparisonRun();
+		break;
+	case ISING_GPU_STARTUP_BENCHMARK_RUN:
+		IsingGPUStartupBenchmarkRun();
+		break;
+	case ISING_GPU_RANDOM_NUMBER_GENERATOR_COMPARISON_RUN:
+		IsingGPURandomNumberGeneratorComparisonRun();
+		break;
+	case ISING_GPU_BATCHED_REPLICAS_RUN:
+		IsingGPUBatchedReplicasRun();
+		break;
+	case ISING_HETEROGENEOUS_SCHEDULER_RUN:
+		IsingHeterogeneousSchedulerRun();
+		break;
+	case ISING_SWENDSEN_WANG_BOND_CHECK_RUN:
+		IsingSwendsenWangBondCheckRun();
+		break;
 	default:
 		break;
 	}